@@ -4,14 +4,20 @@
 //! This module defines the `BigNum`, `Modulus`, and `BigNumMod` structs, which allow for
 //! arithmetic operations on big numbers of a specified size, including modular addition,
 //! subtraction, multiplication, and exponentiation.
+//!
+//! Each operation on `BigNumMod` is a separate ECALL. For longer computations over the same
+//! modulus, `BigNumModBatch` records the operations, and evaluates all of them with a single ECALL.
 
 use core::{
     ops::{Add, AddAssign, MulAssign, Sub, SubAssign},
     panic,
 };
 
+use alloc::vec::Vec;
+
 use crate::ecalls::{Ecall, EcallsInterface};
 
+use common::bn_batch::{BnBatchOp, MAX_INSTRUCTIONS, MAX_REGISTERS};
 use common::ecall_constants::MAX_BIGNUMBER_SIZE;
 use subtle::ConstantTimeEq;
 
@@ -142,15 +148,51 @@ impl<const N: usize> SubAssign<&Self> for BigNum<N> {
 ///
 /// The `Modulus<N>` struct holds a modulus value in a byte array of size `N`.
 /// It is used with `BigNumMod` to perform modular arithmetic operations.
+///
+/// A modulus can also refer to a Montgomery context registered in the VM (see `with_context`);
+/// the multiplications and exponentiations then reuse the constants precomputed by the VM.
 #[derive(Debug, Clone, Copy)]
 pub struct Modulus<const N: usize> {
     m: [u8; N],
+    // handle of the Montgomery context in the VM, or 0 if there is none
+    handle: u32,
 }
 
 impl<const N: usize> Modulus<N> {
     /// Creates a new `Modulus` from a big-endian byte array.
     pub const fn from_be_bytes(m: [u8; N]) -> Self {
-        Self { m }
+        Self { m, handle: 0 }
+    }
+
+    /// Returns the same modulus, with a Montgomery context registered in the VM. This is worth it
+    /// for moduli used for many multiplications or exponentiations, like the order or the field of
+    /// an elliptic curve.
+    ///
+    /// If the VM can not register the context (for example, if the modulus is even), the modulus
+    /// is returned without a context, and the operations use the generic ECALLs.
+    pub fn with_context(self) -> Self {
+        let handle = Ecall::bn_mont_init(self.m.as_ptr(), N);
+        Self { m: self.m, handle }
+    }
+
+    // Computes (a * b) mod m in r; a and b must be reduced, and r can be the same buffer as a.
+    fn multm(&self, r: *mut u8, a: *const u8, b: *const u8) -> u32 {
+        // if the context is not valid anymore (e.g. after resuming from a checkpoint), the VM
+        // rejects the handle, as its modulus differs, and we fall back to the generic ECALL
+        if self.handle != 0 && Ecall::bn_mont_multm(self.handle, r, a, b, self.m.as_ptr()) == 1 {
+            return 1;
+        }
+        Ecall::bn_multm(r, a, b, self.m.as_ptr(), N)
+    }
+
+    // Computes (a ^ e) mod m in r; a must be reduced.
+    fn powm(&self, r: *mut u8, a: *const u8, e: *const u8, len_e: usize) -> u32 {
+        if self.handle != 0
+            && Ecall::bn_mont_powm(self.handle, r, a, e, len_e, self.m.as_ptr()) == 1
+        {
+            return 1;
+        }
+        Ecall::bn_powm(r, a, e, len_e, self.m.as_ptr(), N)
     }
 
     /// Creates a new `BigNumMod` with this modulus.
@@ -243,13 +285,11 @@ impl<'a, const N: usize> BigNumMod<'a, N> {
     /// Returns a new `BigNumMod` representing `(self ^ exponent) mod modulus`.
     pub fn pow<const N_EXP: usize>(&self, exponent: &BigNum<N_EXP>) -> Self {
         let mut result = [0u8; N];
-        let res = Ecall::bn_powm(
+        let res = self.modulus.powm(
             result.as_mut_ptr(),
             self.buffer.as_ptr(),
             exponent.buffer.as_ptr(),
             N_EXP,
-            self.modulus.m.as_ptr(),
-            N,
         );
         if res != 1 {
             panic!("Exponentiation failed");
@@ -411,12 +451,10 @@ impl<'a, const N: usize> core::ops::Mul for &BigNumMod<'a, N> {
         }
 
         let mut result = [0u8; N];
-        let res = Ecall::bn_multm(
+        let res = self.modulus.multm(
             result.as_mut_ptr(),
             self.buffer.as_ptr(),
             other.buffer.as_ptr(),
-            self.modulus.m.as_ptr(),
-            N,
         );
         if res != 1 {
             panic!("Multiplication failed");
@@ -431,12 +469,10 @@ impl<'a, const N: usize> MulAssign<&Self> for BigNumMod<'a, N> {
             panic!("Moduli do not match");
         }
 
-        let res = Ecall::bn_multm(
+        let res = self.modulus.multm(
             self.buffer.as_mut_ptr(),
             self.buffer.as_ptr(),
             other.buffer.as_ptr(),
-            self.modulus.m.as_ptr(),
-            N,
         );
         if res != 1 {
             panic!("Multiplication failed");
@@ -466,6 +502,214 @@ impl<'a, const N: usize> core::ops::Mul<&BigNumMod<'a, N>> for u32 {
     }
 }
 
+/// A register of a `BigNumModBatch`, holding a number modulo the modulus of the batch.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct BnReg(u8);
+
+/// Records a sequence of modular operations over a single modulus, that are then evaluated by the
+/// VM with a single ECALL.
+///
+/// The values are held in at most `MAX_REGISTERS` registers; the operations that return a new
+/// `BnReg` use a new register, while the `_assign` variants overwrite their first operand.
+/// The batch panics if too many registers, inputs or instructions are used.
+pub struct BigNumModBatch<'a, const N: usize> {
+    modulus: &'a Modulus<N>,
+    program: Vec<u8>,
+    inputs: Vec<u8>,
+    n_inputs: usize,
+    n_outputs: usize,
+    n_registers: usize,
+}
+
+impl<'a, const N: usize> BigNumModBatch<'a, N> {
+    /// Creates a new empty batch with the given modulus.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the modulus is zero.
+    pub fn new(modulus: &'a Modulus<N>) -> Self {
+        if modulus.m.ct_eq(&[0u8; N]).into() {
+            panic!("Modulus cannot be 0");
+        }
+        Self {
+            modulus,
+            program: Vec::new(),
+            inputs: Vec::new(),
+            n_inputs: 0,
+            n_outputs: 0,
+            n_registers: 0,
+        }
+    }
+
+    fn push(&mut self, op: BnBatchOp) {
+        if self.program.len() / 4 >= MAX_INSTRUCTIONS {
+            panic!("Too many instructions");
+        }
+        self.program.extend_from_slice(&op.encode());
+    }
+
+    fn new_register(&mut self) -> BnReg {
+        if self.n_registers >= MAX_REGISTERS {
+            panic!("Too many registers");
+        }
+        self.n_registers += 1;
+        BnReg((self.n_registers - 1) as u8)
+    }
+
+    /// Loads a big-endian number in a new register; the value is reduced modulo the modulus.
+    pub fn input_be_bytes(&mut self, bytes: &[u8; N]) -> BnReg {
+        if self.n_inputs > u8::MAX as usize {
+            panic!("Too many inputs");
+        }
+        let index = self.n_inputs as u8;
+        self.inputs.extend_from_slice(bytes);
+        self.n_inputs += 1;
+
+        let dst = self.new_register();
+        self.push(BnBatchOp::Load { dst: dst.0, index });
+        dst
+    }
+
+    /// Loads a `BigNumMod` in a new register.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the moduli do not match.
+    pub fn input(&mut self, value: &BigNumMod<'a, N>) -> BnReg {
+        if self.modulus != value.modulus {
+            panic!("Moduli do not match");
+        }
+        self.input_be_bytes(&value.buffer)
+    }
+
+    /// Returns a new register with `(a + b) mod modulus`.
+    pub fn add(&mut self, a: BnReg, b: BnReg) -> BnReg {
+        let dst = self.new_register();
+        self.push(BnBatchOp::Add {
+            dst: dst.0,
+            a: a.0,
+            b: b.0,
+        });
+        dst
+    }
+
+    /// Returns a new register with `(a - b) mod modulus`.
+    pub fn sub(&mut self, a: BnReg, b: BnReg) -> BnReg {
+        let dst = self.new_register();
+        self.push(BnBatchOp::Sub {
+            dst: dst.0,
+            a: a.0,
+            b: b.0,
+        });
+        dst
+    }
+
+    /// Returns a new register with `(a * b) mod modulus`.
+    pub fn mul(&mut self, a: BnReg, b: BnReg) -> BnReg {
+        let dst = self.new_register();
+        self.push(BnBatchOp::Mul {
+            dst: dst.0,
+            a: a.0,
+            b: b.0,
+        });
+        dst
+    }
+
+    /// Returns a new register with `(a ^ e) mod modulus`. Note that, unlike `BigNumMod::pow`, the
+    /// exponent is a register, therefore it is reduced modulo the modulus.
+    pub fn pow(&mut self, a: BnReg, e: BnReg) -> BnReg {
+        let dst = self.new_register();
+        self.push(BnBatchOp::Pow {
+            dst: dst.0,
+            a: a.0,
+            e: e.0,
+        });
+        dst
+    }
+
+    /// Computes `a = (a + b) mod modulus`.
+    pub fn add_assign(&mut self, a: BnReg, b: BnReg) {
+        self.push(BnBatchOp::Add {
+            dst: a.0,
+            a: a.0,
+            b: b.0,
+        });
+    }
+
+    /// Computes `a = (a - b) mod modulus`.
+    pub fn sub_assign(&mut self, a: BnReg, b: BnReg) {
+        self.push(BnBatchOp::Sub {
+            dst: a.0,
+            a: a.0,
+            b: b.0,
+        });
+    }
+
+    /// Computes `a = (a * b) mod modulus`.
+    pub fn mul_assign(&mut self, a: BnReg, b: BnReg) {
+        self.push(BnBatchOp::Mul {
+            dst: a.0,
+            a: a.0,
+            b: b.0,
+        });
+    }
+
+    /// Computes `a = (a ^ e) mod modulus`.
+    pub fn pow_assign(&mut self, a: BnReg, e: BnReg) {
+        self.push(BnBatchOp::Pow {
+            dst: a.0,
+            a: a.0,
+            e: e.0,
+        });
+    }
+
+    /// Records the current value of the register as an output of the batch, and returns the index
+    /// of the output in the vector returned by `run`.
+    pub fn output(&mut self, reg: BnReg) -> usize {
+        if self.n_outputs > u8::MAX as usize {
+            panic!("Too many outputs");
+        }
+        let index = self.n_outputs;
+        self.push(BnBatchOp::Store {
+            index: index as u8,
+            src: reg.0,
+        });
+        self.n_outputs += 1;
+        index
+    }
+
+    /// Evaluates the batch, and returns its outputs.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the ECALL fails.
+    pub fn run(self) -> Vec<BigNumMod<'a, N>> {
+        let mut outputs = alloc::vec![0u8; self.n_outputs * N];
+        let res = Ecall::bn_batch(
+            self.modulus.m.as_ptr(),
+            N,
+            self.program.as_ptr(),
+            self.program.len(),
+            self.inputs.as_ptr(),
+            self.n_inputs,
+            outputs.as_mut_ptr(),
+            self.n_outputs,
+        );
+        if res != 1 {
+            panic!("Batch evaluation failed");
+        }
+
+        // the outputs are already reduced modulo the modulus
+        outputs
+            .chunks_exact(N)
+            .map(|chunk| BigNumMod {
+                buffer: chunk.try_into().unwrap(),
+                modulus: self.modulus,
+            })
+            .collect()
+    }
+}
+
 #[cfg(test)]
 mod tests {
     // TODO: these tests are only for the native target. We would like to run them for both the native
@@ -763,4 +1007,104 @@ mod tests {
             hex!("3c0baee8c4e2f7220615013d7402fa5e69e43bc10e55500a5af4f8b966658846")
         );
     }
+
+    #[test]
+    fn test_big_num_mod_batch() {
+        let a = M.new_big_num_mod(hex!(
+            "a247598432980432940980983408039480095809832048509809580984320985"
+        ));
+        let b = M.new_big_num_mod(hex!(
+            "7390984098209380980948098230840982340294098092384092834923840923"
+        ));
+
+        let mut batch = BigNumModBatch::new(&M);
+        let ra = batch.input(&a);
+        let rb = batch.input(&b);
+        let sum = batch.add(ra, rb);
+        let product = batch.mul(sum, ra);
+        batch.sub_assign(product, rb);
+        let i_product = batch.output(product);
+        let pow = batch.pow(ra, rb);
+        let i_pow = batch.output(pow);
+        // the input is reduced when loaded
+        let reduced = batch.input_be_bytes(&hex!(
+            "fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc30"
+        ));
+        let i_reduced = batch.output(reduced);
+        let outputs = batch.run();
+
+        assert_eq!(outputs.len(), 3);
+        assert_eq!(outputs[i_product], &(&(&a + &b) * &a) - &b);
+        assert_eq!(
+            outputs[i_pow],
+            a.pow(&BigNum::from_be_bytes(b.to_be_bytes()))
+        );
+        assert_eq!(outputs[i_reduced], BigNumMod::from_u32(1, &M));
+    }
+
+    #[test]
+    #[should_panic(expected = "Too many registers")]
+    fn test_big_num_mod_batch_too_many_registers() {
+        let mut batch = BigNumModBatch::new(&M);
+        let one = batch.input(&BigNumMod::from_u32(1, &M));
+        for _ in 0..MAX_REGISTERS {
+            batch.add(one, one);
+        }
+    }
+
+    #[test]
+    fn test_big_num_mod_with_context() {
+        let m = M.with_context();
+        assert_eq!(m, M);
+
+        let a = m.new_big_num_mod(hex!(
+            "a247598432980432940980983408039480095809832048509809580984320985"
+        ));
+        let b = m.new_big_num_mod(hex!(
+            "7390984098209380980948098230840982340294098092384092834923840923"
+        ));
+        assert_eq!(
+            (&a * &b).buffer,
+            hex!("2d5daeb3ed823bef5a4480a2c5aa0708e8e37ed7302d2b21c9b442b244d48ce6")
+        );
+        let mut a_copy = a;
+        a_copy *= &b;
+        assert_eq!(a_copy, &a * &b);
+
+        let a_generic = M.new_big_num_mod(a.buffer);
+        let e = BigNum::from_be_bytes(hex!("22e0b80916f2f35efab04d6d61155f9d"));
+        assert_eq!(a.pow(&e).buffer, a_generic.pow(&e).buffer);
+
+        // registering the same modulus again returns the same context
+        assert_eq!(M.with_context().handle, m.handle);
+        // a stale handle, that refers to the context of another modulus, is rejected by the VM,
+        // and the operations fall back to the generic ECALLs
+        let stale = Modulus {
+            m: M2.m,
+            handle: m.handle,
+        };
+        let c = hex!("2d5daeb3ed823bef5a4480a2c5aa0708e8e37ed7302d2b21c9b442b244d48ce6");
+        let mut r = [0u8; 32];
+        assert_eq!(
+            Ecall::bn_mont_multm(
+                stale.handle,
+                r.as_mut_ptr(),
+                c.as_ptr(),
+                c.as_ptr(),
+                M2.m.as_ptr()
+            ),
+            0
+        );
+        assert_eq!(
+            (&stale.new_big_num_mod(c) * &stale.new_big_num_mod(c)).buffer,
+            (&M2.new_big_num_mod(c) * &M2.new_big_num_mod(c)).buffer
+        );
+        // even moduli have no context, but the operations still work
+        let even = Modulus::from_be_bytes(hex!("12345678")).with_context();
+        assert_eq!(even.handle, 0);
+        assert_eq!(
+            &BigNumMod::from_u32(0x10000, &even) * &BigNumMod::from_u32(0x10000, &even),
+            BigNumMod::from_u32(0x01234570, &even)
+        );
+    }
 }
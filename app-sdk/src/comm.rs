@@ -13,6 +13,12 @@
 //!   transmission and reception without requiring large buffers.
 //! - **Length-Prefixing**: Messages are prefixed with their length, enabling dynamic buffer allocation
 //!   only when necessary.
+//! - **Streamed Framing**: If the client sets the `STREAMED_FLAG` in the length prefix, only the first
+//!   chunk is acknowledged, and the rest of the message is received with a single `xrecv`. Responses
+//!   are then sent with a single `xsend`, without waiting for acknowledgments. The framing is chosen by
+//!   the client, and the V-App replies with the same framing as the last received message. The V-App
+//!   declares its support by exporting the `VANADIUM_COMM_STREAMED_FRAMING` symbol, that clients look
+//!   for in its ELF file; otherwise, they use the original framing.
 //!
 //! Note: This module is not thread-safe. It is designed for single-threaded execution due to the use of
 //! a static mutable buffer for chunk reuse.
@@ -22,7 +28,7 @@ use alloc::{vec, vec::Vec};
 use core::cmp::min;
 use core::convert::TryInto;
 
-use common::comm::{ACK, CHUNK_LENGTH};
+use common::comm::{ACK, CHUNK_LENGTH, STREAMED_FLAG};
 
 /// Error types that can occur during message transmission.
 #[derive(Debug)]
@@ -53,12 +59,22 @@ impl core::error::Error for MessageError {}
 // Define a static mutable buffer for chunk reuse, in order to avoid unnecessary allocations.
 static mut CHUNK_BUFFER: [u8; CHUNK_LENGTH] = [0u8; CHUNK_LENGTH];
 
+// Whether the last received message used the streamed framing; responses use the same framing.
+static mut STREAMED: bool = false;
+
+// Declares that this V-App supports the streamed framing; the name must match
+// common::comm::STREAMED_FRAMING_SYMBOL.
+#[no_mangle]
+pub static VANADIUM_COMM_STREAMED_FRAMING: u8 = 1;
+
 /// Receives a message, handling chunked data reception and error management.
 ///
 /// The function starts by attempting to read a fixed-size chunk to extract the message length.
 /// It then continues reading in chunks until the entire message is received, sending an
-/// acknowledgment (`ACK`) byte for each chunk received. Errors occur if any unexpected
-/// conditions are encountered, such as insufficient bytes or extra bytes in a chunk.
+/// acknowledgment (`ACK`) byte for each chunk received. If the message uses the streamed framing,
+/// a single `ACK` is sent after the first chunk, and the rest of the message is received at once.
+/// Errors occur if any unexpected conditions are encountered, such as insufficient bytes or extra
+/// bytes in a chunk.
 ///
 /// # Errors
 ///
@@ -66,6 +82,7 @@ static mut CHUNK_BUFFER: [u8; CHUNK_LENGTH] = [0u8; CHUNK_LENGTH];
 ///   message length.
 /// - Returns `MessageError::TooManyBytesReceived` if unexpected extra bytes are received.
 /// - Returns `MessageError::FailedToReadMessage` if a chunk is empty or fails to be read.
+/// - Returns `MessageError::InvalidLength` if the rest of a streamed message is incomplete.
 ///
 /// # Returns
 ///
@@ -75,6 +92,9 @@ static mut CHUNK_BUFFER: [u8; CHUNK_LENGTH] = [0u8; CHUNK_LENGTH];
 ///
 /// This function is only safe in single-threaded execution due to the use of a static mutable buffer.
 pub fn receive_message() -> Result<Vec<u8>, MessageError> {
+    // the marker is otherwise unreferenced, and would be removed by the linker
+    core::hint::black_box(&VANADIUM_COMM_STREAMED_FRAMING);
+
     let chunk = &raw mut CHUNK_BUFFER;
 
     let first_chunk_len = xrecv_to(unsafe { &mut *chunk });
@@ -84,8 +104,11 @@ pub fn receive_message() -> Result<Vec<u8>, MessageError> {
         return Err(MessageError::FailedToReadLength);
     }
 
-    // Extract the message length.
-    let length = u32::from_be_bytes(unsafe { &*chunk }[0..4].try_into().unwrap()) as usize;
+    // Extract the message length and the framing.
+    let prefix = u32::from_be_bytes(unsafe { &*chunk }[0..4].try_into().unwrap());
+    let streamed = prefix & STREAMED_FLAG != 0;
+    let length = (prefix & !STREAMED_FLAG) as usize;
+    unsafe { STREAMED = streamed };
 
     // Check for unexpected extra bytes.
     if first_chunk_len > 4 + length {
@@ -96,6 +119,18 @@ pub fn receive_message() -> Result<Vec<u8>, MessageError> {
     let mut result = Vec::with_capacity(length);
     result.extend_from_slice(&unsafe { &*chunk }[4..first_chunk_len]);
 
+    if streamed && result.len() < length {
+        // Send a single ACK, then receive the rest of the message directly in the result.
+        xsend(&ACK);
+
+        let received = result.len();
+        result.resize(length, 0);
+        let chunk_len = xrecv_to(&mut result[received..]);
+        if chunk_len != length - received {
+            return Err(MessageError::InvalidLength);
+        }
+    }
+
     while result.len() < length {
         // Send ACK to maintain the alternating protocol.
         xsend(&ACK);
@@ -123,6 +158,9 @@ pub fn receive_message() -> Result<Vec<u8>, MessageError> {
 /// chunks, waiting for an acknowledgment (`ACK`) byte from the receiver before each chunk is sent.
 /// The process ensures that messages are transmitted sequentially and fully.
 ///
+/// If the last received message used the streamed framing, the length prefix and the whole message
+/// are instead sent with a single `xsend`, and no acknowledgment is expected.
+///
 /// # Parameters
 ///
 /// - `msg`: A reference to the message bytes (`&[u8]`) that should be sent.
@@ -131,6 +169,12 @@ pub fn receive_message() -> Result<Vec<u8>, MessageError> {
 /// On native execution, the function will panic if the underlying calls to `xsend` or `xrecv` panic.
 /// On Risc-V targets, communication failure causes the ECALL to fail, which will arrest the execution of the VM.
 pub fn send_message(msg: &[u8]) {
+    if unsafe { STREAMED } {
+        let prefix = (msg.len() as u32 | STREAMED_FLAG).to_be_bytes();
+        xsend(&[&prefix, msg].concat());
+        return;
+    }
+
     // Encode the message length in big-endian format.
     let length_be = (msg.len() as u32).to_be_bytes();
 
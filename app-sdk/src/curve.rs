@@ -1,4 +1,4 @@
-use alloc::vec::Vec;
+use alloc::{vec, vec::Vec};
 use core::{
     marker::PhantomData,
     ops::{Add, Deref, Mul},
@@ -8,7 +8,9 @@ use hex_literal::hex;
 use subtle::ConstantTimeEq;
 use zeroize::Zeroizing;
 
-use common::ecall_constants::{CurveKind, EcdsaSignMode, HashId, SchnorrSignMode};
+use common::ecall_constants::{
+    CurveKind, EcdsaSignMode, HashId, SchnorrSignMode, MAX_HD_CHILDREN, MAX_MSM_POINTS,
+};
 
 use crate::ecalls::{Ecall, EcallsInterface};
 
@@ -29,9 +31,24 @@ use crate::ecalls::{Ecall, EcallsInterface};
 /// Retrieves the fingerprint of the master key.
 ///
 /// - Returns: A `u32` value representing the fingerprint of the master key.
+///
+/// ## `derive_hd_pubkeys`
+/// Derives the public nodes of the consecutive children `first_child..first_child + n_children` of the node at a given path,
+/// deriving the parent node only once.
+///
+/// - `path`: A slice of `u32` values representing the derivation path of the parent node.
+/// - `first_child`: The index of the first child; the children must be all hardened, or all non-hardened.
+/// - `n_children`: The number of children, between 1 and `MAX_HD_CHILDREN`.
+/// - Returns: A `Result` containing a tuple with the fingerprint of the parent node and the public nodes of the children on success,
+///   or a static string slice error message on failure.
 pub trait Curve<const SCALAR_LENGTH: usize>: Sized {
     fn derive_hd_node(path: &[u32]) -> Result<HDPrivNode<Self, SCALAR_LENGTH>, &'static str>;
     fn get_master_fingerprint() -> u32;
+    fn derive_hd_pubkeys(
+        path: &[u32],
+        first_child: u32,
+        n_children: usize,
+    ) -> Result<(u32, Vec<HDPubNode<Self, SCALAR_LENGTH>>), &'static str>;
 }
 
 /// A struct representing a Hierarchical Deterministic (HD) node composed of a private key, and a 32-byte chaincode.
@@ -79,6 +96,20 @@ where
     }
 }
 
+/// A struct representing the public part of a Hierarchical Deterministic (HD) node: a public key, and a 32-byte chaincode.
+///
+/// # Fields
+///
+/// * `chaincode` - A 32-byte array representing the chain code.
+/// * `pubkey` - The public key.
+pub struct HDPubNode<C, const SCALAR_LENGTH: usize>
+where
+    C: Curve<SCALAR_LENGTH>,
+{
+    pub chaincode: [u8; 32],
+    pub pubkey: EcfpPublicKey<C, SCALAR_LENGTH>,
+}
+
 // A trait to simplify the implementation of `Curve` for different curves.
 trait HasCurveKind<const SCALAR_LENGTH: usize> {
     // Returns the value that represents this curve in ECALLs.
@@ -110,6 +141,52 @@ where
         let curve_kind = C::get_curve_kind();
         Ecall::get_master_fingerprint(curve_kind as u32)
     }
+
+    fn derive_hd_pubkeys(
+        path: &[u32],
+        first_child: u32,
+        n_children: usize,
+    ) -> Result<(u32, Vec<HDPubNode<C, SCALAR_LENGTH>>), &'static str> {
+        if n_children == 0 || n_children > MAX_HD_CHILDREN {
+            return Err("Invalid number of children");
+        }
+
+        let curve_kind = C::get_curve_kind();
+        // for each child, the chain code followed by the uncompressed public key
+        let child_size = 32 + 1 + 2 * SCALAR_LENGTH;
+        let mut parent_fingerprint = [0u8; 4];
+        let mut children = vec![0u8; n_children * child_size];
+
+        if 1 != Ecall::derive_hd_pubkeys(
+            curve_kind as u32,
+            path.as_ptr(),
+            path.len(),
+            first_child,
+            n_children,
+            parent_fingerprint.as_mut_ptr(),
+            children.as_mut_ptr(),
+        ) {
+            return Err("Failed to derive HD public nodes");
+        }
+
+        let nodes = children
+            .chunks_exact(child_size)
+            .map(|child| {
+                let mut chaincode = [0u8; 32];
+                let mut x = [0u8; SCALAR_LENGTH];
+                let mut y = [0u8; SCALAR_LENGTH];
+                chaincode.copy_from_slice(&child[0..32]);
+                x.copy_from_slice(&child[33..33 + SCALAR_LENGTH]);
+                y.copy_from_slice(&child[33 + SCALAR_LENGTH..]);
+                HDPubNode {
+                    chaincode,
+                    pubkey: EcfpPublicKey::new(x, y),
+                }
+            })
+            .collect();
+
+        Ok((u32::from_be_bytes(parent_fingerprint), nodes))
+    }
 }
 
 /// A representation of an elliptic curve point in uncompressed form.
@@ -364,6 +441,63 @@ where
     }
 }
 
+impl<C, const SCALAR_LENGTH: usize> Point<C, SCALAR_LENGTH>
+where
+    C: Curve<SCALAR_LENGTH> + HasCurveKind<SCALAR_LENGTH>,
+{
+    /// Computes the multi-scalar multiplication `scalars[0]·points[0] + ... + scalars[n-1]·points[n-1]`
+    /// with a single ECALL, instead of a scalar multiplication per point and an addition per term.
+    ///
+    /// The computation is not constant time: it must only be used with public scalars, for example to
+    /// aggregate or tweak public keys.
+    ///
+    /// # Arguments
+    ///
+    /// * `points` - The points, at most `MAX_MSM_POINTS`.
+    /// * `scalars` - The scalars, as many as the points; each scalar must be smaller than the order of
+    ///   the curve.
+    ///
+    /// # Returns
+    ///
+    /// * `Ok(Point)` - The result of the multi-scalar multiplication.
+    /// * `Err(&'static str)` - An error message if the computation fails, or if the result is the point
+    ///   at infinity.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the number of points and scalars differ, or if it is not between 1 and
+    /// `MAX_MSM_POINTS`.
+    pub fn msm(points: &[Self], scalars: &[[u8; SCALAR_LENGTH]]) -> Result<Self, &'static str> {
+        if points.len() != scalars.len() {
+            panic!("The number of points and scalars must be the same");
+        }
+        if points.is_empty() || points.len() > MAX_MSM_POINTS {
+            panic!("Invalid number of points");
+        }
+
+        // the ECALL expects the encoded points one after the other
+        let mut encoded_points = Vec::with_capacity(points.len() * (1 + 2 * SCALAR_LENGTH));
+        for point in points {
+            encoded_points.push(point.prefix);
+            encoded_points.extend_from_slice(&point.x);
+            encoded_points.extend_from_slice(&point.y);
+        }
+
+        let mut result = Point::default();
+        if 1 != Ecall::ecfp_msm(
+            C::get_curve_kind() as u32,
+            result.as_mut_ptr(),
+            encoded_points.as_ptr(),
+            scalars.as_ptr() as *const u8,
+            points.len(),
+        ) {
+            return Err("Failed to compute the multi-scalar multiplication");
+        }
+
+        Ok(result)
+    }
+}
+
 pub struct Secp256k1;
 
 impl HasCurveKind<32> for Secp256k1 {
@@ -519,6 +653,41 @@ mod tests {
         );
     }
 
+    #[test]
+    fn test_derive_hd_pubkeys_secp256k1() {
+        let parent_path = [0x8000002c, 0x80000000, 0x80000001, 0];
+        let parent = Secp256k1::derive_hd_node(&parent_path).unwrap();
+        let parent_pubkey = EcfpPrivateKey::<Secp256k1, 32>::new(*parent.privkey).to_public_key();
+
+        for first_child in [0, 0x80000005] {
+            let (parent_fpr, children) =
+                Secp256k1::derive_hd_pubkeys(&parent_path, first_child, 4).unwrap();
+            assert_eq!(children.len(), 4);
+
+            let parent_pk = parent_pubkey.as_ref().to_bytes();
+            let mut compressed_parent_pk = [0u8; 33];
+            compressed_parent_pk[0] = 0x02 + (parent_pk[64] % 2);
+            compressed_parent_pk[1..].copy_from_slice(&parent_pk[1..33]);
+            let sha256 = crate::hash::Sha256::hash(&compressed_parent_pk);
+            let expected_fpr = crate::hash::Ripemd160::hash(&sha256);
+            assert_eq!(parent_fpr.to_be_bytes(), expected_fpr[0..4]);
+
+            for (i, child) in children.iter().enumerate() {
+                let mut path = parent_path.to_vec();
+                path.push(first_child + i as u32);
+                let node = Secp256k1::derive_hd_node(&path).unwrap();
+                let pubkey = EcfpPrivateKey::<Secp256k1, 32>::new(*node.privkey).to_public_key();
+                assert_eq!(child.chaincode, node.chaincode);
+                assert_eq!(child.pubkey.as_ref().to_bytes(), pubkey.as_ref().to_bytes());
+            }
+        }
+
+        // mixing hardened and non-hardened children is not allowed
+        assert!(Secp256k1::derive_hd_pubkeys(&parent_path, 0x7fffffff, 2).is_err());
+        assert!(Secp256k1::derive_hd_pubkeys(&parent_path, 0, 0).is_err());
+        assert!(Secp256k1::derive_hd_pubkeys(&parent_path, 0, MAX_HD_CHILDREN + 1).is_err());
+    }
+
     #[test]
     fn test_secp256k1_point_addition() {
         let point1 = Secp256k1Point::new(
@@ -594,4 +763,30 @@ mod tests {
         let pubkey = privkey.to_public_key();
         pubkey.schnorr_verify(msg.as_bytes(), &signature).unwrap();
     }
+
+    #[test]
+    fn test_secp256k1_msm() {
+        let g = Secp256k1::get_generator();
+        let p = Secp256k1Point::new(
+            hex!("f9308a019258c31049344f85f89d5229b531c845836f99b08601f113bce036f9"),
+            hex!("388f7b0f632de8140fe337e62a37f3566500a99934c2231b6cb9fd7584b8e672"),
+        );
+        let k1 = hex!("22445566778899aabbccddeeff0011223344556677889900aabbccddeeff0011");
+        let k2 = hex!("4242424242424242424242424242424242424242424242424242424242424242");
+        let k3 = hex!("0000000000000000000000000000000000000000000000000000000000000003");
+
+        let points = [g, p, Secp256k1::get_generator()];
+        let result = Secp256k1Point::msm(&points, &[k1, k2, k3]).unwrap();
+        let expected = &(&(&points[0] * &k1) + &(&points[1] * &k2)) + &(&points[2] * &k3);
+        assert_eq!(result.to_bytes(), expected.to_bytes());
+
+        // a single point
+        let result = Secp256k1Point::msm(&points[1..2], &[k2]).unwrap();
+        assert_eq!(result.to_bytes(), (&points[1] * &k2).to_bytes());
+
+        // k·G + (n - k)·G is the point at infinity
+        let n_minus_k1 = hex!("ddbbaa99887766554433221100ffeedc876a878037c0073b151691aee1374130");
+        let points = [Secp256k1::get_generator(), Secp256k1::get_generator()];
+        assert!(Secp256k1Point::msm(&points, &[k1, n_minus_k1]).is_err());
+    }
 }
@@ -45,6 +45,33 @@ pub(crate) trait EcallsInterface {
     /// The number of bytes received.
     fn xrecv(buffer: *mut u8, max_size: usize) -> usize;
 
+    /// Takes a checkpoint of the V-App, that the host can later use to resume the V-App from this point.
+    ///
+    /// # Returns
+    /// 0 when the checkpoint is taken, 1 when the V-App was resumed from it.
+    fn checkpoint() -> u32;
+
+    /// Sends a request to the handler that the host registered for `request_id`, and receives its
+    /// reply. This allows offloading non-secret work to the host; the host is untrusted, so the
+    /// reply must be validated by the V-App.
+    ///
+    /// # Parameters
+    /// - `request_id`: Identifier of the handler of the request on the host.
+    /// - `payload`: Pointer to the payload of the request.
+    /// - `payload_len`: Length of the payload.
+    /// - `reply`: Pointer to the buffer to store the reply.
+    /// - `reply_max_len`: Maximum size of the reply.
+    ///
+    /// # Returns
+    /// The length of the reply.
+    fn client_call(
+        request_id: u32,
+        payload: *const u8,
+        payload_len: usize,
+        reply: *mut u8,
+        reply_max_len: usize,
+    ) -> usize;
+
     /// Computes the remainder of dividing `n` by `m`, storing the result in `r`.
     ///
     /// # Parameters
@@ -118,6 +145,105 @@ pub(crate) trait EcallsInterface {
         len: usize,
     ) -> u32;
 
+    /// Runs a program of modular operations over the modulus `m`, with the operands held in the
+    /// memory of the VM. See the `bn_batch` module of the `common` crate for the encoding of the
+    /// program.
+    ///
+    /// # Parameters
+    /// - `m`: Pointer to the modulus buffer.
+    /// - `len`: Length of `m`, and of each input and output.
+    /// - `program`: Pointer to the encoded instructions.
+    /// - `program_len`: Length of `program`, in bytes.
+    /// - `inputs`: Pointer to the inputs, stored consecutively.
+    /// - `n_inputs`: Number of inputs.
+    /// - `outputs`: Pointer to the buffer for the outputs, stored consecutively.
+    /// - `n_outputs`: Number of outputs.
+    ///
+    /// # Returns
+    /// 1 on success, 0 on error.
+    fn bn_batch(
+        m: *const u8,
+        len: usize,
+        program: *const u8,
+        program_len: usize,
+        inputs: *const u8,
+        n_inputs: usize,
+        outputs: *mut u8,
+        n_outputs: usize,
+    ) -> u32;
+
+    /// Registers a Montgomery context for the modulus `m`, that must be odd. The VM keeps the
+    /// modulus and its precomputed constants until the V-App exits.
+    ///
+    /// # Parameters
+    /// - `m`: Pointer to the modulus buffer.
+    /// - `len`: Length of `m`.
+    ///
+    /// # Returns
+    /// The handle of the context, or 0 on error. Registering the same modulus again returns the
+    /// same handle.
+    fn bn_mont_init(m: *const u8, len: usize) -> u32;
+
+    /// Multiplies two big numbers `a` and `b` modulo the modulus of a Montgomery context, storing
+    /// the result in `r`.
+    ///
+    /// # Parameters
+    /// - `handle`: Handle of the context, as returned by `bn_mont_init`.
+    /// - `r`: Pointer to the result buffer.
+    /// - `a`: Pointer to the first factor buffer.
+    /// - `b`: Pointer to the second factor buffer.
+    /// - `m`: Pointer to the modulus buffer.
+    ///
+    /// `r`, `a`, `b` and `m` have the length of the modulus, and `a` and `b` must be reduced.
+    ///
+    /// # Returns
+    /// 1 on success, 0 on error or if the handle is not valid, or not for the modulus `m`.
+    fn bn_mont_multm(handle: u32, r: *mut u8, a: *const u8, b: *const u8, m: *const u8) -> u32;
+
+    /// Computes `a` to the power of `e` modulo the modulus of a Montgomery context, storing the
+    /// result in `r`.
+    ///
+    /// # Parameters
+    /// - `handle`: Handle of the context, as returned by `bn_mont_init`.
+    /// - `r`: Pointer to the result buffer.
+    /// - `a`: Pointer to the base buffer.
+    /// - `e`: Pointer to the exponent buffer.
+    /// - `len_e`: Length of `e`.
+    /// - `m`: Pointer to the modulus buffer.
+    ///
+    /// `r`, `a` and `m` have the length of the modulus, and `a` must be reduced.
+    ///
+    /// # Returns
+    /// 1 on success, 0 on error or if the handle is not valid, or not for the modulus `m`.
+    fn bn_mont_powm(
+        handle: u32,
+        r: *mut u8,
+        a: *const u8,
+        e: *const u8,
+        len_e: usize,
+        m: *const u8,
+    ) -> u32;
+
+    /// Computes the root of a Merkle tree of 32-byte leaves with SHA-256, as defined in `common::merkle`.
+    ///
+    /// # Parameters
+    /// - `kind`: The kind of tree, a `MerkleTreeKind`.
+    /// - `leaves`: Pointer to the consecutive 32-byte leaves.
+    /// - `n_leaves`: Number of leaves, between 1 and `MAX_MERKLE_LEAVES`.
+    /// - `depths`: Pointer to the depth of each leaf, one byte per leaf, for taproot trees; ignored
+    ///   for the other kinds of trees.
+    /// - `root`: Pointer to the 32-byte buffer to store the root.
+    ///
+    /// # Returns
+    /// 1 on success, 0 if the kind, the number of leaves or the shape of the tree is invalid.
+    fn merkle_root(
+        kind: u32,
+        leaves: *const u8,
+        n_leaves: usize,
+        depths: *const u8,
+        root: *mut u8,
+    ) -> u32;
+
     /// Derives a hierarchical deterministic (HD) node, made of the private key and the corresponding chain code.
     ///
     /// # Parameters
@@ -153,6 +279,35 @@ pub(crate) trait EcallsInterface {
     /// This function panics if the curve is not supported.
     fn get_master_fingerprint(curve: u32) -> u32;
 
+    /// Derives the public keys and chain codes of consecutive children of a hierarchical deterministic
+    /// (HD) node. The node at `path` is derived only once, and each child is derived from it.
+    ///
+    /// # Parameters
+    /// - `curve`: The elliptic curve identifier. Currently only `Secp256k1` is supported.
+    /// - `path`: Pointer to the derivation path array of the parent node.
+    /// - `path_len`: Length of the derivation path array.
+    /// - `first_child`: Index of the first child; hardened children are allowed.
+    /// - `n_children`: Number of children, between 1 and `MAX_HD_CHILDREN`; the indices must all be
+    ///   hardened or all be non-hardened.
+    /// - `parent_fingerprint`: Pointer to a 4-byte buffer to store the fingerprint of the parent node.
+    /// - `children`: Pointer to the buffer to store, for each child, the chain code (32 bytes) followed
+    ///   by the uncompressed public key (65 bytes).
+    ///
+    /// # Returns
+    /// 1 on success, 0 on error.
+    ///
+    /// # Panics
+    /// This function panics if the curve is not supported.
+    fn derive_hd_pubkeys(
+        curve: u32,
+        path: *const u32,
+        path_len: usize,
+        first_child: u32,
+        n_children: usize,
+        parent_fingerprint: *mut u8,
+        children: *mut u8,
+    ) -> u32;
+
     /// Adds two elliptic curve points `p` and `q`, storing the result in `r`.
     ///
     /// # Parameters
@@ -178,6 +333,21 @@ pub(crate) trait EcallsInterface {
     /// 1 on success, 0 on error.
     fn ecfp_scalar_mult(curve: u32, r: *mut u8, p: *const u8, k: *const u8, k_len: usize) -> u32;
 
+    /// Computes the multi-scalar multiplication `k_1·P_1 + ... + k_n·P_n`, storing the result in `r`.
+    /// It is not constant time, and it must only be used with public scalars.
+    ///
+    /// # Parameters
+    /// - `curve`: The elliptic curve identifier. Currently only `Secp256k1` is supported.
+    /// - `r`: Pointer to the result buffer.
+    /// - `points`: Pointer to the `n` points, stored consecutively.
+    /// - `scalars`: Pointer to the `n` scalars, stored consecutively; each scalar has the length of
+    ///   a coordinate, and must be smaller than the order of the curve.
+    /// - `n`: Number of points, between 1 and `MAX_MSM_POINTS`.
+    ///
+    /// # Returns
+    /// 1 on success, 0 on error, or if the result is the point at infinity.
+    fn ecfp_msm(curve: u32, r: *mut u8, points: *const u8, scalars: *const u8, n: usize) -> u32;
+
     /// Signs a message hash using ECDSA.
     ///
     /// # Warning
@@ -1,8 +1,12 @@
 use std::io;
 use std::io::Write;
+use std::sync::Mutex;
 
 use crate::ecalls::EcallsInterface;
-use common::ecall_constants::{CurveKind, MAX_BIGNUMBER_SIZE};
+use common::bn_batch::{self, BnBatchBackend, BnBatchError};
+use common::bn_context::{self, MAX_BN_CONTEXTS};
+use common::ecall_constants::{CurveKind, MAX_BIGNUMBER_SIZE, MAX_HD_CHILDREN, MAX_MSM_POINTS};
+use common::merkle::{self, MerkleBackend, MerkleError, MerkleTreeKind};
 
 use bip32::{ChildNumber, XPrv};
 use hex_literal::hex;
@@ -21,6 +25,7 @@ use k256::{
 
 use num_bigint::BigUint;
 use num_traits::Zero;
+use sha2::Digest;
 
 unsafe fn to_bigint(bytes: *const u8, len: usize) -> BigUint {
     let bytes = std::slice::from_raw_parts(bytes, len);
@@ -38,6 +43,140 @@ unsafe fn copy_result(r: *mut u8, result_bytes: &[u8], len: usize) -> () {
     );
 }
 
+// Runs the programs of the bn_batch ecall with the other big numbers ecalls.
+struct NativeBnBatch {
+    inputs: *const u8,
+    outputs: *mut u8,
+    len: usize,
+}
+
+fn check_bn_result(res: u32) -> Result<(), BnBatchError> {
+    if res != 1 {
+        return Err(BnBatchError::OperationFailed);
+    }
+    Ok(())
+}
+
+impl BnBatchBackend for NativeBnBatch {
+    type Error = BnBatchError;
+
+    fn read_input(&mut self, index: usize, dst: &mut [u8]) -> Result<(), BnBatchError> {
+        unsafe {
+            std::ptr::copy_nonoverlapping(
+                self.inputs.add(index * self.len),
+                dst.as_mut_ptr(),
+                self.len,
+            );
+        }
+        Ok(())
+    }
+
+    fn write_output(&mut self, index: usize, src: &[u8]) -> Result<(), BnBatchError> {
+        unsafe {
+            std::ptr::copy_nonoverlapping(
+                src.as_ptr(),
+                self.outputs.add(index * self.len),
+                self.len,
+            );
+        }
+        Ok(())
+    }
+
+    fn modm(&mut self, r: &mut [u8], m: &[u8]) -> Result<(), BnBatchError> {
+        let n = r.to_vec();
+        check_bn_result(Ecall::bn_modm(
+            r.as_mut_ptr(),
+            n.as_ptr(),
+            n.len(),
+            m.as_ptr(),
+            m.len(),
+        ))
+    }
+
+    fn addm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), BnBatchError> {
+        check_bn_result(Ecall::bn_addm(
+            r.as_mut_ptr(),
+            a.as_ptr(),
+            b.as_ptr(),
+            m.as_ptr(),
+            m.len(),
+        ))
+    }
+
+    fn subm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), BnBatchError> {
+        check_bn_result(Ecall::bn_subm(
+            r.as_mut_ptr(),
+            a.as_ptr(),
+            b.as_ptr(),
+            m.as_ptr(),
+            m.len(),
+        ))
+    }
+
+    fn multm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), BnBatchError> {
+        check_bn_result(Ecall::bn_multm(
+            r.as_mut_ptr(),
+            a.as_ptr(),
+            b.as_ptr(),
+            m.as_ptr(),
+            m.len(),
+        ))
+    }
+
+    fn powm(&mut self, r: &mut [u8], a: &[u8], e: &[u8], m: &[u8]) -> Result<(), BnBatchError> {
+        check_bn_result(Ecall::bn_powm(
+            r.as_mut_ptr(),
+            a.as_ptr(),
+            e.as_ptr(),
+            e.len(),
+            m.as_ptr(),
+            m.len(),
+        ))
+    }
+}
+
+// Reads the leaves and the depths of the merkle_root ecall in the memory of the process.
+struct NativeMerkle {
+    leaves: *const u8,
+    depths: *const u8,
+}
+
+impl MerkleBackend for NativeMerkle {
+    type Error = MerkleError;
+
+    fn read_leaf(&mut self, index: usize, leaf: &mut [u8; 32]) -> Result<(), MerkleError> {
+        unsafe {
+            std::ptr::copy_nonoverlapping(self.leaves.add(32 * index), leaf.as_mut_ptr(), 32);
+        }
+        Ok(())
+    }
+
+    fn read_depth(&mut self, index: usize) -> Result<u8, MerkleError> {
+        Ok(unsafe { *self.depths.add(index) })
+    }
+
+    fn sha256(&mut self, segments: &[&[u8]]) -> Result<[u8; 32], MerkleError> {
+        let mut hasher = sha2::Sha256::new();
+        for segment in segments {
+            hasher.update(segment);
+        }
+        Ok(hasher.finalize().into())
+    }
+}
+
+// Moduli of the contexts registered with bn_mont_init. There are no precomputations, as the
+// operations are computed with num-bigint.
+static BN_CONTEXTS: Mutex<Vec<Vec<u8>>> = Mutex::new(Vec::new());
+
+// Returns the length of the modulus of the context referred to by the handle, if that modulus is
+// the one pointed to by m.
+fn bn_context_len(handle: u32, m: *const u8) -> Option<usize> {
+    let contexts = BN_CONTEXTS.lock().unwrap();
+    let modulus = contexts.get(bn_context::index(handle)?)?;
+    let m = unsafe { std::slice::from_raw_parts(m, modulus.len()) };
+    (m == modulus.as_slice()).then_some(modulus.len())
+}
+
 pub struct Ecall;
 
 impl EcallsInterface for Ecall {
@@ -96,6 +235,22 @@ impl EcallsInterface for Ecall {
         return n_bytes_to_copy;
     }
 
+    fn checkpoint() -> u32 {
+        // native V-Apps are never resumed
+        0
+    }
+
+    fn client_call(
+        _request_id: u32,
+        _payload: *const u8,
+        _payload_len: usize,
+        _reply: *mut u8,
+        _reply_max_len: usize,
+    ) -> usize {
+        // the standard input and output are reserved to the messages exchanged with the client
+        panic!("Client calls are not supported by native V-Apps");
+    }
+
     fn bn_modm(r: *mut u8, n: *const u8, len: usize, m: *const u8, len_m: usize) -> u32 {
         if len > MAX_BIGNUMBER_SIZE || len_m > MAX_BIGNUMBER_SIZE {
             return 0;
@@ -258,6 +413,100 @@ impl EcallsInterface for Ecall {
         1
     }
 
+    fn bn_batch(
+        m: *const u8,
+        len: usize,
+        program: *const u8,
+        program_len: usize,
+        inputs: *const u8,
+        n_inputs: usize,
+        outputs: *mut u8,
+        n_outputs: usize,
+    ) -> u32 {
+        if len > MAX_BIGNUMBER_SIZE {
+            return 0;
+        }
+
+        let modulus = unsafe { std::slice::from_raw_parts(m, len) };
+        let program = unsafe { std::slice::from_raw_parts(program, program_len) };
+        let mut backend = NativeBnBatch {
+            inputs,
+            outputs,
+            len,
+        };
+
+        match bn_batch::execute(&mut backend, modulus, program, n_inputs, n_outputs) {
+            Ok(()) => 1,
+            Err(_) => 0,
+        }
+    }
+
+    fn bn_mont_init(m: *const u8, len: usize) -> u32 {
+        if len == 0 || len > MAX_BIGNUMBER_SIZE {
+            return 0;
+        }
+        let m = unsafe { std::slice::from_raw_parts(m, len) };
+        if m[len - 1] & 1 == 0 {
+            return 0;
+        }
+
+        let mut contexts = BN_CONTEXTS.lock().unwrap();
+        let index = match contexts.iter().position(|c| c == m) {
+            Some(index) => index,
+            None => {
+                if contexts.len() >= MAX_BN_CONTEXTS {
+                    return 0;
+                }
+                contexts.push(m.to_vec());
+                contexts.len() - 1
+            }
+        };
+        bn_context::handle(index)
+    }
+
+    fn bn_mont_multm(handle: u32, r: *mut u8, a: *const u8, b: *const u8, m: *const u8) -> u32 {
+        let Some(len) = bn_context_len(handle, m) else {
+            return 0;
+        };
+        Self::bn_multm(r, a, b, m, len)
+    }
+
+    fn bn_mont_powm(
+        handle: u32,
+        r: *mut u8,
+        a: *const u8,
+        e: *const u8,
+        len_e: usize,
+        m: *const u8,
+    ) -> u32 {
+        let Some(len) = bn_context_len(handle, m) else {
+            return 0;
+        };
+        Self::bn_powm(r, a, e, len_e, m, len)
+    }
+
+    fn merkle_root(
+        kind: u32,
+        leaves: *const u8,
+        n_leaves: usize,
+        depths: *const u8,
+        root: *mut u8,
+    ) -> u32 {
+        let Ok(kind) = MerkleTreeKind::try_from(kind) else {
+            return 0;
+        };
+        let mut backend = NativeMerkle { leaves, depths };
+        match merkle::merkle_root(&mut backend, kind, n_leaves) {
+            Ok(result) => {
+                unsafe {
+                    std::ptr::copy_nonoverlapping(result.as_ptr(), root, 32);
+                }
+                1
+            }
+            Err(_) => 0,
+        }
+    }
+
     fn derive_hd_node(
         curve: u32,
         path: *const u32,
@@ -303,6 +552,65 @@ impl EcallsInterface for Ecall {
         u32::from_be_bytes(Ecall::get_master_bip32_key().public_key().fingerprint())
     }
 
+    fn derive_hd_pubkeys(
+        curve: u32,
+        path: *const u32,
+        path_len: usize,
+        first_child: u32,
+        n_children: usize,
+        parent_fingerprint: *mut u8,
+        children: *mut u8,
+    ) -> u32 {
+        if curve != CurveKind::Secp256k1 as u32 {
+            panic!("Unsupported curve");
+        }
+        if n_children == 0 || n_children > MAX_HD_CHILDREN {
+            return 0;
+        }
+        // the children must be all hardened, or all non-hardened
+        let Some(last_child) = first_child.checked_add(n_children as u32 - 1) else {
+            return 0;
+        };
+        if (first_child ^ last_child) & 0x80000000 != 0 {
+            return 0;
+        }
+
+        let mut key = Ecall::get_master_bip32_key();
+        let path_slice = unsafe { std::slice::from_raw_parts(path, path_len) };
+        for path_step in path_slice {
+            key = match key.derive_child(ChildNumber::from(*path_step)) {
+                Ok(k) => k,
+                Err(_) => return 0,
+            };
+        }
+
+        let mut result = Vec::with_capacity(n_children * (32 + 65));
+        for index in first_child..=last_child {
+            let Ok(child) = key.derive_child(ChildNumber::from(index)) else {
+                return 0;
+            };
+            result.extend_from_slice(&child.attrs().chain_code);
+            result.extend_from_slice(
+                child
+                    .private_key()
+                    .verifying_key()
+                    .to_encoded_point(false)
+                    .as_bytes(),
+            );
+        }
+
+        unsafe {
+            std::ptr::copy_nonoverlapping(
+                key.public_key().fingerprint().as_ptr(),
+                parent_fingerprint,
+                4,
+            );
+            std::ptr::copy_nonoverlapping(result.as_ptr(), children, result.len());
+        }
+
+        1
+    }
+
     fn ecfp_add_point(curve: u32, r: *mut u8, p: *const u8, q: *const u8) -> u32 {
         if curve != CurveKind::Secp256k1 as u32 {
             panic!("Unsupported curve");
@@ -360,6 +668,47 @@ impl EcallsInterface for Ecall {
         1
     }
 
+    fn ecfp_msm(curve: u32, r: *mut u8, points: *const u8, scalars: *const u8, n: usize) -> u32 {
+        if curve != CurveKind::Secp256k1 as u32 {
+            panic!("Unsupported curve");
+        }
+        if n == 0 || n > MAX_MSM_POINTS {
+            return 0;
+        }
+
+        let points = unsafe { std::slice::from_raw_parts(points, 65 * n) };
+        let scalars = unsafe { std::slice::from_raw_parts(scalars, 32 * n) };
+
+        let mut result_point = ProjectivePoint::IDENTITY;
+        for (p, k) in points.chunks_exact(65).zip(scalars.chunks_exact(32)) {
+            let Ok(p) = EncodedPoint::from_bytes(p) else {
+                return 0;
+            };
+            let Some(p) = Option::<ProjectivePoint>::from(ProjectivePoint::from_encoded_point(&p))
+            else {
+                return 0;
+            };
+            let k: [u8; 32] = k.try_into().unwrap();
+            let Some(k) = Option::<Scalar>::from(Scalar::from_repr(k.into())) else {
+                return 0;
+            };
+            result_point += p * k;
+        }
+
+        if result_point == ProjectivePoint::IDENTITY {
+            return 0;
+        }
+
+        let result_encoded = result_point.to_encoded_point(false);
+        let result_bytes = result_encoded.as_bytes();
+
+        unsafe {
+            std::ptr::copy_nonoverlapping(result_bytes.as_ptr(), r, result_bytes.len());
+        }
+
+        1
+    }
+
     fn ecdsa_sign(
         curve: u32,
         mode: u32,
@@ -1,3 +1,7 @@
+use crate::ecalls::{Ecall, EcallsInterface};
+
+pub use common::merkle::MerkleTreeKind;
+
 pub trait Hasher<const DIGEST_SIZE: usize>: Sized {
     fn new() -> Self;
     fn update(&mut self, buffer: &[u8]) -> &mut Self;
@@ -10,6 +14,17 @@ pub trait Hasher<const DIGEST_SIZE: usize>: Sized {
         hasher.digest(&mut digest);
         digest
     }
+
+    /// Hashes the concatenation of the segments, as in tagged hashes or nodes of Merkle trees.
+    fn hash_segments(segments: &[&[u8]]) -> [u8; DIGEST_SIZE] {
+        let mut hasher = Self::new();
+        for segment in segments {
+            hasher.update(segment);
+        }
+        let mut digest = [0u8; DIGEST_SIZE];
+        hasher.digest(&mut digest);
+        digest
+    }
 }
 
 #[cfg(not(target_arch = "riscv32"))]
@@ -52,7 +67,7 @@ mod hashers {
 mod hashers {
     use super::*;
     use crate::Ecall;
-    use common::ecall_constants::HashId;
+    use common::ecall_constants::{HashId, MAX_HASH_SEGMENTS};
 
     #[derive(Clone, PartialEq, Eq, Debug)]
     #[repr(C)]
@@ -127,6 +142,48 @@ mod hashers {
                         panic!("Failed to finalize hash");
                     }
                 }
+
+                // The one-shot ECALLs hash in the VM without a round trip of the hash context
+                // through the V-App memory.
+                fn hash(data: &[u8]) -> [u8; $digest_size] {
+                    let mut digest = [0u8; $digest_size];
+                    if 0 == Ecall::hash_oneshot(
+                        HashId::$name as u32,
+                        data.as_ptr(),
+                        data.len(),
+                        digest.as_mut_ptr(),
+                    ) {
+                        panic!("Failed to compute hash");
+                    }
+                    digest
+                }
+
+                fn hash_segments(segments: &[&[u8]]) -> [u8; $digest_size] {
+                    let mut digest = [0u8; $digest_size];
+                    if segments.len() > MAX_HASH_SEGMENTS {
+                        let mut hasher = Self::new();
+                        for segment in segments {
+                            hasher.update(segment);
+                        }
+                        hasher.digest(&mut digest);
+                        return digest;
+                    }
+
+                    // pointer and length of each segment
+                    let mut segments_raw = [[0u32; 2]; MAX_HASH_SEGMENTS];
+                    for (raw, segment) in segments_raw.iter_mut().zip(segments) {
+                        *raw = [segment.as_ptr() as u32, segment.len() as u32];
+                    }
+                    if 0 == Ecall::hash_vectored(
+                        HashId::$name as u32,
+                        segments_raw.as_ptr() as *const u8,
+                        segments.len(),
+                        digest.as_mut_ptr(),
+                    ) {
+                        panic!("Failed to compute hash");
+                    }
+                    digest
+                }
             }
         };
     }
@@ -137,3 +194,78 @@ mod hashers {
 }
 
 pub use hashers::{Ripemd160, Sha256, Sha512};
+
+/// Computes the root of a Merkle tree of 32-byte leaves with a single ECALL, instead of hashing each
+/// node in the V-App. See `common::merkle` for the supported kinds of trees.
+///
+/// # Arguments
+///
+/// * `kind` - The kind of tree.
+/// * `leaves` - The leaves, which are already hashed.
+/// * `depths` - For taproot trees, the depth of each leaf, in the same order as the leaves; empty
+///   for the other kinds of trees.
+///
+/// # Returns
+///
+/// * `Ok([u8; 32])` - The root of the tree.
+/// * `Err(&'static str)` - An error message if the number of leaves or the shape of the tree is
+///   invalid.
+pub fn merkle_root(
+    kind: MerkleTreeKind,
+    leaves: &[[u8; 32]],
+    depths: &[u8],
+) -> Result<[u8; 32], &'static str> {
+    if kind == MerkleTreeKind::Taproot && depths.len() != leaves.len() {
+        return Err("There must be a depth for each leaf");
+    }
+
+    let mut root = [0u8; 32];
+    if 1 != Ecall::merkle_root(
+        kind as u32,
+        leaves.as_ptr() as *const u8,
+        leaves.len(),
+        depths.as_ptr(),
+        root.as_mut_ptr(),
+    ) {
+        return Err("Failed to compute the Merkle root");
+    }
+    Ok(root)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use hex_literal::hex;
+
+    #[test]
+    fn test_merkle_root() {
+        let leaves: Vec<[u8; 32]> = (0u8..3).map(|i| Sha256::hash(&[0x00, i])).collect();
+        let node = |a: &[u8; 32], b: &[u8; 32]| Sha256::hash_segments(&[&[0x01], a, b]);
+        assert_eq!(
+            merkle_root(MerkleTreeKind::WalletPolicy, &leaves, &[]),
+            Ok(node(&node(&leaves[0], &leaves[1]), &leaves[2]))
+        );
+        assert!(merkle_root(MerkleTreeKind::WalletPolicy, &[], &[]).is_err());
+        assert!(merkle_root(MerkleTreeKind::Taproot, &leaves, &[1, 2]).is_err());
+        assert!(merkle_root(MerkleTreeKind::Taproot, &leaves, &[1, 1, 1]).is_err());
+    }
+
+    #[test]
+    fn test_hash_segments() {
+        let data = b"The quick brown fox jumps over the lazy dog";
+        let expected = Sha256::hash(data);
+        assert_eq!(
+            expected,
+            hex!("d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592")
+        );
+        assert_eq!(
+            Sha256::hash_segments(&[&data[..4], &[], &data[4..20], &data[20..]]),
+            expected
+        );
+        assert_eq!(Sha256::hash_segments(&[]), Sha256::hash(&[]));
+
+        let segments: Vec<&[u8]> = data.chunks(2).collect();
+        assert_eq!(Sha512::hash_segments(&segments), Sha512::hash(data));
+        assert_eq!(Ripemd160::hash_segments(&segments), Ripemd160::hash(data));
+    }
+}
@@ -15,6 +15,9 @@ mod ecalls;
 #[cfg(target_arch = "riscv32")]
 mod ecalls_riscv;
 
+#[cfg(target_arch = "riscv32")]
+mod mem;
+
 #[cfg(not(target_arch = "riscv32"))]
 mod ecalls_native;
 
@@ -98,6 +101,36 @@ pub fn xsend(buffer: &[u8]) {
     Ecall::xsend(buffer.as_ptr(), buffer.len() as usize)
 }
 
+/// Sends a request with the given payload to the handler that the client registered for
+/// `request_id`, and returns its reply, of at most `max_reply_len` bytes.
+///
+/// This allows offloading work on non-secret data to the client, for example fetching data that
+/// the V-App can check cheaply. The client is untrusted: the V-App must validate the reply.
+pub fn client_call(request_id: u32, payload: &[u8], max_reply_len: usize) -> Vec<u8> {
+    // As in xrecv, the content of the buffer beyond the length of the reply is never accessed.
+    let mut reply = Vec::with_capacity(max_reply_len);
+    unsafe {
+        reply.set_len(max_reply_len);
+    }
+
+    let reply_len = Ecall::client_call(
+        request_id,
+        payload.as_ptr(),
+        payload.len(),
+        reply.as_mut_ptr(),
+        reply.len(),
+    );
+    reply.truncate(reply_len);
+    reply
+}
+
+/// Takes a checkpoint of the V-App: the host can later resume the V-App from this point, for
+/// example to skip an expensive initialization. Returns false when the checkpoint is taken, and
+/// true when execution continues here after the V-App was resumed from it.
+pub fn checkpoint() -> bool {
+    Ecall::checkpoint() != 0
+}
+
 #[cfg(test)]
 mod tests {
     #[test]
@@ -0,0 +1,62 @@
+// Memory intrinsics of the V-Apps, replacing the ones of compiler_builtins (that are weak symbols).
+//
+// The implementations of compiler_builtins work byte by byte on riscv32i, which is very slow when
+// interpreted by the VM. Instead, buffers that are not too small are handled by ECALLs, which the VM
+// executes natively on whole pages.
+//
+// The small buffers are handled with volatile accesses, so that the compiler does not recognize the
+// loops and replace them with a call to the function itself.
+
+use crate::ecalls::Ecall;
+
+// Size from which the intrinsics use an ECALL, rather than a loop in the V-App
+const ECALL_THRESHOLD: usize = 16;
+
+#[no_mangle]
+pub unsafe extern "C" fn memcpy(dest: *mut u8, src: *const u8, n: usize) -> *mut u8 {
+    if n >= ECALL_THRESHOLD {
+        Ecall::memcpy(dest, src, n);
+    } else {
+        for i in 0..n {
+            dest.add(i).write_volatile(src.add(i).read_volatile());
+        }
+    }
+    dest
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn memset(s: *mut u8, c: i32, n: usize) -> *mut u8 {
+    // as in C, the value is converted to an unsigned char
+    let c = c as u8;
+    if n >= ECALL_THRESHOLD {
+        Ecall::memset(s, c, n);
+    } else {
+        for i in 0..n {
+            s.add(i).write_volatile(c);
+        }
+    }
+    s
+}
+
+// Constant-time: the running time only depends on n, not on the content of the buffers
+#[no_mangle]
+pub unsafe extern "C" fn memcmp(s1: *const u8, s2: *const u8, n: usize) -> i32 {
+    if n >= ECALL_THRESHOLD {
+        return Ecall::memcmp(s1, s2, n);
+    }
+
+    let mut result: i32 = 0;
+    for i in 0..n {
+        let diff = s1.add(i).read_volatile() as i32 - s2.add(i).read_volatile() as i32;
+        // all ones as long as no difference was found, without branching on the data
+        let unset = !((result | result.wrapping_neg()) >> 31);
+        result |= diff & unset;
+    }
+    result
+}
+
+// The compiler emits calls to bcmp when only the equality of the buffers matters
+#[no_mangle]
+pub unsafe extern "C" fn bcmp(s1: *const u8, s2: *const u8, n: usize) -> i32 {
+    memcmp(s1, s2, n)
+}
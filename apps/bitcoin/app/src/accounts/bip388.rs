@@ -30,10 +30,9 @@ use bitcoin::{
     consensus::encode::{self, VarInt},
 };
 
-use sdk::hash::{Hasher, Sha256};
+use sdk::hash::{merkle_root, Hasher, MerkleTreeKind, Sha256};
 
 use crate::constants::{BIP44_COIN_TYPE, MAX_BIP44_ACCOUNT_RECOMMENDED};
-use crate::merkle::MerkleTree;
 
 const HARDENED_INDEX: u32 = 0x80000000u32;
 
@@ -850,21 +849,14 @@ impl WalletPolicy {
             &VarInt(self.key_information.len() as u64),
         ));
 
+        let key_leaves: Vec<[u8; 32]> = self
+            .key_information
+            .iter()
+            .map(|key| Sha256::hash_segments(&[&[0x00], &key.pubkey.encode()]))
+            .collect();
         res.extend_from_slice(
-            MerkleTree::new(
-                self.key_information
-                    .iter()
-                    .map(|key| {
-                        let mut sha256hasher = Sha256::new();
-                        sha256hasher.update(&[0x00]);
-                        sha256hasher.update(&key.pubkey.encode());
-                        let mut res = [0u8; 32];
-                        sha256hasher.digest(&mut res);
-                        res
-                    })
-                    .collect(),
-            )
-            .root_hash(),
+            &merkle_root(MerkleTreeKind::WalletPolicy, &key_leaves, &[])
+                .expect("A wallet policy has at least one key"),
         );
 
         res
@@ -1,26 +1,10 @@
 use alloc::{borrow::Cow, vec::Vec};
 
 use common::message::{RequestGetExtendedPubkey, ResponseGetExtendedPubkey};
-use sdk::{
-    curve::{Curve, EcfpPrivateKey, EcfpPublicKey, Secp256k1, ToPublicKey},
-    hash::{Hasher, Ripemd160, Sha256},
-};
+use sdk::curve::{Curve, EcfpPrivateKey, Secp256k1, ToPublicKey};
 
 const BIP32_TESTNET_PUBKEY_VERSION: u32 = 0x043587CFu32;
 
-fn get_pubkey_fingerprint(pubkey: &EcfpPublicKey<Secp256k1, 32>) -> u32 {
-    let pk_bytes = pubkey.as_ref().to_bytes();
-    let mut sha256hasher = Sha256::new();
-    sha256hasher.update(&[pk_bytes[64] % 2 + 0x02]);
-    sha256hasher.update(&pk_bytes[1..33]);
-    let mut sha256 = [0u8; 32];
-    sha256hasher.digest(&mut sha256);
-
-    let hash = Ripemd160::hash(&sha256);
-
-    u32::from_be_bytes([hash[0], hash[1], hash[2], hash[3]])
-}
-
 pub fn handle_get_extended_pubkey<'a, 'b>(
     req: &'a RequestGetExtendedPubkey,
 ) -> Result<ResponseGetExtendedPubkey<'b>, &'static str> {
@@ -32,35 +16,30 @@ pub fn handle_get_extended_pubkey<'a, 'b>(
         todo!("Display is not yet implemented")
     }
 
-    let hd_node = sdk::curve::Secp256k1::derive_hd_node(&req.bip32_path)?;
-    let privkey: EcfpPrivateKey<Secp256k1, 32> = EcfpPrivateKey::new(*hd_node.privkey);
-    let pubkey = privkey.to_public_key();
-    let pubkey_bytes = pubkey.as_ref().to_bytes();
-
     let depth = req.bip32_path.len() as u8;
 
-    let parent_fpr: u32 = if req.bip32_path.is_empty() {
-        0
-    } else {
-        let hd_node =
-            sdk::curve::Secp256k1::derive_hd_node(&req.bip32_path[..req.bip32_path.len() - 1])?;
-        let parent_privkey: EcfpPrivateKey<Secp256k1, 32> = EcfpPrivateKey::new(*hd_node.privkey);
-        let parent_pubkey = parent_privkey.to_public_key();
-        get_pubkey_fingerprint(&parent_pubkey)
-    };
-
-    let child_number: u32 = if req.bip32_path.is_empty() {
-        0
-    } else {
-        req.bip32_path[req.bip32_path.len() - 1]
+    let (parent_fpr, child_number, chaincode, pubkey) = match req.bip32_path.split_last() {
+        None => {
+            let hd_node = Secp256k1::derive_hd_node(&[])?;
+            let privkey: EcfpPrivateKey<Secp256k1, 32> = EcfpPrivateKey::new(*hd_node.privkey);
+            (0, 0, hd_node.chaincode, privkey.to_public_key())
+        }
+        Some((&child_number, parent_path)) => {
+            // derives the parent node once, which also gives its fingerprint
+            let (parent_fpr, children) =
+                Secp256k1::derive_hd_pubkeys(parent_path, child_number, 1)?;
+            let child = children.into_iter().next().ok_or("Derivation failed")?;
+            (parent_fpr, child_number, child.chaincode, child.pubkey)
+        }
     };
+    let pubkey_bytes = pubkey.as_ref().to_bytes();
 
     let mut xpub = Vec::with_capacity(78);
     xpub.extend_from_slice(&BIP32_TESTNET_PUBKEY_VERSION.to_be_bytes());
     xpub.push(depth);
     xpub.extend_from_slice(&parent_fpr.to_be_bytes());
     xpub.extend_from_slice(&child_number.to_be_bytes());
-    xpub.extend_from_slice(&hd_node.chaincode);
+    xpub.extend_from_slice(&chaincode);
     xpub.push(pubkey_bytes[64] % 2 + 0x02);
     xpub.extend_from_slice(&pubkey_bytes[1..33]);
 
@@ -12,7 +12,6 @@ extern crate quick_protobuf;
 mod accounts;
 mod constants;
 mod handlers;
-mod merkle;
 mod script;
 mod taproot;
 
@@ -1,7 +1,9 @@
 // TODO: can we get rid of this module and use the corresponding code from vlib-bitcoin?
 
+use alloc::{vec, vec::Vec};
+
 use bitcoin::{consensus::encode, VarInt};
-use sdk::hash::{Hasher, Sha256};
+use sdk::hash::{merkle_root, Hasher, MerkleTreeKind, Sha256};
 
 use crate::{
     accounts::{DescriptorTemplate, KeyInformation, TapTree},
@@ -11,34 +13,15 @@ use crate::{
 pub const BIP0341_TAPBRANCH_TAG: &[u8; 9] = b"TapBranch";
 pub const BIP0341_TAPLEAF_TAG: &[u8; 7] = b"TapLeaf";
 
-fn new_tagged_hash(tag: &[u8]) -> Sha256 {
-    let mut hashtag = [0u8; 32];
-    {
-        let mut sha256hasher = Sha256::new();
-        sha256hasher.update(tag);
-        sha256hasher.digest(&mut hashtag);
-    }
-
-    let mut hash_context = Sha256::new();
-    hash_context.update(&hashtag);
-    hash_context.update(&hashtag);
+// Computes the BIP-340 tagged hash SHA256(SHA256(tag) || SHA256(tag) || data...) in a single ECALL
+fn tagged_hash(tag: &[u8], data: &[&[u8]]) -> [u8; 32] {
+    let hashtag = Sha256::hash(tag);
 
-    hash_context
-}
-
-fn tagged_hash(tag: &[u8], data: &[u8], data2: Option<&[u8]>) -> [u8; 32] {
-    let mut hash_context = new_tagged_hash(tag);
-    let mut out: [u8; 32] = [0; 32];
-
-    hash_context.update(data);
-
-    if let Some(data2) = data2 {
-        hash_context.update(data2);
-    }
-
-    hash_context.digest(&mut out);
-
-    out
+    let mut segments: Vec<&[u8]> = Vec::with_capacity(2 + data.len());
+    segments.push(&hashtag);
+    segments.push(&hashtag);
+    segments.extend_from_slice(data);
+    Sha256::hash_segments(&segments)
 }
 
 pub trait GetTapTreeHash {
@@ -57,28 +40,29 @@ impl GetTapTreeHash for TapTree {
         is_change: bool,
         address_index: u32,
     ) -> Result<[u8; 32], &'static str> {
-        match self {
-            TapTree::Script(leaf_desc) => {
-                leaf_desc.get_tapleaf_hash(key_information, is_change, address_index)
-            }
-            TapTree::Branch(l, r) => {
-                let hash_left = l.get_taptree_hash(key_information, is_change, address_index)?;
-                let hash_right = r.get_taptree_hash(key_information, is_change, address_index)?;
-                if hash_left <= hash_right {
-                    Ok(tagged_hash(
-                        BIP0341_TAPBRANCH_TAG,
-                        &hash_left,
-                        Some(&hash_right),
-                    ))
-                } else {
-                    Ok(tagged_hash(
-                        BIP0341_TAPBRANCH_TAG,
-                        &hash_right,
-                        Some(&hash_left),
-                    ))
+        // collect the tapleaf hashes and their depths in depth-first order, so that all the
+        // TapBranch hashes are computed by a single ECALL
+        let mut leaves = Vec::new();
+        let mut depths = Vec::new();
+        let mut stack = vec![(self, 0u8)];
+        while let Some((node, depth)) = stack.pop() {
+            match node {
+                TapTree::Script(leaf_desc) => {
+                    leaves.push(leaf_desc.get_tapleaf_hash(
+                        key_information,
+                        is_change,
+                        address_index,
+                    )?);
+                    depths.push(depth);
+                }
+                TapTree::Branch(l, r) => {
+                    let depth = depth.checked_add(1).ok_or("The taptree is too deep")?;
+                    stack.push((r.as_ref(), depth));
+                    stack.push((l.as_ref(), depth));
                 }
             }
         }
+        merkle_root(MerkleTreeKind::Taproot, &leaves, &depths)
     }
 }
 
@@ -98,15 +82,15 @@ impl GetTapLeafHash for DescriptorTemplate {
         is_change: bool,
         address_index: u32,
     ) -> Result<[u8; 32], &'static str> {
-        let mut ctx = new_tagged_hash(BIP0341_TAPLEAF_TAG);
-        ctx.update(&[0xC0u8]); // leaf version
         let leaf_script =
             self.to_script(key_information, is_change, address_index, ScriptContext::Tr)?;
-        ctx.update(&encode::serialize(&VarInt(leaf_script.len() as u64)));
-        ctx.update(&leaf_script.to_bytes());
-
-        let mut result = [0u8; 32];
-        ctx.digest(&mut result);
-        Ok(result)
+        Ok(tagged_hash(
+            BIP0341_TAPLEAF_TAG,
+            &[
+                &[0xC0u8], // leaf version
+                &encode::serialize(&VarInt(leaf_script.len() as u64)),
+                &leaf_script.to_bytes(),
+            ],
+        ))
     }
 }
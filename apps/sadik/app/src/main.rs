@@ -218,6 +218,21 @@ pub fn main(_: isize, _: *const *const u8) -> isize {
                         let k: [u8; 32] = k.as_slice().try_into().unwrap();
                         (p * &k).to_bytes().to_vec()
                     }
+                    ECPointOperation::Msm(points, scalars) => {
+                        let points: Vec<Secp256k1Point> = points
+                            .iter()
+                            .map(|p| Secp256k1Point::from_bytes(p.as_slice().try_into().unwrap()))
+                            .collect();
+                        let scalars: Vec<[u8; 32]> = scalars
+                            .iter()
+                            .map(|k| k.as_slice().try_into().unwrap())
+                            .collect();
+                        // the point at infinity has no encoding, it is returned as an empty result
+                        match Secp256k1Point::msm(&points, &scalars) {
+                            Ok(r) => r.to_bytes().to_vec(),
+                            Err(_) => vec![],
+                        }
+                    }
                 },
             },
             Command::EcdsaSign {
@@ -0,0 +1,240 @@
+//! Runs the big numbers, hash and secp256k1 commands of Sadik on the in-process mock device of the
+//! client SDK, where the RISC-V binary is executed by the `Cpu` interpreter of the `common` crate,
+//! and the ECALLs are computed by the host. For each workload, it reports the number of
+//! instructions executed per second (wall-clock time, including the work of the client and of the
+//! ECALLs), and the number of instructions, page faults, page commits and ECALLs per request.
+//!
+//! The V-App must be built for RISC-V first; its path can be overridden with the `VAPP_BINARY`
+//! environment variable. Run with `cargo bench --bench workloads`.
+
+use std::error::Error;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use common::{BigIntOperator, Curve, HashId};
+use hex_literal::hex;
+use sdk::mock_device::{MockDeviceMetrics, TransportMock};
+use sdk::transport::Transport;
+use sdk::vanadium_client::VanadiumAppClient;
+use vnd_sadik_client::SadikClient;
+
+// Number of measured requests for each workload, after a warm-up request
+const N_REQUESTS: u32 = 20;
+
+// The prime of the field of secp256k1, and two elements of the field
+const P: [u8; 32] = hex!("fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f");
+const A: [u8; 32] = hex!("a247598432980432940980983408039480095809832048509809580984320985");
+const B: [u8; 32] = hex!("7390984098209380980948098230840982340294098092384092834923994535");
+
+// The generator of secp256k1, and another point
+const G: [u8; 65] = hex!("0479be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
+const Q: [u8; 65] = hex!("04f9308a019258c31049344f85f89d5229b531c845836f99b08601f113bce036f9388f7b0f632de8140fe337e62a37f3566500a99934c2231b6cb9fd7584b8e672");
+
+const PRIVKEY: [u8; 32] = hex!("4242424242424242424242424242424242424242424242424242424242424242");
+const MSG_HASH: [u8; 32] = hex!("a3b1e59e5d8e9ae5d0f20d2b6e24d4b8b2e2a9d1c0a8f84a1b7cf1bf3e62b8a1");
+
+// m/44'/0'/0'/0/0
+const BIP44_PATH: [u32; 5] = [0x8000002c, 0x80000000, 0x80000000, 0, 0];
+
+enum Workload {
+    Hash(HashId, usize),
+    Add,
+    ModAdd,
+    ModMul,
+    ModPow,
+    MasterFingerprint,
+    DeriveHdNode,
+    PointAdd,
+    ScalarMult,
+    EcdsaSign,
+    EcdsaVerify,
+    SchnorrSign,
+    SchnorrVerify,
+}
+
+// Inputs of the verification workloads, computed by the V-App itself before the measurements.
+struct Fixtures {
+    pubkey: Vec<u8>,
+    ecdsa_signature: Vec<u8>,
+    schnorr_signature: Vec<u8>,
+}
+
+impl Workload {
+    fn name(&self) -> String {
+        match self {
+            Workload::Hash(hash_id, len) => format!("hash({:?}, {}B)", hash_id, len),
+            Workload::Add => "add(32B)".to_string(),
+            Workload::ModAdd => "mod_add(32B)".to_string(),
+            Workload::ModMul => "mod_mul(32B)".to_string(),
+            Workload::ModPow => "mod_pow(32B)".to_string(),
+            Workload::MasterFingerprint => "master_fingerprint".to_string(),
+            Workload::DeriveHdNode => "derive_hd_node(5)".to_string(),
+            Workload::PointAdd => "point_add".to_string(),
+            Workload::ScalarMult => "scalar_mult".to_string(),
+            Workload::EcdsaSign => "ecdsa_sign".to_string(),
+            Workload::EcdsaVerify => "ecdsa_verify".to_string(),
+            Workload::SchnorrSign => "schnorr_sign".to_string(),
+            Workload::SchnorrVerify => "schnorr_verify".to_string(),
+        }
+    }
+
+    async fn run(&self, client: &mut SadikClient, fixtures: &Fixtures) {
+        let result = match self {
+            Workload::Hash(hash_id, len) => client.hash(*hash_id, &vec![0x42; *len]).await,
+            Workload::Add => {
+                client
+                    .bignum_operation(BigIntOperator::Add, &A, &B, &[])
+                    .await
+            }
+            Workload::ModAdd => {
+                client
+                    .bignum_operation(BigIntOperator::Add, &A, &B, &P)
+                    .await
+            }
+            Workload::ModMul => {
+                client
+                    .bignum_operation(BigIntOperator::Mul, &A, &B, &P)
+                    .await
+            }
+            Workload::ModPow => {
+                client
+                    .bignum_operation(BigIntOperator::Pow, &A, &B, &P)
+                    .await
+            }
+            Workload::MasterFingerprint => client.get_master_fingerprint(Curve::Secp256k1).await,
+            Workload::DeriveHdNode => {
+                client
+                    .derive_hd_node(Curve::Secp256k1, BIP44_PATH.to_vec())
+                    .await
+            }
+            Workload::PointAdd => client.ecpoint_add(Curve::Secp256k1, &G, &Q).await,
+            Workload::ScalarMult => client.ecpoint_scalarmult(Curve::Secp256k1, &G, &A).await,
+            Workload::EcdsaSign => {
+                client
+                    .ecdsa_sign(Curve::Secp256k1, &PRIVKEY, &MSG_HASH)
+                    .await
+            }
+            Workload::EcdsaVerify => {
+                client
+                    .ecdsa_verify(
+                        Curve::Secp256k1,
+                        &fixtures.pubkey,
+                        &MSG_HASH,
+                        &fixtures.ecdsa_signature,
+                    )
+                    .await
+            }
+            Workload::SchnorrSign => {
+                client
+                    .schnorr_sign(Curve::Secp256k1, &PRIVKEY, &MSG_HASH)
+                    .await
+            }
+            Workload::SchnorrVerify => {
+                client
+                    .schnorr_verify(
+                        Curve::Secp256k1,
+                        &fixtures.pubkey,
+                        &MSG_HASH,
+                        &fixtures.schnorr_signature,
+                    )
+                    .await
+            }
+        };
+        result.expect("The request failed");
+    }
+}
+
+fn print_report(name: &str, elapsed: Duration, metrics: &MockDeviceMetrics) {
+    let per_request = |value: u64| value as f64 / N_REQUESTS as f64;
+    println!(
+        "{:<24} {:>14.0} {:>14.0} {:>11.1} {:>11.1} {:>11.1}",
+        name,
+        metrics.instructions as f64 / elapsed.as_secs_f64(),
+        per_request(metrics.instructions),
+        per_request(metrics.page_loads),
+        per_request(metrics.page_commits),
+        per_request(metrics.ecalls),
+    );
+}
+
+async fn start_client(vapp_binary: &str) -> (SadikClient, Arc<TransportMock>) {
+    let mock = Arc::new(TransportMock::new());
+    let transport: Arc<dyn Transport<Error = Box<dyn Error + Send + Sync>>> = mock.clone();
+    let (app_client, _) = VanadiumAppClient::new(vapp_binary, transport, None)
+        .await
+        .expect("Failed to create client");
+    (SadikClient::new(Box::new(app_client)), mock)
+}
+
+#[tokio::main(flavor = "current_thread")]
+async fn main() {
+    let vapp_binary = std::env::var("VAPP_BINARY").unwrap_or_else(|_| {
+        "../app/target/riscv32i-unknown-none-elf/release/vnd-sadik".to_string()
+    });
+    if !std::path::Path::new(&vapp_binary).exists() {
+        eprintln!("V-App binary not found at {}, skipping", vapp_binary);
+        return;
+    }
+
+    let fixtures = {
+        let (mut client, _) = start_client(&vapp_binary).await;
+        let pubkey = client
+            .ecpoint_scalarmult(Curve::Secp256k1, &G, &PRIVKEY)
+            .await
+            .expect("Failed to compute the public key");
+        let ecdsa_signature = client
+            .ecdsa_sign(Curve::Secp256k1, &PRIVKEY, &MSG_HASH)
+            .await
+            .expect("Failed to sign");
+        let schnorr_signature = client
+            .schnorr_sign(Curve::Secp256k1, &PRIVKEY, &MSG_HASH)
+            .await
+            .expect("Failed to sign");
+        client.exit().await.expect("Failed to exit the V-App");
+        Fixtures {
+            pubkey,
+            ecdsa_signature,
+            schnorr_signature,
+        }
+    };
+
+    let workloads = [
+        Workload::Hash(HashId::Sha256, 64),
+        Workload::Hash(HashId::Sha256, 4096),
+        Workload::Hash(HashId::Sha512, 4096),
+        Workload::Hash(HashId::Ripemd160, 4096),
+        Workload::Add,
+        Workload::ModAdd,
+        Workload::ModMul,
+        Workload::ModPow,
+        Workload::MasterFingerprint,
+        Workload::DeriveHdNode,
+        Workload::PointAdd,
+        Workload::ScalarMult,
+        Workload::EcdsaSign,
+        Workload::EcdsaVerify,
+        Workload::SchnorrSign,
+        Workload::SchnorrVerify,
+    ];
+
+    println!(
+        "{:<24} {:>14} {:>14} {:>11} {:>11} {:>11}",
+        "workload", "instr/s", "instr/req", "loads/req", "commits/req", "ecalls/req"
+    );
+    for workload in workloads {
+        // each workload runs in a fresh V-App, so that the caches of the device start empty
+        let (mut client, mock) = start_client(&vapp_binary).await;
+
+        workload.run(&mut client, &fixtures).await;
+
+        mock.reset_metrics();
+        let start = Instant::now();
+        for _ in 0..N_REQUESTS {
+            workload.run(&mut client, &fixtures).await;
+        }
+        let elapsed = start.elapsed();
+
+        print_report(&workload.name(), elapsed, &mock.metrics());
+        client.exit().await.expect("Failed to exit the V-App");
+    }
+}
@@ -144,6 +144,27 @@ impl SadikClient {
             .expect("Error sending message"))
     }
 
+    /// Computes the sum of k_i·P_i; the result is empty if it is the point at infinity.
+    pub async fn ecpoint_msm(
+        &mut self,
+        curve: Curve,
+        points: &[&[u8]],
+        scalars: &[&[u8]],
+    ) -> Result<Vec<u8>, SadikClientError> {
+        let cmd = Command::ECPointOperation {
+            curve,
+            operation: common::ECPointOperation::Msm(
+                points.iter().map(|p| p.to_vec()).collect(),
+                scalars.iter().map(|k| k.to_vec()).collect(),
+            ),
+        };
+
+        let msg = postcard::to_allocvec(&cmd).expect("Serialization failed");
+        Ok(send_message(&mut self.app_client, &msg)
+            .await
+            .expect("Error sending message"))
+    }
+
     pub async fn ecdsa_sign(
         &mut self,
         curve: Curve,
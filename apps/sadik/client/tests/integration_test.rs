@@ -284,6 +284,44 @@ async fn test_secp256k1_point_scalarmul() {
     );
 }
 
+#[tokio::test]
+async fn test_secp256k1_msm() {
+    let mut setup = test_common::setup().await;
+
+    let g: &[u8] = &hex!("0479be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
+    let p: &[u8] = &hex!("04c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee51ae168fea63dc339a3c58419466ceaeef7f632653266d0e1236431a950cfe52a");
+    let k: &[u8] = &hex!("22445566778899aabbccddeeff0011223344556677889900aabbccddeeff0011");
+    let k2: &[u8] = &hex!("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+    // n - k and n - k2, where n is the order of the curve
+    let neg_k: &[u8] = &hex!("ddbbaa99887766554433221100ffeedc876a878037c0073b151691aee1374130");
+    let neg_k2: &[u8] = &hex!("fedcba9876543210fedcba987654320fb98b977f259cd24cbeaf1925468a7352");
+
+    let k2_p = setup
+        .client
+        .ecpoint_scalarmult(common::Curve::Secp256k1, p, k2)
+        .await
+        .unwrap();
+
+    let cases: [(&[&[u8]], &[&[u8]], &[u8]); 4] = [
+        // k·G + (n - k)·G cancels out in a single double scalar multiplication
+        (&[g, g], &[k, neg_k], &[]),
+        // a term that is the point at infinity is skipped
+        (&[g, g, p], &[k, neg_k, k2], &k2_p),
+        // two terms that cancel out when added
+        (&[g, p, g, p], &[k, k2, neg_k, neg_k2], &[]),
+        // the following terms are still added after the sum was the point at infinity
+        (&[g, p, g, p, p], &[k, k2, neg_k, neg_k2, k2], &k2_p),
+    ];
+    for (points, scalars, expected) in cases {
+        let res = setup
+            .client
+            .ecpoint_msm(common::Curve::Secp256k1, points, scalars)
+            .await
+            .unwrap();
+        assert_eq!(res, expected);
+    }
+}
+
 #[tokio::test]
 async fn test_secp256k1_ecdsa_sign() {
     let mut setup = test_common::setup().await;
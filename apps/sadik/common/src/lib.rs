@@ -18,6 +18,7 @@ pub enum BigIntOperator {
 pub enum ECPointOperation {
     Add(Vec<u8>, Vec<u8>),
     ScalarMult(Vec<u8>, Vec<u8>),
+    Msm(Vec<Vec<u8>>, Vec<Vec<u8>>),
 }
 
 #[derive(Serialize, Deserialize, Debug, PartialEq)]
@@ -0,0 +1,123 @@
+//! Runs the handlers of the test V-App on the in-process mock device of the client SDK, where the
+//! RISC-V binary is executed by the `Cpu` interpreter of the `common` crate. For each workload, it
+//! reports the number of instructions executed per second (wall-clock time, including the work of
+//! the client), and the number of instructions, page faults, page commits and ECALLs per request.
+//!
+//! The V-App must be built for RISC-V first; its path can be overridden with the `VAPP_BINARY`
+//! environment variable. Run with `cargo bench --bench workloads`.
+
+use std::error::Error;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use sdk::mock_device::{MockDeviceMetrics, TransportMock};
+use sdk::transport::Transport;
+use sdk::vanadium_client::VanadiumAppClient;
+use vnd_test_client::TestClient;
+
+// Number of measured requests for each workload, after a warm-up request
+const N_REQUESTS: u32 = 20;
+
+enum Workload {
+    CountPrimes(u32),
+    Sha256(usize),
+    Base58(usize),
+    Reverse(usize),
+}
+
+impl Workload {
+    fn name(&self) -> String {
+        match self {
+            Workload::CountPrimes(n) => format!("count_primes({})", n),
+            Workload::Sha256(len) => format!("sha256({}B)", len),
+            Workload::Base58(len) => format!("base58({}B)", len),
+            Workload::Reverse(len) => format!("reverse({}B)", len),
+        }
+    }
+
+    async fn run(&self, client: &mut TestClient) {
+        match self {
+            Workload::CountPrimes(n) => {
+                client.nprimes(*n).await.expect("count_primes failed");
+            }
+            Workload::Sha256(len) => {
+                client
+                    .sha256(&vec![0x42; *len])
+                    .await
+                    .expect("sha256 failed");
+            }
+            Workload::Base58(len) => {
+                client
+                    .b58enc(&vec![0x42; *len])
+                    .await
+                    .expect("base58 failed");
+            }
+            Workload::Reverse(len) => {
+                client
+                    .reverse(&vec![0x42; *len])
+                    .await
+                    .expect("reverse failed");
+            }
+        }
+    }
+}
+
+fn print_report(name: &str, elapsed: Duration, metrics: &MockDeviceMetrics) {
+    let per_request = |value: u64| value as f64 / N_REQUESTS as f64;
+    println!(
+        "{:<20} {:>14.0} {:>14.0} {:>11.1} {:>11.1} {:>11.1}",
+        name,
+        metrics.instructions as f64 / elapsed.as_secs_f64(),
+        per_request(metrics.instructions),
+        per_request(metrics.page_loads),
+        per_request(metrics.page_commits),
+        per_request(metrics.ecalls),
+    );
+}
+
+#[tokio::main(flavor = "current_thread")]
+async fn main() {
+    let vapp_binary = std::env::var("VAPP_BINARY")
+        .unwrap_or_else(|_| "../app/target/riscv32i-unknown-none-elf/release/vnd-test".to_string());
+    if !std::path::Path::new(&vapp_binary).exists() {
+        eprintln!("V-App binary not found at {}, skipping", vapp_binary);
+        return;
+    }
+
+    let workloads = [
+        Workload::CountPrimes(1000),
+        Workload::CountPrimes(10000),
+        Workload::Sha256(64),
+        Workload::Sha256(4096),
+        Workload::Base58(32),
+        Workload::Base58(128),
+        Workload::Reverse(64),
+        Workload::Reverse(4096),
+    ];
+
+    println!(
+        "{:<20} {:>14} {:>14} {:>11} {:>11} {:>11}",
+        "workload", "instr/s", "instr/req", "loads/req", "commits/req", "ecalls/req"
+    );
+    for workload in workloads {
+        // each workload runs in a fresh V-App, so that the caches of the device start empty
+        let mock = Arc::new(TransportMock::new());
+        let transport: Arc<dyn Transport<Error = Box<dyn Error + Send + Sync>>> = mock.clone();
+        let (app_client, _) = VanadiumAppClient::new(&vapp_binary, transport, None)
+            .await
+            .expect("Failed to create client");
+        let mut client = TestClient::new(Box::new(app_client));
+
+        workload.run(&mut client).await;
+
+        mock.reset_metrics();
+        let start = Instant::now();
+        for _ in 0..N_REQUESTS {
+            workload.run(&mut client).await;
+        }
+        let elapsed = start.elapsed();
+
+        print_report(&workload.name(), elapsed, &mock.metrics());
+        client.exit().await.expect("Failed to exit the V-App");
+    }
+}
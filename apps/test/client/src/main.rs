@@ -3,14 +3,16 @@ use client::TestClient;
 use hidapi::HidApi;
 use ledger_transport_hid::TransportNativeHID;
 
+use sdk::elf::ElfFile;
 use sdk::transport::{Transport, TransportHID, TransportTcp, TransportWrapper};
-use sdk::vanadium_client::{NativeAppClient, VanadiumAppClient};
+use sdk::vanadium_client::{MerkleHashKind, NativeAppClient, VanadiumAppClient};
 
 mod commands;
 
 mod client;
 
 use std::io::BufRead;
+use std::path::Path;
 use std::sync::Arc;
 
 #[derive(Parser)]
@@ -26,6 +28,10 @@ struct Args {
     /// Use the native interface
     #[arg(long, group = "interface")]
     native: bool,
+
+    /// Hash function of the Merkle trees of the V-App's memory (sha256 or blake2s256)
+    #[arg(long, default_value = "sha256", value_parser = parse_mt_hash_kind)]
+    mt_hash: MerkleHashKind,
 }
 
 enum CliCommand {
@@ -58,6 +64,15 @@ fn parse_u32(s: &str) -> Result<u32, String> {
         .map_err(|_| "Invalid u32 integer".to_string())
 }
 
+/// Parses the name of the hash function of the Merkle trees.
+fn parse_mt_hash_kind(s: &str) -> Result<MerkleHashKind, String> {
+    match s {
+        "sha256" => Ok(MerkleHashKind::Sha256),
+        "blake2s256" => Ok(MerkleHashKind::Blake2s256),
+        _ => Err(format!("Unknown hash function: '{}'", s)),
+    }
+}
+
 fn parse_command(line: &str) -> Result<CliCommand, String> {
     let mut tokens = line.split_whitespace();
     if let Some(command) = tokens.next() {
@@ -135,9 +150,12 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
         };
         let transport = TransportWrapper::new(transport_raw.clone());
 
-        let (client, _) = VanadiumAppClient::new(&app_path_str, Arc::new(transport), None)
-            .await
-            .map_err(|_| "Failed to create client")?;
+        let elf_file =
+            ElfFile::new(Path::new(&app_path_str)).map_err(|_| "Failed to load the ELF file")?;
+        let (client, _) =
+            VanadiumAppClient::from_elf(&elf_file, Arc::new(transport), None, None, args.mt_hash)
+                .await
+                .map_err(|_| "Failed to create client")?;
 
         TestClient::new(Box::new(client))
     };
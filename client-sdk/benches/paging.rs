@@ -0,0 +1,294 @@
+//! Benchmarks of the client's side of the paging: the Merkle accumulators that store the memory
+//! segments of the V-App, and the full loop of the `VAppEngine` answering the page faults of a
+//! V-App running on the in-process mock device.
+//!
+//! The V-App used for the engine loop is a small RISC-V program generated by this benchmark, that
+//! writes to a configurable number of stack pages in a loop. When the pages do not fit in the cache
+//! of the mock device, every access is a page fault, and the page is committed when evicted;
+//! therefore, the throughput of the benchmark is the number of page exchanges per second.
+
+use std::error::Error;
+use std::path::Path;
+use std::sync::Arc;
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+
+use common::accumulator::{Hasher, MerkleAccumulator, SparseMerkleAccumulator, VectorAccumulator};
+use common::constants::PAGE_SIZE;
+use common::ecall_constants::ECALL_EXIT;
+use vanadium_client_sdk::elf::ElfFile;
+use vanadium_client_sdk::hash::{Blake2s256Hasher, Sha256Hasher};
+use vanadium_client_sdk::mock_device::{MockDeviceConfig, TransportMock};
+use vanadium_client_sdk::transport::Transport;
+use vanadium_client_sdk::vanadium_client::{CodeSegmentCache, MerkleHashKind, VanadiumAppClient};
+
+type Page = [u8; PAGE_SIZE];
+type SharedTransport = Arc<dyn Transport<Error = Box<dyn Error + Send + Sync>>>;
+
+// Number of pages of the segments: a small data segment, the stack, and a large code segment
+const SIZES: [usize; 3] = [16, 256, 4096];
+
+// Reading a page, proving it and storing it are the operations done by the client for each page
+// exchanged with the VM.
+fn bench_page_store<H: Hasher<32>>(c: &mut Criterion, hasher_name: &str) {
+    let mut group = c.benchmark_group(format!("page_store/{}", hasher_name));
+    for size in SIZES {
+        let index = size / 2;
+        let mut dense = MerkleAccumulator::<H, Page, 32>::new(vec![[0u8; PAGE_SIZE]; size]);
+        let mut sparse =
+            SparseMerkleAccumulator::<H, Page, 32>::new_uniform(size, [0u8; PAGE_SIZE]);
+        sparse.update(index, [1u8; PAGE_SIZE]).unwrap();
+
+        group.bench_with_input(BenchmarkId::new("dense/get", size), &index, |b, &index| {
+            b.iter(|| *dense.get(black_box(index)).unwrap())
+        });
+        group.bench_with_input(BenchmarkId::new("sparse/get", size), &index, |b, &index| {
+            b.iter(|| *sparse.get(black_box(index)).unwrap())
+        });
+        group.bench_with_input(
+            BenchmarkId::new("dense/prove", size),
+            &index,
+            |b, &index| b.iter(|| dense.prove(black_box(index)).unwrap()),
+        );
+        group.bench_with_input(
+            BenchmarkId::new("sparse/prove", size),
+            &index,
+            |b, &index| b.iter(|| sparse.prove(black_box(index)).unwrap()),
+        );
+
+        let mut counter = 0u8;
+        group.bench_with_input(
+            BenchmarkId::new("dense/store", size),
+            &index,
+            |b, &index| {
+                b.iter(|| {
+                    counter = counter.wrapping_add(1);
+                    dense.update(index, [counter; PAGE_SIZE]).unwrap()
+                })
+            },
+        );
+        group.bench_with_input(
+            BenchmarkId::new("sparse/store", size),
+            &index,
+            |b, &index| {
+                b.iter(|| {
+                    counter = counter.wrapping_add(1);
+                    sparse.update(index, [counter; PAGE_SIZE]).unwrap()
+                })
+            },
+        );
+    }
+    group.finish();
+}
+
+fn bench_page_stores(c: &mut Criterion) {
+    bench_page_store::<Sha256Hasher>(c, "sha256");
+    bench_page_store::<Blake2s256Hasher>(c, "blake2s256");
+}
+
+// Encoding of the few RV32I instructions used by the generated V-App
+const REG_ZERO: u32 = 0;
+const REG_SP: u32 = 2;
+const REG_T0: u32 = 5;
+const REG_A0: u32 = 10;
+const REG_T3: u32 = 28;
+const REG_T4: u32 = 29;
+const REG_T5: u32 = 30;
+
+fn addi(rd: u32, rs1: u32, imm: i32) -> u32 {
+    ((imm as u32 & 0xfff) << 20) | (rs1 << 15) | (rd << 7) | 0x13
+}
+
+fn sw(rs2: u32, rs1: u32, imm: i32) -> u32 {
+    let imm = imm as u32 & 0xfff;
+    ((imm >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (0b010 << 12) | ((imm & 0x1f) << 7) | 0x23
+}
+
+fn bne(rs1: u32, rs2: u32, offset: i32) -> u32 {
+    let imm = offset as u32 & 0x1fff;
+    (((imm >> 12) & 1) << 31)
+        | (((imm >> 5) & 0x3f) << 25)
+        | (rs2 << 20)
+        | (rs1 << 15)
+        | (0b001 << 12)
+        | (((imm >> 1) & 0xf) << 8)
+        | (((imm >> 11) & 1) << 7)
+        | 0x63
+}
+
+const ECALL: u32 = 0x73;
+
+const CODE_START: u32 = 0x10000;
+const DATA_START: u32 = 0x20000;
+
+// Returns a V-App that writes to the last n_pages pages of the stack, rounds times, then exits.
+fn stack_writer_code(n_pages: i32, rounds: i32) -> Vec<u32> {
+    assert!(n_pages > 0 && n_pages < 256 && rounds > 0 && rounds < 2048);
+    vec![
+        addi(REG_T3, REG_ZERO, rounds),            // 0:  t3 = rounds
+        addi(REG_T4, REG_SP, 0),                   // 4:  outer: t4 = sp
+        addi(REG_T5, REG_ZERO, n_pages),           // 8:  t5 = n_pages
+        sw(REG_T3, REG_T4, 0),                     // 12: inner: *t4 = t3
+        addi(REG_T4, REG_T4, -(PAGE_SIZE as i32)), // 16: t4 -= PAGE_SIZE
+        addi(REG_T5, REG_T5, -1),                  // 20: t5 -= 1
+        bne(REG_T5, REG_ZERO, -12),                // 24: if t5 != 0 goto inner
+        addi(REG_T3, REG_T3, -1),                  // 28: t3 -= 1
+        bne(REG_T3, REG_ZERO, -28),                // 32: if t3 != 0 goto outer
+        addi(REG_T0, REG_ZERO, ECALL_EXIT as i32), // 36: exit
+        addi(REG_A0, REG_ZERO, 0),                 // 40: exit status 0
+        ECALL,                                     // 44
+    ]
+}
+
+// Writes a minimal RISC-V ELF file with the given code, and a small data segment.
+fn write_elf(path: &Path, code: &[u32]) {
+    const EHDR_SIZE: u32 = 52;
+    const PHDR_SIZE: u32 = 32;
+    let code_offset = EHDR_SIZE + 2 * PHDR_SIZE;
+    let code_size = 4 * code.len() as u32;
+    let data_offset = code_offset + code_size;
+    let data_size = 4;
+
+    let mut elf = Vec::new();
+    let put_u16 = |elf: &mut Vec<u8>, v: u16| elf.extend_from_slice(&v.to_le_bytes());
+    let put_u32 = |elf: &mut Vec<u8>, v: u32| elf.extend_from_slice(&v.to_le_bytes());
+
+    // ELF header: 32-bit, little endian, executable for RISC-V
+    elf.extend_from_slice(&[0x7f, b'E', b'L', b'F', 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0]);
+    put_u16(&mut elf, 2); // e_type: ET_EXEC
+    put_u16(&mut elf, 243); // e_machine: EM_RISCV
+    put_u32(&mut elf, 1); // e_version
+    put_u32(&mut elf, CODE_START); // e_entry
+    put_u32(&mut elf, EHDR_SIZE); // e_phoff
+    put_u32(&mut elf, 0); // e_shoff
+    put_u32(&mut elf, 0); // e_flags
+    put_u16(&mut elf, EHDR_SIZE as u16); // e_ehsize
+    put_u16(&mut elf, PHDR_SIZE as u16); // e_phentsize
+    put_u16(&mut elf, 2); // e_phnum
+    put_u16(&mut elf, 40); // e_shentsize
+    put_u16(&mut elf, 0); // e_shnum
+    put_u16(&mut elf, 0); // e_shstrndx
+
+    // program headers: (offset, vaddr, size, flags)
+    for (offset, vaddr, size, flags) in [
+        (code_offset, CODE_START, code_size, 0b101), // PF_R | PF_X
+        (data_offset, DATA_START, data_size, 0b110), // PF_R | PF_W
+    ] {
+        put_u32(&mut elf, 1); // p_type: PT_LOAD
+        put_u32(&mut elf, offset);
+        put_u32(&mut elf, vaddr); // p_vaddr
+        put_u32(&mut elf, vaddr); // p_paddr
+        put_u32(&mut elf, size); // p_filesz
+        put_u32(&mut elf, size); // p_memsz
+        put_u32(&mut elf, flags);
+        put_u32(&mut elf, 4); // p_align
+    }
+
+    for instr in code {
+        put_u32(&mut elf, *instr);
+    }
+    put_u32(&mut elf, 0); // data segment
+
+    std::fs::write(path, elf).expect("Failed to write the ELF file");
+}
+
+// Runs the V-App until it exits.
+async fn run_to_completion(
+    elf: &ElfFile,
+    transport: SharedTransport,
+    app_hmac: [u8; 32],
+    code_cache: &CodeSegmentCache,
+    mt_hash_kind: MerkleHashKind,
+) {
+    let (client, _) = VanadiumAppClient::from_elf(
+        elf,
+        transport,
+        Some(app_hmac),
+        Some(code_cache),
+        mt_hash_kind,
+    )
+    .await
+    .expect("Failed to start the V-App");
+    // the engine stops once the V-App exits
+    client.close().await;
+}
+
+fn bench_engine_loop(c: &mut Criterion) {
+    let runtime = tokio::runtime::Builder::new_current_thread()
+        .enable_all()
+        .build()
+        .unwrap();
+
+    let mut group = c.benchmark_group("engine_loop");
+    // the pages of the stack fit in the cache of the device for the first case only
+    for n_pages in [8, 64] {
+        let path = std::env::temp_dir().join(format!(
+            "vanadium-bench-stack-writer-{}-{}.elf",
+            std::process::id(),
+            n_pages
+        ));
+        write_elf(&path, &stack_writer_code(n_pages, 16));
+        let elf = ElfFile::new(&path).expect("Failed to load the generated ELF file");
+
+        for (hash_name, mt_hash_kind) in [
+            ("sha256", MerkleHashKind::Sha256),
+            ("blake2s256", MerkleHashKind::Blake2s256),
+        ] {
+            let mock = Arc::new(TransportMock::with_config(MockDeviceConfig::default()));
+            let transport: SharedTransport = mock.clone();
+            let code_cache = CodeSegmentCache::new();
+
+            // the first run registers the V-App, and measures the number of page exchanges per run
+            let app_hmac = runtime.block_on(async {
+                let (client, app_hmac) = VanadiumAppClient::from_elf(
+                    &elf,
+                    transport.clone(),
+                    None,
+                    Some(&code_cache),
+                    mt_hash_kind,
+                )
+                .await
+                .expect("Failed to start the V-App");
+                client.close().await;
+                app_hmac
+            });
+            mock.reset_metrics();
+            runtime.block_on(run_to_completion(
+                &elf,
+                transport.clone(),
+                app_hmac,
+                &code_cache,
+                mt_hash_kind,
+            ));
+            let metrics = mock.metrics();
+            let exchanges = metrics.page_loads + metrics.page_commits;
+            eprintln!(
+                "engine_loop/{}/{}: {} APDUs, {} page loads, {} page commits per run",
+                hash_name, n_pages, metrics.apdus, metrics.page_loads, metrics.page_commits
+            );
+
+            group.throughput(Throughput::Elements(exchanges));
+            group.bench_with_input(
+                BenchmarkId::new(format!("stack_pages/{}", hash_name), n_pages),
+                &n_pages,
+                |b, _| {
+                    b.iter(|| {
+                        runtime.block_on(run_to_completion(
+                            &elf,
+                            transport.clone(),
+                            app_hmac,
+                            &code_cache,
+                            mt_hash_kind,
+                        ))
+                    })
+                },
+            );
+        }
+
+        let _ = std::fs::remove_file(&path);
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_page_stores, bench_engine_loop);
+criterion_main!(benches);
@@ -30,6 +30,9 @@ pub enum StatusWord {
     /// The V-App panicked
     VAppPanic = 0xB021,
 
+    /// The V-App was stopped by an Abort command
+    VAppAborted = 0xB022,
+
     /// Unknown
     Unknown,
 }
@@ -50,6 +53,7 @@ impl TryFrom<u16> for StatusWord {
             0xB008 => Ok(StatusWord::SignatureFail),
             0xB020 => Ok(StatusWord::VMRuntimeError),
             0xB021 => Ok(StatusWord::VAppPanic),
+            0xB022 => Ok(StatusWord::VAppAborted),
             0x9000 => Ok(StatusWord::OK),
             0xEEEE => Ok(StatusWord::InterruptedExecution),
             _ => Err(()),
@@ -68,10 +72,16 @@ pub struct APDUCommand {
 
 impl APDUCommand {
     pub fn encode(&self) -> Vec<u8> {
-        let mut vec = vec![self.cla, self.ins, self.p1, self.p2, self.data.len() as u8];
-        vec.extend(self.data.iter());
+        let mut vec = Vec::with_capacity(5 + self.data.len());
+        self.encode_into(&mut vec);
         vec
     }
+
+    /// Appends the encoded APDU to `buf`, so that the same buffer can be reused for many APDUs.
+    pub fn encode_into(&self, buf: &mut Vec<u8>) {
+        buf.extend_from_slice(&[self.cla, self.ins, self.p1, self.p2, self.data.len() as u8]);
+        buf.extend_from_slice(&self.data);
+    }
 }
 
 pub fn apdu_continue(data: Vec<u8>) -> APDUCommand {
@@ -94,6 +104,18 @@ pub fn apdu_continue_with_p1(data: Vec<u8>, p1: u8) -> APDUCommand {
     }
 }
 
+// Stops the V-App if it is waiting for a response from the client; the response is `VAppAborted`.
+// If no V-App is running, there is nothing to abort and the response is `OK`.
+pub fn apdu_abort() -> APDUCommand {
+    APDUCommand {
+        cla: 0xE0,
+        ins: 0xfe,
+        p1: 0,
+        p2: 0,
+        data: vec![],
+    }
+}
+
 pub fn apdu_register_vapp(serialized_manifest: Vec<u8>) -> APDUCommand {
     APDUCommand {
         cla: 0xE0,
@@ -115,3 +137,15 @@ pub fn apdu_run_vapp(serialized_manifest: Vec<u8>, app_hmac: [u8; 32]) -> APDUCo
         data,
     }
 }
+
+pub fn apdu_resume_vapp(serialized_manifest: Vec<u8>, app_hmac: [u8; 32]) -> APDUCommand {
+    let mut data = serialized_manifest;
+    data.extend_from_slice(&app_hmac);
+    APDUCommand {
+        cla: 0xE0,
+        ins: 3,
+        p1: 1,
+        p2: 0,
+        data,
+    }
+}
@@ -4,7 +4,7 @@
 
 use crate::vanadium_client::{VAppClient, VAppExecutionError};
 
-use common::comm::{ACK, CHUNK_LENGTH};
+use common::comm::{ACK, CHUNK_LENGTH, STREAMED_FLAG};
 
 /// Error types that can occur during message transmission.
 #[derive(Debug)]
@@ -15,6 +15,10 @@ pub enum SendMessageError {
     VAppExecutionError(VAppExecutionError),
     /// Error returned when the response is less than the expected 4 bytes.
     ResponseTooShort,
+    /// Error returned when the message is too long to be framed.
+    MessageTooLong,
+    /// Error returned when the length of a streamed response does not match its length prefix.
+    InvalidResponseLength,
 }
 
 impl core::fmt::Display for SendMessageError {
@@ -22,6 +26,8 @@ impl core::fmt::Display for SendMessageError {
         match self {
             SendMessageError::NotAckReceived => write!(f, "ACK was expected but not received"),
             SendMessageError::ResponseTooShort => write!(f, "Response shorter than 4 bytes"),
+            SendMessageError::MessageTooLong => write!(f, "Message too long"),
+            SendMessageError::InvalidResponseLength => write!(f, "Invalid response length"),
             SendMessageError::VAppExecutionError(v) => write!(f, "Error from the VM: {}", v),
         }
     }
@@ -37,6 +43,10 @@ impl core::error::Error for SendMessageError {}
 /// The response must start with a 4-byte length prefix, followed by the actual response data, which
 /// is also split in chunks with the same approach.
 ///
+/// If the V-App supports it (see `VAppClient::supports_streamed_framing`), the streamed framing is
+/// used instead: the streamed framing flag is set in the length prefix, and only the first chunk is
+/// acknowledged; the rest of the message is sent at once, and so is the response.
+///
 /// # Arguments
 ///
 /// * `client` - The V-App client.
@@ -52,40 +62,80 @@ impl core::error::Error for SendMessageError {}
 /// This function will return a `SendMessageError` if:
 ///
 /// * An acknowledgment (ACK) is expected but not received.
-/// * The response length is less than 4 bytes.
+/// * The message is too long for its length to be encoded in the length prefix.
+/// * The response length is less than 4 bytes, or does not match the length prefix.
 /// * An error occurs during the execution of the virtual application client.
 ///
 pub async fn send_message(
     client: &mut Box<dyn VAppClient + Send + Sync>,
     message: &[u8],
 ) -> Result<Vec<u8>, SendMessageError> {
-    // concatenate the length of the message (as a 4-byte big-endian) and the message itself
+    if message.len() as u64 >= STREAMED_FLAG as u64 {
+        return Err(SendMessageError::MessageTooLong);
+    }
+    let streamed = client.supports_streamed_framing();
+
+    // concatenate the length of the message (as a 4-byte big-endian, with the streamed flag set if
+    // the V-App supports it) and the message itself
+    let mut prefix = message.len() as u32;
+    if streamed {
+        prefix |= STREAMED_FLAG;
+    }
     let mut full_message: Vec<u8> = Vec::with_capacity(message.len() + 4);
-    full_message.extend_from_slice(&(message.len() as u32).to_be_bytes());
+    full_message.extend_from_slice(&prefix.to_be_bytes());
     full_message.extend_from_slice(message);
 
-    let mut resp = ACK.to_vec();
-    for chunk in full_message.chunks(CHUNK_LENGTH) {
-        if resp != ACK {
-            return Err(SendMessageError::NotAckReceived);
-        }
-        resp = client
-            .send_message(chunk)
+    let mut resp = if streamed {
+        let (first_chunk, rest) = full_message.split_at(full_message.len().min(CHUNK_LENGTH));
+        let mut resp = client
+            .send_message(first_chunk)
             .await
             .map_err(SendMessageError::VAppExecutionError)?;
-    }
+        if !rest.is_empty() {
+            if resp != ACK {
+                return Err(SendMessageError::NotAckReceived);
+            }
+            resp = client
+                .send_message(rest)
+                .await
+                .map_err(SendMessageError::VAppExecutionError)?;
+        }
+        resp
+    } else {
+        let mut resp = ACK.to_vec();
+        for chunk in full_message.chunks(CHUNK_LENGTH) {
+            if resp != ACK {
+                return Err(SendMessageError::NotAckReceived);
+            }
+            resp = client
+                .send_message(chunk)
+                .await
+                .map_err(SendMessageError::VAppExecutionError)?;
+        }
+        resp
+    };
 
     // The first 4 bytes contain the length of the data in the response.
     // All the remaining data is the response data.
     if resp.len() < 4 {
         return Err(SendMessageError::ResponseTooShort);
     }
-    let response_data_len = u32::from_be_bytes(
+    let prefix = u32::from_be_bytes(
         resp[0..4]
             .try_into()
             .map_err(|_| SendMessageError::ResponseTooShort)?,
-    ) as usize;
+    );
+
+    if streamed && prefix & STREAMED_FLAG != 0 {
+        // the whole response was sent at once
+        if resp.len() - 4 != (prefix & !STREAMED_FLAG) as usize {
+            return Err(SendMessageError::InvalidResponseLength);
+        }
+        resp.drain(0..4);
+        return Ok(resp);
+    }
 
+    let response_data_len = prefix as usize;
     let mut response_data = resp[4..].to_vec();
     while response_data.len() < response_data_len {
         let resp = client
@@ -96,3 +146,51 @@ pub async fn send_message(
     }
     Ok(response_data)
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use async_trait::async_trait;
+    use std::cmp::min;
+
+    // Emulates a V-App that only knows the original framing, and echoes the messages it receives.
+    #[derive(Default)]
+    struct LegacyEchoApp {
+        received: Vec<u8>,
+        response: Vec<u8>,
+    }
+
+    #[async_trait]
+    impl VAppClient for LegacyEchoApp {
+        async fn send_message(&mut self, msg: &[u8]) -> Result<Vec<u8>, VAppExecutionError> {
+            if !self.response.is_empty() {
+                // the client acknowledges each chunk of the response
+                assert_eq!(msg, ACK);
+                let len = min(self.response.len(), CHUNK_LENGTH);
+                return Ok(self.response.drain(..len).collect());
+            }
+
+            assert!(msg.len() <= CHUNK_LENGTH);
+            self.received.extend_from_slice(msg);
+            let length = u32::from_be_bytes(self.received[0..4].try_into().unwrap()) as usize;
+            if self.received.len() < 4 + length {
+                return Ok(ACK.to_vec());
+            }
+
+            // the length prefix followed by the message is also a valid response
+            let mut response = std::mem::take(&mut self.received);
+            self.response = response.split_off(min(response.len(), CHUNK_LENGTH));
+            Ok(response)
+        }
+    }
+
+    #[tokio::test]
+    async fn test_send_message_original_framing() {
+        for len in [0, 10, CHUNK_LENGTH, 1000] {
+            let message: Vec<u8> = (0..len).map(|i| i as u8).collect();
+            let mut client: Box<dyn VAppClient + Send + Sync> = Box::new(LegacyEchoApp::default());
+            assert!(!client.supports_streamed_framing());
+            assert_eq!(send_message(&mut client, &message).await.unwrap(), message);
+        }
+    }
+}
@@ -1,35 +1,56 @@
+use common::comm::STREAMED_FRAMING_SYMBOL;
 use goblin::elf::program_header::{PF_R, PF_W, PF_X, PT_LOAD};
 use goblin::elf::{Elf, ProgramHeader};
+use memmap2::Mmap;
 
 use core::panic;
 use std::fs::File;
 use std::io;
-use std::io::Read;
+use std::ops::Range;
 use std::path::Path;
+use std::sync::Arc;
 
+/// A loadable segment of the ELF file.
+///
+/// The content stored in the file is borrowed from the memory mapping of the file, rather than
+/// copied. The rest of the segment, up to `end` (for example, the bss), is implicitly zero.
 #[derive(Debug)]
 pub struct Segment {
-    pub data: Vec<u8>,
     pub start: u32,
     pub end: u32,
+    file: Arc<Mmap>,
+    file_range: Range<usize>,
 }
 
 impl Segment {
-    fn new(segment: &ProgramHeader, data: &[u8], memsize: usize) -> Self {
+    fn new(segment: &ProgramHeader, file: Arc<Mmap>, memsize: usize) -> io::Result<Self> {
         if (memsize as u64) < segment.p_filesz {
             panic!("memsize cannot be smaller than p_filesz");
         }
 
-        let start = segment.p_vaddr as u32;
+        let file_start = segment.p_offset as usize;
+        let file_range = file_start..file_start + segment.p_filesz as usize;
+        if file_range.end > file.len() {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "Segment exceeds the size of the file",
+            ));
+        }
 
-        let mut data = data.to_vec();
-        data.resize(memsize, 0);
+        let start = segment.p_vaddr as u32;
 
-        Self {
-            data,
+        Ok(Self {
             start,
             end: start + memsize as u32,
-        }
+            file,
+            file_range,
+        })
+    }
+
+    /// Returns the content of the segment that is stored in the file. It might be shorter than the
+    /// segment; the remaining bytes are zero.
+    pub fn data(&self) -> &[u8] {
+        &self.file[self.file_range.clone()]
     }
 }
 
@@ -38,30 +59,37 @@ pub struct ElfFile {
     pub code_segment: Segment,
     pub data_segment: Segment,
     pub entrypoint: u32,
+    /// Whether the V-App supports the streamed framing of the comm protocol.
+    pub streamed_framing: bool,
 }
 
 impl ElfFile {
     pub fn new(path: &Path) -> io::Result<Self> {
-        let mut file = File::open(path)?;
-        let mut buffer = Vec::new();
-        file.read_to_end(&mut buffer)?;
+        let file = File::open(path)?;
+        // Safety: the file must not be modified while it is mapped
+        let file = Arc::new(unsafe { Mmap::map(&file)? });
 
-        let elf = Elf::parse(&buffer).unwrap();
+        let elf = Elf::parse(&file).unwrap();
         assert_eq!(elf.header.e_machine, goblin::elf::header::EM_RISCV);
 
-        let (code_segment, data_segment) = Self::parse_segments(&elf, &buffer)?;
+        let (code_segment, data_segment) = Self::parse_segments(&elf, &file)?;
         let entrypoint = elf.header.e_entry as u32;
+        let streamed_framing = elf
+            .syms
+            .iter()
+            .any(|sym| elf.strtab.get_at(sym.st_name) == Some(STREAMED_FRAMING_SYMBOL));
 
         Ok(Self {
             code_segment,
             data_segment,
             entrypoint,
+            streamed_framing,
         })
     }
 
     // Parses the Elf, extracting the code and data segments.
     // Fails if there are not exactly two loadable segments, one read-execute and one read-write.
-    fn parse_segments(elf: &Elf, data: &[u8]) -> io::Result<(Segment, Segment)> {
+    fn parse_segments(elf: &Elf, file: &Arc<Mmap>) -> io::Result<(Segment, Segment)> {
         let mut segments: Vec<_> = elf
             .program_headers
             .iter()
@@ -88,21 +116,10 @@ impl ElfFile {
             ));
         }
 
-        let code_start = segments[0].p_offset as usize;
         let code_size = segments[0].p_filesz as usize;
-        let code_seg = Segment::new(
-            segments[0],
-            &data[code_start..code_start + code_size],
-            code_size,
-        );
-        let data_start = segments[1].p_offset as usize;
-        let data_filesize = segments[1].p_filesz as usize;
+        let code_seg = Segment::new(segments[0], file.clone(), code_size)?;
         let data_memsize = segments[1].p_memsz as usize;
-        let data_seg = Segment::new(
-            segments[1],
-            &data[data_start..data_start + data_filesize],
-            data_memsize,
-        );
+        let data_seg = Segment::new(segments[1], file.clone(), data_memsize)?;
 
         Ok((code_seg, data_seg))
     }
@@ -0,0 +1,64 @@
+//! Implementations of the `Hasher` trait used for the Merkle trees of the V-App's memory.
+
+use blake2::Blake2s256;
+use common::accumulator::Hasher;
+use sha2::{Digest, Sha256};
+
+pub struct Sha256Hasher {
+    hasher: Sha256,
+}
+
+impl Hasher<32> for Sha256Hasher {
+    fn new() -> Self {
+        Sha256Hasher {
+            hasher: Sha256::new(),
+        }
+    }
+
+    fn update(&mut self, data: &[u8]) {
+        self.hasher.update(data);
+    }
+
+    fn finalize(self) -> [u8; 32] {
+        self.hasher.finalize().into()
+    }
+
+    // hashes the whole preimage in a single call, rather than one update per part
+    fn hash_internal_node(left: &[u8; 32], right: &[u8; 32]) -> [u8; 32] {
+        let mut preimage = [0u8; 65];
+        preimage[0] = 0x01;
+        preimage[1..33].copy_from_slice(left);
+        preimage[33..].copy_from_slice(right);
+        Sha256::digest(preimage).into()
+    }
+}
+
+/// BLAKE2s with a 32-byte output. It has the same block size as SHA-256, but it is significantly
+/// faster in software; therefore, it makes building and updating the Merkle trees cheaper.
+pub struct Blake2s256Hasher {
+    hasher: Blake2s256,
+}
+
+impl Hasher<32> for Blake2s256Hasher {
+    fn new() -> Self {
+        Blake2s256Hasher {
+            hasher: Blake2s256::new(),
+        }
+    }
+
+    fn update(&mut self, data: &[u8]) {
+        self.hasher.update(data);
+    }
+
+    fn finalize(self) -> [u8; 32] {
+        self.hasher.finalize().into()
+    }
+
+    fn hash_internal_node(left: &[u8; 32], right: &[u8; 32]) -> [u8; 32] {
+        let mut preimage = [0u8; 65];
+        preimage[0] = 0x01;
+        preimage[1..33].copy_from_slice(left);
+        preimage[33..].copy_from_slice(right);
+        Blake2s256::digest(preimage).into()
+    }
+}
@@ -1,6 +1,13 @@
 mod apdu;
 pub mod comm;
 pub mod elf;
+pub mod hash;
+#[cfg(feature = "mock-device")]
+mod mock_crypto;
+#[cfg(feature = "mock-device")]
+pub mod mock_device;
+pub mod session;
+pub mod snapshot;
 pub mod transport;
 pub mod vanadium_client;
 
@@ -0,0 +1,272 @@
+//! Host implementations of the cryptographic ECALLs of the Vanadium VM, used by the emulated device
+//! of the `mock_device` module.
+//!
+//! They follow the same conventions as the native implementation of the V-App SDK: the big numbers
+//! are big-endian byte strings, the elliptic curve points are uncompressed SEC1 encodings, and the
+//! HD derivations use the default seed of Speculos. They are meant for testing and benchmarking
+//! only: unlike the device, none of them is constant time.
+
+use bip32::{ChildNumber, XPrv};
+use k256::{
+    ecdsa::{self, signature::hazmat::PrehashVerifier},
+    elliptic_curve::{
+        sec1::{FromEncodedPoint, ToEncodedPoint},
+        PrimeField,
+    },
+    schnorr, EncodedPoint, ProjectivePoint, Scalar,
+};
+use num_bigint::BigUint;
+use num_traits::Zero;
+use sha2::Digest;
+
+use common::ecall_constants::{HashId, MAX_BIGNUMBER_SIZE, MAX_HD_CHILDREN};
+
+// default seed used in Speculos, corresponding to the mnemonic "glory promote mansion idle axis
+// finger extra february uncover one trip resource lawn turtle enact monster seven myth punch hobby
+// comfort wild raise skin"
+const DEFAULT_SEED: &str = "b11997faff420a331bb4a4ffdc8bdc8ba7c01732a99a30d83dbbebd469666c84b47d09d3f5f472b3b9384ac634beba2a440ba36ec7661144132f35e206873564";
+
+// Encodes n as a big-endian number of exactly len bytes, if it fits.
+fn to_be_bytes_padded(n: &BigUint, len: usize) -> Option<Vec<u8>> {
+    let bytes = n.to_bytes_be();
+    if bytes.len() > len {
+        return None;
+    }
+    let mut result = vec![0u8; len - bytes.len()];
+    result.extend_from_slice(&bytes);
+    Some(result)
+}
+
+/// Computes n mod m, with the same length as n.
+pub fn bn_modm(n: &[u8], m: &[u8]) -> Option<Vec<u8>> {
+    if n.len() > MAX_BIGNUMBER_SIZE || m.len() > MAX_BIGNUMBER_SIZE {
+        return None;
+    }
+    let m = BigUint::from_bytes_be(m);
+    if m.is_zero() {
+        return None;
+    }
+    to_be_bytes_padded(&(BigUint::from_bytes_be(n) % m), n.len())
+}
+
+// Parses the operands of a binary modular operation, checking that they are reduced modulo m.
+fn parse_modular_operands(a: &[u8], b: &[u8], m: &[u8]) -> Option<(BigUint, BigUint, BigUint)> {
+    if m.len() > MAX_BIGNUMBER_SIZE || a.len() != m.len() || b.len() != m.len() {
+        return None;
+    }
+    let (a, b, m) = (
+        BigUint::from_bytes_be(a),
+        BigUint::from_bytes_be(b),
+        BigUint::from_bytes_be(m),
+    );
+    if m.is_zero() || a >= m || b >= m {
+        return None;
+    }
+    Some((a, b, m))
+}
+
+/// Computes (a + b) mod m. All the operands have the same length, and a and b must be reduced.
+pub fn bn_addm(a: &[u8], b: &[u8], m: &[u8]) -> Option<Vec<u8>> {
+    let (a, b, modulus) = parse_modular_operands(a, b, m)?;
+    to_be_bytes_padded(&((a + b) % modulus), m.len())
+}
+
+/// Computes (a - b) mod m. All the operands have the same length, and a and b must be reduced.
+pub fn bn_subm(a: &[u8], b: &[u8], m: &[u8]) -> Option<Vec<u8>> {
+    let (a, b, modulus) = parse_modular_operands(a, b, m)?;
+    // the `+ &modulus` is to avoid negative numbers, since BigUints must be non-negative
+    to_be_bytes_padded(&((a + &modulus - b) % &modulus), m.len())
+}
+
+/// Computes (a * b) mod m. All the operands have the same length, and a and b must be reduced.
+pub fn bn_multm(a: &[u8], b: &[u8], m: &[u8]) -> Option<Vec<u8>> {
+    let (a, b, modulus) = parse_modular_operands(a, b, m)?;
+    to_be_bytes_padded(&((a * b) % modulus), m.len())
+}
+
+/// Computes a^e mod m. a and m have the same length, and a must be reduced.
+pub fn bn_powm(a: &[u8], e: &[u8], m: &[u8]) -> Option<Vec<u8>> {
+    if m.len() > MAX_BIGNUMBER_SIZE || a.len() != m.len() || e.len() > MAX_BIGNUMBER_SIZE {
+        return None;
+    }
+    let (a, e, modulus) = (
+        BigUint::from_bytes_be(a),
+        BigUint::from_bytes_be(e),
+        BigUint::from_bytes_be(m),
+    );
+    if modulus.is_zero() || a >= modulus {
+        return None;
+    }
+    to_be_bytes_padded(&a.modpow(&e, &modulus), m.len())
+}
+
+/// The state of one of the hash functions supported by the hash ECALLs.
+#[derive(Clone)]
+pub enum HashState {
+    Ripemd160(ripemd::Ripemd160),
+    Sha256(sha2::Sha256),
+    Sha512(sha2::Sha512),
+}
+
+impl HashState {
+    /// Returns the initial state of the hash function with the given id, if supported.
+    pub fn new(hash_id: u32) -> Option<Self> {
+        match hash_id {
+            id if id == HashId::Ripemd160 as u32 => Some(Self::Ripemd160(Default::default())),
+            id if id == HashId::Sha256 as u32 => Some(Self::Sha256(Default::default())),
+            id if id == HashId::Sha512 as u32 => Some(Self::Sha512(Default::default())),
+            _ => None,
+        }
+    }
+
+    pub fn update(&mut self, data: &[u8]) {
+        match self {
+            Self::Ripemd160(h) => h.update(data),
+            Self::Sha256(h) => h.update(data),
+            Self::Sha512(h) => h.update(data),
+        }
+    }
+
+    /// Returns the digest of the data hashed so far, without modifying the state.
+    pub fn digest(&self) -> Vec<u8> {
+        match self {
+            Self::Ripemd160(h) => h.clone().finalize().to_vec(),
+            Self::Sha256(h) => h.clone().finalize().to_vec(),
+            Self::Sha512(h) => h.clone().finalize().to_vec(),
+        }
+    }
+}
+
+fn master_bip32_key() -> XPrv {
+    let seed = hex::decode(DEFAULT_SEED).expect("Invalid seed");
+    XPrv::new(&seed).expect("Failed to create master key from seed")
+}
+
+/// Derives the private key and the chain code of the BIP-32 path from the master key.
+pub fn derive_hd_node(path: &[u32]) -> Option<([u8; 32], [u8; 32])> {
+    let mut key = master_bip32_key();
+    for step in path {
+        key = key.derive_child(ChildNumber::from(*step)).ok()?;
+    }
+    Some((key.private_key().to_bytes().into(), key.attrs().chain_code))
+}
+
+/// Derives the node of the BIP-32 path once, then n_children consecutive children of it, which
+/// must be all hardened or all non-hardened. Returns the fingerprint of the node, and the chain code
+/// followed by the uncompressed public key of each child.
+pub fn derive_hd_pubkeys(
+    path: &[u32],
+    first_child: u32,
+    n_children: usize,
+) -> Option<(u32, Vec<u8>)> {
+    if n_children == 0 || n_children > MAX_HD_CHILDREN {
+        return None;
+    }
+    let last_child = first_child.checked_add(n_children as u32 - 1)?;
+    if (first_child ^ last_child) & 0x80000000 != 0 {
+        return None;
+    }
+
+    let mut key = master_bip32_key();
+    for step in path {
+        key = key.derive_child(ChildNumber::from(*step)).ok()?;
+    }
+    let mut children = Vec::with_capacity(n_children * (32 + 65));
+    for index in first_child..=last_child {
+        let child = key.derive_child(ChildNumber::from(index)).ok()?;
+        children.extend_from_slice(&child.attrs().chain_code);
+        children.extend_from_slice(
+            child
+                .private_key()
+                .verifying_key()
+                .to_encoded_point(false)
+                .as_bytes(),
+        );
+    }
+    Some((u32::from_be_bytes(key.public_key().fingerprint()), children))
+}
+
+/// Returns the fingerprint of the master key.
+pub fn master_fingerprint() -> u32 {
+    u32::from_be_bytes(master_bip32_key().public_key().fingerprint())
+}
+
+fn parse_point(p: &[u8; 65]) -> Option<ProjectivePoint> {
+    let p = EncodedPoint::from_bytes(p).ok()?;
+    Option::from(ProjectivePoint::from_encoded_point(&p))
+}
+
+fn encode_point(p: &ProjectivePoint) -> Option<[u8; 65]> {
+    p.to_encoded_point(false).as_bytes().try_into().ok()
+}
+
+/// Adds two points of secp256k1.
+pub fn ecfp_add_point(p: &[u8; 65], q: &[u8; 65]) -> Option<[u8; 65]> {
+    encode_point(&(parse_point(p)? + parse_point(q)?))
+}
+
+/// Multiplies a point of secp256k1 by a big-endian scalar of at most 32 bytes.
+pub fn ecfp_scalar_mult(p: &[u8; 65], k: &[u8]) -> Option<[u8; 65]> {
+    if k.len() > 32 {
+        return None;
+    }
+    let mut k_padded = [0u8; 32];
+    k_padded[32 - k.len()..].copy_from_slice(k);
+    let k: Scalar = Option::from(Scalar::from_repr(k_padded.into()))?;
+    encode_point(&(parse_point(p)? * k))
+}
+
+/// Computes the sum of k_i·P_i for the consecutive 65-byte points and 32-byte scalars. Returns None
+/// if a point or a scalar is invalid, and Some(None) if the result is the point at infinity.
+pub fn ecfp_msm(points: &[u8], scalars: &[u8]) -> Option<Option<[u8; 65]>> {
+    let mut result = ProjectivePoint::IDENTITY;
+    for (p, k) in points.chunks_exact(65).zip(scalars.chunks_exact(32)) {
+        let k: [u8; 32] = k.try_into().ok()?;
+        let k: Scalar = Option::from(Scalar::from_repr(k.into()))?;
+        result += parse_point(p.try_into().ok()?)? * k;
+    }
+    if result == ProjectivePoint::IDENTITY {
+        return Some(None);
+    }
+    Some(Some(encode_point(&result)?))
+}
+
+/// Returns the DER-encoded deterministic ECDSA signature of a message hash.
+pub fn ecdsa_sign(privkey: &[u8; 32], msg_hash: &[u8; 32]) -> Option<Vec<u8>> {
+    let signing_key = ecdsa::SigningKey::from_bytes(&(*privkey).into()).ok()?;
+    let (signature, _) = signing_key.sign_prehash_recoverable(msg_hash).ok()?;
+    Some(ecdsa::DerSignature::from(signature).to_bytes().to_vec())
+}
+
+/// Verifies a DER-encoded ECDSA signature of a message hash.
+pub fn ecdsa_verify(pubkey: &[u8; 65], msg_hash: &[u8; 32], signature: &[u8]) -> bool {
+    let Ok(pubkey) = EncodedPoint::from_bytes(pubkey) else {
+        return false;
+    };
+    let Ok(verifying_key) = ecdsa::VerifyingKey::from_encoded_point(&pubkey) else {
+        return false;
+    };
+    let Ok(signature) = ecdsa::DerSignature::from_bytes(signature) else {
+        return false;
+    };
+    verifying_key.verify_prehash(msg_hash, &signature).is_ok()
+}
+
+/// Returns the BIP-340 Schnorr signature of a message. As on the device, the message is signed as
+/// is, without hashing it first. Unlike the device, the auxiliary randomness is all zeros, so that
+/// the signatures are deterministic.
+pub fn schnorr_sign(privkey: &[u8; 32], msg: &[u8]) -> Option<[u8; 64]> {
+    let signing_key = schnorr::SigningKey::from_bytes(privkey).ok()?;
+    Some(signing_key.sign_raw(msg, &[0u8; 32]).ok()?.to_bytes())
+}
+
+/// Verifies a BIP-340 Schnorr signature of a message; the public key is uncompressed.
+pub fn schnorr_verify(pubkey: &[u8; 65], msg: &[u8], signature: &[u8; 64]) -> bool {
+    let Ok(verifying_key) = schnorr::VerifyingKey::from_bytes(&pubkey[1..33]) else {
+        return false;
+    };
+    let Ok(signature) = schnorr::Signature::try_from(&signature[..]) else {
+        return false;
+    };
+    verifying_key.verify_raw(msg, &signature).is_ok()
+}
@@ -0,0 +1,1914 @@
+//! This module provides a `Transport` that emulates a device running the Vanadium VM in-process,
+//! without Speculos or a real device.
+//!
+//! The VM runs in a dedicated thread, with the `Cpu` interpreter from the `common` crate. As in
+//! the Vanadium app, its memory segments are outsourced to the client: the emulated device keeps a
+//! small LRU cache of pages per segment, and exchanges pages with the client using the same
+//! `ClientCommandCode` messages. Therefore, the `VAppEngine` can not tell it apart from a real
+//! device.
+//!
+//! Each APDU can be delayed according to a simple latency and bandwidth model, and the emulated
+//! device keeps counters of the APDUs and of the page exchanges. This makes it suitable to
+//! benchmark the client, the caching policies and the protocol in a deterministic way.
+//!
+//! Besides the ECALLs needed for the communication (exit, panic, xsend, xrecv, client_call,
+//! checkpoint and ux_idle) and the memory intrinsics, the big numbers, hash and secp256k1 ECALLs are
+//! emulated with host implementations (see the `mock_crypto` module). As in the Vanadium app, the
+//! ECALLs are decoded by `common::ecall_dispatch` from the specification of the ECALLs. When the VM
+//! stops with a runtime error, the client receives the `VMRuntimeError` status word, and the error
+//! is available from `TransportMock::take_runtime_error`.
+
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::error::Error;
+use std::rc::Rc;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{mpsc, Arc, Mutex as StdMutex};
+use std::thread;
+use std::time::Duration;
+
+use async_trait::async_trait;
+use hmac::{Hmac, Mac};
+use rand::rngs::OsRng;
+use rand::TryRngCore;
+use sha2::{Digest, Sha256};
+use tokio::sync::{mpsc as tokio_mpsc, Mutex};
+
+use common::bn_batch::{self, BnBatchBackend, BnBatchError};
+use common::bn_context::{self, MAX_BN_CONTEXTS};
+use common::client_commands::{
+    CheckpointMessage, ClientCallMessage, CommitPageContentMessage, CommitPageMessage,
+    GetCheckpointMessage, GetPageMessage, Message, ReceiveBufferMessage, ReceiveBufferResponse,
+    SectionKind, SendBufferMessage, SendPanicBufferMessage, VAppCheckpoint,
+};
+use common::constants::PAGE_SIZE;
+use common::ecall_constants::*;
+use common::ecall_dispatch::{dispatch_ecall, EcallDispatch, GuestPointer};
+use common::manifest::Manifest;
+use common::merkle::{self, MerkleBackend, MerkleError, MerkleTreeKind};
+use common::vm::{Cpu, CpuError, EcallHandler, MemoryError, MemorySegment, Page, PagedMemory};
+
+use crate::apdu::{APDUCommand, StatusWord};
+use crate::mock_crypto::{self, HashState};
+use crate::transport::Transport;
+
+/// The HMAC returned by the emulated device when registering a V-App, and expected when running it.
+const MOCK_APP_HMAC: [u8; 32] = [0x42u8; 32];
+
+// Maximum number of bytes of the buffer sent in each SendBufferMessage or SendPanicBufferMessage
+const MAX_SEND_CHUNK_SIZE: usize = 255 - 4;
+// Maximum number of bytes of the payload sent in each ClientCallMessage, that also has a request id
+const MAX_CLIENT_CALL_CHUNK_SIZE: usize = MAX_SEND_CHUNK_SIZE - 4;
+
+// Index of the register a0
+const REG_A0: usize = 10;
+
+// Same limit as in the Vanadium app
+const MAX_BIP32_PATH: usize = 16;
+
+// Largest buffer read from the V-App memory by an ECALL: the points of ecfp_msm
+const MAX_GUEST_BUFFER_SIZE: usize = 65 * MAX_MSM_POINTS;
+
+// Maximum number of hash contexts of the V-App that are not finalized yet
+const MAX_HASH_STATES: usize = 256;
+
+// Encoding of the ECALL instruction
+const ECALL_INSTRUCTION: u32 = 0x00000073;
+
+type HmacSha256 = Hmac<Sha256>;
+
+// Same HMAC-SHA256 as the one computed by the Vanadium app to authenticate the checkpoints of a
+// V-App, with the secret key of the emulated device. The returned MAC is not finalized yet.
+fn checkpoint_mac(
+    key: &[u8; 32],
+    manifest: &Manifest,
+    app_hmac: &[u8; 32],
+    pc: u32,
+    regs: &[u32; 32],
+) -> HmacSha256 {
+    let mut mac = HmacSha256::new_from_slice(key).expect("HMAC accepts keys of any length");
+    mac.update(&postcard::to_allocvec(manifest).expect("Failed to serialize the manifest"));
+    mac.update(app_hmac);
+    VAppCheckpoint::serialize_state_with(pc, regs, |data| mac.update(data));
+    mac
+}
+
+// Returns a new random key, playing the role of the secret that a device generates on first use.
+fn random_key() -> [u8; 32] {
+    let mut key = [0u8; 32];
+    OsRng
+        .try_fill_bytes(&mut key)
+        .expect("Failed to get randomness from the OS");
+    key
+}
+
+/// Configuration of the emulated device.
+#[derive(Debug, Clone)]
+pub struct MockDeviceConfig {
+    /// Fixed delay added to each APDU exchange.
+    pub apdu_latency: Duration,
+    /// If set, each APDU exchange is further delayed by the time needed to transfer the command
+    /// and the response at this speed, in bytes per second.
+    pub bandwidth: Option<u64>,
+    /// Number of pages cached by the emulated device for each memory segment.
+    pub n_cached_pages: usize,
+}
+
+impl Default for MockDeviceConfig {
+    fn default() -> Self {
+        Self {
+            apdu_latency: Duration::ZERO,
+            bandwidth: None,
+            n_cached_pages: 12,
+        }
+    }
+}
+
+/// Counters collected by the emulated device.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct MockDeviceMetrics {
+    /// Number of APDUs received by the device.
+    pub apdus: u64,
+    /// Total length of the APDUs received by the device, including the headers.
+    pub bytes_received: u64,
+    /// Total length of the responses sent by the device, including the status words.
+    pub bytes_sent: u64,
+    /// Number of pages requested to the client.
+    pub page_loads: u64,
+    /// Number of pages committed to the client.
+    pub page_commits: u64,
+    /// Number of instructions executed by the VM.
+    pub instructions: u64,
+    /// Number of ECALLs made by the V-App.
+    pub ecalls: u64,
+}
+
+#[derive(Debug, Default)]
+struct MetricsCounters {
+    apdus: AtomicU64,
+    bytes_received: AtomicU64,
+    bytes_sent: AtomicU64,
+    page_loads: AtomicU64,
+    page_commits: AtomicU64,
+    instructions: AtomicU64,
+    ecalls: AtomicU64,
+}
+
+impl MetricsCounters {
+    #[inline]
+    fn add(counter: &AtomicU64, value: u64) {
+        counter.fetch_add(value, Ordering::Relaxed);
+    }
+
+    fn snapshot(&self) -> MockDeviceMetrics {
+        MockDeviceMetrics {
+            apdus: self.apdus.load(Ordering::Relaxed),
+            bytes_received: self.bytes_received.load(Ordering::Relaxed),
+            bytes_sent: self.bytes_sent.load(Ordering::Relaxed),
+            page_loads: self.page_loads.load(Ordering::Relaxed),
+            page_commits: self.page_commits.load(Ordering::Relaxed),
+            instructions: self.instructions.load(Ordering::Relaxed),
+            ecalls: self.ecalls.load(Ordering::Relaxed),
+        }
+    }
+
+    fn reset(&self) {
+        for counter in [
+            &self.apdus,
+            &self.bytes_received,
+            &self.bytes_sent,
+            &self.page_loads,
+            &self.page_commits,
+            &self.instructions,
+            &self.ecalls,
+        ] {
+            counter.store(0, Ordering::Relaxed);
+        }
+    }
+}
+
+// Error returned when the transport was dropped, and the emulated device should stop.
+#[derive(Debug)]
+struct Disconnected;
+
+// The device side of the communication channel, playing the role of the Comm of the Vanadium app.
+struct DeviceIo {
+    config: MockDeviceConfig,
+    metrics: Arc<MetricsCounters>,
+    from_host: mpsc::Receiver<APDUCommand>,
+    to_host: tokio_mpsc::UnboundedSender<(StatusWord, Vec<u8>)>,
+    // the error that stopped the last V-App with a VM runtime error, if any
+    runtime_error: Arc<StdMutex<Option<String>>>,
+    // length of the last received command, used for the bandwidth model
+    last_command_len: usize,
+    // set when the client sends Abort instead of the response to a client command
+    aborted: bool,
+    // the key of the HMAC of the checkpoints, that never leaves the emulated device
+    checkpoint_key: [u8; 32],
+}
+
+impl DeviceIo {
+    fn receive(&mut self) -> Result<APDUCommand, Disconnected> {
+        let command = self.from_host.recv().map_err(|_| Disconnected)?;
+        self.last_command_len = 5 + command.data.len();
+        MetricsCounters::add(&self.metrics.apdus, 1);
+        MetricsCounters::add(&self.metrics.bytes_received, self.last_command_len as u64);
+        Ok(command)
+    }
+
+    // Sends the response to the last command, and waits for the next command.
+    fn exchange(&mut self, status: StatusWord, data: Vec<u8>) -> Result<APDUCommand, Disconnected> {
+        let response_len = data.len() + 2;
+        MetricsCounters::add(&self.metrics.bytes_sent, response_len as u64);
+
+        let mut delay = self.config.apdu_latency;
+        if let Some(bandwidth) = self.config.bandwidth {
+            let total_len = (self.last_command_len + response_len) as f64;
+            delay += Duration::from_secs_f64(total_len / bandwidth.max(1) as f64);
+        }
+        if !delay.is_zero() {
+            thread::sleep(delay);
+        }
+
+        self.to_host
+            .send((status, data))
+            .map_err(|_| Disconnected)?;
+        self.receive()
+    }
+
+    // Sends a client command with the InterruptedExecution status word. The client's response must
+    // be a Continue command with P2 = 0; returns its data and P1. If the client sends Abort instead,
+    // the V-App stops with an error.
+    fn interrupt(&mut self, message: Vec<u8>) -> Result<(Vec<u8>, u8), &'static str> {
+        let response = self
+            .exchange(StatusWord::InterruptedExecution, message)
+            .map_err(|_| "Disconnected")?;
+        if (response.ins, response.p1, response.p2) == (0xfe, 0, 0) {
+            self.aborted = true;
+            return Err("Aborted by the client");
+        }
+        if response.ins != 0xff {
+            return Err("INS not supported"); // expected "Continue"
+        }
+        if response.p2 != 0 {
+            return Err("Wrong P2");
+        }
+        Ok((response.data, response.p1))
+    }
+}
+
+// The kind of messages used to send a buffer of the V-App memory to the client
+#[derive(Debug, Clone, Copy)]
+enum OutgoingBuffer {
+    // SendBufferMessage, for xsend
+    Send,
+    // SendPanicBufferMessage, for the message of a panic
+    Panic,
+    // ClientCallMessage with the request id, for the payload of a client_call
+    ClientCall(u32),
+}
+
+#[derive(Clone, Debug)]
+struct CachedPage {
+    idx: u32,
+    page: Page,
+    usage_counter: u32,
+}
+
+// Equivalent of the OutsourcedMemory of the Vanadium app: a LRU cache of pages, where the missing
+// pages are requested to the client, and the evicted pages are committed if the segment is writable.
+struct MockMemory {
+    io: Rc<RefCell<DeviceIo>>,
+    pages: Vec<CachedPage>,
+    max_pages: usize,
+    is_readonly: bool,
+    section_kind: SectionKind,
+    usage_counter: u32,
+}
+
+impl std::fmt::Debug for MockMemory {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("MockMemory")
+            .field("pages", &self.pages.len())
+            .field("is_readonly", &self.is_readonly)
+            .field("section_kind", &self.section_kind)
+            .finish()
+    }
+}
+
+impl MockMemory {
+    fn new(
+        io: Rc<RefCell<DeviceIo>>,
+        max_pages: usize,
+        is_readonly: bool,
+        section_kind: SectionKind,
+    ) -> Self {
+        Self {
+            io,
+            pages: Vec::with_capacity(max_pages),
+            max_pages,
+            is_readonly,
+            section_kind,
+            usage_counter: 0,
+        }
+    }
+
+    fn commit_page(&mut self, page_index: u32, content: Vec<u8>) -> Result<(), MemoryError> {
+        let mut io = self.io.borrow_mut();
+        MetricsCounters::add(&io.metrics.page_commits, 1);
+
+        let (_, p1) = io
+            .interrupt(CommitPageMessage::new(self.section_kind, page_index).serialize())
+            .map_err(MemoryError::GenericError)?;
+        if p1 != 0 {
+            return Err(MemoryError::GenericError("Wrong P1/P2"));
+        }
+
+        let (_, p1) = io
+            .interrupt(CommitPageContentMessage::new(content).serialize())
+            .map_err(MemoryError::GenericError)?;
+        if p1 != 0 {
+            return Err(MemoryError::GenericError("Wrong P1/P2"));
+        }
+        Ok(())
+    }
+
+    fn load_page(&mut self, page_index: u32) -> Result<Page, MemoryError> {
+        let mut io = self.io.borrow_mut();
+        MetricsCounters::add(&io.metrics.page_loads, 1);
+
+        let (fetched_data, p1) = io
+            .interrupt(GetPageMessage::new(self.section_kind, page_index).serialize())
+            .map_err(MemoryError::GenericError)?;
+        if fetched_data.len() != PAGE_SIZE - 1 {
+            return Err(MemoryError::GenericError("Wrong APDU length"));
+        }
+
+        let mut data = [0u8; PAGE_SIZE];
+        data[0..PAGE_SIZE - 1].copy_from_slice(&fetched_data);
+        data[PAGE_SIZE - 1] = p1;
+        Ok(Page { data })
+    }
+}
+
+impl PagedMemory for MockMemory {
+    type PageRef<'a>
+        = &'a mut Page
+    where
+        Self: 'a;
+
+    fn get_page(&mut self, page_index: u32) -> Result<Self::PageRef<'_>, MemoryError> {
+        self.usage_counter = self.usage_counter.wrapping_add(1);
+
+        if let Some(i) = self.pages.iter().position(|p| p.idx == page_index) {
+            self.pages[i].usage_counter = self.usage_counter;
+            return Ok(&mut self.pages[i].page);
+        }
+
+        let slot = if self.pages.len() < self.max_pages {
+            self.pages.len()
+        } else {
+            // evict the least recently used page, committing it if the segment is writable
+            let (evict_index, evicted) = self
+                .pages
+                .iter()
+                .enumerate()
+                .min_by_key(|(_, p)| p.usage_counter)
+                .expect("the cache can not be empty here");
+            if !self.is_readonly {
+                let (evicted_index, content) = (evicted.idx, evicted.page.data.to_vec());
+                self.commit_page(evicted_index, content)?;
+            }
+            evict_index
+        };
+
+        let cached_page = CachedPage {
+            idx: page_index,
+            page: self.load_page(page_index)?,
+            usage_counter: self.usage_counter,
+        };
+        if slot == self.pages.len() {
+            self.pages.push(cached_page);
+        } else {
+            self.pages[slot] = cached_page;
+        }
+        Ok(&mut self.pages[slot].page)
+    }
+
+    fn flush(&mut self) -> Result<(), MemoryError> {
+        if self.is_readonly {
+            return Ok(());
+        }
+        for i in 0..self.pages.len() {
+            let (page_index, content) = (self.pages[i].idx, self.pages[i].page.data.to_vec());
+            self.commit_page(page_index, content)?;
+        }
+        Ok(())
+    }
+}
+
+#[derive(Debug)]
+enum MockEcallError {
+    Exit(i32),
+    Panic,
+    UnsupportedEcall(u32),
+    BnBatchError(BnBatchError),
+    MerkleError(MerkleError),
+    GenericError(&'static str),
+}
+
+impl std::fmt::Display for MockEcallError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            MockEcallError::Exit(status) => write!(f, "Exit with status {}", status),
+            MockEcallError::Panic => write!(f, "V-App panicked"),
+            MockEcallError::UnsupportedEcall(code) => write!(f, "Unsupported ECALL: {}", code),
+            MockEcallError::BnBatchError(e) => write!(f, "Big numbers batch error: {}", e),
+            MockEcallError::MerkleError(e) => write!(f, "Merkle tree error: {}", e),
+            MockEcallError::GenericError(e) => write!(f, "{}", e),
+        }
+    }
+}
+
+impl From<CpuError<MockEcallError>> for MockEcallError {
+    fn from(error: CpuError<MockEcallError>) -> Self {
+        match error {
+            CpuError::EcallError(e) => e,
+            CpuError::MemoryError(_) => MockEcallError::GenericError("Memory error"),
+            CpuError::GenericError(e) => MockEcallError::GenericError(e),
+        }
+    }
+}
+
+impl From<BnBatchError> for MockEcallError {
+    fn from(error: BnBatchError) -> Self {
+        MockEcallError::BnBatchError(error)
+    }
+}
+
+impl From<MerkleError> for MockEcallError {
+    fn from(error: MerkleError) -> Self {
+        MockEcallError::MerkleError(error)
+    }
+}
+
+impl From<MemoryError> for MockEcallError {
+    fn from(_: MemoryError) -> Self {
+        MockEcallError::GenericError("Memory error")
+    }
+}
+
+// Copies len bytes from the V-App memory. Each ECALL checks its lengths against the same limits as
+// the Vanadium app before reading its buffers; this is a last guard against lengths chosen by the
+// V-App.
+fn read_guest(
+    cpu: &mut Cpu<MockMemory>,
+    ptr: GuestPointer,
+    len: usize,
+) -> Result<Vec<u8>, MockEcallError> {
+    if len > MAX_GUEST_BUFFER_SIZE {
+        return Err(MockEcallError::GenericError("Buffer too large"));
+    }
+    let mut buffer = vec![0u8; len];
+    // the pointer of an empty buffer must not be accessed
+    if len > 0 {
+        cpu.get_segment::<MockEcallError>(ptr.0)?
+            .read_buffer(ptr.0, &mut buffer)?;
+    }
+    Ok(buffer)
+}
+
+fn read_guest_array<const N: usize>(
+    cpu: &mut Cpu<MockMemory>,
+    ptr: GuestPointer,
+) -> Result<[u8; N], MockEcallError> {
+    let mut buffer = [0u8; N];
+    cpu.get_segment::<MockEcallError>(ptr.0)?
+        .read_buffer(ptr.0, &mut buffer)?;
+    Ok(buffer)
+}
+
+fn write_guest(
+    cpu: &mut Cpu<MockMemory>,
+    ptr: GuestPointer,
+    data: &[u8],
+) -> Result<(), MockEcallError> {
+    if !data.is_empty() {
+        cpu.get_segment::<MockEcallError>(ptr.0)?
+            .write_buffer(ptr.0, data)?;
+    }
+    Ok(())
+}
+
+// Hashes len bytes of the V-App memory, directly from the pages of the segment.
+fn hash_guest(
+    cpu: &mut Cpu<MockMemory>,
+    state: &mut HashState,
+    ptr: GuestPointer,
+    len: usize,
+) -> Result<(), MockEcallError> {
+    // the pointer of an empty buffer must not be accessed
+    if len > 0 {
+        cpu.get_segment::<MockEcallError>(ptr.0)?
+            .for_each_span(ptr.0, len, |span| state.update(span))?;
+    }
+    Ok(())
+}
+
+// Fails if a buffer of len bytes starting at ptr would wrap around the address space
+fn check_guest_range(ptr: GuestPointer, len: usize) -> Result<(), MockEcallError> {
+    u32::try_from(len)
+        .ok()
+        .and_then(|len| ptr.0.checked_add(len))
+        .ok_or(MockEcallError::GenericError("Buffer too large"))?;
+    Ok(())
+}
+
+// Reads the steps of a BIP-32 path in the V-App memory.
+fn read_bip32_path(
+    cpu: &mut Cpu<MockMemory>,
+    path: GuestPointer,
+    path_len: usize,
+) -> Result<Vec<u32>, MockEcallError> {
+    if path_len > MAX_BIP32_PATH {
+        return Err(MockEcallError::GenericError("path_len is too large"));
+    }
+    Ok(read_guest(cpu, path, 4 * path_len)?
+        .chunks_exact(4)
+        .map(|step| u32::from_le_bytes(step.try_into().unwrap()))
+        .collect())
+}
+
+fn check_curve(curve: u32) -> Result<(), MockEcallError> {
+    if curve != CurveKind::Secp256k1 as u32 {
+        return Err(MockEcallError::GenericError("Unsupported curve"));
+    }
+    Ok(())
+}
+
+// Reads the leaves and the depths of the merkle_root ECALL in the V-App memory.
+struct MockMerkle<'c> {
+    cpu: &'c mut Cpu<MockMemory>,
+    leaves: GuestPointer,
+    depths: GuestPointer,
+}
+
+impl MerkleBackend for MockMerkle<'_> {
+    type Error = MockEcallError;
+
+    fn read_leaf(&mut self, index: usize, leaf: &mut [u8; 32]) -> Result<(), MockEcallError> {
+        let ptr = (self.leaves.0 as u64 + 32 * index as u64)
+            .try_into()
+            .map_err(|_| MockEcallError::GenericError("Buffer overflow"))?;
+        *leaf = read_guest_array::<32>(self.cpu, GuestPointer(ptr))?;
+        Ok(())
+    }
+
+    fn read_depth(&mut self, index: usize) -> Result<u8, MockEcallError> {
+        let ptr = (self.depths.0 as u64 + index as u64)
+            .try_into()
+            .map_err(|_| MockEcallError::GenericError("Buffer overflow"))?;
+        Ok(read_guest_array::<1>(self.cpu, GuestPointer(ptr))?[0])
+    }
+
+    fn sha256(&mut self, segments: &[&[u8]]) -> Result<[u8; 32], MockEcallError> {
+        let mut hasher = Sha256::new();
+        for segment in segments {
+            hasher.update(segment);
+        }
+        Ok(hasher.finalize().into())
+    }
+}
+
+// Runs the programs of the bn_batch ECALL with the host implementations of the big numbers ECALLs.
+struct MockBnBatch<'c> {
+    cpu: &'c mut Cpu<MockMemory>,
+    inputs: GuestPointer,
+    outputs: GuestPointer,
+    len: usize,
+}
+
+impl MockBnBatch<'_> {
+    // the pointers are checked before running the program
+    fn ptr(base: GuestPointer, index: usize, len: usize) -> GuestPointer {
+        GuestPointer(base.0 + (index * len) as u32)
+    }
+}
+
+fn copy_bn_result(r: &mut [u8], result: Option<Vec<u8>>) -> Result<(), MockEcallError> {
+    r.copy_from_slice(&result.ok_or(BnBatchError::OperationFailed)?);
+    Ok(())
+}
+
+impl BnBatchBackend for MockBnBatch<'_> {
+    type Error = MockEcallError;
+
+    fn read_input(&mut self, index: usize, dst: &mut [u8]) -> Result<(), MockEcallError> {
+        let data = read_guest(self.cpu, Self::ptr(self.inputs, index, self.len), self.len)?;
+        dst.copy_from_slice(&data);
+        Ok(())
+    }
+
+    fn write_output(&mut self, index: usize, src: &[u8]) -> Result<(), MockEcallError> {
+        write_guest(self.cpu, Self::ptr(self.outputs, index, self.len), src)
+    }
+
+    fn modm(&mut self, r: &mut [u8], m: &[u8]) -> Result<(), MockEcallError> {
+        let result = mock_crypto::bn_modm(r, m);
+        copy_bn_result(r, result)
+    }
+
+    fn addm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), MockEcallError> {
+        copy_bn_result(r, mock_crypto::bn_addm(a, b, m))
+    }
+
+    fn subm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), MockEcallError> {
+        copy_bn_result(r, mock_crypto::bn_subm(a, b, m))
+    }
+
+    fn multm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), MockEcallError> {
+        copy_bn_result(r, mock_crypto::bn_multm(a, b, m))
+    }
+
+    fn powm(&mut self, r: &mut [u8], a: &[u8], e: &[u8], m: &[u8]) -> Result<(), MockEcallError> {
+        copy_bn_result(r, mock_crypto::bn_powm(a, e, m))
+    }
+}
+
+// A modular operation of the mock_crypto module, computing op(a, b, m)
+type BnOperation = fn(&[u8], &[u8], &[u8]) -> Option<Vec<u8>>;
+
+struct MockEcallHandler {
+    io: Rc<RefCell<DeviceIo>>,
+    manifest: Manifest,
+    // The states of the hash contexts of the V-App, by id. The context in the V-App memory only
+    // stores the hash id and the id of its state, that is freed when the context is finalized;
+    // therefore, a copy of a context in the V-App memory refers to the same state.
+    hash_states: HashMap<u32, HashState>,
+    next_hash_state_id: u32,
+    // The moduli of the Montgomery contexts registered by the V-App; as the operations are
+    // computed with num-bigint, there is nothing to precompute.
+    bn_contexts: Vec<Vec<u8>>,
+}
+
+impl MockEcallHandler {
+    fn new(io: Rc<RefCell<DeviceIo>>, manifest: Manifest) -> Self {
+        Self {
+            io,
+            manifest,
+            hash_states: HashMap::new(),
+            next_hash_state_id: 0,
+            bn_contexts: Vec::new(),
+        }
+    }
+
+    // Sends exactly size bytes from the buffer in the V-App memory to the client, as a sequence of
+    // messages of the given kind
+    fn send_buffer(
+        &self,
+        cpu: &mut Cpu<MockMemory>,
+        buffer: GuestPointer,
+        mut size: usize,
+        kind: OutgoingBuffer,
+    ) -> Result<(), MockEcallError> {
+        check_guest_range(buffer, size)?;
+
+        let max_chunk_size = match kind {
+            OutgoingBuffer::ClientCall(_) => MAX_CLIENT_CALL_CHUNK_SIZE,
+            _ => MAX_SEND_CHUNK_SIZE,
+        };
+
+        let mut g_ptr = buffer.0;
+        let mut chunk = [0u8; MAX_SEND_CHUNK_SIZE];
+        loop {
+            let copy_size = size.min(max_chunk_size);
+            // the pointer of an empty buffer must not be accessed
+            if copy_size > 0 {
+                cpu.get_segment::<MockEcallError>(g_ptr)?
+                    .read_buffer(g_ptr, &mut chunk[..copy_size])?;
+            }
+
+            let mut message = Vec::with_capacity(9 + copy_size);
+            let append = |data: &[u8]| message.extend_from_slice(data);
+            match kind {
+                OutgoingBuffer::Send => {
+                    SendBufferMessage::serialize_borrowed_with(
+                        size as u32,
+                        &chunk[..copy_size],
+                        append,
+                    );
+                }
+                OutgoingBuffer::Panic => {
+                    SendPanicBufferMessage::serialize_borrowed_with(
+                        size as u32,
+                        &chunk[..copy_size],
+                        append,
+                    );
+                }
+                OutgoingBuffer::ClientCall(request_id) => {
+                    ClientCallMessage::serialize_borrowed_with(
+                        request_id,
+                        size as u32,
+                        &chunk[..copy_size],
+                        append,
+                    );
+                }
+            }
+
+            let (_, p1) = self
+                .io
+                .borrow_mut()
+                .interrupt(message)
+                .map_err(MockEcallError::GenericError)?;
+            if p1 != 0 {
+                return Err(MockEcallError::GenericError("Wrong P1/P2"));
+            }
+
+            size -= copy_size;
+            g_ptr += copy_size as u32;
+
+            if size == 0 {
+                return Ok(());
+            }
+        }
+    }
+
+    // Receives up to max_size bytes from the client into the buffer in the V-App memory
+    fn receive_buffer(
+        &self,
+        cpu: &mut Cpu<MockMemory>,
+        buffer: GuestPointer,
+        max_size: usize,
+    ) -> Result<usize, MockEcallError> {
+        let mut g_ptr = buffer.0;
+        let mut remaining_length = None;
+        let mut total_received: usize = 0;
+        while remaining_length != Some(0) {
+            let (data, p1) = self
+                .io
+                .borrow_mut()
+                .interrupt(ReceiveBufferMessage::new().serialize())
+                .map_err(MockEcallError::GenericError)?;
+            if p1 != 0 {
+                return Err(MockEcallError::GenericError("Wrong P1/P2"));
+            }
+
+            let (response_remaining_length, content) =
+                ReceiveBufferResponse::deserialize_borrowed(&data)
+                    .map_err(|_| MockEcallError::GenericError("Invalid response"))?;
+
+            let remaining = match remaining_length {
+                // first chunk, check if the total length is acceptable
+                None if response_remaining_length > max_size as u32 => {
+                    return Err(MockEcallError::GenericError("Received data is too large"));
+                }
+                None => response_remaining_length,
+                Some(remaining) if remaining != response_remaining_length => {
+                    return Err(MockEcallError::GenericError("Mismatching remaining length"));
+                }
+                Some(remaining) => remaining,
+            };
+
+            if !content.is_empty() {
+                cpu.get_segment::<MockEcallError>(g_ptr)?
+                    .write_buffer(g_ptr, content)?;
+            }
+
+            remaining_length = Some(remaining - content.len() as u32);
+            g_ptr += content.len() as u32;
+            total_received += content.len();
+        }
+        Ok(total_received)
+    }
+
+    // Returns the id of the state of the hash context at ctx in the V-App memory.
+    fn hash_state_id(
+        &self,
+        cpu: &mut Cpu<MockMemory>,
+        hash_id: u32,
+        ctx: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        let ctx_local = read_guest_array::<8>(cpu, ctx)?;
+        let id = u32::from_le_bytes(ctx_local[4..8].try_into().unwrap());
+        if u32::from_le_bytes(ctx_local[0..4].try_into().unwrap()) != hash_id
+            || !self.hash_states.contains_key(&id)
+        {
+            return Err(MockEcallError::GenericError("Invalid hash context"));
+        }
+        Ok(id)
+    }
+
+    // Computes r = op(a, b, m) for the modular operations on operands of len bytes.
+    fn bn_binary_op(
+        &self,
+        cpu: &mut Cpu<MockMemory>,
+        op: BnOperation,
+        [r, a, b, m]: [GuestPointer; 4],
+        len: usize,
+    ) -> Result<u32, MockEcallError> {
+        if len > MAX_BIGNUMBER_SIZE {
+            return Err(MockEcallError::GenericError("len is too large"));
+        }
+        let a = read_guest(cpu, a, len)?;
+        let b = read_guest(cpu, b, len)?;
+        let m = read_guest(cpu, m, len)?;
+        let r_local =
+            op(&a, &b, &m).ok_or(MockEcallError::GenericError("Modular operation failed"))?;
+        write_guest(cpu, r, &r_local)?;
+        Ok(1)
+    }
+
+    // Returns the modulus of the context referred to by the handle, if it is the one pointed to by
+    // m in the V-App's memory.
+    fn get_bn_context(
+        &self,
+        cpu: &mut Cpu<MockMemory>,
+        handle: u32,
+        m: GuestPointer,
+    ) -> Result<Option<&[u8]>, MockEcallError> {
+        let Some(modulus) = bn_context::index(handle).and_then(|i| self.bn_contexts.get(i)) else {
+            return Ok(None);
+        };
+        let m = read_guest(cpu, m, modulus.len())?;
+        Ok((m == *modulus).then_some(modulus.as_slice()))
+    }
+}
+
+impl EcallHandler for MockEcallHandler {
+    type Memory = MockMemory;
+    type Error = MockEcallError;
+
+    fn handle_ecall(&mut self, cpu: &mut Cpu<MockMemory>) -> Result<(), MockEcallError> {
+        MetricsCounters::add(&self.io.borrow().metrics.ecalls, 1);
+        dispatch_ecall(self, cpu)
+    }
+}
+
+// The ECALLs for big numbers, hashes and elliptic curves are computed by the host, but the operands
+// and results are read and written in the V-App memory as the Vanadium app does, so that the memory
+// accesses are the same.
+impl EcallDispatch for MockEcallHandler {
+    fn unhandled_ecall(&mut self, code: u32) -> MockEcallError {
+        MockEcallError::UnsupportedEcall(code)
+    }
+
+    fn fatal(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        msg: GuestPointer,
+        size: usize,
+    ) -> MockEcallError {
+        match self.send_buffer(cpu, msg, size, OutgoingBuffer::Panic) {
+            Ok(()) => MockEcallError::Panic,
+            Err(e) => e,
+        }
+    }
+
+    fn xsend(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        buffer: GuestPointer,
+        size: usize,
+    ) -> Result<(), MockEcallError> {
+        self.send_buffer(cpu, buffer, size, OutgoingBuffer::Send)
+    }
+
+    fn xrecv(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        buffer: GuestPointer,
+        size: usize,
+    ) -> Result<usize, MockEcallError> {
+        self.receive_buffer(cpu, buffer, size)
+    }
+
+    fn exit(&mut self, _cpu: &mut Cpu<MockMemory>, status: i32) -> MockEcallError {
+        MockEcallError::Exit(status)
+    }
+
+    fn checkpoint(&mut self, cpu: &mut Cpu<MockMemory>) -> Result<u32, MockEcallError> {
+        cpu.data_seg.flush()?;
+        cpu.stack_seg.flush()?;
+
+        // the V-App resumes right after the ECALL, with a0 = 1
+        let pc = cpu.pc.wrapping_add(4);
+        let mut regs = cpu.regs;
+        regs[REG_A0] = 1;
+        let key = self.io.borrow().checkpoint_key;
+        let hmac = checkpoint_mac(&key, &self.manifest, &MOCK_APP_HMAC, pc, &regs)
+            .finalize()
+            .into_bytes()
+            .into();
+        let message = CheckpointMessage::new(VAppCheckpoint { pc, regs, hmac }).serialize();
+
+        let (_, p1) = self
+            .io
+            .borrow_mut()
+            .interrupt(message)
+            .map_err(MockEcallError::GenericError)?;
+        if p1 != 0 {
+            return Err(MockEcallError::GenericError("Wrong P1/P2"));
+        }
+        Ok(0)
+    }
+
+    fn client_call(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        request_id: u32,
+        payload: GuestPointer,
+        payload_len: usize,
+        reply: GuestPointer,
+        reply_max_len: usize,
+    ) -> Result<usize, MockEcallError> {
+        self.send_buffer(
+            cpu,
+            payload,
+            payload_len,
+            OutgoingBuffer::ClientCall(request_id),
+        )?;
+        self.receive_buffer(cpu, reply, reply_max_len)
+    }
+
+    fn ux_idle(&mut self, _cpu: &mut Cpu<MockMemory>) -> Result<(), MockEcallError> {
+        Ok(())
+    }
+
+    fn memcpy(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        dst: GuestPointer,
+        src: GuestPointer,
+        n: usize,
+    ) -> Result<(), MockEcallError> {
+        check_guest_range(dst, n)?;
+        check_guest_range(src, n)?;
+
+        // as in the Vanadium app, one page of the source at a time
+        let mut copied = 0;
+        while copied < n {
+            let (src_address, dst_address) = (src.0 + copied as u32, dst.0 + copied as u32);
+            let chunk_len = (PAGE_SIZE - src_address as usize % PAGE_SIZE).min(n - copied);
+            let chunk = read_guest(cpu, GuestPointer(src_address), chunk_len)?;
+            write_guest(cpu, GuestPointer(dst_address), &chunk)?;
+            copied += chunk_len;
+        }
+        Ok(())
+    }
+
+    fn memset(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        dst: GuestPointer,
+        c: u8,
+        n: usize,
+    ) -> Result<(), MockEcallError> {
+        // the pointer of an empty buffer must not be accessed
+        if n > 0 {
+            cpu.get_segment::<MockEcallError>(dst.0)?
+                .for_each_span_mut(dst.0, n, |span| span.fill(c))?;
+        }
+        Ok(())
+    }
+
+    fn memcmp(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        a: GuestPointer,
+        b: GuestPointer,
+        n: usize,
+    ) -> Result<i32, MockEcallError> {
+        check_guest_range(a, n)?;
+        check_guest_range(b, n)?;
+
+        // as in the Vanadium app, the running time only depends on n, not on the content of the
+        // buffers
+        let mut result: i32 = 0;
+        let mut compared = 0;
+        while compared < n {
+            let (a_address, b_address) = (a.0 + compared as u32, b.0 + compared as u32);
+            let chunk_len = (PAGE_SIZE - a_address as usize % PAGE_SIZE).min(n - compared);
+            let a_local = read_guest(cpu, GuestPointer(a_address), chunk_len)?;
+            let b_local = read_guest(cpu, GuestPointer(b_address), chunk_len)?;
+            for (&x, &y) in a_local.iter().zip(&b_local) {
+                // all ones as long as no difference was found, without branching on the data
+                let unset = !((result | result.wrapping_neg()) >> 31);
+                result |= (x as i32 - y as i32) & unset;
+            }
+            compared += chunk_len;
+        }
+        Ok(result)
+    }
+
+    fn bn_modm(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        r: GuestPointer,
+        n: GuestPointer,
+        len: usize,
+        m: GuestPointer,
+        len_m: usize,
+    ) -> Result<u32, MockEcallError> {
+        if len > MAX_BIGNUMBER_SIZE || len_m > MAX_BIGNUMBER_SIZE {
+            return Err(MockEcallError::GenericError("len or m_len is too large"));
+        }
+        let n = read_guest(cpu, n, len)?;
+        let m = read_guest(cpu, m, len_m)?;
+        let r_local =
+            mock_crypto::bn_modm(&n, &m).ok_or(MockEcallError::GenericError("bn_modm failed"))?;
+        write_guest(cpu, r, &r_local)?;
+        Ok(1)
+    }
+
+    fn bn_addm(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, MockEcallError> {
+        self.bn_binary_op(cpu, mock_crypto::bn_addm, [r, a, b, m], len)
+    }
+
+    fn bn_subm(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, MockEcallError> {
+        self.bn_binary_op(cpu, mock_crypto::bn_subm, [r, a, b, m], len)
+    }
+
+    fn bn_multm(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, MockEcallError> {
+        self.bn_binary_op(cpu, mock_crypto::bn_multm, [r, a, b, m], len)
+    }
+
+    fn bn_powm(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        r: GuestPointer,
+        a: GuestPointer,
+        e: GuestPointer,
+        len_e: usize,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, MockEcallError> {
+        if len_e > MAX_BIGNUMBER_SIZE {
+            return Err(MockEcallError::GenericError("len_e is too large"));
+        }
+        if len > MAX_BIGNUMBER_SIZE {
+            return Err(MockEcallError::GenericError("len is too large"));
+        }
+        let a = read_guest(cpu, a, len)?;
+        let e = read_guest(cpu, e, len_e)?;
+        let m = read_guest(cpu, m, len)?;
+        let r_local = mock_crypto::bn_powm(&a, &e, &m)
+            .ok_or(MockEcallError::GenericError("bn_powm failed"))?;
+        write_guest(cpu, r, &r_local)?;
+        Ok(1)
+    }
+
+    fn bn_batch(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        m: GuestPointer,
+        len: usize,
+        program: GuestPointer,
+        program_len: usize,
+        inputs: GuestPointer,
+        n_inputs: usize,
+        outputs: GuestPointer,
+        n_outputs: usize,
+    ) -> Result<u32, MockEcallError> {
+        if len > MAX_BIGNUMBER_SIZE {
+            return Err(MockEcallError::GenericError("len is too large"));
+        }
+        for (ptr, n) in [(inputs, n_inputs), (outputs, n_outputs)] {
+            let size = (n as u64) * (len as u64);
+            if ptr.0 as u64 + size > u32::MAX as u64 {
+                return Err(MockEcallError::GenericError("Buffer overflow"));
+            }
+        }
+        if program_len > bn_batch::MAX_INSTRUCTIONS * bn_batch::INSTRUCTION_SIZE {
+            return Err(MockEcallError::GenericError("program_len is too large"));
+        }
+        let m = read_guest(cpu, m, len)?;
+        let program = read_guest(cpu, program, program_len)?;
+        let mut backend = MockBnBatch {
+            cpu,
+            inputs,
+            outputs,
+            len,
+        };
+        bn_batch::execute(&mut backend, &m, &program, n_inputs, n_outputs)?;
+        Ok(1)
+    }
+
+    fn bn_mont_init(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, MockEcallError> {
+        if len == 0 || len > MAX_BIGNUMBER_SIZE {
+            return Ok(0);
+        }
+        let m = read_guest(cpu, m, len)?;
+        Ok(match self.bn_contexts.iter().position(|c| *c == m) {
+            Some(index) => bn_context::handle(index),
+            // Montgomery contexts only exist for odd moduli
+            None if m[len - 1] & 1 == 0 || self.bn_contexts.len() >= MAX_BN_CONTEXTS => 0,
+            None => {
+                self.bn_contexts.push(m);
+                bn_context::handle(self.bn_contexts.len() - 1)
+            }
+        })
+    }
+
+    fn bn_mont_multm(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        handle: u32,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        let Some(m) = self.get_bn_context(cpu, handle, m)? else {
+            return Ok(0);
+        };
+        let a = read_guest(cpu, a, m.len())?;
+        let b = read_guest(cpu, b, m.len())?;
+        let r_local = mock_crypto::bn_multm(&a, &b, m)
+            .ok_or(MockEcallError::GenericError("Modular operation failed"))?;
+        write_guest(cpu, r, &r_local)?;
+        Ok(1)
+    }
+
+    fn bn_mont_powm(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        handle: u32,
+        r: GuestPointer,
+        a: GuestPointer,
+        e: GuestPointer,
+        len_e: usize,
+        m: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        if len_e > MAX_BIGNUMBER_SIZE {
+            return Err(MockEcallError::GenericError("len_e is too large"));
+        }
+        let Some(m) = self.get_bn_context(cpu, handle, m)? else {
+            return Ok(0);
+        };
+        let a = read_guest(cpu, a, m.len())?;
+        let e = read_guest(cpu, e, len_e)?;
+        let r_local = mock_crypto::bn_powm(&a, &e, m)
+            .ok_or(MockEcallError::GenericError("Modular operation failed"))?;
+        write_guest(cpu, r, &r_local)?;
+        Ok(1)
+    }
+
+    fn derive_hd_node(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        path: GuestPointer,
+        path_len: usize,
+        privkey: GuestPointer,
+        chain_code: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        check_curve(curve)?;
+        let path = read_bip32_path(cpu, path, path_len)?;
+        let (private_key, chain_code_local) = mock_crypto::derive_hd_node(&path)
+            .ok_or(MockEcallError::GenericError("HD derivation failed"))?;
+        write_guest(cpu, privkey, &private_key)?;
+        write_guest(cpu, chain_code, &chain_code_local)?;
+        Ok(1)
+    }
+
+    fn get_master_fingerprint(
+        &mut self,
+        _cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+    ) -> Result<u32, MockEcallError> {
+        check_curve(curve)?;
+        Ok(mock_crypto::master_fingerprint())
+    }
+
+    fn derive_hd_pubkeys(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        path: GuestPointer,
+        path_len: usize,
+        first_child: u32,
+        n_children: usize,
+        parent_fingerprint: GuestPointer,
+        children: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        check_curve(curve)?;
+        let path = read_bip32_path(cpu, path, path_len)?;
+        match mock_crypto::derive_hd_pubkeys(&path, first_child, n_children) {
+            Some((fingerprint, children_local)) => {
+                write_guest(cpu, parent_fingerprint, &fingerprint.to_be_bytes())?;
+                write_guest(cpu, children, &children_local)?;
+                Ok(1)
+            }
+            None => Ok(0),
+        }
+    }
+
+    fn hash_init(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        hash_id: u32,
+        ctx: GuestPointer,
+    ) -> Result<(), MockEcallError> {
+        let state =
+            HashState::new(hash_id).ok_or(MockEcallError::GenericError("Unsupported hash id"))?;
+        if self.hash_states.len() >= MAX_HASH_STATES {
+            return Err(MockEcallError::GenericError("Too many hash contexts"));
+        }
+        let id = self.next_hash_state_id;
+        self.next_hash_state_id = id.wrapping_add(1);
+
+        let mut ctx_local = [0u8; 8];
+        ctx_local[0..4].copy_from_slice(&hash_id.to_le_bytes());
+        ctx_local[4..8].copy_from_slice(&id.to_le_bytes());
+        write_guest(cpu, ctx, &ctx_local)?;
+        self.hash_states.insert(id, state);
+        Ok(())
+    }
+
+    fn hash_update(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        hash_id: u32,
+        ctx: GuestPointer,
+        data: GuestPointer,
+        len: usize,
+    ) -> Result<u32, MockEcallError> {
+        let id = self.hash_state_id(cpu, hash_id, ctx)?;
+        let state = self.hash_states.get_mut(&id).unwrap();
+        hash_guest(cpu, state, data, len)?;
+        Ok(1)
+    }
+
+    fn hash_final(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        hash_id: u32,
+        ctx: GuestPointer,
+        digest: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        let id = self.hash_state_id(cpu, hash_id, ctx)?;
+        // the context can not be used after it is finalized
+        let state = self.hash_states.remove(&id).unwrap();
+        write_guest(cpu, digest, &state.digest())?;
+        Ok(1)
+    }
+
+    fn hash_oneshot(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        hash_id: u32,
+        data: GuestPointer,
+        len: usize,
+        digest: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        let mut state =
+            HashState::new(hash_id).ok_or(MockEcallError::GenericError("Unsupported hash id"))?;
+        hash_guest(cpu, &mut state, data, len)?;
+        write_guest(cpu, digest, &state.digest())?;
+        Ok(1)
+    }
+
+    fn hash_vectored(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        hash_id: u32,
+        segments: GuestPointer,
+        n_segments: usize,
+        digest: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        let mut state =
+            HashState::new(hash_id).ok_or(MockEcallError::GenericError("Unsupported hash id"))?;
+        if n_segments > MAX_HASH_SEGMENTS {
+            return Err(MockEcallError::GenericError("Too many segments"));
+        }
+        let segments = read_guest(cpu, segments, 8 * n_segments)?;
+        for segment in segments.chunks_exact(8) {
+            let ptr = u32::from_le_bytes(segment[0..4].try_into().unwrap());
+            let len = u32::from_le_bytes(segment[4..8].try_into().unwrap());
+            hash_guest(cpu, &mut state, GuestPointer(ptr), len as usize)?;
+        }
+        write_guest(cpu, digest, &state.digest())?;
+        Ok(1)
+    }
+
+    fn merkle_root(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        kind: u32,
+        leaves: GuestPointer,
+        n_leaves: usize,
+        depths: GuestPointer,
+        root: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        let mut backend = MockMerkle {
+            cpu: &mut *cpu,
+            leaves,
+            depths,
+        };
+        let root_local = MerkleTreeKind::try_from(kind)
+            .map_err(MockEcallError::from)
+            .and_then(|kind| merkle::merkle_root(&mut backend, kind, n_leaves));
+        match root_local {
+            Ok(root_local) => {
+                write_guest(cpu, root, &root_local)?;
+                Ok(1)
+            }
+            // invalid trees are reported to the V-App
+            Err(MockEcallError::MerkleError(_)) => Ok(0),
+            Err(e) => Err(e),
+        }
+    }
+
+    fn ecfp_add_point(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        r: GuestPointer,
+        p: GuestPointer,
+        q: GuestPointer,
+    ) -> Result<u32, MockEcallError> {
+        check_curve(curve)?;
+        let p = read_guest_array::<65>(cpu, p)?;
+        let q = read_guest_array::<65>(cpu, q)?;
+        let r_local = mock_crypto::ecfp_add_point(&p, &q)
+            .ok_or(MockEcallError::GenericError("add_point failed"))?;
+        write_guest(cpu, r, &r_local)?;
+        Ok(1)
+    }
+
+    fn ecfp_scalar_mult(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        r: GuestPointer,
+        p: GuestPointer,
+        k: GuestPointer,
+        k_len: usize,
+    ) -> Result<u32, MockEcallError> {
+        check_curve(curve)?;
+        if k_len > 32 {
+            return Err(MockEcallError::GenericError("k_len is too large"));
+        }
+        let p = read_guest_array::<65>(cpu, p)?;
+        let k = read_guest(cpu, k, k_len)?;
+        let r_local = mock_crypto::ecfp_scalar_mult(&p, &k)
+            .ok_or(MockEcallError::GenericError("scalar_mult failed"))?;
+        write_guest(cpu, r, &r_local)?;
+        Ok(1)
+    }
+
+    fn ecfp_msm(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        r: GuestPointer,
+        points: GuestPointer,
+        scalars: GuestPointer,
+        n: usize,
+    ) -> Result<u32, MockEcallError> {
+        check_curve(curve)?;
+        if n == 0 || n > MAX_MSM_POINTS {
+            return Err(MockEcallError::GenericError("n is out of range"));
+        }
+        let points = read_guest(cpu, points, 65 * n)?;
+        let scalars = read_guest(cpu, scalars, 32 * n)?;
+        match mock_crypto::ecfp_msm(&points, &scalars)
+            .ok_or(MockEcallError::GenericError("Invalid point or scalar"))?
+        {
+            Some(r_local) => {
+                write_guest(cpu, r, &r_local)?;
+                Ok(1)
+            }
+            // the point at infinity
+            None => Ok(0),
+        }
+    }
+
+    fn ecdsa_sign(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        mode: u32,
+        hash_id: u32,
+        privkey: GuestPointer,
+        msg_hash: GuestPointer,
+        signature: GuestPointer,
+    ) -> Result<usize, MockEcallError> {
+        check_curve(curve)?;
+        if mode != EcdsaSignMode::RFC6979 as u32 || hash_id != HashId::Sha256 as u32 {
+            return Err(MockEcallError::GenericError("Unsupported ecdsa parameters"));
+        }
+        let privkey = read_guest_array::<32>(cpu, privkey)?;
+        let msg_hash = read_guest_array::<32>(cpu, msg_hash)?;
+        let signature_local = mock_crypto::ecdsa_sign(&privkey, &msg_hash)
+            .ok_or(MockEcallError::GenericError("ecdsa_sign failed"))?;
+        write_guest(cpu, signature, &signature_local)?;
+        Ok(signature_local.len())
+    }
+
+    fn ecdsa_verify(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        pubkey: GuestPointer,
+        msg_hash: GuestPointer,
+        signature: GuestPointer,
+        signature_len: usize,
+    ) -> Result<u32, MockEcallError> {
+        check_curve(curve)?;
+        if signature_len > 72 {
+            return Err(MockEcallError::GenericError("signature_len is too large"));
+        }
+        let pubkey = read_guest_array::<65>(cpu, pubkey)?;
+        let msg_hash = read_guest_array::<32>(cpu, msg_hash)?;
+        let signature = read_guest(cpu, signature, signature_len)?;
+        Ok(mock_crypto::ecdsa_verify(&pubkey, &msg_hash, &signature) as u32)
+    }
+
+    fn schnorr_sign(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        mode: u32,
+        hash_id: u32,
+        privkey: GuestPointer,
+        msg: GuestPointer,
+        msg_len: usize,
+        signature: GuestPointer,
+    ) -> Result<usize, MockEcallError> {
+        check_schnorr_parameters(curve, mode, hash_id, msg_len)?;
+        let msg = read_guest(cpu, msg, msg_len)?;
+        let privkey = read_guest_array::<32>(cpu, privkey)?;
+        let signature_local = mock_crypto::schnorr_sign(&privkey, &msg)
+            .ok_or(MockEcallError::GenericError("schnorr_sign failed"))?;
+        write_guest(cpu, signature, &signature_local)?;
+        Ok(signature_local.len())
+    }
+
+    fn schnorr_verify(
+        &mut self,
+        cpu: &mut Cpu<MockMemory>,
+        curve: u32,
+        mode: u32,
+        hash_id: u32,
+        pubkey: GuestPointer,
+        msg: GuestPointer,
+        msg_len: usize,
+        signature: GuestPointer,
+        signature_len: usize,
+    ) -> Result<u32, MockEcallError> {
+        check_schnorr_parameters(curve, mode, hash_id, msg_len)?;
+        if signature_len != 64 {
+            return Err(MockEcallError::GenericError("Invalid signature length"));
+        }
+        let msg = read_guest(cpu, msg, msg_len)?;
+        let pubkey = read_guest_array::<65>(cpu, pubkey)?;
+        let signature = read_guest_array::<64>(cpu, signature)?;
+        Ok(mock_crypto::schnorr_verify(&pubkey, &msg, &signature) as u32)
+    }
+}
+
+fn check_schnorr_parameters(
+    curve: u32,
+    mode: u32,
+    hash_id: u32,
+    msg_len: usize,
+) -> Result<(), MockEcallError> {
+    check_curve(curve)?;
+    if mode != SchnorrSignMode::BIP340 as u32 || hash_id != HashId::Sha256 as u32 {
+        return Err(MockEcallError::GenericError(
+            "Unsupported schnorr parameters",
+        ));
+    }
+    if msg_len > 128 {
+        return Err(MockEcallError::GenericError("msg_len is too large"));
+    }
+    Ok(())
+}
+
+// Requests the checkpoint to resume the V-App from, and checks that it was produced by this V-App
+// on this emulated device.
+fn get_checkpoint(
+    io: &Rc<RefCell<DeviceIo>>,
+    manifest: &Manifest,
+) -> Result<VAppCheckpoint, StatusWord> {
+    let (data, p1) = io
+        .borrow_mut()
+        .interrupt(GetCheckpointMessage::new().serialize())
+        .map_err(|_| StatusWord::InsNotSupported)?;
+    if p1 != 0 {
+        return Err(StatusWord::WrongP1P2);
+    }
+    let checkpoint = VAppCheckpoint::deserialize(&data).map_err(|_| StatusWord::IncorrectData)?;
+
+    // verify_slice compares the tags in constant time
+    let key = io.borrow().checkpoint_key;
+    checkpoint_mac(
+        &key,
+        manifest,
+        &MOCK_APP_HMAC,
+        checkpoint.pc,
+        &checkpoint.regs,
+    )
+    .verify_slice(&checkpoint.hmac)
+    .map_err(|_| StatusWord::SignatureFail)?;
+    Ok(checkpoint)
+}
+
+// Runs the V-App described by the manifest in the StartVApp command, until it exits; if resume is
+// true, the CPU state is restored from the checkpoint provided by the client.
+// Returns the final status word and response data, or the error that stopped the VM.
+fn run_vapp(
+    io: &Rc<RefCell<DeviceIo>>,
+    data: &[u8],
+    resume: bool,
+) -> Result<(StatusWord, Vec<u8>), MockEcallError> {
+    let Ok((manifest, hmac)) = postcard::take_from_bytes::<Manifest>(data) else {
+        return Ok((StatusWord::IncorrectData, vec![]));
+    };
+    if hmac != MOCK_APP_HMAC {
+        return Ok((StatusWord::SignatureFail, vec![]));
+    }
+
+    let checkpoint = if resume {
+        match get_checkpoint(io, &manifest) {
+            Ok(checkpoint) => Some(checkpoint),
+            Err(status) => return Ok((status, vec![])),
+        }
+    } else {
+        None
+    };
+
+    let n_cached_pages = io.borrow().config.n_cached_pages;
+    let metrics = io.borrow().metrics.clone();
+    let segment = |start: u32, end: u32, is_readonly: bool, section_kind: SectionKind| {
+        MemorySegment::new(
+            start,
+            end - start,
+            MockMemory::new(io.clone(), n_cached_pages, is_readonly, section_kind),
+        )
+    };
+    let segments = (
+        segment(
+            manifest.code_start,
+            manifest.code_end,
+            true,
+            SectionKind::Code,
+        ),
+        segment(
+            manifest.data_start,
+            manifest.data_end,
+            false,
+            SectionKind::Data,
+        ),
+        segment(
+            manifest.stack_start,
+            manifest.stack_end,
+            false,
+            SectionKind::Stack,
+        ),
+    );
+    let (Ok(code_seg), Ok(data_seg), Ok(stack_seg)) = segments else {
+        return Ok((StatusWord::IncorrectData, vec![]));
+    };
+
+    let mut cpu = Cpu::new(manifest.entrypoint, code_seg, data_seg, stack_seg);
+    // x2 is the stack pointer, that grows backwards from the end of the stack
+    cpu.regs[2] = (manifest.stack_end - 4) & !3;
+
+    if let Some(checkpoint) = checkpoint {
+        cpu.pc = checkpoint.pc;
+        cpu.regs = checkpoint.regs;
+        cpu.regs[0] = 0;
+    }
+
+    let mut ecall_handler = MockEcallHandler::new(io.clone(), manifest.clone());
+
+    let mut instr_count: u64 = 0;
+    let result = loop {
+        let instr = match cpu.fetch_instruction::<MockEcallError>() {
+            Ok(instr) => instr,
+            Err(e) => break e,
+        };
+        instr_count += 1;
+        // the count is published before each ECALL, so that it is up to date whenever the V-App
+        // waits for the client
+        if instr == ECALL_INSTRUCTION {
+            MetricsCounters::add(&metrics.instructions, instr_count);
+            instr_count = 0;
+        }
+        if let Err(e) = cpu.execute(instr, Some(&mut ecall_handler)) {
+            break e;
+        }
+    };
+    MetricsCounters::add(&metrics.instructions, instr_count);
+
+    match result {
+        CpuError::EcallError(MockEcallError::Exit(status)) => {
+            Ok((StatusWord::OK, status.to_be_bytes().to_vec()))
+        }
+        CpuError::EcallError(MockEcallError::Panic) => Ok((StatusWord::VAppPanic, vec![])),
+        e => Err(MockEcallError::from(e)),
+    }
+}
+
+// Main loop of the emulated device; returns when the transport is dropped.
+fn device_main(io: DeviceIo) {
+    let io = Rc::new(RefCell::new(io));
+
+    let Ok(mut command) = io.borrow_mut().receive() else {
+        return;
+    };
+    loop {
+        let result = match (command.ins, command.p1, command.p2) {
+            // RegisterVApp
+            (2, 0, 0) => Ok((StatusWord::OK, MOCK_APP_HMAC.to_vec())),
+            // StartVApp
+            (3, 0, 0) => run_vapp(&io, &command.data, false),
+            // ResumeVApp
+            (3, 1, 0) => run_vapp(&io, &command.data, true),
+            // Abort, with no V-App running
+            (0xfe, 0, 0) => Ok((StatusWord::OK, vec![])),
+            (0..=3 | 0xfe, _, _) => Ok((StatusWord::WrongP1P2, vec![])),
+            _ => Ok((StatusWord::InsNotSupported, vec![])),
+        };
+        // an aborted V-App stops with the error of the command that received Abort
+        let aborted = std::mem::take(&mut io.borrow_mut().aborted);
+        let result = if aborted {
+            Ok((StatusWord::VAppAborted, vec![]))
+        } else {
+            result
+        };
+        // as the Vanadium app, only the status word is sent to the client; the error is kept for
+        // TransportMock::take_runtime_error
+        let (status, data) = result.unwrap_or_else(|e| {
+            *io.borrow().runtime_error.lock().unwrap() = Some(e.to_string());
+            (StatusWord::VMRuntimeError, vec![])
+        });
+
+        command = match io.borrow_mut().exchange(status, data) {
+            Ok(command) => command,
+            Err(Disconnected) => return,
+        };
+    }
+}
+
+struct MockChannel {
+    to_device: mpsc::Sender<APDUCommand>,
+    from_device: tokio_mpsc::UnboundedReceiver<(StatusWord, Vec<u8>)>,
+}
+
+/// Transport to an emulated device running the Vanadium VM in-process.
+pub struct TransportMock {
+    channel: Mutex<MockChannel>,
+    metrics: Arc<MetricsCounters>,
+    runtime_error: Arc<StdMutex<Option<String>>>,
+}
+
+impl TransportMock {
+    /// Starts an emulated device with the default configuration.
+    pub fn new() -> Self {
+        Self::with_config(MockDeviceConfig::default())
+    }
+
+    /// Starts an emulated device with the given configuration.
+    /// The device is stopped when the transport is dropped.
+    pub fn with_config(config: MockDeviceConfig) -> Self {
+        let (to_device, from_host) = mpsc::channel();
+        let (to_host, from_device) = tokio_mpsc::unbounded_channel();
+        let metrics = Arc::new(MetricsCounters::default());
+        let runtime_error = Arc::new(StdMutex::new(None));
+
+        let io = DeviceIo {
+            config,
+            metrics: metrics.clone(),
+            from_host,
+            to_host,
+            runtime_error: runtime_error.clone(),
+            last_command_len: 0,
+            aborted: false,
+            checkpoint_key: random_key(),
+        };
+        thread::Builder::new()
+            .name("vanadium-mock-device".into())
+            .spawn(move || device_main(io))
+            .expect("Failed to spawn the mock device thread");
+
+        Self {
+            channel: Mutex::new(MockChannel {
+                to_device,
+                from_device,
+            }),
+            metrics,
+            runtime_error,
+        }
+    }
+
+    /// Returns the counters collected by the emulated device since it started, or since the last
+    /// call to `reset_metrics`.
+    pub fn metrics(&self) -> MockDeviceMetrics {
+        self.metrics.snapshot()
+    }
+
+    /// Resets all the counters of the emulated device.
+    pub fn reset_metrics(&self) {
+        self.metrics.reset();
+    }
+
+    /// Returns the error that stopped the last V-App with the `VMRuntimeError` status word, if
+    /// any, and clears it. As for a real device, the client only receives the status word.
+    pub fn take_runtime_error(&self) -> Option<String> {
+        self.runtime_error.lock().unwrap().take()
+    }
+}
+
+impl Default for TransportMock {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[async_trait]
+impl Transport for TransportMock {
+    type Error = Box<dyn Error + Send + Sync>;
+    async fn exchange(&self, command: &APDUCommand) -> Result<(StatusWord, Vec<u8>), Self::Error> {
+        let mut channel = self.channel.lock().await;
+        channel
+            .to_device
+            .send(command.clone())
+            .map_err(|_| "The mock device stopped")?;
+        Ok(channel
+            .from_device
+            .recv()
+            .await
+            .ok_or("The mock device stopped")?)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::apdu::{
+        apdu_abort, apdu_continue, apdu_continue_with_p1, apdu_resume_vapp, apdu_run_vapp,
+    };
+    use common::accumulator::MerkleHashKind;
+
+    const CODE_START: u32 = 0x10000;
+    const DATA_START: u32 = 0x20000;
+    const STACK_START: u32 = 0x30000;
+
+    fn serialized_manifest() -> Vec<u8> {
+        let page_size = PAGE_SIZE as u32;
+        let manifest = Manifest::new(
+            0,
+            "Test",
+            "0.1.0",
+            [0u8; 32],
+            CODE_START,
+            0,
+            CODE_START,
+            CODE_START + page_size,
+            STACK_START,
+            STACK_START + page_size,
+            DATA_START,
+            DATA_START + page_size,
+            [0u8; 32],
+            0,
+            MerkleHashKind::Sha256,
+        )
+        .unwrap();
+        postcard::to_allocvec(&manifest).unwrap()
+    }
+
+    // addi t0, zero, code; ecall
+    fn ecall(code: u32) -> [u32; 2] {
+        [(code << 20) | (5 << 7) | 0x13, ECALL_INSTRUCTION]
+    }
+
+    // Answers the request of the only code page of the V-App, that starts with the given
+    // instructions; returns the next command sent by the device.
+    async fn send_code(mock: &TransportMock, instructions: &[u32]) -> (StatusWord, Vec<u8>) {
+        let mut code = [0u8; PAGE_SIZE];
+        for (chunk, instruction) in code.chunks_mut(4).zip(instructions) {
+            chunk.copy_from_slice(&instruction.to_le_bytes());
+        }
+        let command = apdu_continue_with_p1(code[..PAGE_SIZE - 1].to_vec(), code[PAGE_SIZE - 1]);
+        mock.exchange(&command).await.unwrap()
+    }
+
+    // Starts a V-App that waits for a message from the client; returns the command sent by the
+    // device once the V-App waits.
+    async fn start_waiting_vapp(mock: &TransportMock) -> (StatusWord, Vec<u8>) {
+        let command = apdu_run_vapp(serialized_manifest(), MOCK_APP_HMAC);
+        let (status, _) = mock.exchange(&command).await.unwrap();
+        assert_eq!(status, StatusWord::InterruptedExecution);
+        send_code(mock, &ecall(ECALL_XRECV)).await
+    }
+
+    // Resumes the V-App from the given checkpoint; returns the response of the device to the
+    // checkpoint.
+    async fn resume_vapp(
+        mock: &TransportMock,
+        checkpoint: &VAppCheckpoint,
+    ) -> (StatusWord, Vec<u8>) {
+        let command = apdu_resume_vapp(serialized_manifest(), MOCK_APP_HMAC);
+        let (status, data) = mock.exchange(&command).await.unwrap();
+        assert_eq!(status, StatusWord::InterruptedExecution);
+        assert_eq!(data, GetCheckpointMessage::new().serialize());
+        mock.exchange(&apdu_continue(checkpoint.serialize()))
+            .await
+            .unwrap()
+    }
+
+    #[tokio::test]
+    async fn test_abort_leaves_the_device_idle() {
+        let mock = TransportMock::new();
+
+        let (status, data) = start_waiting_vapp(&mock).await;
+        assert_eq!(status, StatusWord::InterruptedExecution);
+        assert_eq!(data, ReceiveBufferMessage::new().serialize());
+
+        let (status, _) = mock.exchange(&apdu_abort()).await.unwrap();
+        assert_eq!(status, StatusWord::VAppAborted);
+        assert_eq!(mock.take_runtime_error(), None);
+
+        // nothing is running anymore, and the device accepts a new V-App
+        let (status, _) = mock.exchange(&apdu_abort()).await.unwrap();
+        assert_eq!(status, StatusWord::OK);
+        let (status, data) = start_waiting_vapp(&mock).await;
+        assert_eq!(status, StatusWord::InterruptedExecution);
+        assert_eq!(data, ReceiveBufferMessage::new().serialize());
+    }
+
+    #[tokio::test]
+    async fn test_checkpoints_can_not_be_forged() {
+        let mock = TransportMock::new();
+        let code = [ecall(ECALL_CHECKPOINT), ecall(ECALL_XRECV)].concat();
+
+        // take a checkpoint, then stop the V-App while it waits for a message
+        let command = apdu_run_vapp(serialized_manifest(), MOCK_APP_HMAC);
+        let (status, _) = mock.exchange(&command).await.unwrap();
+        assert_eq!(status, StatusWord::InterruptedExecution);
+        let (status, data) = send_code(&mock, &code).await;
+        assert_eq!(status, StatusWord::InterruptedExecution);
+        let CheckpointMessage { checkpoint, .. } = CheckpointMessage::deserialize(&data).unwrap();
+        let (_, data) = mock.exchange(&apdu_continue(vec![])).await.unwrap();
+        assert_eq!(data, ReceiveBufferMessage::new().serialize());
+        let (status, _) = mock.exchange(&apdu_abort()).await.unwrap();
+        assert_eq!(status, StatusWord::VAppAborted);
+
+        // the V-App resumes after the checkpoint, and waits for a message again
+        let (status, _) = resume_vapp(&mock, &checkpoint).await;
+        assert_eq!(status, StatusWord::InterruptedExecution);
+        let (_, data) = send_code(&mock, &code).await;
+        assert_eq!(data, ReceiveBufferMessage::new().serialize());
+        let (status, _) = mock.exchange(&apdu_abort()).await.unwrap();
+        assert_eq!(status, StatusWord::VAppAborted);
+
+        // a modified state is rejected, and so is a tag computed without the key of the device
+        let mut modified = checkpoint.clone();
+        modified.pc = CODE_START;
+        let mut unkeyed = modified.clone();
+        let mut hasher = Sha256::new();
+        hasher.update(MOCK_APP_HMAC);
+        VAppCheckpoint::serialize_state_with(unkeyed.pc, &unkeyed.regs, |data| hasher.update(data));
+        unkeyed.hmac = hasher.finalize().into();
+        for forged in [modified, unkeyed] {
+            let (status, _) = resume_vapp(&mock, &forged).await;
+            assert_eq!(status, StatusWord::SignatureFail);
+        }
+
+        // the checkpoints of a device are not valid on another one
+        let (status, _) = resume_vapp(&TransportMock::new(), &checkpoint).await;
+        assert_eq!(status, StatusWord::SignatureFail);
+    }
+}
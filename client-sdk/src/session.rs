@@ -0,0 +1,379 @@
+//! This module provides a `SessionManager`, that runs many V-App sessions concurrently on a pool
+//! of devices (or emulators).
+//!
+//! Each device can only run one V-App at a time; therefore, a session holds one device of the pool
+//! from the moment it is opened until it is closed. When all the devices are in use, opening a
+//! session waits until one is released; at most `max_pending_sessions` can wait at the same time,
+//! and further attempts fail with `SessionError::Busy`. A device that fails to stop its V-App is
+//! removed from the pool; once no device is left, opening a session fails with
+//! `SessionError::NoDevices`.
+//!
+//! The messages of a session are processed in order by a dedicated task, through a queue of bounded
+//! capacity: when the queue is full, senders wait until the previous messages are processed.
+//!
+//! The code segments of the V-Apps are shared among all the sessions of the same manager, so that
+//! the Merkle tree of the code of each V-App is only computed once.
+
+use std::collections::VecDeque;
+use std::error::Error;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex as StdMutex};
+use std::time::{Duration, Instant};
+
+use async_trait::async_trait;
+use tokio::sync::{mpsc, oneshot, Semaphore, TryAcquireError};
+use tokio::task::JoinHandle;
+
+use crate::apdu::{apdu_abort, StatusWord};
+use crate::elf::ElfFile;
+use crate::transport::Transport;
+use crate::vanadium_client::{
+    CodeSegmentCache, MerkleHashKind, VAppClient, VAppExecutionError, VanadiumAppClient,
+};
+
+/// A transport that can be shared among tasks.
+pub type SharedTransport = Arc<dyn Transport<Error = Box<dyn Error + Send + Sync>> + Send + Sync>;
+
+/// Configuration of a `SessionManager`.
+#[derive(Debug, Clone)]
+pub struct SessionManagerConfig {
+    /// Maximum number of messages waiting to be processed in each session.
+    pub queue_capacity: usize,
+    /// Maximum number of sessions waiting for a device to become available.
+    pub max_pending_sessions: usize,
+    /// Hash function of the Merkle trees of the memory of the V-Apps.
+    pub mt_hash_kind: MerkleHashKind,
+}
+
+impl Default for SessionManagerConfig {
+    fn default() -> Self {
+        Self {
+            queue_capacity: 16,
+            max_pending_sessions: 64,
+            mt_hash_kind: MerkleHashKind::Sha256,
+        }
+    }
+}
+
+/// Errors that can occur when using a session.
+#[derive(Debug)]
+pub enum SessionError {
+    /// Too many sessions are already waiting for a device.
+    Busy,
+    /// All the devices were removed from the pool.
+    NoDevices,
+    /// The session is closed, or its task stopped.
+    Closed,
+    /// The V-App exited with the given status code.
+    AppExited(i32),
+    /// Any other error while starting the V-App or exchanging messages with it.
+    VAppError(String),
+}
+
+impl std::fmt::Display for SessionError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            SessionError::Busy => write!(f, "Too many sessions waiting for a device"),
+            SessionError::NoDevices => write!(f, "No devices left in the pool"),
+            SessionError::Closed => write!(f, "Session closed"),
+            SessionError::AppExited(status) => write!(f, "V-App exited with status {}", status),
+            SessionError::VAppError(e) => write!(f, "V-App error: {}", e),
+        }
+    }
+}
+
+impl Error for SessionError {}
+
+/// Counters collected for each session.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct SessionMetrics {
+    /// Number of messages processed.
+    pub messages: u64,
+    /// Number of messages that failed.
+    pub errors: u64,
+    /// Total length of the messages sent to the V-App.
+    pub bytes_sent: u64,
+    /// Total length of the responses received from the V-App.
+    pub bytes_received: u64,
+    /// Total time spent waiting in the queue before being processed.
+    pub queue_time: Duration,
+    /// Total time spent processing the messages.
+    pub processing_time: Duration,
+}
+
+// A device of the pool, returned to the pool when dropped.
+struct DeviceLease {
+    transport: Option<SharedTransport>,
+    pool: Arc<DevicePool>,
+}
+
+impl DeviceLease {
+    // Removes the device from the pool, rather than giving it back. Once no device is left, the
+    // pool is closed, so that the sessions waiting for a device fail instead of waiting forever.
+    fn remove_device(mut self) {
+        self.transport = None;
+        if self.pool.devices.fetch_sub(1, Ordering::AcqRel) == 1 {
+            self.pool.available.close();
+        }
+    }
+}
+
+impl Drop for DeviceLease {
+    fn drop(&mut self) {
+        if let Some(transport) = self.transport.take() {
+            self.pool.free.lock().unwrap().push_back(transport);
+            self.pool.available.add_permits(1);
+        }
+    }
+}
+
+struct DevicePool {
+    free: StdMutex<VecDeque<SharedTransport>>,
+    // one permit per free device; closed once the pool has no devices
+    available: Semaphore,
+    // one permit per session that can wait for a device
+    waiting: Semaphore,
+    // number of devices in the pool, free or not
+    devices: AtomicUsize,
+}
+
+impl DevicePool {
+    fn new(devices: Vec<SharedTransport>, max_pending: usize) -> Self {
+        let n_devices = devices.len();
+        let pool = Self {
+            free: StdMutex::new(devices.into()),
+            available: Semaphore::new(n_devices),
+            waiting: Semaphore::new(max_pending),
+            devices: AtomicUsize::new(n_devices),
+        };
+        if n_devices == 0 {
+            pool.available.close();
+        }
+        pool
+    }
+
+    async fn acquire(self: &Arc<Self>) -> Result<DeviceLease, SessionError> {
+        let permit = match self.available.try_acquire() {
+            Ok(permit) => permit,
+            Err(TryAcquireError::Closed) => return Err(SessionError::NoDevices),
+            Err(TryAcquireError::NoPermits) => {
+                // the slot is freed when the guard is dropped, even if this future is cancelled
+                let _waiting = self.waiting.try_acquire().map_err(|_| SessionError::Busy)?;
+                self.available
+                    .acquire()
+                    .await
+                    .map_err(|_| SessionError::NoDevices)?
+            }
+        };
+
+        // the permit is given back when the lease is dropped
+        permit.forget();
+        let transport = self
+            .free
+            .lock()
+            .unwrap()
+            .pop_front()
+            .expect("a free device must exist for each permit");
+        Ok(DeviceLease {
+            transport: Some(transport),
+            pool: self.clone(),
+        })
+    }
+}
+
+struct SessionRequest {
+    message: Vec<u8>,
+    enqueued_at: Instant,
+    response: oneshot::Sender<Result<Vec<u8>, SessionError>>,
+}
+
+/// Runs V-App sessions on a pool of devices.
+pub struct SessionManager {
+    pool: Arc<DevicePool>,
+    code_cache: Arc<CodeSegmentCache>,
+    config: SessionManagerConfig,
+}
+
+impl SessionManager {
+    /// Creates a session manager for the given devices.
+    pub fn new(devices: Vec<SharedTransport>, config: SessionManagerConfig) -> Self {
+        Self {
+            pool: Arc::new(DevicePool::new(devices, config.max_pending_sessions)),
+            code_cache: Arc::new(CodeSegmentCache::new()),
+            config,
+        }
+    }
+
+    /// Returns the number of devices that are not used by any session.
+    pub fn available_devices(&self) -> usize {
+        self.pool.available.available_permits()
+    }
+
+    /// Returns the number of devices in the pool, including the ones used by a session.
+    pub fn devices(&self) -> usize {
+        self.pool.devices.load(Ordering::Acquire)
+    }
+
+    /// Returns the number of distinct code segments shared among the sessions.
+    pub fn cached_code_segments(&self) -> usize {
+        self.code_cache.len()
+    }
+
+    /// Opens a session running the V-App in `elf` on the first available device, waiting for
+    /// one if they are all in use. If `app_hmac` is not given, the V-App is registered first.
+    pub async fn open_session(
+        &self,
+        elf: &ElfFile,
+        app_hmac: Option<[u8; 32]>,
+    ) -> Result<Session, SessionError> {
+        let lease = self.pool.acquire().await?;
+        let transport = lease.transport.clone().expect("the lease holds a device");
+
+        let (client, app_hmac) = VanadiumAppClient::from_elf(
+            elf,
+            transport,
+            app_hmac,
+            Some(&self.code_cache),
+            self.config.mt_hash_kind,
+        )
+        .await
+        .map_err(|e| SessionError::VAppError(e.to_string()))?;
+
+        let streamed_framing = client.supports_streamed_framing();
+        let (sender, receiver) = mpsc::channel(self.config.queue_capacity.max(1));
+        let metrics = Arc::new(StdMutex::new(SessionMetrics::default()));
+        let worker = tokio::spawn(run_session(client, lease, receiver, metrics.clone()));
+
+        Ok(Session {
+            sender,
+            metrics,
+            worker,
+            app_hmac,
+            streamed_framing,
+        })
+    }
+}
+
+// Processes the messages of a session in order, until the session is closed or the V-App stops.
+async fn run_session(
+    mut client: VanadiumAppClient<Box<dyn Error + Send + Sync>>,
+    lease: DeviceLease,
+    mut receiver: mpsc::Receiver<SessionRequest>,
+    metrics: Arc<StdMutex<SessionMetrics>>,
+) {
+    while let Some(request) = receiver.recv().await {
+        let started_at = Instant::now();
+        let result = client
+            .send_message(&request.message)
+            .await
+            .map_err(|e| match e {
+                VAppExecutionError::AppExited(status) => SessionError::AppExited(status),
+                VAppExecutionError::Other(e) => SessionError::VAppError(e.to_string()),
+            });
+
+        let stopped = result.is_err();
+        {
+            let mut metrics = metrics.lock().unwrap();
+            metrics.messages += 1;
+            metrics.bytes_sent += request.message.len() as u64;
+            match &result {
+                Ok(response) => metrics.bytes_received += response.len() as u64,
+                Err(_) => metrics.errors += 1,
+            }
+            metrics.queue_time += started_at - request.enqueued_at;
+            metrics.processing_time += started_at.elapsed();
+        }
+        let _ = request.response.send(result);
+
+        if stopped {
+            break;
+        }
+    }
+
+    client.close().await;
+
+    // If the V-App did not exit, the device is still waiting for a response to the V-App's last
+    // request; Abort stops the V-App, so that the device can be reused. If the device does not
+    // confirm that it is idle, it is removed from the pool.
+    let transport = lease.transport.clone().expect("the lease holds a device");
+    let idle = matches!(
+        transport.exchange(&apdu_abort()).await,
+        Ok((StatusWord::OK | StatusWord::VAppAborted, _))
+    );
+    if !idle {
+        lease.remove_device();
+    }
+}
+
+/// A V-App running on one of the devices of a `SessionManager`.
+pub struct Session {
+    sender: mpsc::Sender<SessionRequest>,
+    metrics: Arc<StdMutex<SessionMetrics>>,
+    worker: JoinHandle<()>,
+    app_hmac: [u8; 32],
+    streamed_framing: bool,
+}
+
+impl Session {
+    /// Returns the hmac of the V-App, that can be used to open further sessions without
+    /// registering the V-App again.
+    pub fn app_hmac(&self) -> [u8; 32] {
+        self.app_hmac
+    }
+
+    /// Queues a message for the V-App, and waits for its response. If the queue is full, waits
+    /// until there is room for the message.
+    pub async fn send(&self, message: &[u8]) -> Result<Vec<u8>, SessionError> {
+        let (response, response_receiver) = oneshot::channel();
+        self.sender
+            .send(SessionRequest {
+                message: message.to_vec(),
+                enqueued_at: Instant::now(),
+                response,
+            })
+            .await
+            .map_err(|_| SessionError::Closed)?;
+        response_receiver.await.map_err(|_| SessionError::Closed)?
+    }
+
+    /// Returns the number of messages that can be queued before senders have to wait.
+    pub fn queue_capacity_left(&self) -> usize {
+        self.sender.capacity()
+    }
+
+    /// Returns the counters collected for this session so far.
+    pub fn metrics(&self) -> SessionMetrics {
+        *self.metrics.lock().unwrap()
+    }
+
+    /// Closes the session, after all the queued messages are processed. The device is returned to
+    /// the pool once it is ready to run another V-App; if it does not confirm that it stopped the
+    /// V-App, it is removed from the pool (see `SessionManager::devices`).
+    pub async fn close(self) -> SessionMetrics {
+        let Session {
+            sender,
+            metrics,
+            worker,
+            ..
+        } = self;
+        drop(sender);
+        let _ = worker.await;
+        let metrics = *metrics.lock().unwrap();
+        metrics
+    }
+}
+
+#[async_trait]
+impl VAppClient for Session {
+    async fn send_message(&mut self, msg: &[u8]) -> Result<Vec<u8>, VAppExecutionError> {
+        match self.send(msg).await {
+            Ok(response) => Ok(response),
+            Err(SessionError::AppExited(status)) => Err(VAppExecutionError::AppExited(status)),
+            Err(e) => Err(VAppExecutionError::Other(Box::new(e))),
+        }
+    }
+
+    fn supports_streamed_framing(&self) -> bool {
+        self.streamed_framing
+    }
+}
@@ -0,0 +1,136 @@
+//! This module provides `VAppSnapshot`, the state of a V-App at a checkpoint.
+//!
+//! A V-App takes a checkpoint with the `checkpoint` ECALL, typically once its initialization is
+//! complete. The VM commits all the modified pages, and sends the state of the CPU, authenticated
+//! with an hmac. Together with the content of the data and stack segments (that the client already
+//! stores), this is enough to resume the V-App in a later run of the VM, skipping the
+//! initialization.
+//!
+//! Only the pages that the client stores explicitly (the initial content from the ELF file, and the
+//! pages committed by the VM) are part of the snapshot; all the other pages are zeros. The Merkle
+//! roots of the segments are stored as well, and are checked when the segments are rebuilt.
+
+use std::error::Error;
+
+use common::client_commands::VAppCheckpoint;
+use common::constants::PAGE_SIZE;
+use common::manifest::Manifest;
+
+const SNAPSHOT_VERSION: u8 = 0;
+
+/// The state of a V-App at a checkpoint, that can be used to resume it.
+#[derive(Debug, Clone)]
+pub struct VAppSnapshot {
+    /// The manifest of the V-App that took the checkpoint.
+    pub manifest: Manifest,
+    /// The state of the CPU, as authenticated by the VM.
+    pub checkpoint: VAppCheckpoint,
+    /// The Merkle root of the data segment.
+    pub data_root: [u8; 32],
+    /// The Merkle root of the stack segment.
+    pub stack_root: [u8; 32],
+    /// The `(index, content)` pairs of the pages of the data segment that are stored explicitly.
+    pub data_pages: Vec<(u32, [u8; PAGE_SIZE])>,
+    /// The `(index, content)` pairs of the pages of the stack segment that are stored explicitly.
+    pub stack_pages: Vec<(u32, [u8; PAGE_SIZE])>,
+}
+
+// Reads the serialized snapshot sequentially.
+struct Reader<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, len: usize) -> Result<&'a [u8], &'static str> {
+        if self.data.len() < len {
+            return Err("Truncated snapshot");
+        }
+        let (result, rest) = self.data.split_at(len);
+        self.data = rest;
+        Ok(result)
+    }
+
+    fn take_u32(&mut self) -> Result<u32, &'static str> {
+        Ok(u32::from_be_bytes(self.take(4)?.try_into().unwrap()))
+    }
+
+    fn take_array<const N: usize>(&mut self) -> Result<[u8; N], &'static str> {
+        Ok(self.take(N)?.try_into().unwrap())
+    }
+
+    fn take_pages(&mut self) -> Result<Vec<(u32, [u8; PAGE_SIZE])>, &'static str> {
+        let n_pages = self.take_u32()? as usize;
+        if n_pages > self.data.len() / (4 + PAGE_SIZE) {
+            return Err("Truncated snapshot");
+        }
+        let mut pages = Vec::with_capacity(n_pages);
+        for _ in 0..n_pages {
+            let index = self.take_u32()?;
+            pages.push((index, self.take_array::<PAGE_SIZE>()?));
+        }
+        Ok(pages)
+    }
+}
+
+fn serialize_pages(pages: &[(u32, [u8; PAGE_SIZE])], result: &mut Vec<u8>) {
+    result.extend_from_slice(&(pages.len() as u32).to_be_bytes());
+    for (index, content) in pages {
+        result.extend_from_slice(&index.to_be_bytes());
+        result.extend_from_slice(content);
+    }
+}
+
+impl VAppSnapshot {
+    /// Serializes the snapshot, so that it can be stored and used to resume the V-App from a
+    /// different connection, or a different process.
+    pub fn serialize(&self) -> Result<Vec<u8>, Box<dyn Error + Send + Sync>> {
+        let manifest = postcard::to_allocvec(&self.manifest)?;
+
+        let n_pages = self.data_pages.len() + self.stack_pages.len();
+        let mut result = Vec::with_capacity(
+            1 + 4
+                + manifest.len()
+                + VAppCheckpoint::SERIALIZED_LEN
+                + 64
+                + 8
+                + n_pages * (4 + PAGE_SIZE),
+        );
+        result.push(SNAPSHOT_VERSION);
+        result.extend_from_slice(&(manifest.len() as u32).to_be_bytes());
+        result.extend_from_slice(&manifest);
+        result.extend_from_slice(&self.checkpoint.serialize());
+        result.extend_from_slice(&self.data_root);
+        result.extend_from_slice(&self.stack_root);
+        serialize_pages(&self.data_pages, &mut result);
+        serialize_pages(&self.stack_pages, &mut result);
+        Ok(result)
+    }
+
+    /// Deserializes a snapshot produced by `serialize`.
+    pub fn deserialize(data: &[u8]) -> Result<Self, Box<dyn Error + Send + Sync>> {
+        let mut reader = Reader { data };
+        if reader.take(1)?[0] != SNAPSHOT_VERSION {
+            return Err("Unsupported snapshot version".into());
+        }
+        let manifest_len = reader.take_u32()? as usize;
+        let manifest = postcard::from_bytes::<Manifest>(reader.take(manifest_len)?)?;
+        let checkpoint = VAppCheckpoint::deserialize(reader.take(VAppCheckpoint::SERIALIZED_LEN)?)
+            .map_err(|_| "Invalid checkpoint")?;
+        let data_root = reader.take_array::<32>()?;
+        let stack_root = reader.take_array::<32>()?;
+        let data_pages = reader.take_pages()?;
+        let stack_pages = reader.take_pages()?;
+        if !reader.data.is_empty() {
+            return Err("Unexpected data after the snapshot".into());
+        }
+
+        Ok(Self {
+            manifest,
+            checkpoint,
+            data_root,
+            stack_root,
+            data_pages,
+            stack_pages,
+        })
+    }
+}
@@ -9,8 +9,11 @@ use async_trait::async_trait;
 use ledger_apdu::APDUAnswer;
 use ledger_transport_hid::TransportNativeHID;
 use tokio::{
-    io::{AsyncReadExt, AsyncWriteExt},
-    net::TcpStream,
+    io::{AsyncReadExt, AsyncWriteExt, BufReader, BufWriter},
+    net::{
+        tcp::{OwnedReadHalf, OwnedWriteHalf},
+        TcpStream, ToSocketAddrs,
+    },
     sync::Mutex,
 };
 
@@ -21,6 +24,20 @@ use crate::apdu::{APDUCommand, StatusWord};
 pub trait Transport: Send + Sync {
     type Error: Debug + Send + Sync;
     async fn exchange(&self, command: &APDUCommand) -> Result<(StatusWord, Vec<u8>), Self::Error>;
+
+    /// Like `exchange`, but the response data is written to `response`, replacing its content.
+    /// This allows the caller to reuse the same buffers for many exchanges. Transports should
+    /// override the default implementation if they can avoid the intermediate allocation.
+    async fn exchange_into(
+        &self,
+        command: &APDUCommand,
+        response: &mut Vec<u8>,
+    ) -> Result<StatusWord, Self::Error> {
+        let (status, data) = self.exchange(command).await?;
+        response.clear();
+        response.extend_from_slice(&data);
+        Ok(status)
+    }
 }
 
 /// Transport with the Ledger device.
@@ -32,39 +49,128 @@ impl TransportHID {
     }
 }
 
-#[async_trait]
-impl Transport for TransportHID {
-    type Error = Box<dyn Error + Send + Sync>;
-    async fn exchange(&self, cmd: &APDUCommand) -> Result<(StatusWord, Vec<u8>), Self::Error> {
+impl TransportHID {
+    fn exchange_raw(
+        &self,
+        cmd: &APDUCommand,
+    ) -> Result<APDUAnswer<Vec<u8>>, Box<dyn Error + Send + Sync>> {
+        // the command's data is borrowed, rather than copied
         self.0
             .exchange(&ledger_apdu::APDUCommand {
                 ins: cmd.ins,
                 cla: cmd.cla,
                 p1: cmd.p1,
                 p2: cmd.p2,
-                data: cmd.data.clone(),
-            })
-            .map(|answer| {
-                (
-                    StatusWord::try_from(answer.retcode()).unwrap_or(StatusWord::Unknown),
-                    answer.data().to_vec(),
-                )
+                data: cmd.data.as_slice(),
             })
             .map_err(|e| e.into())
     }
 }
 
+#[async_trait]
+impl Transport for TransportHID {
+    type Error = Box<dyn Error + Send + Sync>;
+    async fn exchange(&self, cmd: &APDUCommand) -> Result<(StatusWord, Vec<u8>), Self::Error> {
+        self.exchange_raw(cmd).map(|answer| {
+            (
+                StatusWord::try_from(answer.retcode()).unwrap_or(StatusWord::Unknown),
+                answer.data().to_vec(),
+            )
+        })
+    }
+
+    async fn exchange_into(
+        &self,
+        cmd: &APDUCommand,
+        response: &mut Vec<u8>,
+    ) -> Result<StatusWord, Self::Error> {
+        let answer = self.exchange_raw(cmd)?;
+        response.clear();
+        response.extend_from_slice(answer.data());
+        Ok(StatusWord::try_from(answer.retcode()).unwrap_or(StatusWord::Unknown))
+    }
+}
+
 /// Transport to communicate with the Ledger Speculos simulator.
 pub struct TransportTcp {
-    connection: Mutex<TcpStream>,
+    connection: Mutex<TcpConnection>,
+}
+
+// Maximum length of the data of a response: the longest response of an extended APDU.
+const MAX_RESPONSE_LENGTH: usize = 65536;
+
+// Buffered halves of the TCP stream. Each APDU is framed with its 4-byte big-endian length; each
+// response is framed with the 4-byte big-endian length of the data, followed by the data and the
+// 2-byte status word.
+struct TcpConnection {
+    reader: BufReader<OwnedReadHalf>,
+    writer: BufWriter<OwnedWriteHalf>,
+    // Set while an exchange is in progress. If an exchange fails or is cancelled, the response
+    // might still be in the stream, and every later exchange would read the wrong one; therefore,
+    // the connection can not be used anymore.
+    poisoned: bool,
+}
+
+impl TcpConnection {
+    // Buffers the framed command; it is only sent when the writer is flushed.
+    async fn write_command(&mut self, command: &APDUCommand) -> Result<(), std::io::Error> {
+        let header = [
+            command.cla,
+            command.ins,
+            command.p1,
+            command.p2,
+            command.data.len() as u8,
+        ];
+        self.writer
+            .write_all(&((header.len() + command.data.len()) as u32).to_be_bytes())
+            .await?;
+        self.writer.write_all(&header).await?;
+        self.writer.write_all(&command.data).await
+    }
+
+    // Reads the response data directly in `response`, and returns the status word.
+    async fn read_response(
+        &mut self,
+        response: &mut Vec<u8>,
+    ) -> Result<StatusWord, std::io::Error> {
+        let len = self.reader.read_u32().await? as usize;
+        if len > MAX_RESPONSE_LENGTH {
+            return Err(std::io::Error::new(
+                std::io::ErrorKind::InvalidData,
+                "response too long",
+            ));
+        }
+
+        response.resize(len + 2, 0);
+        self.reader.read_exact(response).await?;
+        let sw = u16::from_be_bytes([response[len], response[len + 1]]);
+        response.truncate(len);
+        Ok(StatusWord::try_from(sw).unwrap_or(StatusWord::Unknown))
+    }
 }
 
 impl TransportTcp {
+    /// Connects to Speculos on the default APDU port (127.0.0.1:9999).
     pub async fn new() -> Result<Self, Box<dyn Error>> {
-        let addr = SocketAddr::new(IpAddr::V4(Ipv4Addr::new(127, 0, 0, 1)), 9999);
+        Self::connect(SocketAddr::new(
+            IpAddr::V4(Ipv4Addr::new(127, 0, 0, 1)),
+            9999,
+        ))
+        .await
+    }
+
+    /// Connects to the given address.
+    pub async fn connect<A: ToSocketAddrs>(addr: A) -> Result<Self, Box<dyn Error>> {
         let stream = TcpStream::connect(addr).await?;
+        // APDUs are small and strictly request/response; don't let Nagle's algorithm delay them
+        stream.set_nodelay(true)?;
+        let (reader, writer) = stream.into_split();
         Ok(Self {
-            connection: Mutex::new(stream),
+            connection: Mutex::new(TcpConnection {
+                reader: BufReader::new(reader),
+                writer: BufWriter::new(writer),
+                poisoned: false,
+            }),
         })
     }
 }
@@ -73,27 +179,29 @@ impl TransportTcp {
 impl Transport for TransportTcp {
     type Error = Box<dyn Error + Send + Sync>;
     async fn exchange(&self, command: &APDUCommand) -> Result<(StatusWord, Vec<u8>), Self::Error> {
-        let mut stream = self.connection.lock().await;
-        let command_bytes = command.encode();
-
-        let mut req = vec![0u8; command_bytes.len() + 4];
-        req[..4].copy_from_slice(&(command_bytes.len() as u32).to_be_bytes());
-        req[4..].copy_from_slice(&command_bytes);
-        stream.write_all(&req).await?;
-
-        let mut buff = [0u8; 4];
-        let len = match stream.read(&mut buff).await? {
-            4 => u32::from_be_bytes(buff),
-            _ => return Err("Invalid Length".into()),
-        };
+        let mut response = Vec::new();
+        let status = self.exchange_into(command, &mut response).await?;
+        Ok((status, response))
+    }
 
-        let mut resp = vec![0u8; len as usize + 2];
-        stream.read_exact(&mut resp).await?;
-        let answer = APDUAnswer::from_answer(resp).map_err(|_| "Invalid Answer")?;
-        Ok((
-            StatusWord::try_from(answer.retcode()).unwrap_or(StatusWord::Unknown),
-            answer.data().to_vec(),
-        ))
+    async fn exchange_into(
+        &self,
+        command: &APDUCommand,
+        response: &mut Vec<u8>,
+    ) -> Result<StatusWord, Self::Error> {
+        let mut connection = self.connection.lock().await;
+        if connection.poisoned {
+            return Err("The connection is out of sync after a failed exchange".into());
+        }
+
+        // only cleared once the whole response is read
+        connection.poisoned = true;
+        connection.write_command(command).await?;
+        connection.writer.flush().await?;
+        let status = connection.read_response(response).await?;
+        connection.poisoned = false;
+
+        Ok(status)
     }
 }
 
@@ -112,4 +220,51 @@ impl Transport for TransportWrapper {
     async fn exchange(&self, command: &APDUCommand) -> Result<(StatusWord, Vec<u8>), Self::Error> {
         self.0.exchange(command).await
     }
+
+    async fn exchange_into(
+        &self,
+        command: &APDUCommand,
+        response: &mut Vec<u8>,
+    ) -> Result<StatusWord, Self::Error> {
+        self.0.exchange_into(command, response).await
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tokio::net::TcpListener;
+
+    #[tokio::test]
+    async fn test_tcp_rejects_long_responses_and_poisons_the_connection() {
+        let listener = TcpListener::bind("127.0.0.1:0").await.unwrap();
+        let addr = listener.local_addr().unwrap();
+        let server = tokio::spawn(async move {
+            let (mut stream, _) = listener.accept().await.unwrap();
+            let len = stream.read_u32().await.unwrap();
+            let mut command = vec![0u8; len as usize];
+            stream.read_exact(&mut command).await.unwrap();
+            // the announced length is longer than any response
+            stream
+                .write_all(&(MAX_RESPONSE_LENGTH as u32 + 1).to_be_bytes())
+                .await
+                .unwrap();
+            stream
+        });
+
+        let transport = TransportTcp::connect(addr).await.unwrap();
+        let command = APDUCommand {
+            cla: 0xe0,
+            ins: 0x01,
+            p1: 0,
+            p2: 0,
+            data: vec![],
+        };
+        assert!(transport.exchange(&command).await.is_err());
+        let _stream = server.await.unwrap();
+
+        // the rest of the response might still be in the stream
+        let err = transport.exchange(&command).await.unwrap_err();
+        assert!(err.to_string().contains("out of sync"));
+    }
 }
@@ -1,6 +1,9 @@
 use async_trait::async_trait;
 use common::vm::MemoryError;
+use sha2::{Digest, Sha256};
+use std::any::{Any, TypeId};
 use std::cmp::min;
+use std::collections::HashMap;
 use std::path::Path;
 use std::sync::Arc;
 use tokio::io::{AsyncBufReadExt, AsyncWriteExt, BufReader};
@@ -9,46 +12,29 @@ use tokio::sync::{mpsc, Mutex};
 use tokio::task::JoinHandle;
 
 use common::accumulator::{
-    AccumulatorError, HashOutput, Hasher, MerkleAccumulator, VectorAccumulator,
+    AccumulatorError, HashOutput, Hasher, MerkleAccumulator, SparseMerkleAccumulator,
+    VectorAccumulator,
 };
 use common::client_commands::{
-    ClientCommandCode, CommitPageContentMessage, CommitPageMessage, GetPageMessage, Message,
-    MessageDeserializationError, ReceiveBufferMessage, ReceiveBufferResponse, SectionKind,
-    SendBufferMessage, SendPanicBufferMessage,
+    CheckpointMessage, ClientCallMessage, ClientCommandCode, CommitPageContentMessage,
+    CommitPageMessage, GetCheckpointMessage, GetPageMessage, Message, MessageDeserializationError,
+    ReceiveBufferMessage, ReceiveBufferResponse, SectionKind, SendBufferMessage,
+    SendPanicBufferMessage, VAppCheckpoint,
 };
 use common::constants::{page_start, PAGE_SIZE};
 use common::manifest::Manifest;
-use sha2::{Digest, Sha256};
 
 use crate::apdu::{
-    apdu_continue, apdu_continue_with_p1, apdu_register_vapp, apdu_run_vapp, APDUCommand,
-    StatusWord,
+    apdu_continue, apdu_continue_with_p1, apdu_register_vapp, apdu_resume_vapp, apdu_run_vapp,
+    APDUCommand, StatusWord,
 };
 use crate::elf::ElfFile;
+use crate::snapshot::VAppSnapshot;
 use crate::transport::Transport;
 
-pub struct Sha256Hasher {
-    hasher: Sha256,
-}
-
-impl Hasher<32> for Sha256Hasher {
-    fn new() -> Self {
-        Sha256Hasher {
-            hasher: Sha256::new(),
-        }
-    }
-
-    fn update(&mut self, data: &[u8]) {
-        self.hasher.update(data);
-    }
-
-    fn finalize(self) -> [u8; 32] {
-        let result = self.hasher.finalize();
-        let mut hash = [0u8; 32];
-        hash.copy_from_slice(&result);
-        hash
-    }
-}
+pub use common::accumulator::MerkleHashKind;
+// the hashers used to be defined in this module
+pub use crate::hash::{Blake2s256Hasher, Sha256Hasher};
 
 #[derive(Debug)]
 enum MemorySegmentError {
@@ -91,65 +77,127 @@ impl std::error::Error for MemorySegmentError {
     }
 }
 
-// Represents a memory segment stored by the client, using a MerkleAccumulator to provide proofs of integrity.
-struct MemorySegment {
+// The pages of a memory segment, either all stored in a single contiguous vector, so that they can be
+// read and written in place, or only stored once they differ from the all-zero page.
+enum SegmentContent<H: Hasher<32>> {
+    Dense(MerkleAccumulator<H, [u8; PAGE_SIZE], 32>),
+    Sparse(SparseMerkleAccumulator<H, [u8; PAGE_SIZE], 32>),
+}
+
+// Represents a memory segment stored by the client, using a Merkle accumulator to provide proofs of integrity.
+struct MemorySegment<H: Hasher<32>> {
     start: u32,
     end: u32,
-    content: MerkleAccumulator<Sha256Hasher, Vec<u8>, 32>,
+    content: SegmentContent<H>,
 }
 
-impl MemorySegment {
-    fn new(start: u32, data: &[u8]) -> Self {
-        let end = start + data.len() as u32;
+impl<H: Hasher<32>> MemorySegment<H> {
+    // Creates a segment from start to end, initialized with data; the bytes after the end of data
+    // (for example, the bss) are zero.
+    fn new(start: u32, end: u32, data: &[u8]) -> Self {
+        let pages = Self::data_pages(start, end, data);
+        let n_pages = Self::count_pages(start, end);
 
-        let mut pages: Vec<Vec<u8>> = Vec::new();
+        let mut all_pages = vec![[0u8; PAGE_SIZE]; n_pages];
+        all_pages[..pages.len()].copy_from_slice(&pages);
 
-        // current position, in terms of address; `start` needs to be subtracted for the position in `data`
-        let mut current_addr = start;
-        loop {
-            if current_addr >= end {
-                break;
-            }
-            let mut page_content: Vec<u8> = Vec::with_capacity(PAGE_SIZE);
-            let page_start_addr = page_start(current_addr as u32);
-            let page_end_addr = page_start_addr + PAGE_SIZE as u32;
-            let content_end_addr = min(page_end_addr, end);
-
-            // 0-pad with current_addr - page_start_addr bytes (always 0, except for the first page if unaligned to PAGE_SIZE)
-            page_content.extend_from_slice(&vec![0; (current_addr - page_start_addr) as usize]);
+        Self {
+            start,
+            end,
+            content: SegmentContent::Dense(MerkleAccumulator::<H, [u8; PAGE_SIZE], 32>::new(
+                all_pages,
+            )),
+        }
+    }
 
-            // copy content_end_addr - current_addr bytes from data
-            page_content.extend_from_slice(
-                &data[(current_addr - start) as usize..(content_end_addr - start) as usize],
-            );
+    // Like `new`, but the pages that are entirely zero (like the bss, or the whole stack) are not
+    // stored until they are committed by the VM; therefore, the segment can be created in
+    // O(log n) time and memory, plus the size of data.
+    fn new_sparse(start: u32, end: u32, data: &[u8]) -> Self {
+        let pages = Self::data_pages(start, end, data);
+        let n_pages = Self::count_pages(start, end);
 
-            // 0-pad with page_end_addr - content_end_addr bytes bytes (always 0, except possibly for last page)
-            page_content.extend_from_slice(&vec![0; (page_end_addr - content_end_addr) as usize]);
+        let content = SparseMerkleAccumulator::<H, [u8; PAGE_SIZE], 32>::with_elements(
+            n_pages,
+            [0u8; PAGE_SIZE],
+            pages.into_iter().enumerate(),
+        )
+        .expect("data pages are within the segment");
 
-            current_addr = page_end_addr;
-            pages.push(page_content);
+        Self {
+            start,
+            end,
+            content: SegmentContent::Sparse(content),
         }
+    }
 
-        Self {
+    // Like `new_sparse`, but from the pages stored in a snapshot, rather than from the initial content.
+    fn from_stored_pages(
+        start: u32,
+        end: u32,
+        pages: &[(u32, [u8; PAGE_SIZE])],
+    ) -> Result<Self, MemorySegmentError> {
+        let content = SparseMerkleAccumulator::<H, [u8; PAGE_SIZE], 32>::with_elements(
+            Self::count_pages(start, end),
+            [0u8; PAGE_SIZE],
+            pages.iter().map(|(index, page)| (*index as usize, *page)),
+        )?;
+
+        Ok(Self {
             start,
             end,
-            content: MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new(pages),
+            content: SegmentContent::Sparse(content),
+        })
+    }
+
+    // Returns the pages that are stored explicitly, that is, all of them for a dense segment; the
+    // other pages of a sparse segment are all zeros.
+    fn stored_pages(&self) -> Vec<(u32, [u8; PAGE_SIZE])> {
+        match &self.content {
+            SegmentContent::Dense(content) => (0..content.size())
+                .map(|i| (i as u32, *content.get(i).unwrap()))
+                .collect(),
+            SegmentContent::Sparse(content) => content
+                .iter_stored()
+                .map(|(i, page)| (i as u32, *page))
+                .collect(),
         }
     }
 
-    fn get_page(
-        &self,
-        page_index: u32,
-    ) -> Result<(Vec<u8>, Vec<HashOutput<32>>), MemorySegmentError> {
-        let content = self
-            .content
-            .get(page_index as usize)
-            .ok_or(MemorySegmentError::PageNotFound)?
-            .clone();
+    fn root(&self) -> [u8; 32] {
+        let root = match &self.content {
+            SegmentContent::Dense(content) => content.root(),
+            SegmentContent::Sparse(content) => content.root(),
+        };
+        root.try_into().expect("the hash output is 32 bytes long")
+    }
 
-        let proof = self.content.prove(page_index as usize)?;
+    fn count_pages(start: u32, end: u32) -> usize {
+        ((end - page_start(start)) as usize).div_ceil(PAGE_SIZE)
+    }
 
-        Ok((content, proof))
+    // Returns the pages that contain data, starting from the first page of the segment.
+    // The content of the segment is 0-padded at the beginning (if start is not aligned to PAGE_SIZE)
+    // and at the end (if end is not aligned to PAGE_SIZE, or data is shorter than the segment).
+    fn data_pages(start: u32, end: u32, data: &[u8]) -> Vec<[u8; PAGE_SIZE]> {
+        assert!(
+            data.len() <= (end - start) as usize,
+            "data exceeds the segment"
+        );
+
+        let first_page_addr = page_start(start);
+        let offset = (start - first_page_addr) as usize;
+        let mut pages = vec![[0u8; PAGE_SIZE]; (offset + data.len()).div_ceil(PAGE_SIZE)];
+        pages.as_flattened_mut()[offset..offset + data.len()].copy_from_slice(data);
+        pages
+    }
+
+    fn get_page_content(&self, page_index: u32) -> Result<&[u8; PAGE_SIZE], MemorySegmentError> {
+        match &self.content {
+            SegmentContent::Dense(content) => content.get(page_index as usize),
+            SegmentContent::Sparse(content) => content.get(page_index as usize),
+        }
+        .ok_or(MemorySegmentError::PageNotFound)
     }
 
     fn store_page(
@@ -157,14 +205,106 @@ impl MemorySegment {
         page_index: u32,
         content: &[u8],
     ) -> Result<(Vec<HashOutput<32>>, Vec<u8>), MemorySegmentError> {
-        if content.len() != PAGE_SIZE {
-            return Err(MemorySegmentError::InvalidPageSize);
-        }
-        let proof = self.content.update(page_index as usize, content.to_vec())?;
+        let page: &[u8; PAGE_SIZE] = content
+            .try_into()
+            .map_err(|_| MemorySegmentError::InvalidPageSize)?;
+        let proof = match &mut self.content {
+            SegmentContent::Dense(content) => content.update(page_index as usize, *page)?,
+            SegmentContent::Sparse(content) => content.update(page_index as usize, *page)?,
+        };
         Ok(proof)
     }
 }
 
+// Initial capacity of the buffers in the BufferPool; enough for any APDU.
+const APDU_BUFFER_CAPACITY: usize = 260;
+// Maximum number of buffers kept in the BufferPool.
+const BUFFER_POOL_MAX_SIZE: usize = 8;
+// Buffers received from the V-App are allocated upfront up to this size; longer ones grow as their
+// chunks arrive, so that a wrong length can not make the client reserve a huge buffer.
+const MAX_PREALLOCATED_BUFFER_SIZE: usize = 64 * 1024;
+
+// A pool of buffers for the data of the APDUs and of their responses, so that the many round
+// trips of a long session reuse the same few allocations.
+struct BufferPool {
+    buffers: Vec<Vec<u8>>,
+}
+
+impl BufferPool {
+    fn new() -> Self {
+        Self {
+            buffers: Vec::new(),
+        }
+    }
+
+    // Returns an empty buffer.
+    fn get(&mut self) -> Vec<u8> {
+        self.buffers
+            .pop()
+            .unwrap_or_else(|| Vec::with_capacity(APDU_BUFFER_CAPACITY))
+    }
+
+    // Gives back a buffer that is no longer used.
+    fn put(&mut self, mut buffer: Vec<u8>) {
+        if self.buffers.len() < BUFFER_POOL_MAX_SIZE {
+            buffer.clear();
+            self.buffers.push(buffer);
+        }
+    }
+}
+
+/// A cache of the code segments of the V-Apps, shared among all the clients that use it.
+///
+/// The code of a V-App is never modified, therefore the Merkle tree of its code segment only needs
+/// to be computed once, no matter how many instances of the same V-App are running.
+#[derive(Default)]
+pub struct CodeSegmentCache {
+    // indexed by the hash function of the Merkle tree and the hash of the code segment
+    segments: std::sync::Mutex<HashMap<(TypeId, [u8; 32]), Arc<dyn Any + Send + Sync>>>,
+}
+
+impl CodeSegmentCache {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Returns the number of code segments in the cache.
+    pub fn len(&self) -> usize {
+        self.segments.lock().unwrap().len()
+    }
+
+    /// Returns true if the cache is empty.
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    // Returns the code segment of the given ELF file, computing it only if it is not in the cache.
+    fn get_or_insert<H: Hasher<32> + Send + Sync + 'static>(
+        &self,
+        elf: &ElfFile,
+    ) -> Arc<MemorySegment<H>> {
+        let mut hasher = Sha256::new();
+        hasher.update(elf.code_segment.start.to_be_bytes());
+        hasher.update(elf.code_segment.end.to_be_bytes());
+        hasher.update(elf.code_segment.data());
+        let key = (TypeId::of::<H>(), hasher.finalize().into());
+
+        let mut segments = self.segments.lock().unwrap();
+        if let Some(segment) = segments.get(&key) {
+            if let Ok(segment) = segment.clone().downcast::<MemorySegment<H>>() {
+                return segment;
+            }
+        }
+        let segment = Arc::new(MemorySegment::<H>::new(
+            elf.code_segment.start,
+            elf.code_segment.end,
+            elf.code_segment.data(),
+        ));
+        segments.insert(key, segment.clone());
+        segment
+    }
+}
+
 enum VAppMessage {
     SendBuffer(Vec<u8>),
     SendPanicBuffer(String),
@@ -252,27 +392,77 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> From<Box<dyn std::error::Error
     }
 }
 
-struct VAppEngine<E: std::fmt::Debug + Send + Sync + 'static> {
+/// A handler of the requests that a V-App sends to the client with `client_call`, in order to
+/// offload work on non-secret data. The V-App must not trust the reply, and should validate it.
+#[async_trait]
+pub trait ClientCallHandler: Send + Sync {
+    /// Returns the reply to the request with the given payload.
+    async fn handle(
+        &self,
+        payload: &[u8],
+    ) -> Result<Vec<u8>, Box<dyn std::error::Error + Send + Sync>>;
+}
+
+#[async_trait]
+impl<F> ClientCallHandler for F
+where
+    F: Fn(&[u8]) -> Result<Vec<u8>, Box<dyn std::error::Error + Send + Sync>> + Send + Sync,
+{
+    async fn handle(
+        &self,
+        payload: &[u8],
+    ) -> Result<Vec<u8>, Box<dyn std::error::Error + Send + Sync>> {
+        self(payload)
+    }
+}
+
+// The handlers of the client calls, by request id; they can be registered while the V-App is running
+type ClientCallHandlers = Arc<std::sync::RwLock<HashMap<u32, Arc<dyn ClientCallHandler>>>>;
+
+struct VAppEngine<E: std::fmt::Debug + Send + Sync + 'static, H: Hasher<32>> {
     manifest: Manifest,
-    code_seg: MemorySegment,
-    data_seg: MemorySegment,
-    stack_seg: MemorySegment,
+    // the code is never modified, so its segment can be shared among engines running the same V-App
+    code_seg: Arc<MemorySegment<H>>,
+    data_seg: MemorySegment<H>,
+    stack_seg: MemorySegment<H>,
+    // if set, the V-App is resumed from this checkpoint, rather than started from its entrypoint
+    resume_from: Option<VAppCheckpoint>,
+    // the snapshot at the last checkpoint taken by the V-App, if any
+    latest_snapshot: Arc<std::sync::Mutex<Option<VAppSnapshot>>>,
+    client_call_handlers: ClientCallHandlers,
+    buffers: BufferPool,
     transport: Arc<dyn Transport<Error = E>>,
     engine_to_client_sender: mpsc::Sender<VAppMessage>,
     client_to_engine_receiver: mpsc::Receiver<ClientMessage>,
 }
 
-impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
+impl<E: std::fmt::Debug + Send + Sync + 'static, H: Hasher<32>> VAppEngine<E, H> {
     pub async fn run(mut self, app_hmac: [u8; 32]) -> Result<(), VAppEngineError<E>> {
         let serialized_manifest = postcard::to_allocvec(&self.manifest)?;
 
-        let (status, result) = self
+        let apdu = if self.resume_from.is_some() {
+            apdu_resume_vapp(serialized_manifest, app_hmac)
+        } else {
+            apdu_run_vapp(serialized_manifest, app_hmac)
+        };
+        let (status, result) = self.exchange(&apdu).await?;
+
+        self.busy_loop(status, result).await
+    }
+
+    // Sends an APDU and waits for the response.
+    // The response is in a buffer from the pool; callers should give it back once it is processed.
+    async fn exchange(
+        &mut self,
+        apdu: &APDUCommand,
+    ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
+        let mut response = self.buffers.get();
+        let status = self
             .transport
-            .exchange(&apdu_run_vapp(serialized_manifest, app_hmac))
+            .exchange_into(apdu, &mut response)
             .await
             .map_err(VAppEngineError::TransportError)?;
-
-        self.busy_loop(status, result).await
+        Ok((status, response))
     }
 
     // Sends and APDU and repeatedly processes the response if it's a GetPage or CommitPage client command.
@@ -281,11 +471,7 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
         &mut self,
         apdu: &APDUCommand,
     ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
-        let (mut status, mut result) = self
-            .transport
-            .exchange(apdu)
-            .await
-            .map_err(VAppEngineError::TransportError)?;
+        let (mut status, mut result) = self.exchange(apdu).await?;
 
         loop {
             if status != StatusWord::InterruptedExecution || result.len() == 0 {
@@ -295,14 +481,25 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
                 .try_into()
                 .map_err(|_| VAppEngineError::InvalidCommandCode)?;
 
-            (status, result) = match client_command_code {
+            let (new_status, new_result) = match client_command_code {
                 ClientCommandCode::GetPage => self.process_get_page(&result).await?,
                 ClientCommandCode::CommitPage => self.process_commit_page(&result).await?,
                 _ => return Ok((status, result)),
-            }
+            };
+            status = new_status;
+            self.buffers.put(std::mem::replace(&mut result, new_result));
         }
     }
 
+    // Sends an APDU with an empty Continue command; the response is processed as in
+    // exchange_and_process_page_requests.
+    async fn continue_and_process_page_requests(
+        &mut self,
+    ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
+        self.exchange_and_process_page_requests(&apdu_continue(vec![]))
+            .await
+    }
+
     async fn process_get_page(
         &mut self,
         command: &[u8],
@@ -314,21 +511,23 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
         } = GetPageMessage::deserialize(command)?;
 
         let segment = match section_kind {
-            SectionKind::Code => &self.code_seg,
+            SectionKind::Code => self.code_seg.as_ref(),
             SectionKind::Data => &self.data_seg,
             SectionKind::Stack => &self.stack_seg,
         };
 
-        // TODO: for now we're ignoring proofs
-        let (mut data, _) = segment.get_page(page_index)?;
-        let p1 = data.pop().unwrap();
+        let data = segment.get_page_content(page_index)?;
+        let p1 = data[PAGE_SIZE - 1];
+        let mut apdu_data = self.buffers.get();
+        apdu_data.extend_from_slice(&data[..PAGE_SIZE - 1]);
+
+        // TODO: for now we're ignoring proofs; they are not computed, as the VM does not verify them
 
         // return the content of the page (the last byte is in p1)
-        Ok(self
-            .transport
-            .exchange(&apdu_continue_with_p1(data, p1))
-            .await
-            .map_err(VAppEngineError::TransportError)?)
+        let apdu = apdu_continue_with_p1(apdu_data, p1);
+        let response = self.exchange(&apdu).await;
+        self.buffers.put(apdu.data);
+        response
     }
 
     async fn process_commit_page(
@@ -337,6 +536,15 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
     ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
         let msg = CommitPageMessage::deserialize(command)?;
 
+        // get the next message, which contains the content of the page
+        let (tmp_status, tmp_result) = self.exchange(&apdu_continue(vec![])).await?;
+
+        if tmp_status != StatusWord::InterruptedExecution {
+            return Err(VAppEngineError::InterruptedExecutionExpected);
+        }
+
+        let data = CommitPageContentMessage::deserialize_borrowed(&tmp_result)?;
+
         let segment = match msg.section_kind {
             SectionKind::Code => {
                 return Err(VAppEngineError::AccessViolation);
@@ -345,56 +553,42 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
             SectionKind::Stack => &mut self.stack_seg,
         };
 
-        // get the next message, which contains the content of the page
-        let (tmp_status, tmp_result) = self
-            .transport
-            .exchange(&apdu_continue(vec![]))
-            .await
-            .map_err(VAppEngineError::TransportError)?;
-
-        if tmp_status != StatusWord::InterruptedExecution {
-            return Err(VAppEngineError::InterruptedExecutionExpected);
-        }
-
-        let CommitPageContentMessage {
-            command_code: _,
-            data,
-        } = CommitPageContentMessage::deserialize(&tmp_result)?;
-
-        let update_proof = segment.store_page(msg.page_index, &data)?;
+        segment.store_page(msg.page_index, data)?;
+        self.buffers.put(tmp_result);
 
         // TODO: for now we ignore the update proof
 
-        Ok(self
-            .transport
-            .exchange(&apdu_continue(vec![]))
-            .await
-            .map_err(VAppEngineError::TransportError)?)
+        self.exchange(&apdu_continue(vec![])).await
     }
 
-    // receive a buffer sent by the V-App via xsend; send it to the VappEngine
-    async fn process_send_buffer(
+    // Reassembles a buffer that the V-App sends in chunks (via xsend, or while panicking), starting
+    // from the first chunk, contained in `command`.
+    async fn receive_chunked_buffer(
         &mut self,
         command: &[u8],
-    ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
-        let SendBufferMessage {
-            command_code: _,
-            total_remaining_size: mut remaining_len,
-            data: mut buf,
-        } = SendBufferMessage::deserialize(command)?;
+        deserialize: fn(&[u8]) -> Result<(u32, &[u8]), MessageDeserializationError>,
+    ) -> Result<Vec<u8>, VAppEngineError<E>> {
+        let (mut remaining_len, data) = deserialize(command)?;
 
-        if (buf.len() as u32) > remaining_len {
+        // the buffer is in the memory of the V-App, therefore it fits in one of its segments
+        if remaining_len as usize > self.max_vapp_buffer_len() {
             return Err(VAppEngineError::ResponseError(
-                "Received data length exceeds expected remaining length",
+                "Received length exceeds the memory of the V-App",
             ));
         }
 
-        remaining_len -= buf.len() as u32;
+        // the total length is known from the first chunk, so short buffers are only allocated once
+        let mut buf = Vec::with_capacity(min(remaining_len as usize, MAX_PREALLOCATED_BUFFER_SIZE));
+        buf.extend_from_slice(data);
+        remaining_len =
+            remaining_len
+                .checked_sub(data.len() as u32)
+                .ok_or(VAppEngineError::ResponseError(
+                    "Received data length exceeds expected remaining length",
+                ))?;
 
         while remaining_len > 0 {
-            let (status, result) = self
-                .exchange_and_process_page_requests(&apdu_continue(vec![]))
-                .await?;
+            let (status, result) = self.continue_and_process_page_requests().await?;
 
             if status != StatusWord::InterruptedExecution {
                 return Err(VAppEngineError::InterruptedExecutionExpected);
@@ -403,26 +597,56 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
                 return Err(VAppEngineError::ResponseError("Empty response"));
             }
 
-            let msg = SendBufferMessage::deserialize(&result)?;
+            let (total_remaining_size, data) = deserialize(&result)?;
 
-            if msg.total_remaining_size != remaining_len {
+            if total_remaining_size != remaining_len {
                 return Err(VAppEngineError::ResponseError(
                     "Received total_remaining_size does not match expected",
                 ));
             }
 
-            buf.extend_from_slice(&msg.data);
-            remaining_len -= msg.data.len() as u32;
+            buf.extend_from_slice(data);
+            remaining_len = remaining_len.checked_sub(data.len() as u32).ok_or(
+                VAppEngineError::ResponseError(
+                    "Received data length exceeds expected remaining length",
+                ),
+            )?;
+            self.buffers.put(result);
         }
 
+        Ok(buf)
+    }
+
+    // Returns the size of the largest memory segment of the V-App, that bounds the length of any
+    // buffer that the V-App can send.
+    fn max_vapp_buffer_len(&self) -> usize {
+        let m = &self.manifest;
+        [
+            m.code_end - m.code_start,
+            m.data_end - m.data_start,
+            m.stack_end - m.stack_start,
+        ]
+        .into_iter()
+        .max()
+        .unwrap_or(0) as usize
+    }
+
+    // receive a buffer sent by the V-App via xsend; send it to the VappEngine
+    async fn process_send_buffer(
+        &mut self,
+        command: &[u8],
+    ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
+        let buf = self
+            .receive_chunked_buffer(command, SendBufferMessage::deserialize_borrowed)
+            .await?;
+
         // Send the buffer back to the client via engine_to_client_sender
         self.engine_to_client_sender
             .send(VAppMessage::SendBuffer(buf))
             .await
             .map_err(|e| VAppEngineError::GenericError(Box::new(e)))?;
 
-        self.exchange_and_process_page_requests(&apdu_continue(vec![]))
-            .await
+        self.continue_and_process_page_requests().await
     }
 
     // the V-App is expecting a buffer via xrecv; get it from the VAppEngine, and send it to the V-App
@@ -441,21 +665,31 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
                 "Failed to receive buffer from client",
             ))?;
 
+        self.send_buffer_to_vapp(&bytes).await
+    }
+
+    // Sends a buffer to the V-App, that just sent a ReceiveBufferMessage, in as many
+    // ReceiveBufferResponse as needed.
+    async fn send_buffer_to_vapp(
+        &mut self,
+        bytes: &[u8],
+    ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
         let mut remaining_len = bytes.len() as u32;
         let mut offset: usize = 0;
 
         loop {
             // TODO: check if correct when the buffer is long
             let chunk_len = min(remaining_len, 255 - 4);
-            let data = ReceiveBufferResponse::new(
+            let mut data = self.buffers.get();
+            ReceiveBufferResponse::serialize_borrowed_with(
                 remaining_len,
-                bytes[offset..offset + chunk_len as usize].to_vec(),
-            )
-            .serialize();
+                &bytes[offset..offset + chunk_len as usize],
+                |part| data.extend_from_slice(part),
+            );
 
-            let (status, result) = self
-                .exchange_and_process_page_requests(&apdu_continue(data))
-                .await?;
+            let apdu = apdu_continue(data);
+            let (status, result) = self.exchange_and_process_page_requests(&apdu).await?;
+            self.buffers.put(apdu.data);
 
             remaining_len -= chunk_len;
             offset += chunk_len as usize;
@@ -472,52 +706,55 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
                     return Err(VAppEngineError::ResponseError("Empty response"));
                 }
                 ReceiveBufferMessage::deserialize(&result)?;
+                self.buffers.put(result);
             }
         }
     }
 
-    // receive a buffer sent by the V-App during a panic; send it to the VAppEngine
-    // TODO: almost identical to process_send_buffer; it might be nice to refactor
-    async fn process_send_panic_buffer(
+    // the V-App sends a request to the handler registered for its request id; the reply is then
+    // sent as for a ReceiveBufferMessage
+    async fn process_client_call(
         &mut self,
         command: &[u8],
     ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
-        let SendPanicBufferMessage {
-            command_code: _,
-            total_remaining_size: mut remaining_len,
-            data: mut buf,
-        } = SendPanicBufferMessage::deserialize(command)?;
+        let (request_id, _, _) = ClientCallMessage::deserialize_borrowed(command)?;
+        let payload = self
+            .receive_chunked_buffer(command, |data| {
+                ClientCallMessage::deserialize_borrowed(data)
+                    .map(|(_, total_remaining_size, data)| (total_remaining_size, data))
+            })
+            .await?;
+
+        let handler = self
+            .client_call_handlers
+            .read()
+            .unwrap()
+            .get(&request_id)
+            .cloned()
+            .ok_or(VAppEngineError::ResponseError(
+                "No handler registered for the client call",
+            ))?;
+        let reply = handler.handle(&payload).await?;
 
-        if (buf.len() as u32) > remaining_len {
-            return Err(VAppEngineError::ResponseError(
-                "Received data length exceeds expected remaining length",
-            ));
+        // the V-App now requests the reply
+        let (status, result) = self.continue_and_process_page_requests().await?;
+        if status != StatusWord::InterruptedExecution {
+            return Err(VAppEngineError::InterruptedExecutionExpected);
         }
+        ReceiveBufferMessage::deserialize(&result)?;
+        self.buffers.put(result);
 
-        remaining_len -= buf.len() as u32;
-
-        while remaining_len > 0 {
-            let (status, result) = self
-                .exchange_and_process_page_requests(&apdu_continue(vec![]))
-                .await?;
-
-            if status != StatusWord::InterruptedExecution {
-                return Err(VAppEngineError::InterruptedExecutionExpected);
-            }
-            if result.len() == 0 {
-                return Err(VAppEngineError::ResponseError("Empty response"));
-            }
-            let msg = SendPanicBufferMessage::deserialize(&result)?;
-
-            if msg.total_remaining_size != remaining_len {
-                return Err(VAppEngineError::ResponseError(
-                    "Received total_remaining_size does not match expected",
-                ));
-            }
+        self.send_buffer_to_vapp(&reply).await
+    }
 
-            buf.extend_from_slice(&msg.data);
-            remaining_len -= msg.data.len() as u32;
-        }
+    // receive a buffer sent by the V-App during a panic; send it to the VAppEngine
+    async fn process_send_panic_buffer(
+        &mut self,
+        command: &[u8],
+    ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
+        let buf = self
+            .receive_chunked_buffer(command, SendPanicBufferMessage::deserialize_borrowed)
+            .await?;
 
         let panic_message =
             String::from_utf8(buf).map_err(|e| VAppEngineError::GenericError(Box::new(e)))?;
@@ -529,8 +766,45 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
             .map_err(|e| VAppEngineError::GenericError(Box::new(e)))?;
 
         // Continue processing
-        self.exchange_and_process_page_requests(&apdu_continue(vec![]))
-            .await
+        self.continue_and_process_page_requests().await
+    }
+
+    // The V-App took a checkpoint, after committing all its modified pages: the segments are now
+    // the ones to resume from, together with the state of the CPU.
+    async fn process_checkpoint(
+        &mut self,
+        command: &[u8],
+    ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
+        let CheckpointMessage { checkpoint, .. } = CheckpointMessage::deserialize(command)?;
+
+        let snapshot = VAppSnapshot {
+            manifest: self.manifest.clone(),
+            checkpoint,
+            data_root: self.data_seg.root(),
+            stack_root: self.stack_seg.root(),
+            data_pages: self.data_seg.stored_pages(),
+            stack_pages: self.stack_seg.stored_pages(),
+        };
+        *self.latest_snapshot.lock().unwrap() = Some(snapshot);
+
+        self.exchange(&apdu_continue(vec![])).await
+    }
+
+    // The VM is resuming the V-App, and requests the state of the CPU at the checkpoint.
+    async fn process_get_checkpoint(
+        &mut self,
+        command: &[u8],
+    ) -> Result<(StatusWord, Vec<u8>), VAppEngineError<E>> {
+        GetCheckpointMessage::deserialize(command)?;
+
+        let checkpoint = self
+            .resume_from
+            .take()
+            .ok_or(VAppEngineError::ResponseError(
+                "No checkpoint to resume from",
+            ))?;
+
+        self.exchange(&apdu_continue(checkpoint.serialize())).await
     }
 
     async fn busy_loop(
@@ -576,7 +850,7 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
                 .try_into()
                 .map_err(|_| VAppEngineError::InvalidCommandCode)?;
 
-            (status, result) = match client_command_code {
+            let (new_status, new_result) = match client_command_code {
                 ClientCommandCode::GetPage => self.process_get_page(&result).await?,
                 ClientCommandCode::CommitPage => self.process_commit_page(&result).await?,
                 ClientCommandCode::CommitPageContent => {
@@ -590,7 +864,12 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppEngine<E> {
                 ClientCommandCode::SendPanicBuffer => {
                     self.process_send_panic_buffer(&result).await?
                 }
-            }
+                ClientCommandCode::Checkpoint => self.process_checkpoint(&result).await?,
+                ClientCommandCode::GetCheckpoint => self.process_get_checkpoint(&result).await?,
+                ClientCommandCode::ClientCall => self.process_client_call(&result).await?,
+            };
+            status = new_status;
+            self.buffers.put(std::mem::replace(&mut result, new_result));
         }
     }
 }
@@ -599,6 +878,8 @@ struct GenericVanadiumClient<E: std::fmt::Debug + Send + Sync + 'static> {
     client_to_engine_sender: Option<mpsc::Sender<ClientMessage>>,
     engine_to_client_receiver: Option<Mutex<mpsc::Receiver<VAppMessage>>>,
     vapp_engine_handle: Option<JoinHandle<Result<(), VAppEngineError<E>>>>,
+    latest_snapshot: Arc<std::sync::Mutex<Option<VAppSnapshot>>>,
+    client_call_handlers: ClientCallHandlers,
 }
 
 #[derive(Debug)]
@@ -636,6 +917,8 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> GenericVanadiumClient<E> {
             client_to_engine_sender: None,
             engine_to_client_receiver: None,
             vapp_engine_handle: None,
+            latest_snapshot: Arc::new(std::sync::Mutex::new(None)),
+            client_call_handlers: Arc::new(std::sync::RwLock::new(HashMap::new())),
         }
     }
 
@@ -671,42 +954,146 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> GenericVanadiumClient<E> {
         manifest: &Manifest,
         app_hmac: &[u8; 32],
         elf: &ElfFile,
+        code_cache: Option<&CodeSegmentCache>,
+        snapshot: Option<&VAppSnapshot>,
     ) -> Result<(), VAppEngineError<E>> {
-        let mut data = postcard::to_allocvec(manifest)?;
-        data.extend_from_slice(app_hmac);
-
-        // Create the memory segments for the code, data, and stack sections
-        let code_seg = MemorySegment::new(elf.code_segment.start, &elf.code_segment.data);
-        let data_seg = MemorySegment::new(elf.data_segment.start, &elf.data_segment.data);
-        let stack_seg = MemorySegment::new(
-            manifest.stack_start,
-            &vec![0; (manifest.stack_end - manifest.stack_start) as usize],
-        );
+        if let Some(snapshot) = snapshot {
+            if postcard::to_allocvec(&snapshot.manifest)? != postcard::to_allocvec(manifest)? {
+                return Err(VAppEngineError::GenericError(
+                    "The snapshot was taken by a different V-App".into(),
+                ));
+            }
+        }
 
         let (client_to_engine_sender, client_to_engine_receiver) =
             mpsc::channel::<ClientMessage>(10);
         let (engine_to_client_sender, engine_to_client_receiver) = mpsc::channel::<VAppMessage>(10);
 
+        // Start the VAppEngine in a task, using the hash function of the manifest for the memory segments
+        let vapp_engine_handle = match manifest.mt_hash_kind {
+            MerkleHashKind::Sha256 => Self::spawn_vapp_engine::<Sha256Hasher>(
+                transport,
+                manifest,
+                app_hmac,
+                elf,
+                code_cache,
+                snapshot,
+                self.latest_snapshot.clone(),
+                self.client_call_handlers.clone(),
+                engine_to_client_sender,
+                client_to_engine_receiver,
+            )?,
+            MerkleHashKind::Blake2s256 => Self::spawn_vapp_engine::<Blake2s256Hasher>(
+                transport,
+                manifest,
+                app_hmac,
+                elf,
+                code_cache,
+                snapshot,
+                self.latest_snapshot.clone(),
+                self.client_call_handlers.clone(),
+                engine_to_client_sender,
+                client_to_engine_receiver,
+            )?,
+        };
+
+        // Store the senders and receivers
+        self.client_to_engine_sender = Some(client_to_engine_sender);
+        self.engine_to_client_receiver = Some(Mutex::new(engine_to_client_receiver));
+        self.vapp_engine_handle = Some(vapp_engine_handle);
+
+        Ok(())
+    }
+
+    fn spawn_vapp_engine<H: Hasher<32> + Send + Sync + 'static>(
+        transport: Arc<dyn Transport<Error = E>>,
+        manifest: &Manifest,
+        app_hmac: &[u8; 32],
+        elf: &ElfFile,
+        code_cache: Option<&CodeSegmentCache>,
+        snapshot: Option<&VAppSnapshot>,
+        latest_snapshot: Arc<std::sync::Mutex<Option<VAppSnapshot>>>,
+        client_call_handlers: ClientCallHandlers,
+        engine_to_client_sender: mpsc::Sender<VAppMessage>,
+        client_to_engine_receiver: mpsc::Receiver<ClientMessage>,
+    ) -> Result<JoinHandle<Result<(), VAppEngineError<E>>>, VAppEngineError<E>> {
+        // Create the memory segments for the code, data, and stack sections
+        let code_seg = match code_cache {
+            Some(code_cache) => code_cache.get_or_insert::<H>(elf),
+            None => Arc::new(MemorySegment::<H>::new(
+                elf.code_segment.start,
+                elf.code_segment.end,
+                elf.code_segment.data(),
+            )),
+        };
+        let (data_seg, stack_seg) = match snapshot {
+            None => (
+                MemorySegment::<H>::new_sparse(
+                    elf.data_segment.start,
+                    elf.data_segment.end,
+                    elf.data_segment.data(),
+                ),
+                MemorySegment::<H>::new_sparse(manifest.stack_start, manifest.stack_end, &[]),
+            ),
+            Some(snapshot) => {
+                let data_seg = MemorySegment::<H>::from_stored_pages(
+                    elf.data_segment.start,
+                    elf.data_segment.end,
+                    &snapshot.data_pages,
+                )?;
+                let stack_seg = MemorySegment::<H>::from_stored_pages(
+                    manifest.stack_start,
+                    manifest.stack_end,
+                    &snapshot.stack_pages,
+                )?;
+                if data_seg.root() != snapshot.data_root || stack_seg.root() != snapshot.stack_root
+                {
+                    return Err(VAppEngineError::GenericError(
+                        "The content of the snapshot does not match its Merkle roots".into(),
+                    ));
+                }
+                (data_seg, stack_seg)
+            }
+        };
+
         let vapp_engine = VAppEngine {
             manifest: manifest.clone(),
             code_seg,
             data_seg,
             stack_seg,
+            resume_from: snapshot.map(|snapshot| snapshot.checkpoint.clone()),
+            latest_snapshot,
+            client_call_handlers,
+            buffers: BufferPool::new(),
             transport,
             engine_to_client_sender,
             client_to_engine_receiver,
         };
 
-        // Start the VAppEngine in a task
-        let app_hmac_clone = *app_hmac;
-        let vapp_engine_handle = tokio::spawn(async move { vapp_engine.run(app_hmac_clone).await });
+        let app_hmac = *app_hmac;
+        Ok(tokio::spawn(async move { vapp_engine.run(app_hmac).await }))
+    }
 
-        // Store the senders and receivers
-        self.client_to_engine_sender = Some(client_to_engine_sender);
-        self.engine_to_client_receiver = Some(Mutex::new(engine_to_client_receiver));
-        self.vapp_engine_handle = Some(vapp_engine_handle);
+    // Stops the communication with the VAppEngine, and waits until it terminates.
+    async fn close(&mut self) {
+        self.client_to_engine_sender = None;
+        self.engine_to_client_receiver = None;
+        if let Some(handle) = self.vapp_engine_handle.take() {
+            let _ = handle.await;
+        }
+    }
 
-        Ok(())
+    // Returns the snapshot at the last checkpoint taken by the V-App, if any.
+    fn snapshot(&self) -> Option<VAppSnapshot> {
+        self.latest_snapshot.lock().unwrap().clone()
+    }
+
+    // Registers the handler of the client calls with the given request id, replacing any previous one.
+    fn register_client_call_handler(&self, request_id: u32, handler: Arc<dyn ClientCallHandler>) {
+        self.client_call_handlers
+            .write()
+            .unwrap()
+            .insert(request_id, handler);
     }
 
     pub async fn send_message(&mut self, message: &[u8]) -> Result<Vec<u8>, VanadiumClientError> {
@@ -784,11 +1171,18 @@ pub trait VAppClient {
     /// or a `VAppExecutionError` if an error occurs.
 
     async fn send_message(&mut self, msg: &[u8]) -> Result<Vec<u8>, VAppExecutionError>;
+
+    /// Returns true if the app declared its support for the streamed framing of the `comm`
+    /// protocol. Otherwise, messages are sent with the original framing.
+    fn supports_streamed_framing(&self) -> bool {
+        false
+    }
 }
 
 /// Implementation of a VAppClient using the Vanadium VM.
 pub struct VanadiumAppClient<E: std::fmt::Debug + Send + Sync + 'static> {
     client: GenericVanadiumClient<E>,
+    streamed_framing: bool,
 }
 
 #[derive(Debug)]
@@ -821,14 +1215,98 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> From<VAppEngineError<E>>
 }
 
 impl<E: std::fmt::Debug + Send + Sync + 'static> VanadiumAppClient<E> {
+    /// Starts the V-App in the ELF file at `elf_path`, building its Merkle trees with SHA-256. Use
+    /// `from_elf` to choose another hash function.
     pub async fn new(
         elf_path: &str,
         transport: Arc<dyn Transport<Error = E>>,
         app_hmac: Option<[u8; 32]>,
     ) -> Result<(Self, [u8; 32]), Box<dyn std::error::Error + Send + Sync>> {
-        // Create ELF file and manifest
         let elf_file = ElfFile::new(Path::new(&elf_path))?;
-        let manifest = Manifest::new(
+        Self::from_elf(&elf_file, transport, app_hmac, None, MerkleHashKind::Sha256).await
+    }
+
+    /// Like `new`, but from an already parsed ELF file, and with the hash function of the Merkle
+    /// trees given by `mt_hash_kind`. If `code_cache` is given, the code segment is taken from it
+    /// (or added to it), rather than being computed for this client only.
+    pub async fn from_elf(
+        elf_file: &ElfFile,
+        transport: Arc<dyn Transport<Error = E>>,
+        app_hmac: Option<[u8; 32]>,
+        code_cache: Option<&CodeSegmentCache>,
+        mt_hash_kind: MerkleHashKind,
+    ) -> Result<(Self, [u8; 32]), Box<dyn std::error::Error + Send + Sync>> {
+        let manifest = Self::manifest_for_elf(elf_file, mt_hash_kind)?;
+
+        let mut client = GenericVanadiumClient::new();
+
+        // Register the V-App if the hmac was not given
+        let app_hmac =
+            app_hmac.unwrap_or(client.register_vapp(transport.clone(), &manifest).await?);
+
+        // run the V-App
+        client.run_vapp(transport, &manifest, &app_hmac, elf_file, code_cache, None)?;
+
+        Ok((
+            Self {
+                client,
+                streamed_framing: elf_file.streamed_framing,
+            },
+            app_hmac,
+        ))
+    }
+
+    /// Like `from_elf`, but resumes the V-App from a snapshot taken in a previous run, instead of
+    /// starting it from its entrypoint. The V-App must have been registered already, and the
+    /// snapshot must have been taken by the same V-App.
+    pub async fn resume_from_elf(
+        elf_file: &ElfFile,
+        transport: Arc<dyn Transport<Error = E>>,
+        app_hmac: [u8; 32],
+        snapshot: &VAppSnapshot,
+        code_cache: Option<&CodeSegmentCache>,
+    ) -> Result<Self, Box<dyn std::error::Error + Send + Sync>> {
+        // the hash function of the Merkle trees is the one the snapshot was taken with
+        let manifest = Self::manifest_for_elf(elf_file, snapshot.manifest.mt_hash_kind)?;
+
+        let mut client = GenericVanadiumClient::new();
+        client.run_vapp(
+            transport,
+            &manifest,
+            &app_hmac,
+            elf_file,
+            code_cache,
+            Some(snapshot),
+        )?;
+
+        Ok(Self {
+            client,
+            streamed_framing: elf_file.streamed_framing,
+        })
+    }
+
+    /// Returns the snapshot at the last checkpoint taken by the V-App, if any. It can be used to
+    /// resume the V-App from that point with `resume_from_elf`.
+    pub fn snapshot(&self) -> Option<VAppSnapshot> {
+        self.client.snapshot()
+    }
+
+    /// Registers the handler of the requests that the V-App sends with `client_call` for the given
+    /// request id, replacing any previous one. Handlers can be registered while the V-App is running.
+    pub fn register_client_call_handler(
+        &self,
+        request_id: u32,
+        handler: impl ClientCallHandler + 'static,
+    ) {
+        self.client
+            .register_client_call_handler(request_id, Arc::new(handler));
+    }
+
+    fn manifest_for_elf(
+        elf_file: &ElfFile,
+        mt_hash_kind: MerkleHashKind,
+    ) -> Result<Manifest, &'static str> {
+        Manifest::new(
             0,
             "Test",
             "0.1.0",
@@ -843,18 +1321,14 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VanadiumAppClient<E> {
             elf_file.data_segment.end,
             [0u8; 32],
             0,
-        )?;
-
-        let mut client = GenericVanadiumClient::new();
-
-        // Register the V-App if the hmac was not given
-        let app_hmac =
-            app_hmac.unwrap_or(client.register_vapp(transport.clone(), &manifest).await?);
-
-        // run the V-App
-        client.run_vapp(transport, &manifest, &app_hmac, &elf_file)?;
+            mt_hash_kind,
+        )
+    }
 
-        Ok((Self { client }, app_hmac))
+    /// Stops the communication with the V-App, and waits until the client is done with the
+    /// transport. The V-App might still be running on the device, if it did not exit.
+    pub async fn close(mut self) {
+        self.client.close().await;
     }
 }
 
@@ -869,6 +1343,10 @@ impl<E: std::fmt::Debug + Send + Sync + 'static> VAppClient for VanadiumAppClien
             Err(e) => Err(VAppExecutionError::Other(Box::new(e))),
         }
     }
+
+    fn supports_streamed_framing(&self) -> bool {
+        self.streamed_framing
+    }
 }
 
 /// Implementation of a VAppClient for a native app running on the host, and communicating
@@ -0,0 +1,154 @@
+//! Benchmarks of the Merkle accumulators, with pages of memory as elements, for segments of
+//! different sizes.
+
+use criterion::{black_box, criterion_group, criterion_main, BatchSize, BenchmarkId, Criterion};
+use sha2::{Digest, Sha256};
+
+use common::accumulator::{Hasher, MerkleAccumulator, SparseMerkleAccumulator, VectorAccumulator};
+use common::constants::PAGE_SIZE;
+
+struct Sha256Hasher {
+    hasher: Sha256,
+}
+
+impl Hasher<32> for Sha256Hasher {
+    fn new() -> Self {
+        Sha256Hasher {
+            hasher: Sha256::new(),
+        }
+    }
+
+    fn update(&mut self, data: &[u8]) {
+        self.hasher.update(data);
+    }
+
+    fn finalize(self) -> [u8; 32] {
+        self.hasher.finalize().into()
+    }
+}
+
+type Page = [u8; PAGE_SIZE];
+type PageAccumulator = MerkleAccumulator<Sha256Hasher, Page, 32>;
+type SparsePageAccumulator = SparseMerkleAccumulator<Sha256Hasher, Page, 32>;
+
+// Number of pages of the segments: from a small data segment to a 1 MiB code segment
+const SIZES: [usize; 4] = [16, 256, 1024, 4096];
+
+fn pages(n: usize) -> Vec<Page> {
+    (0..n)
+        .map(|i| {
+            let mut page = [0u8; PAGE_SIZE];
+            page[..4].copy_from_slice(&(i as u32).to_be_bytes());
+            page
+        })
+        .collect()
+}
+
+fn bench_new(c: &mut Criterion) {
+    let mut group = c.benchmark_group("accumulator/new");
+    for size in SIZES {
+        group.bench_with_input(BenchmarkId::new("dense", size), &size, |b, &size| {
+            b.iter_batched(
+                || pages(size),
+                |pages| PageAccumulator::new(pages),
+                BatchSize::LargeInput,
+            )
+        });
+        group.bench_with_input(BenchmarkId::new("sparse", size), &size, |b, &size| {
+            b.iter(|| SparsePageAccumulator::new_uniform(size, [0u8; PAGE_SIZE]))
+        });
+    }
+    group.finish();
+}
+
+fn bench_prove(c: &mut Criterion) {
+    let mut group = c.benchmark_group("accumulator/prove");
+    for size in SIZES {
+        let acc = PageAccumulator::new(pages(size));
+        group.bench_with_input(BenchmarkId::new("single", size), &size, |b, &size| {
+            b.iter(|| acc.prove(black_box(size / 2)).unwrap())
+        });
+
+        let indices: Vec<usize> = (0..size).step_by(size / 8).collect();
+        group.bench_with_input(BenchmarkId::new("many_8", size), &indices, |b, indices| {
+            b.iter(|| acc.prove_many(black_box(indices)).unwrap())
+        });
+    }
+    group.finish();
+}
+
+fn bench_update(c: &mut Criterion) {
+    let mut group = c.benchmark_group("accumulator/update");
+    for size in SIZES {
+        let mut dense = PageAccumulator::new(pages(size));
+        let mut sparse = SparsePageAccumulator::new_uniform(size, [0u8; PAGE_SIZE]);
+        let mut counter = 0u8;
+        group.bench_with_input(BenchmarkId::new("dense", size), &size, |b, &size| {
+            b.iter(|| {
+                counter = counter.wrapping_add(1);
+                dense.update(size / 2, [counter; PAGE_SIZE]).unwrap()
+            })
+        });
+        group.bench_with_input(BenchmarkId::new("sparse", size), &size, |b, &size| {
+            b.iter(|| {
+                counter = counter.wrapping_add(1);
+                sparse.update(size / 2, [counter; PAGE_SIZE]).unwrap()
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_verify(c: &mut Criterion) {
+    let mut group = c.benchmark_group("accumulator/verify");
+    for size in SIZES {
+        let mut acc = PageAccumulator::new(pages(size));
+        let index = size / 2;
+        let old_value = *acc.get(index).unwrap();
+
+        let root = acc.root();
+        let proof = acc.prove(index).unwrap();
+        group.bench_with_input(BenchmarkId::new("inclusion", size), &size, |b, &size| {
+            b.iter(|| {
+                assert!(PageAccumulator::verify_inclusion_proof(
+                    &root, &proof, &old_value, index, size
+                ))
+            })
+        });
+
+        let indices: Vec<usize> = (0..size).step_by(size / 8).collect();
+        let elements: Vec<(usize, &Page)> =
+            indices.iter().map(|&i| (i, acc.get(i).unwrap())).collect();
+        let multiproof = acc.prove_many(&indices).unwrap();
+        group.bench_with_input(BenchmarkId::new("many_8", size), &size, |b, &size| {
+            b.iter(|| {
+                assert!(PageAccumulator::verify_many(
+                    &root,
+                    &multiproof,
+                    &elements,
+                    size
+                ))
+            })
+        });
+
+        let new_value = [0xffu8; PAGE_SIZE];
+        let update_proof = acc.update(index, new_value).unwrap();
+        let new_root = acc.root();
+        group.bench_with_input(BenchmarkId::new("update", size), &size, |b, &size| {
+            b.iter(|| {
+                assert!(PageAccumulator::verify_update_proof(
+                    &new_root,
+                    &update_proof,
+                    &old_value,
+                    &new_value,
+                    index,
+                    size
+                ))
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_new, bench_prove, bench_update, bench_verify);
+criterion_main!(benches);
@@ -0,0 +1,106 @@
+//! Benchmarks of the serialization and deserialization of the messages exchanged between the VM
+//! and the client, for the messages on the hot paths: paging and buffer transfers.
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion};
+
+use common::client_commands::{
+    CheckpointMessage, CommitPageContentMessage, CommitPageMessage, GetPageMessage, Message,
+    ReceiveBufferResponse, SectionKind, SendBufferMessage, VAppCheckpoint,
+};
+use common::constants::PAGE_SIZE;
+
+// Maximum size of the chunk of a buffer in a single message
+const CHUNK_SIZE: usize = 255 - 4;
+
+fn bench_page_messages(c: &mut Criterion) {
+    let mut group = c.benchmark_group("client_commands/page");
+
+    let get_page = GetPageMessage::new(SectionKind::Code, 1234);
+    let serialized = get_page.serialize();
+    group.bench_function("get_page/serialize", |b| {
+        b.iter(|| black_box(&get_page).serialize())
+    });
+    group.bench_function("get_page/deserialize", |b| {
+        b.iter(|| GetPageMessage::deserialize(black_box(&serialized)).unwrap())
+    });
+
+    let commit_page = CommitPageMessage::new(SectionKind::Stack, 42);
+    let serialized = commit_page.serialize();
+    group.bench_function("commit_page/serialize", |b| {
+        b.iter(|| black_box(&commit_page).serialize())
+    });
+    group.bench_function("commit_page/deserialize", |b| {
+        b.iter(|| CommitPageMessage::deserialize(black_box(&serialized)).unwrap())
+    });
+
+    let content = CommitPageContentMessage::new(vec![0xa5; PAGE_SIZE]);
+    let serialized = content.serialize();
+    let mut buffer = Vec::with_capacity(PAGE_SIZE + 1);
+    group.bench_function("commit_page_content/serialize", |b| {
+        b.iter(|| black_box(&content).serialize())
+    });
+    group.bench_function("commit_page_content/serialize_into", |b| {
+        b.iter(|| {
+            buffer.clear();
+            black_box(&content).serialize_with(|data| buffer.extend_from_slice(data));
+        })
+    });
+    group.bench_function("commit_page_content/deserialize", |b| {
+        b.iter(|| CommitPageContentMessage::deserialize(black_box(&serialized)).unwrap())
+    });
+    group.bench_function("commit_page_content/deserialize_borrowed", |b| {
+        b.iter(|| CommitPageContentMessage::deserialize_borrowed(black_box(&serialized)).unwrap())
+    });
+
+    group.finish();
+}
+
+fn bench_buffer_messages(c: &mut Criterion) {
+    let mut group = c.benchmark_group("client_commands/buffer");
+
+    let chunk = vec![0x5a; CHUNK_SIZE];
+    let mut buffer = Vec::with_capacity(CHUNK_SIZE + 5);
+    group.bench_function("send_buffer/serialize_borrowed", |b| {
+        b.iter(|| {
+            buffer.clear();
+            SendBufferMessage::serialize_borrowed_with(4096, black_box(&chunk), |data| {
+                buffer.extend_from_slice(data)
+            });
+        })
+    });
+    let serialized = SendBufferMessage::new(4096, chunk.clone()).serialize();
+    group.bench_function("send_buffer/deserialize_borrowed", |b| {
+        b.iter(|| SendBufferMessage::deserialize_borrowed(black_box(&serialized)).unwrap())
+    });
+
+    group.bench_function("receive_buffer_response/serialize_borrowed", |b| {
+        b.iter(|| {
+            buffer.clear();
+            ReceiveBufferResponse::serialize_borrowed_with(4096, black_box(&chunk), |data| {
+                buffer.extend_from_slice(data)
+            });
+        })
+    });
+    let serialized = ReceiveBufferResponse::new(4096, chunk.clone()).serialize();
+    group.bench_function("receive_buffer_response/deserialize_borrowed", |b| {
+        b.iter(|| ReceiveBufferResponse::deserialize_borrowed(black_box(&serialized)).unwrap())
+    });
+
+    let checkpoint = CheckpointMessage::new(VAppCheckpoint {
+        pc: 0x10000,
+        regs: [0x12345678; 32],
+        hmac: [0x42; 32],
+    });
+    let serialized = checkpoint.serialize();
+    group.bench_function("checkpoint/serialize", |b| {
+        b.iter(|| black_box(&checkpoint).serialize())
+    });
+    group.bench_function("checkpoint/deserialize", |b| {
+        b.iter(|| CheckpointMessage::deserialize(black_box(&serialized)).unwrap())
+    });
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_page_messages, bench_buffer_messages);
+criterion_main!(benches);
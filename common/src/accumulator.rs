@@ -1,4 +1,3 @@
-
 //! This module provides a generic framework, and a Merkle-tree based implementation,
 //! for vector accumulators. This allows a party (the verifier) to outsource the storage
 //! of the vector to another party (the prover). The verifier only maintains a single
@@ -7,27 +6,31 @@
 //! Each retrieval or update operation is guaranteed by an accompanied proof, that is
 //! produced by the prover.
 
-use alloc::{vec, vec::Vec};
+use alloc::{
+    collections::{BTreeMap, BTreeSet},
+    vec,
+    vec::Vec,
+};
 use core::{error::Error, fmt, marker::PhantomData};
-use serde::{Serialize, Deserialize, Serializer, Deserializer, de::DeserializeOwned};
-
+use serde::{de::DeserializeOwned, Deserialize, Deserializer, Serialize, Serializer};
 
 #[derive(Debug)]
 pub enum AccumulatorError {
     IndexOutOfBounds,
+    DuplicateIndex,
 }
 
 impl fmt::Display for AccumulatorError {
     fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
         match self {
             AccumulatorError::IndexOutOfBounds => write!(f, "Index out of bounds"),
+            AccumulatorError::DuplicateIndex => write!(f, "Duplicate index"),
         }
     }
 }
 
 impl Error for AccumulatorError {}
 
-
 /// A trait representing a cryptographic hasher that produces a fixed-size output.
 pub trait Hasher<const OUTPUT_SIZE: usize>: Sized {
     /// Creates a new instance of the hasher.
@@ -42,7 +45,7 @@ pub trait Hasher<const OUTPUT_SIZE: usize>: Sized {
 
     /// Finalizes the hashing process and returns the output as an array of bytes.
     fn finalize(self) -> [u8; OUTPUT_SIZE];
-    
+
     /// Convenience method to hash data in a single step.
     ///
     /// # Arguments
@@ -57,6 +60,38 @@ pub trait Hasher<const OUTPUT_SIZE: usize>: Sized {
         hasher.update(data);
         hasher.finalize()
     }
+
+    /// Computes the hash for a leaf of a Merkle tree. A 0x00 byte is prepended to the data before hashing it.
+    ///
+    /// Implementations can override this method if they can compute the same hash more efficiently.
+    fn hash_leaf(data: &[u8]) -> [u8; OUTPUT_SIZE] {
+        let mut hasher = Self::new();
+        hasher.update(&[0x00]);
+        hasher.update(data);
+        hasher.finalize()
+    }
+
+    /// Computes the hash for an internal node of a Merkle tree. A 0x01 byte is prepended to the
+    /// concatenation of the children before hashing it.
+    ///
+    /// Implementations can override this method if they can compute the same hash more efficiently.
+    fn hash_internal_node(
+        left: &[u8; OUTPUT_SIZE],
+        right: &[u8; OUTPUT_SIZE],
+    ) -> [u8; OUTPUT_SIZE] {
+        let mut hasher = Self::new();
+        hasher.update(&[0x01]);
+        hasher.update(left);
+        hasher.update(right);
+        hasher.finalize()
+    }
+}
+
+/// The hash function used to build the Merkle trees of the memory of a V-App.
+#[derive(Serialize, Deserialize, Debug, Clone, Copy, PartialEq, Eq)]
+pub enum MerkleHashKind {
+    Sha256,
+    Blake2s256,
 }
 
 /// A wrapper type for fixed-size byte arrays used to represent hash outputs.
@@ -81,20 +116,28 @@ impl<'de, const N: usize> Deserialize<'de> for HashOutput<N> {
         D: Deserializer<'de>,
     {
         let slice: &[u8] = Deserialize::deserialize(deserializer)?;
-        let array: [u8; N] = slice.try_into().map_err(|_| serde::de::Error::custom("Incorrect length"))?;
+        let array: [u8; N] = slice
+            .try_into()
+            .map_err(|_| serde::de::Error::custom("Incorrect length"))?;
         Ok(HashOutput(array))
     }
 }
 
 /// A trait representing a cryptographic vector accumulator, that can generate and verify
 /// proofs of inclusion and updates.
-pub trait VectorAccumulator<T: AsRef<[u8]> + Clone + Serialize + DeserializeOwned> {
+pub trait VectorAccumulator<T: AsRef<[u8]> + Clone> {
     /// The type representing an inclusion proof.
     type InclusionProof: Serialize + DeserializeOwned;
 
     /// The type representing an update proof.
     type UpdateProof: Serialize + DeserializeOwned;
 
+    /// The type representing an inclusion proof for several elements at once.
+    type MultiInclusionProof: Serialize + DeserializeOwned;
+
+    /// The type representing an update proof for several elements at once.
+    type MultiUpdateProof: Serialize + DeserializeOwned;
+
     /// Creates a new accumulator with the given data.
     fn new(data: Vec<T>) -> Self;
 
@@ -125,7 +168,13 @@ pub trait VectorAccumulator<T: AsRef<[u8]> + Clone + Serialize + DeserializeOwne
     /// # Returns
     ///
     /// `true` if the proof is valid, `false` otherwise.
-    fn verify_inclusion_proof(root: &[u8], proof: &Self::InclusionProof, value: &T, index: usize, size: usize) -> bool;
+    fn verify_inclusion_proof(
+        root: &[u8],
+        proof: &Self::InclusionProof,
+        value: &T,
+        index: usize,
+        size: usize,
+    ) -> bool;
 
     /// Updates the accumulator by replacing the element at the given index.
     ///
@@ -162,18 +211,87 @@ pub trait VectorAccumulator<T: AsRef<[u8]> + Clone + Serialize + DeserializeOwne
         index: usize,
         size: usize,
     ) -> bool;
+
+    /// Generates a single proof of inclusion for the elements at all the given indices.
+    /// Returns the inclusion proof, or an error if any index is out of bounds or repeated.
+    fn prove_many(&self, indices: &[usize]) -> Result<Self::MultiInclusionProof, AccumulatorError>;
+
+    /// Verifies an inclusion proof for multiple elements. This associated function is called
+    /// by the verifier, rather than the owner of the instance.
+    ///
+    /// # Arguments
+    ///
+    /// * `root` - The expected root hash of the accumulator.
+    /// * `proof` - The inclusion proof to verify.
+    /// * `elements` - The `(index, value)` pairs of the elements, in any order.
+    /// * `size` - The size of the accumulator.
+    ///
+    /// # Returns
+    ///
+    /// `true` if the proof is valid, `false` otherwise. An empty list of elements is never valid.
+    fn verify_many(
+        root: &[u8],
+        proof: &Self::MultiInclusionProof,
+        elements: &[(usize, &T)],
+        size: usize,
+    ) -> bool;
+
+    /// Updates the accumulator by replacing the elements at the given indices.
+    ///
+    /// # Arguments
+    ///
+    /// * `updates` - The `(index, value)` pairs of the elements to be updated.
+    ///
+    /// # Returns
+    ///
+    /// An update proof, or an error if any index is out of bounds or repeated.
+    fn update_many(
+        &mut self,
+        updates: Vec<(usize, T)>,
+    ) -> Result<Self::MultiUpdateProof, AccumulatorError>;
+
+    /// Verifies an update proof for multiple elements. This associated function is called
+    /// by the verifier, rather than the owner of the instance.
+    ///
+    /// # Arguments
+    ///
+    /// * `new_root` - The expected new root hash after the update.
+    /// * `update_proof` - The update proof to verify.
+    /// * `updates` - The `(index, old_value, new_value)` triples of the updated elements.
+    /// * `size` - The size of the accumulator.
+    ///
+    /// # Returns
+    ///
+    /// `true` if the update proof is valid, `false` otherwise.
+    fn verify_many_update_proof(
+        new_root: &[u8],
+        update_proof: &Self::MultiUpdateProof,
+        updates: &[(usize, &T, &T)],
+        size: usize,
+    ) -> bool;
 }
 
 /// A Merkle tree-based implementation of the `VectorAccumulator` trait.
-pub struct MerkleAccumulator<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone + Serialize + DeserializeOwned, const OUTPUT_SIZE: usize> {
+///
+/// Both the elements and the nodes of the tree are stored in flat vectors; when `T` is a fixed-size
+/// array (like a page of memory), the whole content is a single contiguous allocation.
+pub struct MerkleAccumulator<
+    H: Hasher<OUTPUT_SIZE>,
+    T: AsRef<[u8]> + Clone,
+    const OUTPUT_SIZE: usize,
+> {
     data: Vec<T>,
     tree: Vec<HashOutput<OUTPUT_SIZE>>,
     _marker: PhantomData<H>,
 }
 
-impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone + Serialize + DeserializeOwned, const OUTPUT_SIZE: usize> VectorAccumulator<T> for MerkleAccumulator<H, T, OUTPUT_SIZE> {
+impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone, const OUTPUT_SIZE: usize> VectorAccumulator<T>
+    for MerkleAccumulator<H, T, OUTPUT_SIZE>
+{
     type InclusionProof = Vec<HashOutput<OUTPUT_SIZE>>;
     type UpdateProof = (Self::InclusionProof, Vec<u8>);
+    type MultiInclusionProof = Vec<HashOutput<OUTPUT_SIZE>>;
+    type MultiUpdateProof = (Self::MultiInclusionProof, Vec<u8>);
 
     /// Creates a new `MerkleAccumulator` with the given data.
     ///
@@ -233,10 +351,16 @@ impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone + Serialize + DeserializeOwn
     }
 
     /// Verifies an inclusion proof for a given element and index
-    fn verify_inclusion_proof(root: &[u8], proof: &Self::InclusionProof, element: &T, index: usize, size: usize) -> bool {
+    fn verify_inclusion_proof(
+        root: &[u8],
+        proof: &Self::InclusionProof,
+        element: &T,
+        index: usize,
+        size: usize,
+    ) -> bool {
         let mut hash = Self::hash_leaf(element);
         let mut pos = size - 1 + index;
-    
+
         for sibling_hash in proof.iter() {
             let (left, right) = if pos % 2 == 0 {
                 (sibling_hash, &hash)
@@ -246,7 +370,7 @@ impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone + Serialize + DeserializeOwn
             hash = Self::hash_internal_node(left, right);
             pos = (pos - 1) / 2;
         }
-    
+
         hash.0 == root
     }
 
@@ -267,7 +391,7 @@ impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone + Serialize + DeserializeOwn
 
         let old_root = self.root();
 
-        let merkle_proof = self.prove(index)?;  // Capture proof before update
+        let merkle_proof = self.prove(index)?; // Capture proof before update
         self.data[index] = value;
         let n = self.data.len();
         let mut pos = n - 1 + index;
@@ -275,7 +399,8 @@ impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone + Serialize + DeserializeOwn
 
         while pos > 0 {
             pos = (pos - 1) / 2;
-            self.tree[pos] = Self::hash_internal_node(&self.tree[2 * pos + 1], &self.tree[2 * pos + 2]);
+            self.tree[pos] =
+                Self::hash_internal_node(&self.tree[2 * pos + 1], &self.tree[2 * pos + 2]);
         }
 
         Ok((merkle_proof, old_root))
@@ -293,44 +418,496 @@ impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone + Serialize + DeserializeOwn
         let (proof, old_root) = update_proof;
 
         // verify that the old value was correct, and that the same proof is correct for the new value (with the new root)
-        Self::verify_inclusion_proof(old_root, proof, old_value, index, size) &&
-        Self::verify_inclusion_proof(new_root, proof, new_value, index, size)
+        Self::verify_inclusion_proof(old_root, proof, old_value, index, size)
+            && Self::verify_inclusion_proof(new_root, proof, new_value, index, size)
+    }
+
+    /// Generates a multiproof for the elements at the given indices.
+    ///
+    /// The proof contains the hashes of the siblings of the nodes on the paths from the leaves
+    /// to the root, except the ones that can be computed from the proven leaves themselves.
+    /// They are ordered by decreasing position in the tree, which is the order in which
+    /// the verifier consumes them.
+    fn prove_many(&self, indices: &[usize]) -> Result<Self::MultiInclusionProof, AccumulatorError> {
+        let mut positions = Self::leaf_positions(indices.iter().copied(), self.data.len())?;
+
+        let mut proof = Vec::new();
+        while let Some(pos) = positions.pop_last() {
+            if pos == 0 {
+                break;
+            }
+            if pos % 2 == 0 {
+                // right child: the left sibling is either known, or part of the proof
+                if !positions.remove(&(pos - 1)) {
+                    proof.push(self.tree[pos - 1].clone());
+                }
+            } else {
+                // left child: if the right sibling was known, it was already processed together with this node
+                proof.push(self.tree[pos + 1].clone());
+            }
+            positions.insert((pos - 1) / 2);
+        }
+        Ok(proof)
+    }
+
+    /// Verifies a multiproof for the given elements.
+    fn verify_many(
+        root: &[u8],
+        proof: &Self::MultiInclusionProof,
+        elements: &[(usize, &T)],
+        size: usize,
+    ) -> bool {
+        let mut nodes = BTreeMap::new();
+        for (index, value) in elements {
+            if *index >= size
+                || nodes
+                    .insert(size - 1 + index, Self::hash_leaf(value))
+                    .is_some()
+            {
+                return false;
+            }
+        }
+
+        let mut proof_iter = proof.iter();
+        while let Some((pos, hash)) = nodes.pop_last() {
+            if pos == 0 {
+                // all the proof must have been consumed
+                return proof_iter.next().is_none() && hash.0 == root;
+            }
+            let parent_hash = if pos % 2 == 0 {
+                let sibling_hash = match nodes.remove(&(pos - 1)) {
+                    Some(h) => h,
+                    None => match proof_iter.next() {
+                        Some(h) => h.clone(),
+                        None => return false,
+                    },
+                };
+                Self::hash_internal_node(&sibling_hash, &hash)
+            } else {
+                match proof_iter.next() {
+                    Some(sibling_hash) => Self::hash_internal_node(&hash, sibling_hash),
+                    None => return false,
+                }
+            };
+            nodes.insert((pos - 1) / 2, parent_hash);
+        }
+
+        false // no elements
+    }
+
+    /// Updates the Merkle tree by replacing the elements at the given indices. Internal nodes that are
+    /// ancestors of more than one updated leaf are only recomputed once.
+    fn update_many(
+        &mut self,
+        updates: Vec<(usize, T)>,
+    ) -> Result<Self::MultiUpdateProof, AccumulatorError> {
+        let old_root = self.root();
+        let merkle_proof =
+            self.prove_many(&updates.iter().map(|(index, _)| *index).collect::<Vec<_>>())?; // Capture proof before update
+
+        let n = self.data.len();
+        let mut dirty = BTreeSet::new();
+        for (index, value) in updates {
+            let pos = n - 1 + index;
+            self.tree[pos] = Self::hash_leaf(&value);
+            self.data[index] = value;
+            if pos > 0 {
+                dirty.insert((pos - 1) / 2);
+            }
+        }
+
+        while let Some(pos) = dirty.pop_last() {
+            self.tree[pos] =
+                Self::hash_internal_node(&self.tree[2 * pos + 1], &self.tree[2 * pos + 2]);
+            if pos > 0 {
+                dirty.insert((pos - 1) / 2);
+            }
+        }
+
+        Ok((merkle_proof, old_root))
+    }
+
+    /// Verifies an update proof for multiple elements.
+    fn verify_many_update_proof(
+        new_root: &[u8],
+        update_proof: &Self::MultiUpdateProof,
+        updates: &[(usize, &T, &T)],
+        size: usize,
+    ) -> bool {
+        let (proof, old_root) = update_proof;
+
+        let old_elements = updates
+            .iter()
+            .map(|(index, old_value, _)| (*index, *old_value))
+            .collect::<Vec<_>>();
+        let new_elements = updates
+            .iter()
+            .map(|(index, _, new_value)| (*index, *new_value))
+            .collect::<Vec<_>>();
+
+        // the siblings are not affected by the update, therefore the same proof is valid for both roots
+        Self::verify_many(old_root, proof, &old_elements, size)
+            && Self::verify_many(new_root, proof, &new_elements, size)
     }
 }
 
-impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone + Serialize + DeserializeOwned, const OUTPUT_SIZE: usize> MerkleAccumulator<H, T, OUTPUT_SIZE> {
+impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone, const OUTPUT_SIZE: usize>
+    MerkleAccumulator<H, T, OUTPUT_SIZE>
+{
     /// Constructs the Merkle tree from the provided data.
+    /// The tree is stored as an implicit binary heap in a single contiguous vector: the root is at
+    /// position 0, the children of the node at position `i` are at positions `2i + 1` and `2i + 2`,
+    /// and the leaves occupy the last `n` positions.
     fn build_tree(&mut self) {
         let n = self.data.len();
-        let leaves = self.data.iter().map(|x| Self::hash_leaf(x)).collect::<Vec<_>>();
 
         self.tree = vec![HashOutput([0u8; OUTPUT_SIZE]); 2 * n - 1];
-        self.tree[n - 1..].clone_from_slice(&leaves);
+        for (node, x) in self.tree[n - 1..].iter_mut().zip(self.data.iter()) {
+            *node = Self::hash_leaf(x);
+        }
 
         for i in (0..n - 1).rev() {
             self.tree[i] = Self::hash_internal_node(&self.tree[2 * i + 1], &self.tree[2 * i + 2]);
         }
     }
 
-    /// Computes the hash for a leaf node. A 0x00 byte is prepended to the data before hashing the element.
+    /// Returns the set of the positions in the tree of the leaves at the given indices.
+    fn leaf_positions(
+        indices: impl Iterator<Item = usize>,
+        size: usize,
+    ) -> Result<BTreeSet<usize>, AccumulatorError> {
+        let mut positions = BTreeSet::new();
+        for index in indices {
+            if index >= size {
+                return Err(AccumulatorError::IndexOutOfBounds);
+            }
+            if !positions.insert(size - 1 + index) {
+                return Err(AccumulatorError::DuplicateIndex);
+            }
+        }
+        Ok(positions)
+    }
+
+    /// Computes the hash for a leaf node.
     fn hash_leaf(data: &T) -> HashOutput<OUTPUT_SIZE> {
-        let mut hasher = H::new();
-        hasher.update(&[0x00]);
-        hasher.update(data.as_ref());
-        HashOutput(hasher.finalize())
+        HashOutput(H::hash_leaf(data.as_ref()))
     }
 
-    /// Computes the hash for an internal node. A 0x01 byte is prepended to the data before hashing the child nodes.
-    fn hash_internal_node(left: &HashOutput<OUTPUT_SIZE>, right: &HashOutput<OUTPUT_SIZE>) -> HashOutput<OUTPUT_SIZE> {
-        // prepend a 0x01 byte to the data before hashing internal nodes
-        let mut hasher = H::new();
-        hasher.update(&[0x01]);
-        hasher.update(&left.0);
-        hasher.update(&right.0);
-        HashOutput(hasher.finalize())
+    /// Computes the hash for an internal node.
+    fn hash_internal_node(
+        left: &HashOutput<OUTPUT_SIZE>,
+        right: &HashOutput<OUTPUT_SIZE>,
+    ) -> HashOutput<OUTPUT_SIZE> {
+        HashOutput(H::hash_internal_node(&left.0, &right.0))
+    }
+}
+
+/// A Merkle tree-based implementation of the `VectorAccumulator` trait for vectors where most
+/// elements are equal to a default value, like a freshly allocated memory that is all zeros.
+///
+/// The tree has the same shape as the one of `MerkleAccumulator`, and therefore the same roots and
+/// proofs. However, only the elements that were updated, and the nodes on their paths to the root,
+/// are stored. The hashes of the other nodes only depend on the height of their subtree; they are
+/// precomputed once per level of the tree, so creating the accumulator takes O(log n) hashes and
+/// memory, independently of its size.
+pub struct SparseMerkleAccumulator<
+    H: Hasher<OUTPUT_SIZE>,
+    T: AsRef<[u8]> + Clone,
+    const OUTPUT_SIZE: usize,
+> {
+    size: usize,
+    default_element: T,
+    data: BTreeMap<usize, T>,
+    tree: BTreeMap<usize, HashOutput<OUTPUT_SIZE>>,
+    // depth of the deepest leaves
+    depth: usize,
+    // perfect_hashes[h] is the hash of a perfect subtree of height h with default leaves
+    perfect_hashes: Vec<HashOutput<OUTPUT_SIZE>>,
+    // mixed_hashes[k] is the hash of the only node at depth k whose subtree has leaves at two
+    // different depths, if any
+    mixed_hashes: Vec<Option<HashOutput<OUTPUT_SIZE>>>,
+    _marker: PhantomData<H>,
+}
+
+impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone, const OUTPUT_SIZE: usize>
+    SparseMerkleAccumulator<H, T, OUTPUT_SIZE>
+{
+    /// Creates a new accumulator for a vector of `size` elements, all equal to `default_element`.
+    pub fn new_uniform(size: usize, default_element: T) -> Self {
+        assert!(size > 0, "The accumulator can not be empty");
+
+        let last_pos = 2 * size - 2;
+        let depth = (usize::BITS - 1 - (last_pos + 1).leading_zeros()) as usize;
+
+        let mut perfect_hashes = Vec::with_capacity(depth + 1);
+        perfect_hashes.push(MerkleAccumulator::<H, T, OUTPUT_SIZE>::hash_leaf(
+            &default_element,
+        ));
+        for h in 1..=depth {
+            let child = &perfect_hashes[h - 1];
+            perfect_hashes.push(MerkleAccumulator::<H, T, OUTPUT_SIZE>::hash_internal_node(
+                child, child,
+            ));
+        }
+
+        let mut acc = SparseMerkleAccumulator {
+            size,
+            default_element,
+            data: BTreeMap::new(),
+            tree: BTreeMap::new(),
+            depth,
+            perfect_hashes,
+            mixed_hashes: vec![None; depth + 1],
+            _marker: PhantomData,
+        };
+
+        // the mixed nodes are the ancestors of the last leaf whose subtree is not perfect;
+        // each of them only depends on its children, that are at the next level
+        for k in (0..depth).rev() {
+            let pos = ((last_pos + 1) >> (depth - k)) - 1;
+            let (_, last) = acc.deepest_descendants(pos, k);
+            if last > last_pos {
+                let hash = MerkleAccumulator::<H, T, OUTPUT_SIZE>::hash_internal_node(
+                    &acc.default_node(2 * pos + 1),
+                    &acc.default_node(2 * pos + 2),
+                );
+                acc.mixed_hashes[k] = Some(hash);
+            }
+        }
+        acc
+    }
+
+    /// Creates a new accumulator for a vector of `size` elements, that are equal to `default_element`,
+    /// except for the given `(index, value)` pairs.
+    pub fn with_elements(
+        size: usize,
+        default_element: T,
+        elements: impl IntoIterator<Item = (usize, T)>,
+    ) -> Result<Self, AccumulatorError> {
+        let mut acc = Self::new_uniform(size, default_element);
+        acc.set_many(elements)?;
+        Ok(acc)
+    }
+
+    /// Returns the number of elements that are explicitly stored, because they were updated.
+    pub fn stored_elements(&self) -> usize {
+        self.data.len()
+    }
+
+    /// Returns the `(index, value)` pairs of the elements that are explicitly stored, in increasing
+    /// order of index. All the other elements are equal to the default one.
+    pub fn iter_stored(&self) -> impl Iterator<Item = (usize, &T)> {
+        self.data.iter().map(|(index, value)| (*index, value))
+    }
+
+    /// Returns the range of positions of the descendants at the maximum depth of the node at
+    /// position `pos` and depth `k`. Some of them might not exist.
+    fn deepest_descendants(&self, pos: usize, k: usize) -> (usize, usize) {
+        let first = ((pos + 1) << (self.depth - k)) - 1;
+        (first, first + (1 << (self.depth - k)) - 1)
+    }
+
+    /// Returns the hash of the node at the given position if all the leaves had the default value.
+    fn default_node(&self, pos: usize) -> HashOutput<OUTPUT_SIZE> {
+        let k = (usize::BITS - 1 - (pos + 1).leading_zeros()) as usize;
+        let (first, last) = self.deepest_descendants(pos, k);
+        let last_pos = 2 * self.size - 2;
+        if last <= last_pos {
+            self.perfect_hashes[self.depth - k].clone()
+        } else if first > last_pos {
+            self.perfect_hashes[self.depth - k - 1].clone()
+        } else {
+            self.mixed_hashes[k]
+                .clone()
+                .expect("mixed nodes are precomputed")
+        }
+    }
+
+    /// Returns the hash of the node at the given position.
+    fn node(&self, pos: usize) -> HashOutput<OUTPUT_SIZE> {
+        match self.tree.get(&pos) {
+            Some(hash) => hash.clone(),
+            None => self.default_node(pos),
+        }
+    }
+
+    /// Replaces the elements at the given indices, and recomputes their ancestors once.
+    fn set_many(
+        &mut self,
+        updates: impl IntoIterator<Item = (usize, T)>,
+    ) -> Result<(), AccumulatorError> {
+        let n = self.size;
+        let mut dirty = BTreeSet::new();
+        for (index, value) in updates {
+            if index >= n {
+                return Err(AccumulatorError::IndexOutOfBounds);
+            }
+            let pos = n - 1 + index;
+            self.tree.insert(
+                pos,
+                MerkleAccumulator::<H, T, OUTPUT_SIZE>::hash_leaf(&value),
+            );
+            self.data.insert(index, value);
+            if pos > 0 {
+                dirty.insert((pos - 1) / 2);
+            }
+        }
+
+        while let Some(pos) = dirty.pop_last() {
+            let hash = MerkleAccumulator::<H, T, OUTPUT_SIZE>::hash_internal_node(
+                &self.node(2 * pos + 1),
+                &self.node(2 * pos + 2),
+            );
+            self.tree.insert(pos, hash);
+            if pos > 0 {
+                dirty.insert((pos - 1) / 2);
+            }
+        }
+        Ok(())
     }
 }
 
+impl<H: Hasher<OUTPUT_SIZE>, T: AsRef<[u8]> + Clone, const OUTPUT_SIZE: usize> VectorAccumulator<T>
+    for SparseMerkleAccumulator<H, T, OUTPUT_SIZE>
+{
+    type InclusionProof = Vec<HashOutput<OUTPUT_SIZE>>;
+    type UpdateProof = (Self::InclusionProof, Vec<u8>);
+    type MultiInclusionProof = Vec<HashOutput<OUTPUT_SIZE>>;
+    type MultiUpdateProof = (Self::MultiInclusionProof, Vec<u8>);
+
+    /// Creates a new `SparseMerkleAccumulator` with the given data, using the first element as
+    /// the default one. Prefer `new_uniform` or `with_elements` to benefit from the sparse storage.
+    fn new(data: Vec<T>) -> Self {
+        let default_element = data[0].clone();
+        Self::with_elements(data.len(), default_element, data.into_iter().enumerate())
+            .expect("all the indices are in range")
+    }
+
+    fn get(&self, index: usize) -> Option<&T> {
+        if index >= self.size {
+            return None;
+        }
+        Some(self.data.get(&index).unwrap_or(&self.default_element))
+    }
+
+    fn size(&self) -> usize {
+        self.size
+    }
+
+    fn root(&self) -> Vec<u8> {
+        self.node(0).0.to_vec()
+    }
+
+    fn prove(&self, index: usize) -> Result<Self::InclusionProof, AccumulatorError> {
+        if index >= self.size {
+            return Err(AccumulatorError::IndexOutOfBounds);
+        }
+
+        let mut proof = Vec::new();
+        let mut pos = self.size - 1 + index;
+        while pos > 0 {
+            let sibling = if pos % 2 == 0 { pos - 1 } else { pos + 1 };
+            proof.push(self.node(sibling));
+            pos = (pos - 1) / 2;
+        }
+        Ok(proof)
+    }
+
+    fn verify_inclusion_proof(
+        root: &[u8],
+        proof: &Self::InclusionProof,
+        element: &T,
+        index: usize,
+        size: usize,
+    ) -> bool {
+        MerkleAccumulator::<H, T, OUTPUT_SIZE>::verify_inclusion_proof(
+            root, proof, element, index, size,
+        )
+    }
+
+    fn update(&mut self, index: usize, value: T) -> Result<Self::UpdateProof, AccumulatorError> {
+        let old_root = self.root();
+        let merkle_proof = self.prove(index)?; // Capture proof before update
+        self.set_many([(index, value)])?;
+        Ok((merkle_proof, old_root))
+    }
+
+    fn verify_update_proof(
+        new_root: &[u8],
+        update_proof: &Self::UpdateProof,
+        old_value: &T,
+        new_value: &T,
+        index: usize,
+        size: usize,
+    ) -> bool {
+        MerkleAccumulator::<H, T, OUTPUT_SIZE>::verify_update_proof(
+            new_root,
+            update_proof,
+            old_value,
+            new_value,
+            index,
+            size,
+        )
+    }
+
+    fn prove_many(&self, indices: &[usize]) -> Result<Self::MultiInclusionProof, AccumulatorError> {
+        let mut positions = MerkleAccumulator::<H, T, OUTPUT_SIZE>::leaf_positions(
+            indices.iter().copied(),
+            self.size,
+        )?;
+
+        // same traversal as MerkleAccumulator::prove_many
+        let mut proof = Vec::new();
+        while let Some(pos) = positions.pop_last() {
+            if pos == 0 {
+                break;
+            }
+            if pos % 2 == 0 {
+                if !positions.remove(&(pos - 1)) {
+                    proof.push(self.node(pos - 1));
+                }
+            } else {
+                proof.push(self.node(pos + 1));
+            }
+            positions.insert((pos - 1) / 2);
+        }
+        Ok(proof)
+    }
+
+    fn verify_many(
+        root: &[u8],
+        proof: &Self::MultiInclusionProof,
+        elements: &[(usize, &T)],
+        size: usize,
+    ) -> bool {
+        MerkleAccumulator::<H, T, OUTPUT_SIZE>::verify_many(root, proof, elements, size)
+    }
+
+    fn update_many(
+        &mut self,
+        updates: Vec<(usize, T)>,
+    ) -> Result<Self::MultiUpdateProof, AccumulatorError> {
+        let old_root = self.root();
+        let merkle_proof =
+            self.prove_many(&updates.iter().map(|(index, _)| *index).collect::<Vec<_>>())?; // Capture proof before update
+        self.set_many(updates)?;
+        Ok((merkle_proof, old_root))
+    }
+
+    fn verify_many_update_proof(
+        new_root: &[u8],
+        update_proof: &Self::MultiUpdateProof,
+        updates: &[(usize, &T, &T)],
+        size: usize,
+    ) -> bool {
+        MerkleAccumulator::<H, T, OUTPUT_SIZE>::verify_many_update_proof(
+            new_root,
+            update_proof,
+            updates,
+            size,
+        )
+    }
+}
 
 #[cfg(test)]
 mod tests {
@@ -373,79 +950,87 @@ mod tests {
     fn test_out_of_bounds_proof_generation() {
         let data = generate_test_data(3);
         let ma = MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new(data.clone());
-    
+
         // Trying to prove an element at an out-of-bounds index should return an error
         assert!(ma.prove(3).is_err());
     }
-    
+
     #[test]
     fn test_out_of_bounds_update() {
         let data = generate_test_data(3);
         let mut ma = MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new(data.clone());
-    
+
         // Trying to update an element at an out-of-bounds index should return an error
         assert!(ma.update(3, b"new_data".to_vec()).is_err());
     }
-    
+
     #[test]
     fn test_verify_incorrect_proof() {
         let data = generate_test_data(4);
-    
+
         let ma = MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new(data.clone());
         let root = ma.root();
-    
+
         // Generate a proof for one element and try to verify it with another
         let proof = ma.prove(0).unwrap();
-        assert!(!MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_inclusion_proof(
-            &root,
-            &proof,
-            &data[1],
-            1,
-            data.len()
-        ));
+        assert!(
+            !MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_inclusion_proof(
+                &root,
+                &proof,
+                &data[1],
+                1,
+                data.len()
+            )
+        );
     }
-    
+
     #[test]
     fn test_update_proof_with_incorrect_values() {
         let data = generate_test_data(4);
-    
+
         let mut ma = MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new(data.clone());
         let old_root = ma.root();
-    
+
         // Update an element
         let new_data = b"new_data".to_vec();
         let update_proof = ma.update(2, new_data.clone()).unwrap();
         let new_root = ma.root();
-    
+
         // Verify update proof is false with incorrect old root
-        assert!(!MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
-            &old_root, // Incorrect old root
-            &update_proof,
-            &data[2],
-            &new_data,
-            2,
-            data.len()
-        ));
+        assert!(
+            !MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
+                &old_root, // Incorrect old root
+                &update_proof,
+                &data[2],
+                &new_data,
+                2,
+                data.len()
+            )
+        );
 
         // Verify update proof is false with incorrect old value
-        assert!(!MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
-            &new_root,
-            &update_proof,
-            &data[0], // Incorrect old value
-            &new_data,
-            2,
-            data.len()
-        ));
-    
+        assert!(
+            !MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
+                &new_root,
+                &update_proof,
+                &data[0], // Incorrect old value
+                &new_data,
+                2,
+                data.len()
+            )
+        );
+
         // Verify update proof is false with incorrect new value
-        assert!(!MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
-            &new_root,
-            &update_proof,
-            &data[2],
-            &data[0], // Incorrect new value
-            2,
-            data.len()
-        ));
+        assert!(
+            !MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
+                &new_root,
+                &update_proof,
+                &data[2],
+                &data[0], // Incorrect new value
+                2,
+                data.len()
+            )
+        );
     }
 
     #[test]
@@ -462,7 +1047,15 @@ mod tests {
         let root = ma.root();
 
         let proof = ma.prove(2).unwrap();
-        assert!(MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_inclusion_proof(&root, &proof, &data[2], 2, data.len()));
+        assert!(
+            MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_inclusion_proof(
+                &root,
+                &proof,
+                &data[2],
+                2,
+                data.len()
+            )
+        );
 
         // Update an element and check if root changes
         let new_data = b"new_data".to_vec();
@@ -471,25 +1064,368 @@ mod tests {
         assert_ne!(root, new_root);
 
         let new_proof = ma.prove(2).unwrap();
-        assert!(MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_inclusion_proof(&new_root, &new_proof, &new_data, 2, data.len()));
+        assert!(
+            MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_inclusion_proof(
+                &new_root,
+                &new_proof,
+                &new_data,
+                2,
+                data.len()
+            )
+        );
 
         // Verify the update proof
-        assert!(MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
-            &new_root,
-            &update_proof,
-            &data[2],
-            &new_data,
-            2,
-            data.len()
-        ));
+        assert!(
+            MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
+                &new_root,
+                &update_proof,
+                &data[2],
+                &new_data,
+                2,
+                data.len()
+            )
+        );
 
         // Test that serializing/deserializing inclusion proofs and update proofs works
         let serialized_proof: Vec<u8> = postcard::to_allocvec(&proof).unwrap();
-        let deserialized_proof: Vec<HashOutput<32>> = postcard::from_bytes(&serialized_proof).unwrap();
+        let deserialized_proof: Vec<HashOutput<32>> =
+            postcard::from_bytes(&serialized_proof).unwrap();
         assert_eq!(proof, deserialized_proof);
 
         let serialized_update_proof = postcard::to_allocvec(&update_proof).unwrap();
-        let deserialized_update_proof: (Vec<HashOutput<32>>, Vec<u8>) = postcard::from_bytes(&serialized_update_proof).unwrap();
+        let deserialized_update_proof: (Vec<HashOutput<32>>, Vec<u8>) =
+            postcard::from_bytes(&serialized_update_proof).unwrap();
         assert_eq!(update_proof, deserialized_update_proof);
     }
+
+    #[test]
+    fn test_multiproof() {
+        type MA = MerkleAccumulator<Sha256Hasher, Vec<u8>, 32>;
+
+        for size in 1..=9 {
+            let data = generate_test_data(size);
+            let ma = MA::new(data.clone());
+            let root = ma.root();
+
+            // every non-empty subset of indices
+            for mask in 1..(1usize << size) {
+                let indices: Vec<usize> = (0..size).filter(|i| mask & (1 << i) != 0).collect();
+                let proof = ma.prove_many(&indices).unwrap();
+
+                // the multiproof is never larger than the sum of the individual proofs
+                let individual_proofs_len: usize =
+                    indices.iter().map(|&i| ma.prove(i).unwrap().len()).sum();
+                assert!(proof.len() <= individual_proofs_len);
+
+                // the order of the elements does not matter
+                let elements: Vec<(usize, &Vec<u8>)> =
+                    indices.iter().rev().map(|&i| (i, &data[i])).collect();
+                assert!(MA::verify_many(&root, &proof, &elements, size));
+            }
+        }
+    }
+
+    #[test]
+    fn test_multiproof_shares_siblings() {
+        type MA = MerkleAccumulator<Sha256Hasher, Vec<u8>, 32>;
+
+        let data = generate_test_data(8);
+        let ma = MA::new(data.clone());
+
+        // two adjacent leaves share all the siblings except each other
+        assert_eq!(ma.prove_many(&[2, 3]).unwrap().len(), 2);
+        // all the leaves together need no sibling at all
+        assert_eq!(ma.prove_many(&(0..8).collect::<Vec<_>>()).unwrap().len(), 0);
+    }
+
+    #[test]
+    fn test_verify_incorrect_multiproof() {
+        type MA = MerkleAccumulator<Sha256Hasher, Vec<u8>, 32>;
+
+        let data = generate_test_data(6);
+        let ma = MA::new(data.clone());
+        let root = ma.root();
+
+        let proof = ma.prove_many(&[1, 4]).unwrap();
+        assert!(MA::verify_many(
+            &root,
+            &proof,
+            &[(1, &data[1]), (4, &data[4])],
+            data.len()
+        ));
+
+        // wrong value
+        assert!(!MA::verify_many(
+            &root,
+            &proof,
+            &[(1, &data[1]), (4, &data[5])],
+            data.len()
+        ));
+        // wrong index
+        assert!(!MA::verify_many(
+            &root,
+            &proof,
+            &[(1, &data[1]), (5, &data[4])],
+            data.len()
+        ));
+        // missing element
+        assert!(!MA::verify_many(
+            &root,
+            &proof,
+            &[(1, &data[1])],
+            data.len()
+        ));
+        // duplicated element
+        assert!(!MA::verify_many(
+            &root,
+            &proof,
+            &[(1, &data[1]), (1, &data[1]), (4, &data[4])],
+            data.len()
+        ));
+        // no elements
+        assert!(!MA::verify_many(&root, &proof, &[], data.len()));
+        // truncated proof
+        assert!(!MA::verify_many(
+            &root,
+            &proof[..proof.len() - 1].to_vec(),
+            &[(1, &data[1]), (4, &data[4])],
+            data.len()
+        ));
+
+        // invalid indices
+        assert!(matches!(
+            ma.prove_many(&[1, 6]),
+            Err(AccumulatorError::IndexOutOfBounds)
+        ));
+        assert!(matches!(
+            ma.prove_many(&[1, 1]),
+            Err(AccumulatorError::DuplicateIndex)
+        ));
+    }
+
+    #[test]
+    fn test_update_many() {
+        type MA = MerkleAccumulator<Sha256Hasher, Vec<u8>, 32>;
+
+        let data = generate_test_data(7);
+        let mut ma = MA::new(data.clone());
+        let mut expected = data.clone();
+
+        let new_data = vec![
+            b"new_data0".to_vec(),
+            b"new_data3".to_vec(),
+            b"new_data6".to_vec(),
+        ];
+        let update_proof = ma
+            .update_many(vec![
+                (3, new_data[1].clone()),
+                (0, new_data[0].clone()),
+                (6, new_data[2].clone()),
+            ])
+            .unwrap();
+        let new_root = ma.root();
+
+        // the resulting tree is the same as if the elements were updated one by one
+        expected[0] = new_data[0].clone();
+        expected[3] = new_data[1].clone();
+        expected[6] = new_data[2].clone();
+        assert_eq!(new_root, MA::new(expected).root());
+
+        let updates = [
+            (0, &data[0], &new_data[0]),
+            (3, &data[3], &new_data[1]),
+            (6, &data[6], &new_data[2]),
+        ];
+        assert!(MA::verify_many_update_proof(
+            &new_root,
+            &update_proof,
+            &updates,
+            data.len()
+        ));
+
+        // incorrect old value
+        let updates = [
+            (0, &data[1], &new_data[0]),
+            (3, &data[3], &new_data[1]),
+            (6, &data[6], &new_data[2]),
+        ];
+        assert!(!MA::verify_many_update_proof(
+            &new_root,
+            &update_proof,
+            &updates,
+            data.len()
+        ));
+
+        // incorrect new value
+        let updates = [
+            (0, &data[0], &new_data[0]),
+            (3, &data[3], &new_data[2]),
+            (6, &data[6], &new_data[2]),
+        ];
+        assert!(!MA::verify_many_update_proof(
+            &new_root,
+            &update_proof,
+            &updates,
+            data.len()
+        ));
+
+        // incorrect new root
+        let updates = [
+            (0, &data[0], &new_data[0]),
+            (3, &data[3], &new_data[1]),
+            (6, &data[6], &new_data[2]),
+        ];
+        assert!(!MA::verify_many_update_proof(
+            &update_proof.1,
+            &update_proof,
+            &updates,
+            data.len()
+        ));
+
+        // a failed update leaves the accumulator untouched
+        assert!(ma
+            .update_many(vec![(1, b"x".to_vec()), (1, b"y".to_vec())])
+            .is_err());
+        assert_eq!(ma.root(), new_root);
+    }
+
+    #[test]
+    fn test_fixed_size_elements() {
+        // fixed-size arrays can be used as elements, with the same tree as the equivalent vectors
+        let data: Vec<[u8; 64]> = (0..5u8).map(|i| [i; 64]).collect();
+        let data_vec: Vec<Vec<u8>> = data.iter().map(|x| x.to_vec()).collect();
+
+        let mut ma = MerkleAccumulator::<Sha256Hasher, [u8; 64], 32>::new(data.clone());
+        let mut ma_vec = MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new(data_vec);
+        assert_eq!(ma.root(), ma_vec.root());
+
+        ma.update(3, [0xff; 64]).unwrap();
+        ma_vec.update(3, vec![0xff; 64]).unwrap();
+        assert_eq!(ma.root(), ma_vec.root());
+        assert_eq!(ma.get(3), Some(&[0xff; 64]));
+    }
+
+    #[test]
+    fn test_sparse_accumulator_matches_dense() {
+        for size in [1usize, 2, 3, 5, 7, 8, 12, 13, 33] {
+            let zeros = vec![0u8; 16];
+            let mut ma =
+                MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new(vec![zeros.clone(); size]);
+            let mut sa = SparseMerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new_uniform(
+                size,
+                zeros.clone(),
+            );
+            assert_eq!(sa.root(), ma.root());
+            assert_eq!(sa.stored_elements(), 0);
+            for i in 0..size {
+                assert_eq!(sa.get(i), ma.get(i));
+                assert_eq!(sa.prove(i).unwrap(), ma.prove(i).unwrap());
+            }
+
+            let index = size / 2;
+            let value = vec![0x42u8; 16];
+            assert_eq!(
+                sa.update(index, value.clone()).unwrap(),
+                ma.update(index, value.clone()).unwrap()
+            );
+            assert_eq!(sa.root(), ma.root());
+            assert_eq!(sa.get(index), Some(&value));
+
+            let updates: Vec<(usize, Vec<u8>)> = (0..size)
+                .step_by(3)
+                .map(|i| (i, vec![i as u8; 16]))
+                .collect();
+            let indices: Vec<usize> = updates.iter().map(|(i, _)| *i).collect();
+            assert_eq!(
+                sa.prove_many(&indices).unwrap(),
+                ma.prove_many(&indices).unwrap()
+            );
+            assert_eq!(
+                sa.update_many(updates.clone()).unwrap(),
+                ma.update_many(updates).unwrap()
+            );
+            assert_eq!(sa.root(), ma.root());
+            assert_eq!(
+                sa.stored_elements(),
+                (0..size).filter(|i| i % 3 == 0 || *i == index).count()
+            );
+            assert_eq!(sa.get(size), None);
+        }
+    }
+
+    #[test]
+    fn test_sparse_accumulator_proofs() {
+        let size = 11;
+        let mut sa = SparseMerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::with_elements(
+            size,
+            vec![0u8; 4],
+            [(2, vec![2u8; 4]), (9, vec![9u8; 4])],
+        )
+        .unwrap();
+        let ma = MerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new(
+            (0..size)
+                .map(|i| {
+                    if i == 2 || i == 9 {
+                        vec![i as u8; 4]
+                    } else {
+                        vec![0u8; 4]
+                    }
+                })
+                .collect(),
+        );
+        assert_eq!(sa.root(), ma.root());
+
+        let proof = sa.prove(5).unwrap();
+        assert!(
+            SparseMerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_inclusion_proof(
+                &sa.root(),
+                &proof,
+                &vec![0u8; 4],
+                5,
+                size
+            )
+        );
+
+        let new_value = vec![0xffu8; 4];
+        let update_proof = sa.update(5, new_value.clone()).unwrap();
+        assert!(
+            SparseMerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::verify_update_proof(
+                &sa.root(),
+                &update_proof,
+                &vec![0u8; 4],
+                &new_value,
+                5,
+                size
+            )
+        );
+
+        assert!(matches!(
+            sa.update(size, new_value),
+            Err(AccumulatorError::IndexOutOfBounds)
+        ));
+    }
+
+    #[test]
+    fn test_sparse_accumulator_rebuild_from_stored() {
+        let size = 13;
+        let mut sa =
+            SparseMerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::new_uniform(size, vec![0u8; 4]);
+        sa.update_many(vec![(7, vec![7u8; 4]), (1, vec![1u8; 4])])
+            .unwrap();
+        sa.update(12, vec![12u8; 4]).unwrap();
+
+        let stored: Vec<(usize, Vec<u8>)> = sa.iter_stored().map(|(i, v)| (i, v.clone())).collect();
+        assert_eq!(
+            stored.iter().map(|(i, _)| *i).collect::<Vec<_>>(),
+            vec![1, 7, 12]
+        );
+
+        let rebuilt = SparseMerkleAccumulator::<Sha256Hasher, Vec<u8>, 32>::with_elements(
+            size,
+            vec![0u8; 4],
+            stored,
+        )
+        .unwrap();
+        assert_eq!(rebuilt.root(), sa.root());
+    }
 }
@@ -0,0 +1,416 @@
+//! This module defines the programs of modular arithmetic executed by the `bn_batch` ECALL, and a
+//! generic interpreter for them.
+//!
+//! A program works on up to `MAX_REGISTERS` registers, each holding a number modulo a single
+//! modulus of at most `MAX_BIGNUMBER_SIZE` bytes; all the registers start at 0. The program is a
+//! sequence of 4-byte instructions `[opcode, x, y, z]`, where the meaning of `x`, `y` and `z` depends
+//! on the opcode (see `BnBatchOp`). Numbers are loaded from an array of inputs and stored to an array
+//! of outputs, both in the memory of the V-App, as consecutive big-endian numbers of the same length
+//! as the modulus.
+//!
+//! This allows a V-App to evaluate a whole sequence of modular operations with a single ECALL: the
+//! operands stay in the memory of the VM, instead of being copied from and to the paged memory of
+//! the V-App for each operation.
+
+use alloc::vec;
+
+use crate::ecall_constants::MAX_BIGNUMBER_SIZE;
+
+/// Maximum number of registers of a program.
+pub const MAX_REGISTERS: usize = 16;
+
+/// Maximum number of instructions of a program.
+pub const MAX_INSTRUCTIONS: usize = 256;
+
+/// Size of each encoded instruction.
+pub const INSTRUCTION_SIZE: usize = 4;
+
+const OP_LOAD: u8 = 0;
+const OP_STORE: u8 = 1;
+const OP_ADD: u8 = 2;
+const OP_SUB: u8 = 3;
+const OP_MUL: u8 = 4;
+const OP_POW: u8 = 5;
+
+/// An instruction of a program. Register and input/output indices are at most 255.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum BnBatchOp {
+    /// `dst = inputs[index] mod m`.
+    Load { dst: u8, index: u8 },
+    /// `outputs[index] = src`.
+    Store { index: u8, src: u8 },
+    /// `dst = (a + b) mod m`.
+    Add { dst: u8, a: u8, b: u8 },
+    /// `dst = (a - b) mod m`.
+    Sub { dst: u8, a: u8, b: u8 },
+    /// `dst = (a * b) mod m`.
+    Mul { dst: u8, a: u8, b: u8 },
+    /// `dst = (a ^ e) mod m`. As the exponent is a register, it is smaller than the modulus.
+    Pow { dst: u8, a: u8, e: u8 },
+}
+
+/// Errors for invalid programs, or for operations that the backend failed to compute.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum BnBatchError {
+    InvalidModulus,
+    InvalidProgramLength,
+    InvalidOpcode,
+    InvalidRegister,
+    InvalidInputIndex,
+    InvalidOutputIndex,
+    OperationFailed,
+}
+
+impl core::fmt::Display for BnBatchError {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        match self {
+            BnBatchError::InvalidModulus => write!(f, "Invalid modulus"),
+            BnBatchError::InvalidProgramLength => write!(f, "Invalid program length"),
+            BnBatchError::InvalidOpcode => write!(f, "Invalid opcode"),
+            BnBatchError::InvalidRegister => write!(f, "Invalid register"),
+            BnBatchError::InvalidInputIndex => write!(f, "Invalid input index"),
+            BnBatchError::InvalidOutputIndex => write!(f, "Invalid output index"),
+            BnBatchError::OperationFailed => write!(f, "Operation failed"),
+        }
+    }
+}
+
+impl BnBatchOp {
+    pub fn encode(&self) -> [u8; INSTRUCTION_SIZE] {
+        match *self {
+            BnBatchOp::Load { dst, index } => [OP_LOAD, dst, index, 0],
+            BnBatchOp::Store { index, src } => [OP_STORE, index, src, 0],
+            BnBatchOp::Add { dst, a, b } => [OP_ADD, dst, a, b],
+            BnBatchOp::Sub { dst, a, b } => [OP_SUB, dst, a, b],
+            BnBatchOp::Mul { dst, a, b } => [OP_MUL, dst, a, b],
+            BnBatchOp::Pow { dst, a, e } => [OP_POW, dst, a, e],
+        }
+    }
+
+    pub fn decode(bytes: &[u8; INSTRUCTION_SIZE]) -> Result<Self, BnBatchError> {
+        let [opcode, x, y, z] = *bytes;
+        match opcode {
+            OP_LOAD => Ok(BnBatchOp::Load { dst: x, index: y }),
+            OP_STORE => Ok(BnBatchOp::Store { index: x, src: y }),
+            OP_ADD => Ok(BnBatchOp::Add { dst: x, a: y, b: z }),
+            OP_SUB => Ok(BnBatchOp::Sub { dst: x, a: y, b: z }),
+            OP_MUL => Ok(BnBatchOp::Mul { dst: x, a: y, b: z }),
+            OP_POW => Ok(BnBatchOp::Pow { dst: x, a: y, e: z }),
+            _ => Err(BnBatchError::InvalidOpcode),
+        }
+    }
+
+    // Returns the registers accessed by the instruction.
+    fn registers(&self) -> ([u8; 3], usize) {
+        match *self {
+            BnBatchOp::Load { dst, .. } => ([dst, 0, 0], 1),
+            BnBatchOp::Store { src, .. } => ([src, 0, 0], 1),
+            BnBatchOp::Add { dst, a, b }
+            | BnBatchOp::Sub { dst, a, b }
+            | BnBatchOp::Mul { dst, a, b }
+            | BnBatchOp::Pow { dst, a, e: b } => ([dst, a, b], 3),
+        }
+    }
+}
+
+/// The operations that the interpreter delegates to the implementation of the ECALL. All the
+/// buffers have the length of the modulus, and the operands are always reduced modulo `m`.
+pub trait BnBatchBackend {
+    type Error: From<BnBatchError>;
+
+    /// Reads the input with the given index; the value is not necessarily reduced.
+    fn read_input(&mut self, index: usize, dst: &mut [u8]) -> Result<(), Self::Error>;
+    /// Writes the output with the given index.
+    fn write_output(&mut self, index: usize, src: &[u8]) -> Result<(), Self::Error>;
+
+    /// Reduces `r` modulo `m` in place.
+    fn modm(&mut self, r: &mut [u8], m: &[u8]) -> Result<(), Self::Error>;
+    fn addm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), Self::Error>;
+    fn subm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), Self::Error>;
+    fn multm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), Self::Error>;
+    fn powm(&mut self, r: &mut [u8], a: &[u8], e: &[u8], m: &[u8]) -> Result<(), Self::Error>;
+}
+
+/// Validates and runs a program. The whole program is validated before executing any instruction,
+/// so no output is written for invalid programs.
+pub fn execute<B: BnBatchBackend>(
+    backend: &mut B,
+    modulus: &[u8],
+    program: &[u8],
+    n_inputs: usize,
+    n_outputs: usize,
+) -> Result<(), B::Error> {
+    let len = modulus.len();
+    if len == 0 || len > MAX_BIGNUMBER_SIZE || modulus.iter().all(|&b| b == 0) {
+        return Err(BnBatchError::InvalidModulus.into());
+    }
+    if program.len() % INSTRUCTION_SIZE != 0 || program.len() > MAX_INSTRUCTIONS * INSTRUCTION_SIZE
+    {
+        return Err(BnBatchError::InvalidProgramLength.into());
+    }
+
+    // validate all the instructions, and count the registers actually used
+    let mut n_registers = 0usize;
+    for chunk in program.chunks_exact(INSTRUCTION_SIZE) {
+        let op = BnBatchOp::decode(chunk.try_into().unwrap())?;
+        let (registers, count) = op.registers();
+        for &reg in &registers[..count] {
+            if reg as usize >= MAX_REGISTERS {
+                return Err(BnBatchError::InvalidRegister.into());
+            }
+            n_registers = n_registers.max(reg as usize + 1);
+        }
+        match op {
+            BnBatchOp::Load { index, .. } if index as usize >= n_inputs => {
+                return Err(BnBatchError::InvalidInputIndex.into());
+            }
+            BnBatchOp::Store { index, .. } if index as usize >= n_outputs => {
+                return Err(BnBatchError::InvalidOutputIndex.into());
+            }
+            _ => {}
+        }
+    }
+
+    let mut registers = vec![0u8; n_registers * len];
+    let mut a = [0u8; MAX_BIGNUMBER_SIZE];
+    let mut b = [0u8; MAX_BIGNUMBER_SIZE];
+    let reg = |i: u8| i as usize * len..(i as usize + 1) * len;
+
+    for chunk in program.chunks_exact(INSTRUCTION_SIZE) {
+        // the operands are copied, as the destination can be one of them
+        match BnBatchOp::decode(chunk.try_into().unwrap())? {
+            BnBatchOp::Load { dst, index } => {
+                let r = &mut registers[reg(dst)];
+                backend.read_input(index as usize, r)?;
+                backend.modm(r, modulus)?;
+            }
+            BnBatchOp::Store { index, src } => {
+                backend.write_output(index as usize, &registers[reg(src)])?;
+            }
+            BnBatchOp::Add { dst, a: x, b: y }
+            | BnBatchOp::Sub { dst, a: x, b: y }
+            | BnBatchOp::Mul { dst, a: x, b: y }
+            | BnBatchOp::Pow { dst, a: x, e: y } => {
+                let op = chunk[0];
+                a[..len].copy_from_slice(&registers[reg(x)]);
+                b[..len].copy_from_slice(&registers[reg(y)]);
+                let r = &mut registers[reg(dst)];
+                let (a, b) = (&a[..len], &b[..len]);
+                match op {
+                    OP_ADD => backend.addm(r, a, b, modulus)?,
+                    OP_SUB => backend.subm(r, a, b, modulus)?,
+                    OP_MUL => backend.multm(r, a, b, modulus)?,
+                    _ => backend.powm(r, a, b, modulus)?,
+                }
+            }
+        }
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use alloc::vec::Vec;
+
+    // Backend for moduli of at most 8 bytes, using u128 arithmetic
+    struct TestBackend {
+        inputs: Vec<[u8; 8]>,
+        outputs: Vec<[u8; 8]>,
+    }
+
+    #[derive(Debug, PartialEq)]
+    enum TestError {
+        Batch(BnBatchError),
+    }
+
+    impl From<BnBatchError> for TestError {
+        fn from(e: BnBatchError) -> Self {
+            TestError::Batch(e)
+        }
+    }
+
+    fn to_u128(x: &[u8]) -> u128 {
+        let mut buf = [0u8; 16];
+        buf[16 - x.len()..].copy_from_slice(x);
+        u128::from_be_bytes(buf)
+    }
+
+    fn write(r: &mut [u8], value: u128) {
+        let len = r.len();
+        r.copy_from_slice(&value.to_be_bytes()[16 - len..]);
+    }
+
+    impl BnBatchBackend for TestBackend {
+        type Error = TestError;
+
+        fn read_input(&mut self, index: usize, dst: &mut [u8]) -> Result<(), TestError> {
+            dst.copy_from_slice(&self.inputs[index]);
+            Ok(())
+        }
+        fn write_output(&mut self, index: usize, src: &[u8]) -> Result<(), TestError> {
+            self.outputs[index].copy_from_slice(src);
+            Ok(())
+        }
+        fn modm(&mut self, r: &mut [u8], m: &[u8]) -> Result<(), TestError> {
+            let value = to_u128(r) % to_u128(m);
+            write(r, value);
+            Ok(())
+        }
+        fn addm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), TestError> {
+            write(r, (to_u128(a) + to_u128(b)) % to_u128(m));
+            Ok(())
+        }
+        fn subm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), TestError> {
+            let m = to_u128(m);
+            write(r, (to_u128(a) + m - to_u128(b)) % m);
+            Ok(())
+        }
+        fn multm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), TestError> {
+            write(r, (to_u128(a) * to_u128(b)) % to_u128(m));
+            Ok(())
+        }
+        fn powm(&mut self, r: &mut [u8], a: &[u8], e: &[u8], m: &[u8]) -> Result<(), TestError> {
+            let (m, e) = (to_u128(m), to_u128(e));
+            let (mut result, mut base) = (1 % m, to_u128(a));
+            for i in 0..128 {
+                if (e >> i) & 1 == 1 {
+                    result = result * base % m;
+                }
+                base = base * base % m;
+            }
+            write(r, result);
+            Ok(())
+        }
+    }
+
+    fn assemble(ops: &[BnBatchOp]) -> Vec<u8> {
+        ops.iter().flat_map(|op| op.encode()).collect()
+    }
+
+    const M: [u8; 8] = 0xffff_ffff_0000_0001u64.to_be_bytes();
+
+    fn run(inputs: &[u64], n_outputs: usize, ops: &[BnBatchOp]) -> Result<Vec<u64>, TestError> {
+        let mut backend = TestBackend {
+            inputs: inputs.iter().map(|x| x.to_be_bytes()).collect(),
+            outputs: vec![[0u8; 8]; n_outputs],
+        };
+        execute(&mut backend, &M, &assemble(ops), inputs.len(), n_outputs)?;
+        Ok(backend
+            .outputs
+            .iter()
+            .map(|x| u64::from_be_bytes(*x))
+            .collect())
+    }
+
+    #[test]
+    fn test_encode_decode() {
+        let ops = [
+            BnBatchOp::Load { dst: 1, index: 2 },
+            BnBatchOp::Store { index: 3, src: 4 },
+            BnBatchOp::Add { dst: 5, a: 6, b: 7 },
+            BnBatchOp::Sub {
+                dst: 8,
+                a: 9,
+                b: 10,
+            },
+            BnBatchOp::Mul {
+                dst: 11,
+                a: 12,
+                b: 13,
+            },
+            BnBatchOp::Pow {
+                dst: 14,
+                a: 15,
+                e: 0,
+            },
+        ];
+        for op in ops {
+            assert_eq!(BnBatchOp::decode(&op.encode()), Ok(op));
+        }
+        assert_eq!(
+            BnBatchOp::decode(&[0xff, 0, 0, 0]),
+            Err(BnBatchError::InvalidOpcode)
+        );
+    }
+
+    #[test]
+    fn test_execute() {
+        let m = u64::from_be_bytes(M) as u128;
+        let (x, y) = (0x1234_5678_9abc_def0u64, 0xffff_ffff_ffff_fff0u64);
+        let (xr, yr) = (x as u128 % m, y as u128 % m);
+
+        // (x + y) * x - y, and x^y
+        let outputs = run(
+            &[x, y],
+            2,
+            &[
+                BnBatchOp::Load { dst: 0, index: 0 },
+                BnBatchOp::Load { dst: 1, index: 1 },
+                BnBatchOp::Add { dst: 2, a: 0, b: 1 },
+                BnBatchOp::Mul { dst: 2, a: 2, b: 0 },
+                BnBatchOp::Sub { dst: 2, a: 2, b: 1 },
+                BnBatchOp::Store { index: 0, src: 2 },
+                BnBatchOp::Pow { dst: 0, a: 0, e: 1 },
+                BnBatchOp::Store { index: 1, src: 0 },
+            ],
+        )
+        .unwrap();
+
+        let expected = ((xr + yr) % m * xr % m + m - yr) % m;
+        assert_eq!(outputs[0] as u128, expected);
+
+        let mut pow = 1u128;
+        for i in (0..64).rev() {
+            pow = pow * pow % m;
+            if (yr >> i) & 1 == 1 {
+                pow = pow * xr % m;
+            }
+        }
+        assert_eq!(outputs[1] as u128, pow);
+    }
+
+    #[test]
+    fn test_registers_start_at_zero() {
+        let outputs = run(&[], 1, &[BnBatchOp::Store { index: 0, src: 3 }]).unwrap();
+        assert_eq!(outputs, vec![0]);
+    }
+
+    #[test]
+    fn test_invalid_programs() {
+        fn err<T>(e: BnBatchError) -> Result<T, TestError> {
+            Err(TestError::Batch(e))
+        }
+        assert_eq!(
+            run(&[1], 1, &[BnBatchOp::Load { dst: 16, index: 0 }]),
+            err(BnBatchError::InvalidRegister)
+        );
+        assert_eq!(
+            run(&[1], 1, &[BnBatchOp::Load { dst: 0, index: 1 }]),
+            err(BnBatchError::InvalidInputIndex)
+        );
+        // the program is validated before any output is written
+        let mut backend = TestBackend {
+            inputs: vec![],
+            outputs: vec![[0xaa; 8]],
+        };
+        let program = assemble(&[
+            BnBatchOp::Store { index: 0, src: 0 },
+            BnBatchOp::Store { index: 1, src: 0 },
+        ]);
+        assert_eq!(
+            execute(&mut backend, &M, &program, 0, 1),
+            err(BnBatchError::InvalidOutputIndex)
+        );
+        assert_eq!(backend.outputs[0], [0xaa; 8]);
+
+        assert_eq!(
+            execute(&mut backend, &M, &[0, 0, 0], 0, 1),
+            err(BnBatchError::InvalidProgramLength)
+        );
+        assert_eq!(
+            execute(&mut backend, &[0u8; 8], &[], 0, 1),
+            err(BnBatchError::InvalidModulus)
+        );
+    }
+}
@@ -0,0 +1,46 @@
+//! Handles of the Montgomery contexts registered with the `bn_mont_init` ECALL.
+//!
+//! The VM keeps the modulus and the precomputed Montgomery constants of each context, and the V-App
+//! refers to them through a handle, which is the index of the context plus one. As the contexts are
+//! not part of the checkpoints of the V-App, a V-App resumed from a checkpoint might use a handle
+//! from a previous run, that now refers to a different context, or to none. Therefore, the V-App
+//! also passes the modulus to each operation, and the VM rejects the handle unless the modulus of
+//! the context is the same, byte by byte.
+
+/// Maximum number of contexts that a V-App can register.
+pub const MAX_BN_CONTEXTS: usize = 8;
+
+/// Returns the handle of the context with the given index. The handle is never 0.
+pub fn handle(index: usize) -> u32 {
+    assert!(index < MAX_BN_CONTEXTS);
+    index as u32 + 1
+}
+
+/// Returns the index of the context referred to by the handle, if the handle is well formed. The
+/// caller must still check that the modulus of the context is the one passed by the V-App.
+pub fn index(handle: u32) -> Option<usize> {
+    let index = handle.checked_sub(1)? as usize;
+    if index >= MAX_BN_CONTEXTS {
+        return None;
+    }
+    Some(index)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_handle() {
+        for i in 0..MAX_BN_CONTEXTS {
+            let h = handle(i);
+            assert_ne!(h, 0);
+            assert_eq!(index(h), Some(i));
+        }
+
+        // unknown indices are rejected, and so is the null handle
+        assert_eq!(index(MAX_BN_CONTEXTS as u32 + 1), None);
+        assert_eq!(index(0x01000001), None);
+        assert_eq!(index(0), None);
+    }
+}
@@ -64,6 +64,9 @@ pub enum ClientCommandCode {
     SendBuffer = 3,
     ReceiveBuffer = 4,
     SendPanicBuffer = 5,
+    Checkpoint = 6,
+    GetCheckpoint = 7,
+    ClientCall = 8,
 }
 
 impl TryFrom<u8> for ClientCommandCode {
@@ -77,6 +80,9 @@ impl TryFrom<u8> for ClientCommandCode {
             3 => Ok(ClientCommandCode::SendBuffer),
             4 => Ok(ClientCommandCode::ReceiveBuffer),
             5 => Ok(ClientCommandCode::SendPanicBuffer),
+            6 => Ok(ClientCommandCode::Checkpoint),
+            7 => Ok(ClientCommandCode::GetCheckpoint),
+            8 => Ok(ClientCommandCode::ClientCall),
             _ => Err("Invalid value for ClientCommandCode"),
         }
     }
@@ -172,16 +178,9 @@ impl CommitPageContentMessage {
             data,
         }
     }
-}
-
-impl Message for CommitPageContentMessage {
-    #[inline]
-    fn serialize_with<F: FnMut(&[u8])>(&self, mut f: F) {
-        f(&[self.command_code as u8]);
-        f(&self.data);
-    }
 
-    fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
+    /// Like `deserialize`, but returns a reference to the content of the page, without copying it.
+    pub fn deserialize_borrowed(data: &[u8]) -> Result<&[u8], MessageDeserializationError> {
         if data.len() != PAGE_SIZE + 1 {
             return Err(MessageDeserializationError::InvalidDataLength);
         }
@@ -191,9 +190,21 @@ impl Message for CommitPageContentMessage {
         if !matches!(command_code, ClientCommandCode::CommitPageContent) {
             return Err(MessageDeserializationError::MismatchingClientCommandCode);
         }
+        Ok(&data[1..])
+    }
+}
+
+impl Message for CommitPageContentMessage {
+    #[inline]
+    fn serialize_with<F: FnMut(&[u8])>(&self, mut f: F) {
+        f(&[self.command_code as u8]);
+        f(&self.data);
+    }
+
+    fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
         Ok(CommitPageContentMessage {
-            command_code,
-            data: data[1..].to_vec(),
+            command_code: ClientCommandCode::CommitPageContent,
+            data: Self::deserialize_borrowed(data)?.to_vec(),
         })
     }
 }
@@ -267,37 +278,71 @@ impl SendBufferMessage {
             data,
         }
     }
+
+    /// Like `deserialize`, but returns the total remaining size and a reference to the data,
+    /// without copying it.
+    #[inline]
+    pub fn deserialize_borrowed(data: &[u8]) -> Result<(u32, &[u8]), MessageDeserializationError> {
+        deserialize_buffer_message(data, ClientCommandCode::SendBuffer)
+    }
+
+    /// Like `serialize_with`, but from a reference to the data, without constructing the message.
+    #[inline]
+    pub fn serialize_borrowed_with<F: FnMut(&[u8])>(
+        total_remaining_size: u32,
+        data: &[u8],
+        mut f: F,
+    ) {
+        f(&[ClientCommandCode::SendBuffer as u8]);
+        f(&total_remaining_size.to_be_bytes());
+        f(data);
+    }
 }
 
 impl Message for SendBufferMessage {
     #[inline]
-    fn serialize_with<F: FnMut(&[u8])>(&self, mut f: F) {
-        f(&[self.command_code as u8]);
-        f(&self.total_remaining_size.to_be_bytes());
-        f(&self.data);
+    fn serialize_with<F: FnMut(&[u8])>(&self, f: F) {
+        Self::serialize_borrowed_with(self.total_remaining_size, &self.data, f);
     }
 
     fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
-        let command_code = ClientCommandCode::try_from(data[0])
-            .map_err(|_| MessageDeserializationError::InvalidClientCommandCode)?;
-        if (!matches!(command_code, ClientCommandCode::SendBuffer)) || (data.len() < 5) {
-            return Err(MessageDeserializationError::MismatchingClientCommandCode);
-        }
-        let total_remaining_size = u32::from_be_bytes([data[1], data[2], data[3], data[4]]);
-        let data = data[5..].to_vec();
-
-        if data.len() > total_remaining_size as usize {
-            return Err(MessageDeserializationError::InvalidDataLength);
-        }
+        let (total_remaining_size, data) = Self::deserialize_borrowed(data)?;
 
         Ok(SendBufferMessage {
-            command_code,
+            command_code: ClientCommandCode::SendBuffer,
             total_remaining_size,
-            data,
+            data: data.to_vec(),
         })
     }
 }
 
+// Common deserialization logic of SendBufferMessage and SendPanicBufferMessage, that only differ in the command code.
+fn deserialize_buffer_message(
+    data: &[u8],
+    expected_command_code: ClientCommandCode,
+) -> Result<(u32, &[u8]), MessageDeserializationError> {
+    if data.is_empty() {
+        return Err(MessageDeserializationError::InvalidDataLength);
+    }
+    let command_code = ClientCommandCode::try_from(data[0])
+        .map_err(|_| MessageDeserializationError::InvalidClientCommandCode)?;
+    if command_code as u8 != expected_command_code as u8 {
+        return Err(MessageDeserializationError::MismatchingClientCommandCode);
+    }
+
+    if data.len() < 5 {
+        return Err(MessageDeserializationError::InvalidDataLength);
+    }
+    let total_remaining_size = u32::from_be_bytes([data[1], data[2], data[3], data[4]]);
+    let data = &data[5..];
+
+    if data.len() > total_remaining_size as usize {
+        return Err(MessageDeserializationError::InvalidDataLength);
+    }
+
+    Ok((total_remaining_size, data))
+}
+
 /// Message sent by the VM to receive a buffer during an ECALL_XRECV.
 #[derive(Debug, Clone)]
 pub struct ReceiveBufferMessage {
@@ -347,17 +392,22 @@ impl ReceiveBufferResponse {
             content,
         }
     }
-}
 
-impl Message for ReceiveBufferResponse {
+    /// Like `serialize_with`, but from a reference to the content, without constructing the message.
     #[inline]
-    fn serialize_with<F: FnMut(&[u8])>(&self, mut f: F) {
-        f(&self.remaining_length.to_be_bytes());
-        f(&self.content);
+    pub fn serialize_borrowed_with<F: FnMut(&[u8])>(
+        remaining_length: u32,
+        content: &[u8],
+        mut f: F,
+    ) {
+        f(&remaining_length.to_be_bytes());
+        f(content);
     }
 
+    /// Like `deserialize`, but returns the remaining length and a reference to the content,
+    /// without copying it.
     #[inline]
-    fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
+    pub fn deserialize_borrowed(data: &[u8]) -> Result<(u32, &[u8]), MessageDeserializationError> {
         if data.len() < 4 {
             return Err(MessageDeserializationError::InvalidDataLength);
         }
@@ -365,9 +415,22 @@ impl Message for ReceiveBufferResponse {
         if data.len() - 4 > remaining_length as usize {
             return Err(MessageDeserializationError::InvalidDataLength);
         }
+        Ok((remaining_length, &data[4..]))
+    }
+}
+
+impl Message for ReceiveBufferResponse {
+    #[inline]
+    fn serialize_with<F: FnMut(&[u8])>(&self, f: F) {
+        Self::serialize_borrowed_with(self.remaining_length, &self.content, f);
+    }
+
+    #[inline]
+    fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
+        let (remaining_length, content) = Self::deserialize_borrowed(data)?;
         Ok(ReceiveBufferResponse {
             remaining_length,
-            content: data[4..].to_vec(),
+            content: content.to_vec(),
         })
     }
 }
@@ -393,37 +456,259 @@ impl SendPanicBufferMessage {
             data,
         }
     }
+
+    /// Like `deserialize`, but returns the total remaining size and a reference to the data,
+    /// without copying it.
+    #[inline]
+    pub fn deserialize_borrowed(data: &[u8]) -> Result<(u32, &[u8]), MessageDeserializationError> {
+        deserialize_buffer_message(data, ClientCommandCode::SendPanicBuffer)
+    }
+
+    /// Like `serialize_with`, but from a reference to the data, without constructing the message.
+    #[inline]
+    pub fn serialize_borrowed_with<F: FnMut(&[u8])>(
+        total_remaining_size: u32,
+        data: &[u8],
+        mut f: F,
+    ) {
+        f(&[ClientCommandCode::SendPanicBuffer as u8]);
+        f(&total_remaining_size.to_be_bytes());
+        f(data);
+    }
 }
 
 impl Message for SendPanicBufferMessage {
     #[inline]
-    fn serialize_with<F: FnMut(&[u8])>(&self, mut f: F) {
-        f(&[self.command_code as u8]);
-        f(&self.total_remaining_size.to_be_bytes());
-        f(&self.data);
+    fn serialize_with<F: FnMut(&[u8])>(&self, f: F) {
+        Self::serialize_borrowed_with(self.total_remaining_size, &self.data, f);
     }
 
     fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
+        let (total_remaining_size, data) = Self::deserialize_borrowed(data)?;
+
+        Ok(SendPanicBufferMessage {
+            command_code: ClientCommandCode::SendPanicBuffer,
+            total_remaining_size,
+            data: data.to_vec(),
+        })
+    }
+}
+
+/// Message sent by the VM during an ECALL_CLIENT_CALL, to send the payload of a request (or a chunk of
+/// it) to the handler registered by the host for request_id. Once the whole payload is sent, the VM
+/// receives the reply exactly as in an ECALL_XRECV.
+#[derive(Debug, Clone)]
+pub struct ClientCallMessage {
+    pub command_code: ClientCommandCode,
+    pub request_id: u32,
+    pub total_remaining_size: u32,
+    pub data: Vec<u8>,
+}
+
+impl ClientCallMessage {
+    #[inline]
+    pub fn new(request_id: u32, total_remaining_size: u32, data: Vec<u8>) -> Self {
+        if data.len() > total_remaining_size as usize {
+            panic!("Data size exceeds total remaining size");
+        }
+
+        ClientCallMessage {
+            command_code: ClientCommandCode::ClientCall,
+            request_id,
+            total_remaining_size,
+            data,
+        }
+    }
+
+    /// Like `deserialize`, but returns the request id, the total remaining size and a reference to
+    /// the data, without copying it.
+    #[inline]
+    pub fn deserialize_borrowed(
+        data: &[u8],
+    ) -> Result<(u32, u32, &[u8]), MessageDeserializationError> {
+        if data.is_empty() {
+            return Err(MessageDeserializationError::InvalidDataLength);
+        }
         let command_code = ClientCommandCode::try_from(data[0])
             .map_err(|_| MessageDeserializationError::InvalidClientCommandCode)?;
-        if !matches!(command_code, ClientCommandCode::SendPanicBuffer) {
+        if !matches!(command_code, ClientCommandCode::ClientCall) {
             return Err(MessageDeserializationError::MismatchingClientCommandCode);
         }
 
-        if data.len() < 5 {
+        if data.len() < 9 {
             return Err(MessageDeserializationError::InvalidDataLength);
         }
-        let total_remaining_size = u32::from_be_bytes([data[1], data[2], data[3], data[4]]);
-        let data = data[5..].to_vec();
+        let request_id = u32::from_be_bytes([data[1], data[2], data[3], data[4]]);
+        let total_remaining_size = u32::from_be_bytes([data[5], data[6], data[7], data[8]]);
+        let payload = &data[9..];
 
-        if data.len() > total_remaining_size as usize {
+        if payload.len() > total_remaining_size as usize {
             return Err(MessageDeserializationError::InvalidDataLength);
         }
 
-        Ok(SendPanicBufferMessage {
-            command_code,
+        Ok((request_id, total_remaining_size, payload))
+    }
+
+    /// Like `serialize_with`, but from a reference to the data, without constructing the message.
+    #[inline]
+    pub fn serialize_borrowed_with<F: FnMut(&[u8])>(
+        request_id: u32,
+        total_remaining_size: u32,
+        data: &[u8],
+        mut f: F,
+    ) {
+        f(&[ClientCommandCode::ClientCall as u8]);
+        f(&request_id.to_be_bytes());
+        f(&total_remaining_size.to_be_bytes());
+        f(data);
+    }
+}
+
+impl Message for ClientCallMessage {
+    #[inline]
+    fn serialize_with<F: FnMut(&[u8])>(&self, f: F) {
+        Self::serialize_borrowed_with(self.request_id, self.total_remaining_size, &self.data, f);
+    }
+
+    fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
+        let (request_id, total_remaining_size, data) = Self::deserialize_borrowed(data)?;
+
+        Ok(ClientCallMessage {
+            command_code: ClientCommandCode::ClientCall,
+            request_id,
             total_remaining_size,
-            data,
+            data: data.to_vec(),
         })
     }
 }
+
+/// The state of the CPU when the V-App took a checkpoint, together with the VM's authentication of it.
+/// The content of the memory is not part of it, as it is already stored by the host.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct VAppCheckpoint {
+    pub pc: u32,
+    pub regs: [u32; 32],
+    pub hmac: [u8; 32],
+}
+
+impl VAppCheckpoint {
+    pub const SERIALIZED_LEN: usize = 4 + 32 * 4 + 32;
+
+    /// Serializes the state of the CPU, without the hmac; this is the content that the hmac authenticates.
+    #[inline]
+    pub fn serialize_state_with<F: FnMut(&[u8])>(pc: u32, regs: &[u32; 32], mut f: F) {
+        f(&pc.to_be_bytes());
+        for reg in regs.iter() {
+            f(&reg.to_be_bytes());
+        }
+    }
+
+    #[inline]
+    pub fn serialize_with<F: FnMut(&[u8])>(&self, mut f: F) {
+        Self::serialize_state_with(self.pc, &self.regs, &mut f);
+        f(&self.hmac);
+    }
+
+    pub fn serialize(&self) -> Vec<u8> {
+        let mut result = Vec::with_capacity(Self::SERIALIZED_LEN);
+        self.serialize_with(|data| result.extend_from_slice(data));
+        result
+    }
+
+    pub fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
+        if data.len() != Self::SERIALIZED_LEN {
+            return Err(MessageDeserializationError::InvalidDataLength);
+        }
+        let read_u32 = |pos: usize| {
+            u32::from_be_bytes([data[pos], data[pos + 1], data[pos + 2], data[pos + 3]])
+        };
+
+        let pc = read_u32(0);
+        let mut regs = [0u32; 32];
+        for (i, reg) in regs.iter_mut().enumerate() {
+            *reg = read_u32(4 + 4 * i);
+        }
+        let mut hmac = [0u8; 32];
+        hmac.copy_from_slice(&data[4 + 32 * 4..]);
+
+        Ok(VAppCheckpoint { pc, regs, hmac })
+    }
+}
+
+/// Message sent by the VM during an ECALL_CHECKPOINT, after committing all the modified pages.
+/// The host can later resume the V-App from this state, using its copy of the memory.
+#[derive(Debug, Clone)]
+pub struct CheckpointMessage {
+    pub command_code: ClientCommandCode,
+    pub checkpoint: VAppCheckpoint,
+}
+
+impl CheckpointMessage {
+    #[inline]
+    pub fn new(checkpoint: VAppCheckpoint) -> Self {
+        CheckpointMessage {
+            command_code: ClientCommandCode::Checkpoint,
+            checkpoint,
+        }
+    }
+}
+
+impl Message for CheckpointMessage {
+    #[inline]
+    fn serialize_with<F: FnMut(&[u8])>(&self, mut f: F) {
+        f(&[self.command_code as u8]);
+        self.checkpoint.serialize_with(f);
+    }
+
+    fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
+        if data.is_empty() {
+            return Err(MessageDeserializationError::InvalidDataLength);
+        }
+        let command_code = ClientCommandCode::try_from(data[0])
+            .map_err(|_| MessageDeserializationError::InvalidClientCommandCode)?;
+        if !matches!(command_code, ClientCommandCode::Checkpoint) {
+            return Err(MessageDeserializationError::MismatchingClientCommandCode);
+        }
+
+        Ok(CheckpointMessage {
+            command_code,
+            checkpoint: VAppCheckpoint::deserialize(&data[1..])?,
+        })
+    }
+}
+
+/// Message sent by the VM when resuming a V-App, to request the checkpoint to resume from.
+/// The host responds with the serialized VAppCheckpoint.
+#[derive(Debug, Clone)]
+pub struct GetCheckpointMessage {
+    pub command_code: ClientCommandCode,
+}
+
+impl GetCheckpointMessage {
+    #[inline]
+    pub fn new() -> Self {
+        GetCheckpointMessage {
+            command_code: ClientCommandCode::GetCheckpoint,
+        }
+    }
+}
+
+impl Message for GetCheckpointMessage {
+    #[inline]
+    fn serialize_with<F: FnMut(&[u8])>(&self, mut f: F) {
+        f(&[self.command_code as u8]);
+    }
+
+    fn deserialize(data: &[u8]) -> Result<Self, MessageDeserializationError> {
+        if data.len() != 1 {
+            return Err(MessageDeserializationError::InvalidDataLength);
+        }
+        let command_code = ClientCommandCode::try_from(data[0])
+            .map_err(|_| MessageDeserializationError::InvalidClientCommandCode)?;
+        if !matches!(command_code, ClientCommandCode::GetCheckpoint) {
+            return Err(MessageDeserializationError::MismatchingClientCommandCode);
+        }
+
+        Ok(GetCheckpointMessage { command_code })
+    }
+}
@@ -9,3 +9,16 @@ pub const ACK: [u8; 1] = [0x42];
 
 /// The length of each chunk of data to be sent or received when calling xrecv/xsend.
 pub const CHUNK_LENGTH: usize = 256;
+
+/// Flag set in the most significant bit of the 4-byte length prefix of a message to select the
+/// streamed framing. In the streamed framing, the receiver acknowledges the first chunk only, and
+/// the rest of the message is transmitted with a single xsend/xrecv, which the VM splits in as
+/// many APDUs as needed. A V-App that receives a streamed message replies with a streamed message.
+/// Messages sent without the flag use the original framing, where each chunk is acknowledged.
+///
+/// V-Apps built before the streamed framing would read the flag as part of the length; therefore,
+/// clients only set it if the V-App exports the `STREAMED_FRAMING_SYMBOL` symbol.
+pub const STREAMED_FLAG: u32 = 0x8000_0000;
+
+/// Name of the symbol that V-Apps supporting the streamed framing export.
+pub const STREAMED_FRAMING_SYMBOL: &str = "VANADIUM_COMM_STREAMED_FRAMING";
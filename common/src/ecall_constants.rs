@@ -1,15 +1,94 @@
-pub const ECALL_FATAL: u32 = 1;
-pub const ECALL_XSEND: u32 = 2;
-pub const ECALL_XRECV: u32 = 3;
-pub const ECALL_EXIT: u32 = 4;
-pub const ECALL_UX_IDLE: u32 = 12;
-
-// Big numbers
-pub const ECALL_MODM: u32 = 110;
-pub const ECALL_ADDM: u32 = 111;
-pub const ECALL_SUBM: u32 = 112;
-pub const ECALL_MULTM: u32 = 113;
-pub const ECALL_POWM: u32 = 114;
+/// The specification of all the ECALLs, from which their constants, the stubs of the V-Apps and
+/// the dispatch of the ECALLs in the VM are generated.
+///
+/// Each entry gives the kind of the ECALL, the name and the code of its constant, and its signature
+/// as seen from the V-App; the arguments are passed in `a0`, `a1`, ..., in this order, and the
+/// return value, if any, in `a0`. The kind is one of:
+/// - `interface`: the ECALL is part of the `EcallsInterface` of the app-sdk;
+/// - `target`: the ECALL is specific to the Risc-V target;
+/// - `diverging`: the ECALL never returns to the V-App, and its stub is written by hand.
+///
+/// `all_ecalls!(callback)` invokes `callback!` once, with all the entries, each of them followed
+/// by a `;`. The arguments of each signature are a single token tree, and so is the return type.
+#[macro_export]
+macro_rules! all_ecalls {
+    ($cb:path $(, $($prefix:tt)*)?) => {
+        $cb! {
+            $($($prefix)*)?
+            diverging ECALL_FATAL = 1, fn fatal(msg: *const u8, size: usize) -> !;
+            interface ECALL_XSEND = 2, fn xsend(buffer: *const u8, size: usize);
+            interface ECALL_XRECV = 3, fn xrecv(buffer: *mut u8, size: usize) -> usize;
+            diverging ECALL_EXIT = 4, fn exit(status: i32) -> !;
+            interface ECALL_CHECKPOINT = 5, fn checkpoint() -> u32;
+            interface ECALL_CLIENT_CALL = 6, fn client_call(request_id: u32, payload: *const u8, payload_len: usize, reply: *mut u8, reply_max_len: usize) -> usize;
+            interface ECALL_UX_IDLE = 12, fn ux_idle();
+
+            // Memory intrinsics
+            target ECALL_MEMCPY = 20, fn memcpy(dst: *mut u8, src: *const u8, n: usize);
+            target ECALL_MEMSET = 21, fn memset(dst: *mut u8, c: u8, n: usize);
+            target ECALL_MEMCMP = 22, fn memcmp(a: *const u8, b: *const u8, n: usize) -> i32;
+
+            // Big numbers
+            interface ECALL_MODM = 110, fn bn_modm(r: *mut u8, n: *const u8, len: usize, m: *const u8, len_m: usize) -> u32;
+            interface ECALL_ADDM = 111, fn bn_addm(r: *mut u8, a: *const u8, b: *const u8, m: *const u8, len: usize) -> u32;
+            interface ECALL_SUBM = 112, fn bn_subm(r: *mut u8, a: *const u8, b: *const u8, m: *const u8, len: usize) -> u32;
+            interface ECALL_MULTM = 113, fn bn_multm(r: *mut u8, a: *const u8, b: *const u8, m: *const u8, len: usize) -> u32;
+            interface ECALL_POWM = 114, fn bn_powm(r: *mut u8, a: *const u8, e: *const u8, len_e: usize, m: *const u8, len: usize) -> u32;
+            interface ECALL_BN_BATCH = 115, fn bn_batch(m: *const u8, len: usize, program: *const u8, program_len: usize, inputs: *const u8, n_inputs: usize, outputs: *mut u8, n_outputs: usize) -> u32;
+            interface ECALL_BN_MONT_INIT = 116, fn bn_mont_init(m: *const u8, len: usize) -> u32;
+            interface ECALL_BN_MONT_MULTM = 117, fn bn_mont_multm(handle: u32, r: *mut u8, a: *const u8, b: *const u8, m: *const u8) -> u32;
+            interface ECALL_BN_MONT_POWM = 118, fn bn_mont_powm(handle: u32, r: *mut u8, a: *const u8, e: *const u8, len_e: usize, m: *const u8) -> u32;
+
+            // HD derivations
+            interface ECALL_DERIVE_HD_NODE = 130, fn derive_hd_node(curve: u32, path: *const u32, path_len: usize, privkey: *mut u8, chain_code: *mut u8) -> u32;
+            interface ECALL_GET_MASTER_FINGERPRINT = 131, fn get_master_fingerprint(curve: u32) -> u32;
+            interface ECALL_DERIVE_HD_PUBKEYS = 132, fn derive_hd_pubkeys(curve: u32, path: *const u32, path_len: usize, first_child: u32, n_children: usize, parent_fingerprint: *mut u8, children: *mut u8) -> u32;
+
+            // Hash functions
+            target ECALL_HASH_INIT = 150, fn hash_init(hash_id: u32, ctx: *mut u8);
+            target ECALL_HASH_UPDATE = 151, fn hash_update(hash_id: u32, ctx: *mut u8, data: *const u8, len: usize) -> u32;
+            target ECALL_HASH_DIGEST = 152, fn hash_final(hash_id: u32, ctx: *mut u8, digest: *mut u8) -> u32;
+            target ECALL_HASH_ONESHOT = 153, fn hash_oneshot(hash_id: u32, data: *const u8, len: usize, digest: *mut u8) -> u32;
+            target ECALL_HASH_VECTORED = 154, fn hash_vectored(hash_id: u32, segments: *const u8, n_segments: usize, digest: *mut u8) -> u32;
+            interface ECALL_MERKLE_ROOT = 155, fn merkle_root(kind: u32, leaves: *const u8, n_leaves: usize, depths: *const u8, root: *mut u8) -> u32;
+
+            // Operations for public keys over elliptic curves
+            interface ECALL_ECFP_ADD_POINT = 160, fn ecfp_add_point(curve: u32, r: *mut u8, p: *const u8, q: *const u8) -> u32;
+            interface ECALL_ECFP_SCALAR_MULT = 161, fn ecfp_scalar_mult(curve: u32, r: *mut u8, p: *const u8, k: *const u8, k_len: usize) -> u32;
+            interface ECALL_ECFP_MSM = 162, fn ecfp_msm(curve: u32, r: *mut u8, points: *const u8, scalars: *const u8, n: usize) -> u32;
+
+            // Signatures
+            interface ECALL_ECDSA_SIGN = 180, fn ecdsa_sign(curve: u32, mode: u32, hash_id: u32, privkey: *const u8, msg_hash: *const u8, signature: *mut u8) -> usize;
+            interface ECALL_ECDSA_VERIFY = 181, fn ecdsa_verify(curve: u32, pubkey: *const u8, msg_hash: *const u8, signature: *const u8, signature_len: usize) -> u32;
+            interface ECALL_SCHNORR_SIGN = 182, fn schnorr_sign(curve: u32, mode: u32, hash_id: u32, privkey: *const u8, msg: *const u8, msg_len: usize, signature: *mut u8) -> usize;
+            interface ECALL_SCHNORR_VERIFY = 183, fn schnorr_verify(curve: u32, mode: u32, hash_id: u32, pubkey: *const u8, msg: *const u8, msg_len: usize, signature: *const u8, signature_len: usize) -> u32;
+        }
+    };
+}
+
+/// Invokes `callback!` once per entry of the specification (see `all_ecalls!`).
+#[macro_export]
+macro_rules! for_each_ecall {
+    ($cb:ident) => {
+        $crate::all_ecalls!($crate::__for_each_ecall_entry, $cb);
+    };
+}
+
+#[doc(hidden)]
+#[macro_export]
+macro_rules! __for_each_ecall_entry {
+    ($cb:ident $($kind:ident $constant:ident = $code:literal, fn $name:ident $args:tt $(-> $ret:tt)?;)*) => {
+        $($cb! { $kind $constant = $code, fn $name $args $(-> $ret)? })*
+    };
+}
+
+macro_rules! define_ecall_constant {
+    ($kind:ident $constant:ident = $code:literal, fn $($signature:tt)*) => {
+        pub const $constant: u32 = $code;
+    };
+}
+
+for_each_ecall!(define_ecall_constant);
 
 pub const MAX_BIGNUMBER_SIZE: usize = 64;
 
@@ -41,19 +120,39 @@ pub enum SchnorrSignMode {
     BIP340 = 0,
 }
 
-pub const ECALL_DERIVE_HD_NODE: u32 = 130;
-pub const ECALL_GET_MASTER_FINGERPRINT: u32 = 131;
+// Maximum number of children derived by a single derive_hd_pubkeys ECALL
+pub const MAX_HD_CHILDREN: usize = 32;
 
-// Hash functions
-pub const ECALL_HASH_INIT: u32 = 150;
-pub const ECALL_HASH_UPDATE: u32 = 151;
-pub const ECALL_HASH_DIGEST: u32 = 152;
+// Maximum number of segments hashed by a single hash_vectored ECALL
+pub const MAX_HASH_SEGMENTS: usize = 16;
 
-// Operations for public keys over elliptic curves
-pub const ECALL_ECFP_ADD_POINT: u32 = 160;
-pub const ECALL_ECFP_SCALAR_MULT: u32 = 161;
+// Maximum number of points of a multi-scalar multiplication
+pub const MAX_MSM_POINTS: usize = 32;
 
-pub const ECALL_ECDSA_SIGN: u32 = 180;
-pub const ECALL_ECDSA_VERIFY: u32 = 181;
-pub const ECALL_SCHNORR_SIGN: u32 = 182;
-pub const ECALL_SCHNORR_VERIFY: u32 = 183;
+#[cfg(test)]
+mod tests {
+    use alloc::vec::Vec;
+
+    #[test]
+    fn test_ecall_spec() {
+        let mut entries: Vec<(u32, &str, usize)> = Vec::new();
+        macro_rules! collect_entry {
+            ($kind:ident $constant:ident = $code:literal, fn $name:ident($($arg:ident: $ty:ty),*) $(-> $ret:ty)?) => {
+                assert_eq!($code, super::$constant);
+                entries.push(($code, stringify!($name), <[&str]>::len(&[$(stringify!($arg)),*])));
+            };
+        }
+        for_each_ecall!(collect_entry);
+
+        // ECALLs have at most 8 arguments, passed in registers
+        assert!(entries.iter().all(|&(_, _, n_args)| n_args <= 8));
+
+        // codes and names are unique
+        for (i, a) in entries.iter().enumerate() {
+            for b in &entries[i + 1..] {
+                assert_ne!(a.0, b.0, "{} and {} have the same code", a.1, b.1);
+                assert_ne!(a.1, b.1);
+            }
+        }
+    }
+}
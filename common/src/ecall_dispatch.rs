@@ -0,0 +1,318 @@
+//! Decoding of the ECALLs made by the V-App, generated from the specification in `all_ecalls!`.
+//!
+//! The handlers of the ECALLs implement `EcallDispatch`, that has one method per ECALL with the same
+//! name and arguments as in the specification, where the pointers of the V-App are replaced by
+//! `GuestPointer`s. `dispatch_ecall` decodes the code and the arguments of the ECALL from the
+//! registers, calls the corresponding method, and stores its return value in `a0`. As every handler
+//! must implement all the methods, the implementations can not drift apart from the specification.
+
+use crate::vm::{Cpu, EcallHandler};
+
+// Indices of the registers used by the ECALLs
+const REG_T0: usize = 5;
+const REG_A0: usize = 10;
+const REG_A7: usize = 17;
+
+/// A pointer in the address space of the V-App.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct GuestPointer(pub u32);
+
+/// The type of an argument in the specification of an ECALL, and how its value is decoded from the
+/// register.
+pub trait EcallArg {
+    /// The type of the argument, as seen by the handler of the ECALL.
+    type Value;
+
+    fn from_reg(value: u32) -> Self::Value;
+}
+
+impl EcallArg for u32 {
+    type Value = u32;
+
+    #[inline(always)]
+    fn from_reg(value: u32) -> u32 {
+        value
+    }
+}
+
+// Only the least significant byte of the register is defined
+impl EcallArg for u8 {
+    type Value = u8;
+
+    #[inline(always)]
+    fn from_reg(value: u32) -> u8 {
+        value as u8
+    }
+}
+
+impl EcallArg for i32 {
+    type Value = i32;
+
+    #[inline(always)]
+    fn from_reg(value: u32) -> i32 {
+        value as i32
+    }
+}
+
+impl EcallArg for usize {
+    type Value = usize;
+
+    #[inline(always)]
+    fn from_reg(value: u32) -> usize {
+        value as usize
+    }
+}
+
+impl<T> EcallArg for *const T {
+    type Value = GuestPointer;
+
+    #[inline(always)]
+    fn from_reg(value: u32) -> GuestPointer {
+        GuestPointer(value)
+    }
+}
+
+impl<T> EcallArg for *mut T {
+    type Value = GuestPointer;
+
+    #[inline(always)]
+    fn from_reg(value: u32) -> GuestPointer {
+        GuestPointer(value)
+    }
+}
+
+/// The type of the return value of an ECALL, encoded in `a0`.
+pub trait EcallReturn {
+    fn into_reg(self) -> u32;
+}
+
+impl EcallReturn for u32 {
+    #[inline(always)]
+    fn into_reg(self) -> u32 {
+        self
+    }
+}
+
+impl EcallReturn for i32 {
+    #[inline(always)]
+    fn into_reg(self) -> u32 {
+        self as u32
+    }
+}
+
+impl EcallReturn for usize {
+    #[inline(always)]
+    fn into_reg(self) -> u32 {
+        self as u32
+    }
+}
+
+// Declares the method handling an ECALL. The diverging ECALLs never resume the V-App, therefore
+// their method returns the error that stops it.
+macro_rules! ecall_method {
+    (diverging $constant:ident = $code:literal, fn $name:ident($($arg:ident: $ty:ty),*) -> !) => {
+        fn $name(
+            &mut self,
+            cpu: &mut Cpu<Self::Memory>,
+            $($arg: <$ty as EcallArg>::Value),*
+        ) -> Self::Error;
+    };
+    ($kind:ident $constant:ident = $code:literal, fn $name:ident($($arg:ident: $ty:ty),*) -> $ret:ty) => {
+        fn $name(
+            &mut self,
+            cpu: &mut Cpu<Self::Memory>,
+            $($arg: <$ty as EcallArg>::Value),*
+        ) -> Result<$ret, Self::Error>;
+    };
+    ($kind:ident $constant:ident = $code:literal, fn $name:ident($($arg:ident: $ty:ty),*)) => {
+        fn $name(
+            &mut self,
+            cpu: &mut Cpu<Self::Memory>,
+            $($arg: <$ty as EcallArg>::Value),*
+        ) -> Result<(), Self::Error>;
+    };
+}
+
+/// The handlers of all the ECALLs of the specification.
+// The methods take the arguments of the ECALLs, up to the 8 argument registers
+#[allow(clippy::too_many_arguments)]
+pub trait EcallDispatch: EcallHandler {
+    /// Returns the error for an ECALL that is not in the specification.
+    fn unhandled_ecall(&mut self, code: u32) -> Self::Error;
+
+    crate::for_each_ecall!(ecall_method);
+}
+
+/// Handles the ECALL made by the V-App: the code is in `t0`, the arguments in `a0`, `a1`, ..., and
+/// the return value, if any, is stored in `a0`.
+pub fn dispatch_ecall<H: EcallDispatch>(
+    handler: &mut H,
+    cpu: &mut Cpu<H::Memory>,
+) -> Result<(), H::Error> {
+    let code = cpu.regs[REG_T0];
+    let regs = cpu.regs;
+
+    // Calls the method of an ECALL, and stores its return value in a0.
+    // ECALLs have at most 8 arguments (see test_ecall_spec), therefore the registers never run out
+    macro_rules! dispatch_call {
+        (diverging $name:ident($($arg:ident: $ty:ty),*) -> !) => {{
+            #[allow(unused_mut, unused_variables)]
+            let mut args = regs[REG_A0..=REG_A7].iter().copied();
+            Err(handler.$name(
+                cpu,
+                $(<$ty as EcallArg>::from_reg(args.next().unwrap_or(0))),*
+            ))
+        }};
+        ($kind:ident $name:ident($($arg:ident: $ty:ty),*) -> $ret:ty) => {{
+            #[allow(unused_mut, unused_variables)]
+            let mut args = regs[REG_A0..=REG_A7].iter().copied();
+            let ret: $ret = handler.$name(
+                cpu,
+                $(<$ty as EcallArg>::from_reg(args.next().unwrap_or(0))),*
+            )?;
+            cpu.regs[REG_A0] = EcallReturn::into_reg(ret);
+            Ok(())
+        }};
+        ($kind:ident $name:ident($($arg:ident: $ty:ty),*)) => {{
+            #[allow(unused_mut, unused_variables)]
+            let mut args = regs[REG_A0..=REG_A7].iter().copied();
+            handler.$name(
+                cpu,
+                $(<$ty as EcallArg>::from_reg(args.next().unwrap_or(0))),*
+            )
+        }};
+    }
+
+    // A single match over the codes of all the ECALLs
+    macro_rules! dispatch_match {
+        ($($kind:ident $constant:ident = $code:literal, fn $name:ident $args:tt $(-> $ret:tt)?;)*) => {
+            return match code {
+                $($code => dispatch_call!($kind $name $args $(-> $ret)?),)*
+                _ => Err(handler.unhandled_ecall(code)),
+            };
+        };
+    }
+    crate::all_ecalls!(dispatch_match);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::constants::PAGE_SIZE;
+    use crate::ecall_constants::*;
+    use crate::vm::{MemorySegment, VecMemory};
+    use alloc::format;
+    use alloc::string::String;
+    use alloc::vec::Vec;
+
+    // Records the name and the arguments of each ECALL, and returns 42 from all of them
+    #[derive(Default)]
+    struct RecordingHandler {
+        calls: Vec<(&'static str, Vec<String>)>,
+    }
+
+    #[derive(Debug, PartialEq, Eq)]
+    enum TestError {
+        Diverged(&'static str),
+        Unhandled(u32),
+    }
+
+    impl EcallHandler for RecordingHandler {
+        type Memory = VecMemory;
+        type Error = TestError;
+
+        fn handle_ecall(&mut self, cpu: &mut Cpu<VecMemory>) -> Result<(), TestError> {
+            dispatch_ecall(self, cpu)
+        }
+    }
+
+    macro_rules! recording_method {
+        (diverging $constant:ident = $code:literal, fn $name:ident($($arg:ident: $ty:ty),*) -> !) => {
+            fn $name(
+                &mut self,
+                _cpu: &mut Cpu<VecMemory>,
+                $($arg: <$ty as EcallArg>::Value),*
+            ) -> TestError {
+                self.calls.push((stringify!($name), alloc::vec![$(format!("{:?}", $arg)),*]));
+                TestError::Diverged(stringify!($name))
+            }
+        };
+        ($kind:ident $constant:ident = $code:literal, fn $name:ident($($arg:ident: $ty:ty),*) $(-> $ret:ty)?) => {
+            #[allow(unused_parens)]
+            fn $name(
+                &mut self,
+                _cpu: &mut Cpu<VecMemory>,
+                $($arg: <$ty as EcallArg>::Value),*
+            ) -> Result<($($ret)?), TestError> {
+                self.calls.push((stringify!($name), alloc::vec![$(format!("{:?}", $arg)),*]));
+                Ok(($(42 as $ret)?))
+            }
+        };
+    }
+
+    impl EcallDispatch for RecordingHandler {
+        fn unhandled_ecall(&mut self, code: u32) -> TestError {
+            TestError::Unhandled(code)
+        }
+
+        crate::for_each_ecall!(recording_method);
+    }
+
+    fn new_cpu(code: u32, args: &[u32]) -> Cpu<VecMemory> {
+        let segment = || MemorySegment::new(0, PAGE_SIZE as u32, VecMemory::new(1)).unwrap();
+        let mut cpu = Cpu::new(0, segment(), segment(), segment());
+        cpu.regs[REG_T0] = code;
+        cpu.regs[REG_A0..REG_A0 + args.len()].copy_from_slice(args);
+        cpu
+    }
+
+    #[test]
+    fn test_dispatch_decodes_arguments() {
+        let mut handler = RecordingHandler::default();
+        let mut cpu = new_cpu(ECALL_MEMSET, &[0x1000, 0xab, 16]);
+        assert_eq!(handler.handle_ecall(&mut cpu), Ok(()));
+        assert_eq!(
+            handler.calls,
+            [(
+                "memset",
+                ["GuestPointer(4096)", "171", "16"]
+                    .map(String::from)
+                    .to_vec()
+            )]
+        );
+        // memset returns nothing, a0 is unchanged
+        assert_eq!(cpu.regs[REG_A0], 0x1000);
+
+        // the eighth argument is taken from a7
+        let args = [1, 2, 3, 4, 5, 6, 7, 8];
+        let mut cpu = new_cpu(ECALL_SCHNORR_VERIFY, &args);
+        assert_eq!(handler.handle_ecall(&mut cpu), Ok(()));
+        assert_eq!(handler.calls[1].0, "schnorr_verify");
+        assert_eq!(handler.calls[1].1[7], "8");
+    }
+
+    #[test]
+    fn test_dispatch_return_value() {
+        let mut handler = RecordingHandler::default();
+        let mut cpu = new_cpu(ECALL_MEMCMP, &[0x1000, 0x2000, 32]);
+        assert_eq!(handler.handle_ecall(&mut cpu), Ok(()));
+        assert_eq!(cpu.regs[REG_A0], 42);
+    }
+
+    #[test]
+    fn test_dispatch_diverging_and_unhandled() {
+        let mut handler = RecordingHandler::default();
+        let mut cpu = new_cpu(ECALL_EXIT, &[(-1i32) as u32]);
+        assert_eq!(
+            handler.handle_ecall(&mut cpu),
+            Err(TestError::Diverged("exit"))
+        );
+        assert_eq!(handler.calls[0].1, ["-1"]);
+
+        let mut cpu = new_cpu(0xdead, &[]);
+        assert_eq!(
+            handler.handle_ecall(&mut cpu),
+            Err(TestError::Unhandled(0xdead))
+        );
+    }
+}
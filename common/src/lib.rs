@@ -3,11 +3,15 @@
 extern crate alloc;
 
 pub mod accumulator;
+pub mod bn_batch;
+pub mod bn_context;
 pub mod client_commands;
 pub mod comm;
 pub mod constants;
 pub mod ecall_constants;
+pub mod ecall_dispatch;
 pub mod manifest;
+pub mod merkle;
 pub mod vm;
 
 pub mod riscv;
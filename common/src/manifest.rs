@@ -1,5 +1,7 @@
 use serde::{self, Deserialize, Serialize};
 
+use crate::accumulator::MerkleHashKind;
+
 const APP_NAME_LEN: usize = 32; // Define a suitable length
 const APP_VERSION_LEN: usize = 32; // Define a suitable length
 
@@ -21,6 +23,7 @@ pub struct Manifest {
     pub data_end: u32,
     pub mt_root_hash: [u8; 32],
     pub mt_size: u32,
+    pub mt_hash_kind: MerkleHashKind,
 }
 
 impl Manifest {
@@ -40,6 +43,7 @@ impl Manifest {
         data_end: u32,
         mt_root_hash: [u8; 32],
         mt_size: u32,
+        mt_hash_kind: MerkleHashKind,
     ) -> Result<Self, &'static str> {
         if app_name.len() > APP_NAME_LEN {
             return Err("app_name is too long");
@@ -72,6 +76,7 @@ impl Manifest {
             data_end,
             mt_root_hash,
             mt_size,
+            mt_hash_kind,
         })
     }
 
@@ -0,0 +1,314 @@
+//! This module defines the Merkle trees whose root is computed by the `merkle_root` ECALL, and a
+//! generic implementation of the computation of their root.
+//!
+//! The leaves are consecutive 32-byte hashes in the memory of the V-App; they are read one at a
+//! time, and only O(log n) intermediate hashes are kept in memory, so that large trees can be
+//! hashed in the memory of the VM. All the internal nodes are computed with SHA-256:
+//!
+//! - `WalletPolicy`: the trees of the wallet policies of the Ledger Bitcoin app. An internal node is
+//!   `SHA256(0x01 || left || right)`, and the left subtree of a tree with `n > 1` leaves has the
+//!   largest power of 2 smaller than `n` leaves.
+//! - `Taproot`: the BIP-341 script trees. The shape of the tree is given by the depth of each leaf,
+//!   with the leaves in depth-first order (as in the PSBT encoding of taproot trees). An internal
+//!   node is the tagged hash `TapBranch` of its two children, in lexicographic order.
+//! - `Txid`: the trees of the transactions of Bitcoin blocks. An internal node is
+//!   `SHA256(SHA256(left || right))`, and the last node of each level with an odd number of nodes
+//!   is paired with itself.
+
+use alloc::vec::Vec;
+
+/// Maximum number of leaves of a tree.
+pub const MAX_MERKLE_LEAVES: usize = 1 << 24;
+
+/// Maximum depth of a leaf of a taproot tree, as in BIP-341.
+pub const MAX_TAPTREE_DEPTH: u8 = 128;
+
+const TAPBRANCH_TAG: &[u8] = b"TapBranch";
+
+/// The kinds of Merkle trees supported by the `merkle_root` ECALL.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[repr(u32)]
+pub enum MerkleTreeKind {
+    WalletPolicy = 0,
+    Taproot = 1,
+    Txid = 2,
+}
+
+impl TryFrom<u32> for MerkleTreeKind {
+    type Error = MerkleError;
+
+    fn try_from(value: u32) -> Result<Self, MerkleError> {
+        match value {
+            0 => Ok(MerkleTreeKind::WalletPolicy),
+            1 => Ok(MerkleTreeKind::Taproot),
+            2 => Ok(MerkleTreeKind::Txid),
+            _ => Err(MerkleError::InvalidKind),
+        }
+    }
+}
+
+/// Errors for invalid trees, or for hashes that the backend failed to compute.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum MerkleError {
+    InvalidKind,
+    InvalidLeafCount,
+    InvalidShape,
+    HashFailed,
+}
+
+impl core::fmt::Display for MerkleError {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        match self {
+            MerkleError::InvalidKind => write!(f, "Invalid kind of Merkle tree"),
+            MerkleError::InvalidLeafCount => write!(f, "Invalid number of leaves"),
+            MerkleError::InvalidShape => write!(f, "Invalid shape of the tree"),
+            MerkleError::HashFailed => write!(f, "Hash failed"),
+        }
+    }
+}
+
+/// The accesses to the leaves and the hash function, provided by the implementation of the ECALL.
+pub trait MerkleBackend {
+    type Error: From<MerkleError>;
+
+    /// Reads the leaf with the given index.
+    fn read_leaf(&mut self, index: usize, leaf: &mut [u8; 32]) -> Result<(), Self::Error>;
+    /// Reads the depth of the leaf with the given index; only used for taproot trees.
+    fn read_depth(&mut self, index: usize) -> Result<u8, Self::Error>;
+    /// Computes the SHA-256 hash of the concatenation of the segments.
+    fn sha256(&mut self, segments: &[&[u8]]) -> Result<[u8; 32], Self::Error>;
+}
+
+/// Computes the root of the tree of the given kind with `n_leaves` leaves.
+pub fn merkle_root<B: MerkleBackend>(
+    backend: &mut B,
+    kind: MerkleTreeKind,
+    n_leaves: usize,
+) -> Result<[u8; 32], B::Error> {
+    if n_leaves == 0 || n_leaves > MAX_MERKLE_LEAVES {
+        return Err(MerkleError::InvalidLeafCount.into());
+    }
+    match kind {
+        MerkleTreeKind::WalletPolicy => wallet_policy_root(backend, 0, n_leaves),
+        MerkleTreeKind::Taproot => taproot_root(backend, n_leaves),
+        MerkleTreeKind::Txid => {
+            let mut height = 0;
+            while level_width(n_leaves, height) > 1 {
+                height += 1;
+            }
+            txid_root(backend, n_leaves, height, 0)
+        }
+    }
+}
+
+// Root of the subtree with the leaves start..start + size
+fn wallet_policy_root<B: MerkleBackend>(
+    backend: &mut B,
+    start: usize,
+    size: usize,
+) -> Result<[u8; 32], B::Error> {
+    if size == 1 {
+        let mut leaf = [0u8; 32];
+        backend.read_leaf(start, &mut leaf)?;
+        return Ok(leaf);
+    }
+    // largest power of 2 smaller than size
+    let left_size = 1 << (usize::BITS - 1 - (size - 1).leading_zeros());
+    let left = wallet_policy_root(backend, start, left_size)?;
+    let right = wallet_policy_root(backend, start + left_size, size - left_size)?;
+    backend.sha256(&[&[0x01], &left, &right])
+}
+
+// The leaves are combined with a stack, as in the decoding of taproot trees in PSBTs: two
+// consecutive nodes with the same depth are the children of a node one level up.
+fn taproot_root<B: MerkleBackend>(backend: &mut B, n_leaves: usize) -> Result<[u8; 32], B::Error> {
+    let tag = backend.sha256(&[TAPBRANCH_TAG])?;
+    let mut stack: Vec<(u8, [u8; 32])> = Vec::new();
+    for index in 0..n_leaves {
+        let depth = backend.read_depth(index)?;
+        if depth > MAX_TAPTREE_DEPTH || stack.len() > MAX_TAPTREE_DEPTH as usize {
+            return Err(MerkleError::InvalidShape.into());
+        }
+        let mut node = [0u8; 32];
+        backend.read_leaf(index, &mut node)?;
+        stack.push((depth, node));
+
+        while stack.len() >= 2 && stack[stack.len() - 1].0 == stack[stack.len() - 2].0 {
+            let (depth, right) = stack.pop().unwrap();
+            let (_, left) = stack.pop().unwrap();
+            if depth == 0 {
+                return Err(MerkleError::InvalidShape.into());
+            }
+            let (a, b) = if left <= right {
+                (left, right)
+            } else {
+                (right, left)
+            };
+            stack.push((depth - 1, backend.sha256(&[&tag, &tag, &a, &b])?));
+        }
+    }
+    match stack[..] {
+        [(0, root)] => Ok(root),
+        _ => Err(MerkleError::InvalidShape.into()),
+    }
+}
+
+// Number of nodes at the given height of a txid tree
+fn level_width(n_leaves: usize, height: u32) -> usize {
+    ((n_leaves as u64 + (1u64 << height) - 1) >> height) as usize
+}
+
+// Node at the given height and position of a txid tree, as in `CalcHash` in Bitcoin Core
+fn txid_root<B: MerkleBackend>(
+    backend: &mut B,
+    n_leaves: usize,
+    height: u32,
+    pos: usize,
+) -> Result<[u8; 32], B::Error> {
+    if height == 0 {
+        let mut leaf = [0u8; 32];
+        backend.read_leaf(pos, &mut leaf)?;
+        return Ok(leaf);
+    }
+    let left = txid_root(backend, n_leaves, height - 1, 2 * pos)?;
+    let right = if 2 * pos + 1 < level_width(n_leaves, height - 1) {
+        txid_root(backend, n_leaves, height - 1, 2 * pos + 1)?
+    } else {
+        left
+    };
+    let hash = backend.sha256(&[&left, &right])?;
+    backend.sha256(&[&hash])
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use alloc::{vec, vec::Vec};
+    use sha2::{Digest, Sha256};
+
+    struct TestBackend {
+        leaves: Vec<[u8; 32]>,
+        depths: Vec<u8>,
+    }
+
+    impl MerkleBackend for TestBackend {
+        type Error = MerkleError;
+
+        fn read_leaf(&mut self, index: usize, leaf: &mut [u8; 32]) -> Result<(), MerkleError> {
+            *leaf = self.leaves[index];
+            Ok(())
+        }
+        fn read_depth(&mut self, index: usize) -> Result<u8, MerkleError> {
+            Ok(self.depths[index])
+        }
+        fn sha256(&mut self, segments: &[&[u8]]) -> Result<[u8; 32], MerkleError> {
+            let mut hasher = Sha256::new();
+            for segment in segments {
+                hasher.update(segment);
+            }
+            Ok(hasher.finalize().into())
+        }
+    }
+
+    fn sha256(segments: &[&[u8]]) -> [u8; 32] {
+        TestBackend {
+            leaves: vec![],
+            depths: vec![],
+        }
+        .sha256(segments)
+        .unwrap()
+    }
+
+    fn root(
+        kind: MerkleTreeKind,
+        leaves: &[[u8; 32]],
+        depths: &[u8],
+    ) -> Result<[u8; 32], MerkleError> {
+        let mut backend = TestBackend {
+            leaves: leaves.to_vec(),
+            depths: depths.to_vec(),
+        };
+        merkle_root(&mut backend, kind, leaves.len())
+    }
+
+    fn leaves(n: usize) -> Vec<[u8; 32]> {
+        (0..n).map(|i| sha256(&[&[0x00], &[i as u8]])).collect()
+    }
+
+    #[test]
+    fn test_wallet_policy() {
+        let l = leaves(5);
+        let node = |a: &[u8; 32], b: &[u8; 32]| sha256(&[&[0x01], a, b]);
+
+        assert_eq!(root(MerkleTreeKind::WalletPolicy, &l[..1], &[]), Ok(l[0]));
+        assert_eq!(
+            root(MerkleTreeKind::WalletPolicy, &l[..3], &[]),
+            Ok(node(&node(&l[0], &l[1]), &l[2]))
+        );
+        assert_eq!(
+            root(MerkleTreeKind::WalletPolicy, &l[..5], &[]),
+            Ok(node(&node(&node(&l[0], &l[1]), &node(&l[2], &l[3])), &l[4]))
+        );
+    }
+
+    #[test]
+    fn test_txid() {
+        let l = leaves(5);
+        let node = |a: &[u8; 32], b: &[u8; 32]| sha256(&[&sha256(&[a, b])]);
+
+        assert_eq!(root(MerkleTreeKind::Txid, &l[..1], &[]), Ok(l[0]));
+        assert_eq!(
+            root(MerkleTreeKind::Txid, &l[..3], &[]),
+            Ok(node(&node(&l[0], &l[1]), &node(&l[2], &l[2])))
+        );
+        let n45 = node(&l[4], &l[4]);
+        assert_eq!(
+            root(MerkleTreeKind::Txid, &l[..5], &[]),
+            Ok(node(
+                &node(&node(&l[0], &l[1]), &node(&l[2], &l[3])),
+                &node(&n45, &n45)
+            ))
+        );
+    }
+
+    #[test]
+    fn test_taproot() {
+        let l = leaves(4);
+        let tag = sha256(&[TAPBRANCH_TAG]);
+        let branch = |a: &[u8; 32], b: &[u8; 32]| {
+            let (a, b) = if a <= b { (a, b) } else { (b, a) };
+            sha256(&[&tag, &tag, a, b])
+        };
+
+        assert_eq!(root(MerkleTreeKind::Taproot, &l[..1], &[0]), Ok(l[0]));
+        assert_eq!(
+            root(MerkleTreeKind::Taproot, &l[..3], &[1, 2, 2]),
+            Ok(branch(&l[0], &branch(&l[1], &l[2])))
+        );
+        assert_eq!(
+            root(MerkleTreeKind::Taproot, &l[..4], &[2, 2, 2, 2]),
+            Ok(branch(&branch(&l[0], &l[1]), &branch(&l[2], &l[3])))
+        );
+
+        // not a full binary tree
+        for depths in [&[1u8, 1, 1][..], &[2, 1, 2], &[1, 2], &[0, 0]] {
+            assert_eq!(
+                root(MerkleTreeKind::Taproot, &l[..depths.len()], depths),
+                Err(MerkleError::InvalidShape)
+            );
+        }
+        assert_eq!(
+            root(MerkleTreeKind::Taproot, &l[..1], &[MAX_TAPTREE_DEPTH + 1]),
+            Err(MerkleError::InvalidShape)
+        );
+    }
+
+    #[test]
+    fn test_invalid_leaf_count() {
+        assert_eq!(
+            root(MerkleTreeKind::Txid, &[], &[]),
+            Err(MerkleError::InvalidLeafCount)
+        );
+        assert_eq!(MerkleTreeKind::try_from(3), Err(MerkleError::InvalidKind));
+    }
+}
@@ -57,6 +57,12 @@ pub trait PagedMemory: fmt::Debug {
 
     /// Retrieves a mutable reference to the page at the given index.
     fn get_page(&mut self, page_index: u32) -> Result<Self::PageRef<'_>, MemoryError>;
+
+    /// Writes back the content of all the pages that are only held by this memory, if any.
+    /// After this call, the backing storage reflects the whole content of the memory.
+    fn flush(&mut self) -> Result<(), MemoryError> {
+        Ok(())
+    }
 }
 
 /// A simple implementation of `PagedMemory` using a vector of pages.
@@ -121,6 +127,11 @@ impl<M: PagedMemory> MemorySegment<M> {
         })
     }
 
+    /// Writes back the content of the pages held by the underlying paged memory.
+    pub fn flush(&mut self) -> Result<(), MemoryError> {
+        self.paged_memory.flush()
+    }
+
     #[inline]
     /// Returns true if this segment contains the byte at the specified address.
     pub fn contains(&self, address: u32) -> bool {
@@ -335,6 +346,72 @@ impl<M: PagedMemory> MemorySegment<M> {
 
         Ok(())
     }
+
+    /// Visits the `len` bytes starting at `address`, one page at a time.
+    ///
+    /// The closure is called with consecutive slices borrowed directly from the pages, each of them
+    /// within a single page. Each page is fetched only once, and no data is copied; this is the
+    /// preferred way to consume large buffers, for example to hash them.
+    pub fn for_each_span(
+        &mut self,
+        address: u32,
+        len: usize,
+        mut f: impl FnMut(&[u8]),
+    ) -> Result<(), MemoryError> {
+        let end_address = u32::try_from(len)
+            .ok()
+            .and_then(|len| address.checked_add(len))
+            .ok_or(MemoryError::Overflow)?;
+        if address < self.start_address || end_address > self.start_address + self.size {
+            return Err(MemoryError::AddressOutOfBounds);
+        }
+
+        let mut current_address = address;
+        while current_address < end_address {
+            let relative_address = current_address - page_start(self.start_address);
+            let page_index = relative_address / (PAGE_SIZE as u32);
+            let offset = (relative_address % (PAGE_SIZE as u32)) as usize;
+            let span_len = min(PAGE_SIZE - offset, (end_address - current_address) as usize);
+
+            let page = self.paged_memory.get_page(page_index)?;
+            f(&page.data[offset..offset + span_len]);
+
+            current_address += span_len as u32;
+        }
+
+        Ok(())
+    }
+
+    /// Like `for_each_span`, but lends mutable slices, in order to modify the memory in place.
+    pub fn for_each_span_mut(
+        &mut self,
+        address: u32,
+        len: usize,
+        mut f: impl FnMut(&mut [u8]),
+    ) -> Result<(), MemoryError> {
+        let end_address = u32::try_from(len)
+            .ok()
+            .and_then(|len| address.checked_add(len))
+            .ok_or(MemoryError::Overflow)?;
+        if address < self.start_address || end_address > self.start_address + self.size {
+            return Err(MemoryError::AddressOutOfBounds);
+        }
+
+        let mut current_address = address;
+        while current_address < end_address {
+            let relative_address = current_address - page_start(self.start_address);
+            let page_index = relative_address / (PAGE_SIZE as u32);
+            let offset = (relative_address % (PAGE_SIZE as u32)) as usize;
+            let span_len = min(PAGE_SIZE - offset, (end_address - current_address) as usize);
+
+            let mut page = self.paged_memory.get_page(page_index)?;
+            f(&mut page.data[offset..offset + span_len]);
+
+            current_address += span_len as u32;
+        }
+
+        Ok(())
+    }
 }
 
 /// Represents the state of the Risc-V CPU, with registers and three memory segments
@@ -863,4 +940,61 @@ mod tests {
         let read_result = segment.read_buffer(0, &mut read_buffer);
         assert!(read_result.is_ok());
     }
+
+    #[test]
+    fn test_memory_segment_for_each_span() {
+        let paged_memory = VecMemory::new(4);
+        let mut segment = MemorySegment::new(44, (PAGE_SIZE * 3) as u32, paged_memory).unwrap();
+
+        let start_address = 56u32;
+        let buffer: Vec<u8> = (0..PAGE_SIZE * 2).map(|i| (i % 251) as u8).collect();
+        segment.write_buffer(start_address, &buffer).unwrap();
+
+        // the buffer is misaligned, so it is visited in three spans
+        let mut spans = Vec::new();
+        let mut visited = Vec::new();
+        segment
+            .for_each_span(start_address, buffer.len(), |span| {
+                spans.push(span.len());
+                visited.extend_from_slice(span);
+            })
+            .unwrap();
+        assert_eq!(spans, vec![PAGE_SIZE - 56, PAGE_SIZE, 56]);
+        assert_eq!(visited, buffer);
+
+        // empty range
+        let mut n_spans = 0;
+        segment.for_each_span(100, 0, |_| n_spans += 1).unwrap();
+        assert_eq!(n_spans, 0);
+
+        // out of bounds
+        assert!(segment
+            .for_each_span(start_address, PAGE_SIZE * 3, |_| {})
+            .is_err());
+        assert!(segment.for_each_span(40, 8, |_| {}).is_err());
+    }
+
+    #[test]
+    fn test_memory_segment_for_each_span_mut() {
+        let paged_memory = VecMemory::new(3);
+        let mut segment = MemorySegment::new(0, (PAGE_SIZE * 3) as u32, paged_memory).unwrap();
+
+        let start_address = PAGE_SIZE as u32 - 16;
+        let mut n_spans = 0;
+        segment
+            .for_each_span_mut(start_address, PAGE_SIZE + 32, |span| {
+                n_spans += 1;
+                span.fill(0xab);
+            })
+            .unwrap();
+        assert_eq!(n_spans, 3);
+
+        let mut read_buffer = vec![0; PAGE_SIZE + 34];
+        segment
+            .read_buffer(start_address - 1, &mut read_buffer)
+            .unwrap();
+        assert_eq!(read_buffer[0], 0);
+        assert!(read_buffer[1..PAGE_SIZE + 33].iter().all(|&b| b == 0xab));
+        assert_eq!(read_buffer[PAGE_SIZE + 33], 0);
+    }
 }
@@ -0,0 +1,30 @@
+use ledger_device_sdk::nvm::*;
+use ledger_device_sdk::NVMData;
+use zeroize::Zeroizing;
+
+// A random key generated by the device on first use, that never leaves the device: neither the host
+// nor the V-Apps can read it. The first byte is 1 once the key is generated.
+const SECRET_SIZE: usize = 1 + 32;
+#[link_section = ".nvm_data"]
+static mut DATA: NVMData<AtomicStorage<[u8; SECRET_SIZE]>> =
+    NVMData::new(AtomicStorage::new(&[0u8; SECRET_SIZE]));
+
+// Returns the key of the HMAC that authenticates the checkpoints of the V-Apps, generating it if
+// needed.
+#[inline(never)]
+#[allow(static_mut_refs)] // This is safe because we are in single-threaded mode
+pub fn checkpoint_key() -> Zeroizing<[u8; 32]> {
+    let storage = unsafe { DATA.get_mut() };
+    if storage.get_ref()[0] != 1 {
+        let mut data = Zeroizing::new([0u8; SECRET_SIZE]);
+        data[0] = 1;
+        ledger_device_sdk::random::rand_bytes(&mut data[1..]);
+        unsafe {
+            storage.update(&*data);
+        }
+    }
+
+    let mut key = Zeroizing::new([0u8; 32]);
+    key.copy_from_slice(&storage.get_ref()[1..]);
+    key
+}
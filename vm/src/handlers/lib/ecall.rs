@@ -1,29 +1,55 @@
 use core::{cell::RefCell, cmp::min, fmt};
 
-use alloc::{format, rc::Rc, string::String, vec};
+use alloc::{format, rc::Rc, string::String, vec, vec::Vec};
 use common::{
+    bn_batch::{self, BnBatchBackend, BnBatchError, INSTRUCTION_SIZE, MAX_INSTRUCTIONS},
+    bn_context::{self, MAX_BN_CONTEXTS},
     client_commands::{
-        Message, MessageDeserializationError, ReceiveBufferMessage, ReceiveBufferResponse,
-        SendBufferMessage, SendPanicBufferMessage,
+        CheckpointMessage, ClientCallMessage, Message, MessageDeserializationError,
+        ReceiveBufferMessage, ReceiveBufferResponse, SendBufferMessage, SendPanicBufferMessage,
+        VAppCheckpoint,
     },
+    constants::PAGE_SIZE,
     ecall_constants::{self, *},
+    ecall_dispatch::{dispatch_ecall, EcallDispatch, GuestPointer},
     manifest::Manifest,
+    merkle::{self, MerkleBackend, MerkleError, MerkleTreeKind},
     vm::{Cpu, CpuError, EcallHandler, MemoryError},
 };
-use ledger_device_sdk::hash::HashInit;
+use ledger_device_sdk::{hash::HashInit, hmac::HMACInit};
 use ledger_secure_sdk_sys::{
-    cx_ripemd160_t, cx_sha256_t, cx_sha512_t, CX_OK, CX_RIPEMD160, CX_SHA256, CX_SHA512,
+    cx_bn_mont_ctx_t, cx_bn_t, cx_ecpoint_t, cx_ripemd160_t, cx_sha256_t, cx_sha512_t,
+    CX_EC_INFINITE_POINT, CX_OK, CX_RIPEMD160, CX_SHA256, CX_SHA512,
 };
 
-use crate::{AppSW, Instruction};
+use crate::{device_secret, AppSW, Instruction};
 
 use super::outsourced_mem::OutsourcedMemory;
 
-use zeroize::Zeroizing;
+use zeroize::{Zeroize, Zeroizing};
 
 // BIP32 supports up to 255, but we don't want that many, and it would be very slow anyway
 const MAX_BIP32_PATH: usize = 16;
 
+const BIP32_HARDENED: u32 = 0x80000000;
+
+// Size of each child returned by the derive_hd_pubkeys ecall: chain code and uncompressed pubkey
+const HD_CHILD_SIZE: usize = 32 + 65;
+
+// Order of the group of secp256k1
+const SECP256K1_ORDER: [u8; 32] = [
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+    0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b, 0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x41,
+];
+
+// Maximum number of bytes of the buffer sent in each SendBufferMessage or SendPanicBufferMessage
+const MAX_SEND_CHUNK_SIZE: usize = 255 - 4;
+// Maximum number of bytes of the payload sent in each ClientCallMessage, that also has a request id
+const MAX_CLIENT_CALL_CHUNK_SIZE: usize = MAX_SEND_CHUNK_SIZE - 4;
+// Maximum number of bytes of the buffer received in each ReceiveBufferResponse: the whole APDU
+// data, except for the 4 bytes of the remaining length
+const MAX_RECV_CHUNK_SIZE: usize = 255 - 4;
+
 #[allow(dead_code)]
 #[derive(Debug, Clone, Copy)]
 enum Register {
@@ -101,9 +127,16 @@ impl Register {
     }
 }
 
-// A pointer in the V-app's address space
+// The kind of messages used to send a buffer of the V-App memory to the host
 #[derive(Debug, Clone, Copy)]
-struct GuestPointer(pub u32);
+enum OutgoingBuffer {
+    // SendBufferMessage, for xsend
+    Send,
+    // SendPanicBufferMessage, for the message of a panic
+    Panic,
+    // ClientCallMessage with the request id, for the payload of a client_call
+    ClientCall(u32),
+}
 
 #[derive(Debug, Clone, Copy)]
 enum LedgerHashContextError {
@@ -177,6 +210,8 @@ pub enum CommEcallError {
     WrongP1P2,
     Overflow,
     HashError(LedgerHashContextError),
+    BnBatchError(BnBatchError),
+    MerkleError(MerkleError),
     MessageDeserializationError(MessageDeserializationError),
     InvalidResponse(&'static str),
     CpuError(String),
@@ -197,6 +232,8 @@ impl core::fmt::Display for CommEcallError {
             CommEcallError::WrongP1P2 => write!(f, "Wrong P1/P2"),
             CommEcallError::Overflow => write!(f, "Buffer overflow"),
             CommEcallError::HashError(e) => write!(f, "Hash error: {:?}", e),
+            CommEcallError::BnBatchError(e) => write!(f, "Big numbers batch error: {}", e),
+            CommEcallError::MerkleError(e) => write!(f, "Merkle tree error: {}", e),
             CommEcallError::MessageDeserializationError(e) => {
                 write!(f, "Message deserialization error: {:?}", e)
             }
@@ -228,6 +265,18 @@ impl From<LedgerHashContextError> for CommEcallError {
     }
 }
 
+impl From<BnBatchError> for CommEcallError {
+    fn from(error: BnBatchError) -> Self {
+        CommEcallError::BnBatchError(error)
+    }
+}
+
+impl From<MerkleError> for CommEcallError {
+    fn from(error: MerkleError) -> Self {
+        CommEcallError::MerkleError(error)
+    }
+}
+
 impl From<MemoryError> for CommEcallError {
     fn from(error: MemoryError) -> Self {
         CommEcallError::MemoryError(error)
@@ -252,121 +301,438 @@ impl core::error::Error for CommEcallError {
     }
 }
 
-pub struct CommEcallHandler<'a> {
-    comm: Rc<RefCell<&'a mut ledger_device_sdk::io::Comm>>,
-    manifest: &'a Manifest,
+// Computes the HMAC that authenticates a checkpoint of the V-App with the given manifest and hmac.
+// The key is a secret of the device, therefore only the device can produce a valid checkpoint; as
+// the manifest is authenticated, a checkpoint can only resume the V-App that took it.
+pub fn checkpoint_hmac(
+    manifest: &Manifest,
+    app_hmac: &[u8; 32],
+    pc: u32,
+    regs: &[u32; 32],
+) -> [u8; 32] {
+    let key = device_secret::checkpoint_key();
+    let serialized_manifest = postcard::to_allocvec(manifest).unwrap();
+
+    let mut mac = ledger_device_sdk::hmac::sha2::Sha2_256::new(&key[..]);
+    mac.update(&serialized_manifest).unwrap();
+    mac.update(app_hmac).unwrap();
+    VAppCheckpoint::serialize_state_with(pc, regs, |data| mac.update(data).unwrap());
+    let mut result = [0u8; 32];
+    mac.finalize(&mut result).unwrap();
+    result
 }
 
-impl<'a> CommEcallHandler<'a> {
-    pub fn new(
-        comm: Rc<RefCell<&'a mut ledger_device_sdk::io::Comm>>,
-        manifest: &'a Manifest,
-    ) -> Self {
-        Self { comm, manifest }
-    }
+// Computes the Merkle trees of the merkle_root ecall with the SHA-256 of the device; the leaves and
+// the depths are read from the V-App memory one at a time.
+struct CxMerkle<'c, 'm> {
+    cpu: &'c mut Cpu<OutsourcedMemory<'m>>,
+    leaves: GuestPointer,
+    depths: GuestPointer,
+}
 
-    // TODO: can we refactor this and handle_xsend? They are almost identical
-    fn handle_panic<E: fmt::Debug>(
-        &self,
-        cpu: &mut Cpu<OutsourcedMemory<'_>>,
-        buffer: GuestPointer,
-        mut size: usize,
-    ) -> Result<(), CommEcallError> {
-        if size == 0 {
-            // We must not read the pointer for an empty buffer; Rust always uses address 0x01 for
-            // an empty buffer
+impl<'c, 'm> MerkleBackend for CxMerkle<'c, 'm> {
+    type Error = CommEcallError;
 
-            let mut comm = self.comm.borrow_mut();
-            SendPanicBufferMessage::new(size as u32, vec![]).serialize_to_comm(&mut comm);
-            comm.reply(AppSW::InterruptedExecution);
+    fn read_leaf(&mut self, index: usize, leaf: &mut [u8; 32]) -> Result<(), CommEcallError> {
+        let ptr = u32::try_from(index * 32)
+            .ok()
+            .and_then(|offset| self.leaves.0.checked_add(offset))
+            .ok_or(CommEcallError::Overflow)?;
+        self.cpu
+            .get_segment::<CommEcallError>(ptr)?
+            .read_buffer(ptr, leaf)?;
+        Ok(())
+    }
 
-            let Instruction::Continue(p1, p2) = comm.next_command() else {
-                return Err(CommEcallError::WrongINS); // expected "Continue"
-            };
+    fn read_depth(&mut self, index: usize) -> Result<u8, CommEcallError> {
+        let ptr = u32::try_from(index)
+            .ok()
+            .and_then(|offset| self.depths.0.checked_add(offset))
+            .ok_or(CommEcallError::Overflow)?;
+        let mut depth = [0u8; 1];
+        self.cpu
+            .get_segment::<CommEcallError>(ptr)?
+            .read_buffer(ptr, &mut depth)?;
+        Ok(depth[0])
+    }
 
-            if (p1, p2) != (0, 0) {
-                return Err(CommEcallError::WrongP1P2);
-            }
-            return Ok(());
+    fn sha256(&mut self, segments: &[&[u8]]) -> Result<[u8; 32], CommEcallError> {
+        let mut hasher = ledger_device_sdk::hash::sha2::Sha2_256::new();
+        for segment in segments {
+            hasher
+                .update(segment)
+                .map_err(|_| MerkleError::HashFailed)?;
         }
+        let mut result = [0u8; 32];
+        hasher
+            .finalize(&mut result)
+            .map_err(|_| MerkleError::HashFailed)?;
+        Ok(result)
+    }
+}
 
-        if buffer.0.checked_add(size as u32).is_none() {
-            return Err(CommEcallError::Overflow);
-        }
+// Computes the uncompressed public key of a private key.
+fn public_key_of(curve: u8, private_key: &[u8; 32]) -> Result<[u8; 65], CommEcallError> {
+    let mut privkey: ledger_secure_sdk_sys::cx_ecfp_private_key_t = Default::default();
+    let mut pubkey: ledger_secure_sdk_sys::cx_ecfp_public_key_t = Default::default();
+    let (ret1, ret2) = unsafe {
+        let ret1 = ledger_secure_sdk_sys::cx_ecfp_init_private_key_no_throw(
+            curve,
+            private_key.as_ptr(),
+            private_key.len(),
+            &mut privkey,
+        );
+        let ret2 = ledger_secure_sdk_sys::cx_ecfp_generate_pair_no_throw(
+            curve,
+            &mut pubkey,
+            &mut privkey,
+            true,
+        );
+        (ret1, ret2)
+    };
+    privkey.d.zeroize();
+    if ret1 != CX_OK || ret2 != CX_OK {
+        return Err(CommEcallError::GenericError("Failed to generate key pair"));
+    }
+    Ok(pubkey.W)
+}
 
-        let mut g_ptr = buffer.0;
+// Computes the BIP32 fingerprint of an uncompressed public key, that is the first 32 bits of
+// ripemd160(sha256(pk)), where pk is the public key in compressed form.
+fn pubkey_fingerprint(pubkey: &[u8; 65]) -> u32 {
+    let mut sha_hasher = ledger_device_sdk::hash::sha2::Sha2_256::new();
+    sha_hasher.update(&[02u8 + (pubkey[64] % 2)]).unwrap();
+    sha_hasher.update(&pubkey[1..33]).unwrap();
+    let mut sha256hash = [0u8; 32];
+    sha_hasher.finalize(&mut sha256hash).unwrap();
+    let mut ripemd160_hasher = ledger_device_sdk::hash::ripemd::Ripemd160::new();
+    ripemd160_hasher.update(&sha256hash).unwrap();
+    let mut rip = [0u8; 20];
+    ripemd160_hasher.finalize(&mut rip).unwrap();
+    u32::from_be_bytes([rip[0], rip[1], rip[2], rip[3]])
+}
 
-        let segment = cpu.get_segment::<E>(g_ptr)?;
+// Runs the programs of the bn_batch ecall with the cx_math functions; the registers are kept in
+// the memory of the VM, and only the inputs and outputs are accessed in the V-App memory.
+struct CxBnBatch<'c, 'm> {
+    cpu: &'c mut Cpu<OutsourcedMemory<'m>>,
+    inputs: GuestPointer,
+    outputs: GuestPointer,
+    len: usize,
+}
 
-        // loop while size > 0
-        while size > 0 {
-            let copy_size = min(size, 255 - 4); // send maximum 251 bytes per message
+fn check_cx_result(
+    res: ledger_secure_sdk_sys::cx_err_t,
+    msg: &'static str,
+) -> Result<(), CommEcallError> {
+    if res != CX_OK {
+        return Err(CommEcallError::GenericError(msg));
+    }
+    Ok(())
+}
 
-            let mut buffer = vec![0; copy_size];
-            segment.read_buffer(g_ptr, &mut buffer)?;
+impl<'c, 'm> BnBatchBackend for CxBnBatch<'c, 'm> {
+    type Error = CommEcallError;
 
-            let mut comm = self.comm.borrow_mut();
-            SendPanicBufferMessage::new(size as u32, buffer).serialize_to_comm(&mut comm);
-            comm.reply(AppSW::InterruptedExecution);
+    // the caller checks that the inputs and outputs do not overflow the address space
+    fn read_input(&mut self, index: usize, dst: &mut [u8]) -> Result<(), CommEcallError> {
+        let ptr = self.inputs.0 + (index * self.len) as u32;
+        self.cpu
+            .get_segment::<CommEcallError>(ptr)?
+            .read_buffer(ptr, dst)?;
+        Ok(())
+    }
 
-            let Instruction::Continue(p1, p2) = comm.next_command() else {
-                return Err(CommEcallError::WrongINS); // expected "Continue"
-            };
+    fn write_output(&mut self, index: usize, src: &[u8]) -> Result<(), CommEcallError> {
+        let ptr = self.outputs.0 + (index * self.len) as u32;
+        self.cpu
+            .get_segment::<CommEcallError>(ptr)?
+            .write_buffer(ptr, src)?;
+        Ok(())
+    }
 
-            if (p1, p2) != (0, 0) {
-                return Err(CommEcallError::WrongP1P2);
-            }
+    fn modm(&mut self, r: &mut [u8], m: &[u8]) -> Result<(), CommEcallError> {
+        let res = unsafe {
+            ledger_secure_sdk_sys::cx_math_modm_no_throw(
+                r.as_mut_ptr(),
+                r.len(),
+                m.as_ptr(),
+                m.len(),
+            )
+        };
+        check_cx_result(res, "modm failed")
+    }
 
-            size -= copy_size;
-            g_ptr += copy_size as u32;
+    fn addm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), CommEcallError> {
+        let res = unsafe {
+            ledger_secure_sdk_sys::cx_math_addm_no_throw(
+                r.as_mut_ptr(),
+                a.as_ptr(),
+                b.as_ptr(),
+                m.as_ptr(),
+                m.len(),
+            )
+        };
+        check_cx_result(res, "addm failed")
+    }
+
+    fn subm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), CommEcallError> {
+        let res = unsafe {
+            ledger_secure_sdk_sys::cx_math_subm_no_throw(
+                r.as_mut_ptr(),
+                a.as_ptr(),
+                b.as_ptr(),
+                m.as_ptr(),
+                m.len(),
+            )
+        };
+        check_cx_result(res, "subm failed")
+    }
+
+    fn multm(&mut self, r: &mut [u8], a: &[u8], b: &[u8], m: &[u8]) -> Result<(), CommEcallError> {
+        let res = unsafe {
+            ledger_secure_sdk_sys::cx_math_multm_no_throw(
+                r.as_mut_ptr(),
+                a.as_ptr(),
+                b.as_ptr(),
+                m.as_ptr(),
+                m.len(),
+            )
+        };
+        check_cx_result(res, "multm failed")
+    }
+
+    fn powm(&mut self, r: &mut [u8], a: &[u8], e: &[u8], m: &[u8]) -> Result<(), CommEcallError> {
+        let res = unsafe {
+            ledger_secure_sdk_sys::cx_math_powm_no_throw(
+                r.as_mut_ptr(),
+                a.as_ptr(),
+                e.as_ptr(),
+                e.len(),
+                m.as_ptr(),
+                m.len(),
+            )
+        };
+        check_cx_result(res, "powm failed")
+    }
+}
+
+// Size of the words of the cx_bn library; the length of its numbers must be a multiple of it
+const CX_BN_WORD_SIZE: usize = 16;
+
+// A Montgomery context registered with the bn_mont_init ecall. The cx_bn numbers only live while
+// the library is locked, so the context keeps the modulus and the precomputed constant
+// h = R^2 mod m, that are imported again for each operation.
+struct BnMontContext {
+    len: usize,
+    m: [u8; MAX_BIGNUMBER_SIZE],
+    h: [u8; MAX_BIGNUMBER_SIZE],
+}
+
+impl BnMontContext {
+    fn modulus(&self) -> &[u8] {
+        &self.m[0..self.len]
+    }
+
+    // length of the cx_bn numbers
+    fn padded_len(&self) -> usize {
+        self.len.next_multiple_of(CX_BN_WORD_SIZE)
+    }
+}
+
+// Runs f with the cx_bn library locked, and unlocks it even if f fails.
+fn with_cx_bn_lock<T>(f: impl FnOnce() -> Result<T, CommEcallError>) -> Result<T, CommEcallError> {
+    check_cx_result(
+        unsafe { ledger_secure_sdk_sys::cx_bn_lock(CX_BN_WORD_SIZE, 0) },
+        "cx_bn_lock failed",
+    )?;
+    let result = f();
+    unsafe {
+        ledger_secure_sdk_sys::cx_bn_unlock();
+    }
+    result
+}
+
+// Allocates a cx_bn number of len bytes with the given big-endian value, or 0 if the value is
+// empty. Must be called with the cx_bn library locked.
+fn cx_bn_new(len: usize, value: &[u8]) -> Result<cx_bn_t, CommEcallError> {
+    let mut x: cx_bn_t = Default::default();
+    let res = if value.is_empty() {
+        unsafe { ledger_secure_sdk_sys::cx_bn_alloc(&mut x, len) }
+    } else {
+        unsafe { ledger_secure_sdk_sys::cx_bn_alloc_init(&mut x, len, value.as_ptr(), value.len()) }
+    };
+    check_cx_result(res, "cx_bn_alloc failed")?;
+    Ok(x)
+}
+
+// Allocates the Montgomery context of the modulus m, computing h = R^2 mod m if it is not given.
+// Must be called with the cx_bn library locked.
+fn cx_mont_new(
+    m: &[u8],
+    padded_len: usize,
+    h: Option<&[u8]>,
+) -> Result<cx_bn_mont_ctx_t, CommEcallError> {
+    let mut ctx: cx_bn_mont_ctx_t = Default::default();
+    check_cx_result(
+        unsafe { ledger_secure_sdk_sys::cx_mont_alloc(&mut ctx, padded_len) },
+        "cx_mont_alloc failed",
+    )?;
+    let n = cx_bn_new(padded_len, m)?;
+    let res = match h {
+        None => unsafe { ledger_secure_sdk_sys::cx_mont_init(&mut ctx, n) },
+        Some(h) => {
+            let h = cx_bn_new(padded_len, h)?;
+            unsafe { ledger_secure_sdk_sys::cx_mont_init2(&mut ctx, n, h) }
         }
+    };
+    check_cx_result(res, "cx_mont_init failed")?;
+    Ok(ctx)
+}
 
-        Ok(())
+// Allocates a point of the curve. Must be called with the cx_bn library locked.
+fn cx_ecpoint_new(curve: u8) -> Result<cx_ecpoint_t, CommEcallError> {
+    let mut p: cx_ecpoint_t = Default::default();
+    check_cx_result(
+        unsafe { ledger_secure_sdk_sys::cx_ecpoint_alloc(&mut p, curve) },
+        "cx_ecpoint_alloc failed",
+    )?;
+    Ok(p)
+}
+
+// Sets p to the uncompressed point, after checking that it is on the curve.
+fn cx_ecpoint_load(p: &mut cx_ecpoint_t, point: &[u8]) -> Result<(), CommEcallError> {
+    if point[0] != 0x04 {
+        return Err(CommEcallError::InvalidParameters("Invalid point"));
+    }
+    let mut is_on_curve = false;
+    unsafe {
+        check_cx_result(
+            ledger_secure_sdk_sys::cx_ecpoint_init(
+                p,
+                point[1..33].as_ptr(),
+                32,
+                point[33..65].as_ptr(),
+                32,
+            ),
+            "cx_ecpoint_init failed",
+        )?;
+        check_cx_result(
+            ledger_secure_sdk_sys::cx_ecpoint_is_on_curve(p, &mut is_on_curve),
+            "cx_ecpoint_is_on_curve failed",
+        )?;
     }
+    if !is_on_curve {
+        return Err(CommEcallError::InvalidParameters("Invalid point"));
+    }
+    Ok(())
+}
 
-    // Sends exactly size bytes from the buffer in the V-app memory to the host
-    // TODO: we might want to revise the protocol, not as optimized as it could be
-    fn handle_xsend<E: fmt::Debug>(
-        &self,
-        cpu: &mut Cpu<OutsourcedMemory<'_>>,
-        buffer: GuestPointer,
-        mut size: usize,
-    ) -> Result<(), CommEcallError> {
-        if size == 0 {
-            // We must not read the pointer for an empty buffer; Rust always uses address 0x01 for
-            // an empty buffer
+fn cx_ecpoint_is_infinity(p: &cx_ecpoint_t) -> Result<bool, CommEcallError> {
+    let mut is_infinity = false;
+    check_cx_result(
+        unsafe { ledger_secure_sdk_sys::cx_ecpoint_is_at_infinity(p, &mut is_infinity) },
+        "cx_ecpoint_is_at_infinity failed",
+    )?;
+    Ok(is_infinity)
+}
 
-            let mut comm = self.comm.borrow_mut();
-            SendBufferMessage::new(size as u32, vec![]).serialize_to_comm(&mut comm);
-            comm.reply(AppSW::InterruptedExecution);
+// Checks the result of a cx_ecpoint operation; returns true if the result is the point at
+// infinity, that cx reports with the CX_EC_INFINITE_POINT error rather than computing it.
+fn check_cx_point_result(
+    res: ledger_secure_sdk_sys::cx_err_t,
+    msg: &'static str,
+) -> Result<bool, CommEcallError> {
+    match res {
+        CX_OK => Ok(false),
+        CX_EC_INFINITE_POINT => Ok(true),
+        _ => Err(CommEcallError::GenericError(msg)),
+    }
+}
 
-            let Instruction::Continue(p1, p2) = comm.next_command() else {
-                return Err(CommEcallError::WrongINS); // expected "Continue"
-            };
+pub struct CommEcallHandler<'a> {
+    comm: Rc<RefCell<&'a mut ledger_device_sdk::io::Comm>>,
+    manifest: &'a Manifest,
+    app_hmac: [u8; 32],
+    bn_contexts: Vec<BnMontContext>,
+}
 
-            if (p1, p2) != (0, 0) {
-                return Err(CommEcallError::WrongP1P2);
-            }
-            return Ok(());
+impl<'a> CommEcallHandler<'a> {
+    pub fn new(
+        comm: Rc<RefCell<&'a mut ledger_device_sdk::io::Comm>>,
+        manifest: &'a Manifest,
+        app_hmac: [u8; 32],
+    ) -> Self {
+        Self {
+            comm,
+            manifest,
+            app_hmac,
+            bn_contexts: Vec::new(),
         }
+    }
 
+    // Sends exactly size bytes from the buffer in the V-app memory to the host, as a sequence of
+    // messages of the given kind.
+    // Each chunk is read from the V-App memory into a stack buffer, and appended to the comm buffer.
+    fn send_buffer<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        buffer: GuestPointer,
+        mut size: usize,
+        kind: OutgoingBuffer,
+    ) -> Result<(), CommEcallError> {
         if buffer.0.checked_add(size as u32).is_none() {
             return Err(CommEcallError::Overflow);
         }
 
         let mut g_ptr = buffer.0;
 
-        let segment = cpu.get_segment::<E>(g_ptr)?;
+        // We must not read the pointer for an empty buffer; Rust always uses address 0x01 for
+        // an empty buffer. In that case, a single message with no data is sent.
+        let mut segment = if size > 0 {
+            Some(cpu.get_segment::<E>(g_ptr)?)
+        } else {
+            None
+        };
 
-        // loop while size > 0
-        while size > 0 {
-            let copy_size = min(size, 255 - 4); // send maximum 251 bytes per message
+        let max_chunk_size = match kind {
+            OutgoingBuffer::ClientCall(_) => MAX_CLIENT_CALL_CHUNK_SIZE,
+            _ => MAX_SEND_CHUNK_SIZE,
+        };
 
-            let mut buffer = vec![0; copy_size];
-            segment.read_buffer(g_ptr, &mut buffer)?;
+        let mut chunk = [0u8; MAX_SEND_CHUNK_SIZE];
+        loop {
+            let copy_size = min(size, max_chunk_size);
+            if let Some(segment) = segment.as_mut() {
+                segment.read_buffer(g_ptr, &mut chunk[..copy_size])?;
+            }
 
             let mut comm = self.comm.borrow_mut();
-            SendBufferMessage::new(size as u32, buffer).serialize_to_comm(&mut comm);
+            let append = |data: &[u8]| comm.append(data);
+            match kind {
+                OutgoingBuffer::Send => {
+                    SendBufferMessage::serialize_borrowed_with(
+                        size as u32,
+                        &chunk[..copy_size],
+                        append,
+                    );
+                }
+                OutgoingBuffer::Panic => {
+                    SendPanicBufferMessage::serialize_borrowed_with(
+                        size as u32,
+                        &chunk[..copy_size],
+                        append,
+                    );
+                }
+                OutgoingBuffer::ClientCall(request_id) => {
+                    ClientCallMessage::serialize_borrowed_with(
+                        request_id,
+                        size as u32,
+                        &chunk[..copy_size],
+                        append,
+                    );
+                }
+            }
             comm.reply(AppSW::InterruptedExecution);
 
             let Instruction::Continue(p1, p2) = comm.next_command() else {
@@ -379,9 +745,31 @@ impl<'a> CommEcallHandler<'a> {
 
             size -= copy_size;
             g_ptr += copy_size as u32;
+
+            if size == 0 {
+                return Ok(());
+            }
         }
+    }
 
-        Ok(())
+    // Sends the panic message in the V-app memory to the host
+    fn handle_panic<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        buffer: GuestPointer,
+        size: usize,
+    ) -> Result<(), CommEcallError> {
+        self.send_buffer::<E>(cpu, buffer, size, OutgoingBuffer::Panic)
+    }
+
+    // Sends exactly size bytes from the buffer in the V-app memory to the host
+    fn handle_xsend<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        buffer: GuestPointer,
+        size: usize,
+    ) -> Result<(), CommEcallError> {
+        self.send_buffer::<E>(cpu, buffer, size, OutgoingBuffer::Send)
     }
 
     // Receives up to max_size bytes from the host into the buffer in the V-app memory
@@ -398,6 +786,7 @@ impl<'a> CommEcallHandler<'a> {
 
         let mut remaining_length = None;
         let mut total_received: usize = 0;
+        let mut chunk = [0u8; MAX_RECV_CHUNK_SIZE];
         while remaining_length != Some(0) {
             let mut comm = self.comm.borrow_mut();
             ReceiveBufferMessage::new().serialize_to_comm(&mut comm);
@@ -414,22 +803,34 @@ impl<'a> CommEcallHandler<'a> {
             let raw_data = comm
                 .get_data()
                 .map_err(|_| CommEcallError::InvalidResponse(""))?;
-            let response = ReceiveBufferResponse::deserialize(raw_data)?;
+            let (response_remaining_length, content) =
+                ReceiveBufferResponse::deserialize_borrowed(raw_data)?;
+
+            if content.len() > MAX_RECV_CHUNK_SIZE {
+                return Err(CommEcallError::InvalidResponse(
+                    "Received chunk is too large",
+                ));
+            }
+
+            // Writing to the V-App memory might need to exchange pages with the host, therefore
+            // the content is copied to a stack buffer before releasing the comm.
+            let chunk_len = content.len();
+            chunk[..chunk_len].copy_from_slice(content);
 
             drop(comm); // TODO: figure out how to avoid having to deal with this drop explicitly
 
             match remaining_length {
                 None => {
                     // first chunk, check if the total length is acceptable
-                    if response.remaining_length > max_size as u32 {
+                    if response_remaining_length > max_size as u32 {
                         return Err(CommEcallError::InvalidResponse(
                             "Received data is too large",
                         ));
                     }
-                    remaining_length = Some(response.remaining_length);
+                    remaining_length = Some(response_remaining_length);
                 }
                 Some(remaining) => {
-                    if remaining != response.remaining_length {
+                    if remaining != response_remaining_length {
                         return Err(CommEcallError::InvalidResponse(
                             "Mismatching remaining length",
                         ));
@@ -437,15 +838,157 @@ impl<'a> CommEcallHandler<'a> {
                 }
             }
 
-            segment.write_buffer(g_ptr, &response.content)?;
+            segment.write_buffer(g_ptr, &chunk[..chunk_len])?;
 
-            remaining_length = Some(remaining_length.unwrap() - response.content.len() as u32);
-            g_ptr += response.content.len() as u32;
-            total_received += response.content.len();
+            remaining_length = Some(remaining_length.unwrap() - chunk_len as u32);
+            g_ptr += chunk_len as u32;
+            total_received += chunk_len;
         }
         Ok(total_received)
     }
 
+    // Sends the payload of a request to the handler that the host registered for request_id, then
+    // receives its reply into the buffer in the V-app memory, exactly as in handle_xrecv.
+    // Returns the length of the reply. The host is untrusted: the V-App must validate the reply.
+    fn handle_client_call<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        request_id: u32,
+        payload: GuestPointer,
+        payload_len: usize,
+        reply: GuestPointer,
+        reply_max_len: usize,
+    ) -> Result<usize, CommEcallError> {
+        self.send_buffer::<E>(
+            cpu,
+            payload,
+            payload_len,
+            OutgoingBuffer::ClientCall(request_id),
+        )?;
+        self.handle_xrecv::<E>(cpu, reply, reply_max_len)
+    }
+
+    // Commits all the modified pages of the V-App, then sends the state of the CPU to the host, so
+    // that a later run can resume from here. The checkpoint is taken right after the ECALL, with
+    // a0 = 1, so that the resumed V-App can tell that the ECALL returned from a resume.
+    fn handle_checkpoint<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+    ) -> Result<(), CommEcallError> {
+        cpu.data_seg.flush()?;
+        cpu.stack_seg.flush()?;
+
+        let pc = cpu.pc.wrapping_add(4);
+        let mut regs = cpu.regs;
+        regs[Register::A0.as_index() as usize] = 1;
+        let hmac = checkpoint_hmac(self.manifest, &self.app_hmac, pc, &regs);
+
+        let mut comm = self.comm.borrow_mut();
+        CheckpointMessage::new(VAppCheckpoint { pc, regs, hmac }).serialize_to_comm(&mut comm);
+        comm.reply(AppSW::InterruptedExecution);
+
+        let Instruction::Continue(p1, p2) = comm.next_command() else {
+            return Err(CommEcallError::WrongINS); // expected "Continue"
+        };
+
+        if (p1, p2) != (0, 0) {
+            return Err(CommEcallError::WrongP1P2);
+        }
+        Ok(())
+    }
+
+    // Fails if a buffer of len bytes starting at address would wrap around the address space
+    fn check_guest_range(address: GuestPointer, len: usize) -> Result<(), CommEcallError> {
+        u32::try_from(len)
+            .ok()
+            .and_then(|len| address.0.checked_add(len))
+            .ok_or(CommEcallError::InvalidParameters("Buffer too large"))?;
+        Ok(())
+    }
+
+    // Copies n bytes of the V-App memory from src to dst, one page of the source at a time
+    fn handle_memcpy<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        dst: GuestPointer,
+        src: GuestPointer,
+        n: usize,
+    ) -> Result<(), CommEcallError> {
+        Self::check_guest_range(dst, n)?;
+        Self::check_guest_range(src, n)?;
+
+        let mut buffer = [0u8; PAGE_SIZE];
+        let mut copied = 0;
+        while copied < n {
+            let src_address = src.0 + copied as u32;
+            let dst_address = dst.0 + copied as u32;
+            let chunk_len = min(PAGE_SIZE - src_address as usize % PAGE_SIZE, n - copied);
+
+            cpu.get_segment::<E>(src_address)?
+                .read_buffer(src_address, &mut buffer[..chunk_len])?;
+            cpu.get_segment::<E>(dst_address)?
+                .write_buffer(dst_address, &buffer[..chunk_len])?;
+
+            copied += chunk_len;
+        }
+        Ok(())
+    }
+
+    // Fills n bytes of the V-App memory at dst with the byte c, directly in the pages
+    fn handle_memset<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        dst: GuestPointer,
+        c: u8,
+        n: usize,
+    ) -> Result<(), CommEcallError> {
+        if n == 0 {
+            return Ok(());
+        }
+
+        cpu.get_segment::<E>(dst.0)?
+            .for_each_span_mut(dst.0, n, |span| span.fill(c))?;
+        Ok(())
+    }
+
+    // Compares n bytes of the V-App memory at a and b, returning the difference between the first
+    // pair of bytes that differ, or 0 if the buffers are equal. The running time only depends on n,
+    // not on the content of the buffers.
+    fn handle_memcmp<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        a: GuestPointer,
+        b: GuestPointer,
+        n: usize,
+    ) -> Result<i32, CommEcallError> {
+        Self::check_guest_range(a, n)?;
+        Self::check_guest_range(b, n)?;
+
+        let mut a_local = [0u8; PAGE_SIZE];
+        let mut b_local = [0u8; PAGE_SIZE];
+        let mut result: i32 = 0;
+        let mut compared = 0;
+        while compared < n {
+            let a_address = a.0 + compared as u32;
+            let b_address = b.0 + compared as u32;
+            let chunk_len = min(PAGE_SIZE - a_address as usize % PAGE_SIZE, n - compared);
+
+            cpu.get_segment::<E>(a_address)?
+                .read_buffer(a_address, &mut a_local[..chunk_len])?;
+            cpu.get_segment::<E>(b_address)?
+                .read_buffer(b_address, &mut b_local[..chunk_len])?;
+
+            for (&x, &y) in a_local[..chunk_len].iter().zip(&b_local[..chunk_len]) {
+                // all ones as long as no difference was found, without branching on the data
+                let unset = !((result | result.wrapping_neg()) >> 31);
+                result |= (x as i32 - y as i32) & unset;
+            }
+
+            compared += chunk_len;
+        }
+        Ok(result)
+    }
+
     fn handle_bn_modm<E: fmt::Debug>(
         &self,
         cpu: &mut Cpu<OutsourcedMemory<'_>>,
@@ -669,37 +1212,313 @@ impl<'a> CommEcallHandler<'a> {
         Ok(())
     }
 
-    fn handle_hash_init<E: fmt::Debug>(
+    fn handle_bn_batch(
         &self,
         cpu: &mut Cpu<OutsourcedMemory<'_>>,
-        hash_id: u32,
-        ctx: GuestPointer,
+        m: GuestPointer,
+        len: usize,
+        program: GuestPointer,
+        program_len: usize,
+        inputs: GuestPointer,
+        n_inputs: usize,
+        outputs: GuestPointer,
+        n_outputs: usize,
     ) -> Result<(), CommEcallError> {
-        // in-memory size of the hash context struct
-        let ctx_size = LedgerHashContext::get_size_from_id(hash_id)?;
-
-        // copy context to local memory
-        let mut ctx_local: [u8; LedgerHashContext::MAX_HASH_CONTEXT_SIZE] =
-            [0; LedgerHashContext::MAX_HASH_CONTEXT_SIZE];
-
-        cpu.get_segment::<E>(ctx.0)?
-            .read_buffer(ctx.0, &mut ctx_local[0..ctx_size])?;
-
-        unsafe {
-            ledger_secure_sdk_sys::cx_hash_init(
-                ctx_local.as_mut_ptr() as *mut ledger_secure_sdk_sys::cx_hash_header_s,
-                hash_id as u8,
-            );
+        if len == 0 || len > MAX_BIGNUMBER_SIZE {
+            return Err(CommEcallError::InvalidParameters("invalid len"));
+        }
+        if program_len > MAX_INSTRUCTIONS * INSTRUCTION_SIZE {
+            return Err(CommEcallError::InvalidParameters(
+                "program_len is too large",
+            ));
+        }
+        for (ptr, n) in [(inputs, n_inputs), (outputs, n_outputs)] {
+            let size = n
+                .checked_mul(len)
+                .and_then(|size| u32::try_from(size).ok())
+                .ok_or(CommEcallError::Overflow)?;
+            if ptr.0.checked_add(size).is_none() {
+                return Err(CommEcallError::Overflow);
+            }
         }
 
-        // copy context back to V-App memory
-        let segment = cpu.get_segment::<E>(ctx.0)?;
-        segment.write_buffer(ctx.0, &ctx_local[0..ctx_size])?;
+        // copy the modulus and the program to local memory
+        let mut m_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        cpu.get_segment::<CommEcallError>(m.0)?
+            .read_buffer(m.0, &mut m_local[0..len])?;
+        let mut program_local = vec![0u8; program_len];
+        if program_len > 0 {
+            cpu.get_segment::<CommEcallError>(program.0)?
+                .read_buffer(program.0, &mut program_local)?;
+        }
 
-        Ok(())
+        let mut backend = CxBnBatch {
+            cpu,
+            inputs,
+            outputs,
+            len,
+        };
+        bn_batch::execute(
+            &mut backend,
+            &m_local[0..len],
+            &program_local,
+            n_inputs,
+            n_outputs,
+        )
     }
 
-    fn handle_hash_update<E: fmt::Debug>(
+    // Registers the Montgomery context of the modulus, and returns its handle; returns 0 if the
+    // modulus is not valid, or if there are too many contexts.
+    fn handle_bn_mont_init(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, CommEcallError> {
+        if len == 0 || len > MAX_BIGNUMBER_SIZE {
+            return Ok(0);
+        }
+
+        let mut m_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        cpu.get_segment::<CommEcallError>(m.0)?
+            .read_buffer(m.0, &mut m_local[0..len])?;
+        let modulus = &m_local[0..len];
+
+        // Montgomery reduction only works for odd moduli
+        if modulus[len - 1] & 1 == 0 {
+            return Ok(0);
+        }
+
+        if let Some(index) = self.bn_contexts.iter().position(|c| c.modulus() == modulus) {
+            return Ok(bn_context::handle(index));
+        }
+        if self.bn_contexts.len() >= MAX_BN_CONTEXTS {
+            return Ok(0);
+        }
+
+        let mut context = BnMontContext {
+            len,
+            m: m_local,
+            h: [0; MAX_BIGNUMBER_SIZE],
+        };
+        let padded_len = context.padded_len();
+        with_cx_bn_lock(|| {
+            let ctx = cx_mont_new(modulus, padded_len, None)?;
+            check_cx_result(
+                unsafe {
+                    ledger_secure_sdk_sys::cx_bn_export(ctx.h, context.h.as_mut_ptr(), padded_len)
+                },
+                "cx_bn_export failed",
+            )
+        })?;
+
+        self.bn_contexts.push(context);
+        Ok(bn_context::handle(self.bn_contexts.len() - 1))
+    }
+
+    // Returns the context referred to by the handle, if its modulus is the one pointed to by m in
+    // the V-App's memory.
+    fn get_bn_context(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        handle: u32,
+        m: GuestPointer,
+    ) -> Result<Option<&BnMontContext>, CommEcallError> {
+        let Some(context) = bn_context::index(handle).and_then(|i| self.bn_contexts.get(i)) else {
+            return Ok(None);
+        };
+        let mut m_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        cpu.get_segment::<CommEcallError>(m.0)?
+            .read_buffer(m.0, &mut m_local[0..context.len])?;
+        if m_local[0..context.len] != *context.modulus() {
+            return Ok(None);
+        }
+        Ok(Some(context))
+    }
+
+    // Returns false if the handle is not valid.
+    fn handle_bn_mont_multm(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        handle: u32,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+    ) -> Result<bool, CommEcallError> {
+        let Some(context) = self.get_bn_context(cpu, handle, m)? else {
+            return Ok(false);
+        };
+        let (len, padded_len) = (context.len, context.padded_len());
+
+        // copy inputs to local memory
+        let mut a_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        cpu.get_segment::<CommEcallError>(a.0)?
+            .read_buffer(a.0, &mut a_local[0..len])?;
+        let mut b_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        cpu.get_segment::<CommEcallError>(b.0)?
+            .read_buffer(b.0, &mut b_local[0..len])?;
+
+        // a * b = mont_mul(a * R, b)
+        let mut r_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        with_cx_bn_lock(|| {
+            let ctx = cx_mont_new(
+                context.modulus(),
+                padded_len,
+                Some(&context.h[0..padded_len]),
+            )?;
+            let a_bn = cx_bn_new(padded_len, &a_local[0..len])?;
+            let b_bn = cx_bn_new(padded_len, &b_local[0..len])?;
+            let a_mont = cx_bn_new(padded_len, &[])?;
+            let r_bn = cx_bn_new(padded_len, &[])?;
+            unsafe {
+                check_cx_result(
+                    ledger_secure_sdk_sys::cx_mont_to_montgomery(a_mont, a_bn, &ctx),
+                    "cx_mont_to_montgomery failed",
+                )?;
+                check_cx_result(
+                    ledger_secure_sdk_sys::cx_mont_mul(r_bn, a_mont, b_bn, &ctx),
+                    "cx_mont_mul failed",
+                )?;
+                check_cx_result(
+                    ledger_secure_sdk_sys::cx_bn_export(r_bn, r_local.as_mut_ptr(), padded_len),
+                    "cx_bn_export failed",
+                )
+            }
+        })?;
+
+        // copy the result to r; the padding bytes are zeros, since the result is reduced
+        let segment = cpu.get_segment::<CommEcallError>(r.0)?;
+        segment.write_buffer(r.0, &r_local[padded_len - len..padded_len])?;
+        Ok(true)
+    }
+
+    // Returns false if the handle is not valid.
+    fn handle_bn_mont_powm(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        handle: u32,
+        r: GuestPointer,
+        a: GuestPointer,
+        e: GuestPointer,
+        len_e: usize,
+        m: GuestPointer,
+    ) -> Result<bool, CommEcallError> {
+        if len_e > MAX_BIGNUMBER_SIZE {
+            return Err(CommEcallError::InvalidParameters("len_e is too large"));
+        }
+        let Some(context) = self.get_bn_context(cpu, handle, m)? else {
+            return Ok(false);
+        };
+        let (len, padded_len) = (context.len, context.padded_len());
+
+        // copy inputs to local memory
+        let mut a_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        cpu.get_segment::<CommEcallError>(a.0)?
+            .read_buffer(a.0, &mut a_local[0..len])?;
+        let mut e_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        if len_e > 0 {
+            cpu.get_segment::<CommEcallError>(e.0)?
+                .read_buffer(e.0, &mut e_local[0..len_e])?;
+        }
+
+        let mut r_local: [u8; MAX_BIGNUMBER_SIZE] = [0; MAX_BIGNUMBER_SIZE];
+        with_cx_bn_lock(|| {
+            let ctx = cx_mont_new(
+                context.modulus(),
+                padded_len,
+                Some(&context.h[0..padded_len]),
+            )?;
+            let a_bn = cx_bn_new(padded_len, &a_local[0..len])?;
+            let a_mont = cx_bn_new(padded_len, &[])?;
+            let r_mont = cx_bn_new(padded_len, &[])?;
+            let r_bn = cx_bn_new(padded_len, &[])?;
+            unsafe {
+                check_cx_result(
+                    ledger_secure_sdk_sys::cx_mont_to_montgomery(a_mont, a_bn, &ctx),
+                    "cx_mont_to_montgomery failed",
+                )?;
+                check_cx_result(
+                    ledger_secure_sdk_sys::cx_mont_pow(
+                        r_mont,
+                        a_mont,
+                        e_local.as_ptr(),
+                        len_e as u32,
+                        &ctx,
+                    ),
+                    "cx_mont_pow failed",
+                )?;
+                check_cx_result(
+                    ledger_secure_sdk_sys::cx_mont_from_montgomery(r_bn, r_mont, &ctx),
+                    "cx_mont_from_montgomery failed",
+                )?;
+                check_cx_result(
+                    ledger_secure_sdk_sys::cx_bn_export(r_bn, r_local.as_mut_ptr(), padded_len),
+                    "cx_bn_export failed",
+                )
+            }
+        })?;
+
+        let segment = cpu.get_segment::<CommEcallError>(r.0)?;
+        segment.write_buffer(r.0, &r_local[padded_len - len..padded_len])?;
+        Ok(true)
+    }
+
+    // Hashes data_len bytes of the V-App memory into the local hash context ctx_local, one page
+    // at a time
+    fn hash_guest_buffer<E: fmt::Debug>(
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        ctx_local: &mut [u8; LedgerHashContext::MAX_HASH_CONTEXT_SIZE],
+        data: GuestPointer,
+        data_len: usize,
+    ) -> Result<(), CommEcallError> {
+        if data_len == 0 {
+            return Ok(());
+        }
+
+        // the data is hashed directly from the pages, each of them being fetched only once
+        cpu.get_segment::<E>(data.0)?
+            .for_each_span(data.0, data_len, |span| unsafe {
+                ledger_secure_sdk_sys::cx_hash_update(
+                    ctx_local.as_mut_ptr() as *mut ledger_secure_sdk_sys::cx_hash_header_s,
+                    span.as_ptr(),
+                    span.len(),
+                );
+            })?;
+        Ok(())
+    }
+
+    fn handle_hash_init<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        hash_id: u32,
+        ctx: GuestPointer,
+    ) -> Result<(), CommEcallError> {
+        // in-memory size of the hash context struct
+        let ctx_size = LedgerHashContext::get_size_from_id(hash_id)?;
+
+        // copy context to local memory
+        let mut ctx_local: [u8; LedgerHashContext::MAX_HASH_CONTEXT_SIZE] =
+            [0; LedgerHashContext::MAX_HASH_CONTEXT_SIZE];
+
+        cpu.get_segment::<E>(ctx.0)?
+            .read_buffer(ctx.0, &mut ctx_local[0..ctx_size])?;
+
+        unsafe {
+            ledger_secure_sdk_sys::cx_hash_init(
+                ctx_local.as_mut_ptr() as *mut ledger_secure_sdk_sys::cx_hash_header_s,
+                hash_id as u8,
+            );
+        }
+
+        // copy context back to V-App memory
+        let segment = cpu.get_segment::<E>(ctx.0)?;
+        segment.write_buffer(ctx.0, &ctx_local[0..ctx_size])?;
+
+        Ok(())
+    }
+
+    fn handle_hash_update<E: fmt::Debug>(
         &self,
         cpu: &mut Cpu<OutsourcedMemory<'_>>,
         hash_id: u32,
@@ -721,26 +1540,7 @@ impl<'a> CommEcallHandler<'a> {
         cpu.get_segment::<E>(ctx.0)?
             .read_buffer(ctx.0, &mut ctx_local[0..ctx_size])?;
 
-        // copy data to local memory in chanks of at most 256 bytes
-        let mut data_local: [u8; 256] = [0; 256];
-        let mut data_remaining = data_len;
-        let mut data_ptr = data.0;
-        let data_seg = cpu.get_segment::<E>(data_ptr)?;
-        while data_remaining > 0 {
-            let copy_size = min(data_remaining, 256);
-            data_seg.read_buffer(data_ptr, &mut data_local[0..copy_size])?;
-
-            unsafe {
-                ledger_secure_sdk_sys::cx_hash_update(
-                    ctx_local.as_mut_ptr() as *mut ledger_secure_sdk_sys::cx_hash_header_s,
-                    data_local.as_ptr(),
-                    copy_size as usize,
-                );
-            }
-
-            data_remaining -= copy_size;
-            data_ptr += copy_size as u32;
-        }
+        Self::hash_guest_buffer::<E>(cpu, &mut ctx_local, data, data_len)?;
 
         // copy context back to V-App memory
         cpu.get_segment::<E>(ctx.0)?
@@ -785,6 +1585,123 @@ impl<'a> CommEcallHandler<'a> {
         Ok(())
     }
 
+    // Hashes the concatenation of the segments of the V-App memory, without storing the hash
+    // context in the V-App memory
+    fn hash_segments<E: fmt::Debug>(
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        hash_id: u32,
+        segments: &[(GuestPointer, usize)],
+        digest: GuestPointer,
+    ) -> Result<(), CommEcallError> {
+        // checks that the hash is supported
+        LedgerHashContext::get_size_from_id(hash_id)?;
+        let digest_len = LedgerHashContext::get_digest_len_from_id(hash_id)?;
+
+        let mut ctx_local: [u8; LedgerHashContext::MAX_HASH_CONTEXT_SIZE] =
+            [0; LedgerHashContext::MAX_HASH_CONTEXT_SIZE];
+        unsafe {
+            ledger_secure_sdk_sys::cx_hash_init(
+                ctx_local.as_mut_ptr() as *mut ledger_secure_sdk_sys::cx_hash_header_s,
+                hash_id as u8,
+            );
+        }
+
+        for &(data, data_len) in segments {
+            Self::hash_guest_buffer::<E>(cpu, &mut ctx_local, data, data_len)?;
+        }
+
+        let mut digest_local: [u8; LedgerHashContext::MAX_DIGEST_LEN] =
+            [0; LedgerHashContext::MAX_DIGEST_LEN];
+        unsafe {
+            ledger_secure_sdk_sys::cx_hash_final(
+                ctx_local.as_mut_ptr() as *mut ledger_secure_sdk_sys::cx_hash_header_s,
+                digest_local.as_mut_ptr(),
+            );
+        }
+
+        cpu.get_segment::<E>(digest.0)?
+            .write_buffer(digest.0, &digest_local[0..digest_len])?;
+
+        Ok(())
+    }
+
+    fn handle_hash_oneshot<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        hash_id: u32,
+        data: GuestPointer,
+        data_len: usize,
+        digest: GuestPointer,
+    ) -> Result<(), CommEcallError> {
+        Self::hash_segments::<E>(cpu, hash_id, &[(data, data_len)], digest)
+    }
+
+    fn handle_hash_vectored<E: fmt::Debug>(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        hash_id: u32,
+        segments: GuestPointer,
+        n_segments: usize,
+        digest: GuestPointer,
+    ) -> Result<(), CommEcallError> {
+        if n_segments > MAX_HASH_SEGMENTS {
+            return Err(CommEcallError::InvalidParameters("Too many segments"));
+        }
+
+        // each segment is a pointer and a length, as 32-bit little-endian integers
+        let mut segments_raw = [0u8; MAX_HASH_SEGMENTS * 8];
+        if n_segments > 0 {
+            cpu.get_segment::<E>(segments.0)?
+                .read_buffer(segments.0, &mut segments_raw[0..n_segments * 8])?;
+        }
+        let mut segments_local = [(GuestPointer(0), 0usize); MAX_HASH_SEGMENTS];
+        for (segment, raw) in segments_local
+            .iter_mut()
+            .zip(segments_raw.chunks_exact(8))
+            .take(n_segments)
+        {
+            let ptr = u32::from_le_bytes(raw[0..4].try_into().unwrap());
+            let len = u32::from_le_bytes(raw[4..8].try_into().unwrap());
+            if ptr.checked_add(len).is_none() {
+                return Err(CommEcallError::Overflow);
+            }
+            *segment = (GuestPointer(ptr), len as usize);
+        }
+
+        Self::hash_segments::<E>(cpu, hash_id, &segments_local[0..n_segments], digest)
+    }
+
+    // Returns 0 if the tree is invalid
+    fn handle_merkle_root(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        kind: u32,
+        leaves: GuestPointer,
+        n_leaves: usize,
+        depths: GuestPointer,
+        root: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        let Ok(kind) = MerkleTreeKind::try_from(kind) else {
+            return Ok(0);
+        };
+        let mut backend = CxMerkle {
+            cpu: &mut *cpu,
+            leaves,
+            depths,
+        };
+        let root_local = match merkle::merkle_root(&mut backend, kind, n_leaves) {
+            Ok(root_local) => root_local,
+            Err(CommEcallError::MerkleError(MerkleError::HashFailed)) => {
+                return Err(CommEcallError::GenericError("Failed to compute hash"))
+            }
+            Err(CommEcallError::MerkleError(_)) => return Ok(0),
+            Err(e) => return Err(e),
+        };
+        cpu.get_segment::<CommEcallError>(root.0)?
+            .write_buffer(root.0, &root_local)?;
+        Ok(1)
+    }
+
     fn handle_derive_hd_node<E: fmt::Debug>(
         &self,
         cpu: &mut Cpu<OutsourcedMemory<'_>>,
@@ -848,8 +1765,6 @@ impl<'a> CommEcallHandler<'a> {
         // derive the key
         let mut private_key_local = Zeroizing::new([0u8; 32]);
         let mut chain_code_local: [u8; 32] = [0; 32];
-
-        let mut pubkey: ledger_secure_sdk_sys::cx_ecfp_public_key_t = Default::default();
         unsafe {
             ledger_secure_sdk_sys::os_perso_derive_node_bip32(
                 CurveKind::Secp256k1 as u8,
@@ -858,39 +1773,127 @@ impl<'a> CommEcallHandler<'a> {
                 private_key_local.as_mut_ptr(),
                 chain_code_local.as_mut_ptr(),
             );
+        }
 
-            // generate the corresponding public key
-            let mut privkey: ledger_secure_sdk_sys::cx_ecfp_private_key_t = Default::default();
+        let pubkey = public_key_of(curve as u8, &private_key_local)?;
+        Ok(pubkey_fingerprint(&pubkey))
+    }
 
-            let ret1 = ledger_secure_sdk_sys::cx_ecfp_init_private_key_no_throw(
-                curve as u8,
-                private_key_local.as_ptr(),
-                private_key_local.len(),
-                &mut privkey,
-            );
+    fn handle_derive_hd_pubkeys(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        curve: u32,
+        path: GuestPointer,
+        path_len: usize,
+        first_child: u32,
+        n_children: usize,
+        parent_fingerprint: GuestPointer,
+        children: GuestPointer,
+    ) -> Result<(), CommEcallError> {
+        if curve != CurveKind::Secp256k1 as u32 {
+            return Err(CommEcallError::InvalidParameters("Unsupported curve"));
+        }
+        if path_len > MAX_BIP32_PATH {
+            return Err(CommEcallError::InvalidParameters("path_len is too large"));
+        }
+        if n_children == 0 || n_children > MAX_HD_CHILDREN {
+            return Err(CommEcallError::InvalidParameters(
+                "n_children is out of range",
+            ));
+        }
+        // the children must be all hardened, or all non-hardened
+        let last_child = first_child
+            .checked_add(n_children as u32 - 1)
+            .ok_or(CommEcallError::InvalidParameters("Invalid child indices"))?;
+        if (first_child ^ last_child) & BIP32_HARDENED != 0 {
+            return Err(CommEcallError::InvalidParameters("Invalid child indices"));
+        }
+        if children
+            .0
+            .checked_add((HD_CHILD_SIZE * n_children) as u32)
+            .is_none()
+        {
+            return Err(CommEcallError::Overflow);
+        }
 
-            let ret2 = ledger_secure_sdk_sys::cx_ecfp_generate_pair_no_throw(
+        // copy path to local memory
+        let mut path_local_raw: [u8; MAX_BIP32_PATH * 4] = [0; MAX_BIP32_PATH * 4];
+        if path_len > 0 {
+            cpu.get_segment::<CommEcallError>(path.0)?
+                .read_buffer(path.0, &mut path_local_raw[0..(path_len * 4)])?;
+        }
+        let path_local = unsafe {
+            core::slice::from_raw_parts(path_local_raw.as_ptr() as *const u32, path_len as usize)
+        };
+
+        // derive the parent node once; the children are derived from it with CKDpriv
+        let mut private_key_local = Zeroizing::new([0u8; 32]);
+        let mut chain_code_local: [u8; 32] = [0; 32];
+        unsafe {
+            ledger_secure_sdk_sys::os_perso_derive_node_bip32(
                 curve as u8,
-                &mut pubkey,
-                &mut privkey,
-                true,
+                path_local.as_ptr(),
+                path_len as u32,
+                private_key_local.as_mut_ptr(),
+                chain_code_local.as_mut_ptr(),
             );
+        }
+        let pubkey = public_key_of(curve as u8, &private_key_local)?;
+        cpu.get_segment::<CommEcallError>(parent_fingerprint.0)?
+            .write_buffer(
+                parent_fingerprint.0,
+                &pubkey_fingerprint(&pubkey).to_be_bytes(),
+            )?;
+
+        // the data of the HMAC is 0x00 || privkey || index for hardened children, and
+        // compressed pubkey || index otherwise
+        let mut data = Zeroizing::new([0u8; 37]);
+        if first_child & BIP32_HARDENED != 0 {
+            data[1..33].copy_from_slice(&private_key_local[..]);
+        } else {
+            data[0] = 0x02 + (pubkey[64] % 2);
+            data[1..33].copy_from_slice(&pubkey[1..33]);
+        }
+
+        for (i, index) in (first_child..=last_child).enumerate() {
+            data[33..37].copy_from_slice(&index.to_be_bytes());
+
+            let mut hmac = Zeroizing::new([0u8; 64]);
+            let mut mac = ledger_device_sdk::hmac::sha2::Sha2_512::new(&chain_code_local);
+            mac.update(&data[..])
+                .map_err(|_| CommEcallError::GenericError("HMAC failed"))?;
+            mac.finalize(&mut hmac[..])
+                .map_err(|_| CommEcallError::GenericError("HMAC failed"))?;
 
-            if ret1 != CX_OK || ret2 != CX_OK {
-                return Err(CommEcallError::GenericError("Failed to generate key pair"));
+            // the child private key is IL + k mod n; BIP32 says to skip the (extremely unlikely)
+            // invalid keys, but we just fail
+            if hmac[0..32] >= SECP256K1_ORDER[..] {
+                return Err(CommEcallError::GenericError("Invalid child key"));
             }
+            let mut child_private_key = Zeroizing::new([0u8; 32]);
+            let res = unsafe {
+                ledger_secure_sdk_sys::cx_math_addm_no_throw(
+                    child_private_key.as_mut_ptr(),
+                    hmac.as_ptr(),
+                    private_key_local.as_ptr(),
+                    SECP256K1_ORDER.as_ptr(),
+                    32,
+                )
+            };
+            check_cx_result(res, "addm failed")?;
+            if child_private_key.iter().all(|&b| b == 0) {
+                return Err(CommEcallError::GenericError("Invalid child key"));
+            }
+
+            let mut child = [0u8; HD_CHILD_SIZE];
+            child[0..32].copy_from_slice(&hmac[32..64]);
+            child[32..].copy_from_slice(&public_key_of(curve as u8, &child_private_key)?);
+            let ptr = children.0 + (i * HD_CHILD_SIZE) as u32;
+            cpu.get_segment::<CommEcallError>(ptr)?
+                .write_buffer(ptr, &child)?;
         }
 
-        let mut sha_hasher = ledger_device_sdk::hash::sha2::Sha2_256::new();
-        sha_hasher.update(&[02u8 + (pubkey.W[64] % 2)]).unwrap();
-        sha_hasher.update(&pubkey.W[1..33]).unwrap();
-        let mut sha256hash = [0u8; 32];
-        sha_hasher.finalize(&mut sha256hash).unwrap();
-        let mut ripemd160_hasher = ledger_device_sdk::hash::ripemd::Ripemd160::new();
-        ripemd160_hasher.update(&sha256hash).unwrap();
-        let mut rip = [0u8; 20];
-        ripemd160_hasher.finalize(&mut rip).unwrap();
-        Ok(u32::from_be_bytes([rip[0], rip[1], rip[2], rip[3]]))
+        Ok(())
     }
 
     fn handle_ecfp_add_point<E: fmt::Debug>(
@@ -980,9 +1983,136 @@ impl<'a> CommEcallHandler<'a> {
             }
         }
 
-        // copy r_local to r
-        let segment = cpu.get_segment::<E>(r.0)?;
-        segment.write_buffer(r.0, &r_local.W)?;
+        // copy r_local to r
+        let segment = cpu.get_segment::<E>(r.0)?;
+        segment.write_buffer(r.0, &r_local.W)?;
+
+        Ok(1)
+    }
+
+    // Computes the sum of k_i·P_i, two points at a time with Shamir's trick
+    // (cx_ecpoint_double_scalarmul). The points stay in the cx_bn memory, and are only exported at
+    // the end; returns 0 if the result is the point at infinity.
+    fn handle_ecfp_msm(
+        &self,
+        cpu: &mut Cpu<OutsourcedMemory<'_>>,
+        curve: u32,
+        r: GuestPointer,
+        points: GuestPointer,
+        scalars: GuestPointer,
+        n: usize,
+    ) -> Result<u32, CommEcallError> {
+        if curve != CurveKind::Secp256k1 as u32 {
+            return Err(CommEcallError::InvalidParameters("Unsupported curve"));
+        }
+        if n == 0 || n > MAX_MSM_POINTS {
+            return Err(CommEcallError::InvalidParameters("n is out of range"));
+        }
+        if points.0.checked_add(65 * n as u32).is_none()
+            || scalars.0.checked_add(32 * n as u32).is_none()
+        {
+            return Err(CommEcallError::Overflow);
+        }
+
+        // copy inputs to local memory
+        let mut points_local = vec![0u8; 65 * n];
+        cpu.get_segment::<CommEcallError>(points.0)?
+            .read_buffer(points.0, &mut points_local)?;
+        let mut scalars_local = vec![0u8; 32 * n];
+        cpu.get_segment::<CommEcallError>(scalars.0)?
+            .read_buffer(scalars.0, &mut scalars_local)?;
+
+        let mut r_local = [0u8; 65];
+        r_local[0] = 0x04;
+        let curve = curve as u8;
+        let is_infinity = with_cx_bn_lock(|| {
+            let mut acc = cx_ecpoint_new(curve)?;
+            let mut sum = cx_ecpoint_new(curve)?;
+            let mut t = cx_ecpoint_new(curve)?;
+            let mut p = cx_ecpoint_new(curve)?;
+            let mut q = cx_ecpoint_new(curve)?;
+            let mut acc_is_infinity = true;
+
+            for (pts, ks) in points_local
+                .chunks(2 * 65)
+                .zip(scalars_local.chunks(2 * 32))
+            {
+                // terms that are the point at infinity (e.g. k_1·P + k_2·Q = 0) are skipped
+                cx_ecpoint_load(&mut p, &pts[0..65])?;
+                if pts.len() == 2 * 65 {
+                    cx_ecpoint_load(&mut q, &pts[65..130])?;
+                    let is_infinity = check_cx_point_result(
+                        unsafe {
+                            ledger_secure_sdk_sys::cx_ecpoint_double_scalarmul(
+                                &mut t,
+                                &mut p,
+                                &mut q,
+                                ks[0..32].as_ptr(),
+                                32,
+                                ks[32..64].as_ptr(),
+                                32,
+                            )
+                        },
+                        "cx_ecpoint_double_scalarmul failed",
+                    )?;
+                    if is_infinity {
+                        continue;
+                    }
+                } else {
+                    let is_infinity = check_cx_point_result(
+                        unsafe {
+                            ledger_secure_sdk_sys::cx_ecpoint_scalarmul(&mut p, ks.as_ptr(), 32)
+                        },
+                        "cx_ecpoint_scalarmul failed",
+                    )?;
+                    if is_infinity {
+                        continue;
+                    }
+                    core::mem::swap(&mut t, &mut p);
+                }
+
+                if cx_ecpoint_is_infinity(&t)? {
+                    continue;
+                }
+                if acc_is_infinity {
+                    core::mem::swap(&mut acc, &mut t);
+                    acc_is_infinity = false;
+                } else {
+                    // if the sum is the point at infinity, the content of acc does not matter, as
+                    // it is replaced by the next term
+                    acc_is_infinity = check_cx_point_result(
+                        unsafe { ledger_secure_sdk_sys::cx_ecpoint_add(&mut sum, &acc, &t) },
+                        "cx_ecpoint_add failed",
+                    )? || cx_ecpoint_is_infinity(&sum)?;
+                    core::mem::swap(&mut acc, &mut sum);
+                }
+            }
+
+            if acc_is_infinity {
+                return Ok(true);
+            }
+            let (x, y) = r_local[1..].split_at_mut(32);
+            check_cx_result(
+                unsafe {
+                    ledger_secure_sdk_sys::cx_ecpoint_export(
+                        &acc,
+                        x.as_mut_ptr(),
+                        32,
+                        y.as_mut_ptr(),
+                        32,
+                    )
+                },
+                "cx_ecpoint_export failed",
+            )?;
+            Ok(false)
+        })?;
+
+        if is_infinity {
+            return Ok(0);
+        }
+
+        let segment = cpu.get_segment::<CommEcallError>(r.0)?;
+        segment.write_buffer(r.0, &r_local)?;
 
         Ok(1)
     }
@@ -1260,232 +2390,501 @@ impl<'a> EcallHandler for CommEcallHandler<'a> {
     type Error = CommEcallError;
 
     fn handle_ecall(&mut self, cpu: &mut Cpu<OutsourcedMemory<'a>>) -> Result<(), CommEcallError> {
-        macro_rules! reg {
-            ($reg:ident) => {
-                cpu.regs[Register::$reg.as_index() as usize]
-            };
-        }
+        dispatch_ecall(self, cpu)
+    }
+}
 
-        macro_rules! GPreg {
-            ($reg:ident) => {
-                GuestPointer(cpu.regs[Register::$reg.as_index() as usize] as u32)
-            };
+// The ECALLs are decoded from their specification by dispatch_ecall; each method forwards the
+// arguments to the handler of the ECALL, and returns the value stored in a0.
+impl<'a> EcallDispatch for CommEcallHandler<'a> {
+    // Any other ecall is unhandled and will case the CPU to abort
+    fn unhandled_ecall(&mut self, _code: u32) -> CommEcallError {
+        CommEcallError::UnhandledEcall
+    }
+
+    fn fatal(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        msg: GuestPointer,
+        size: usize,
+    ) -> CommEcallError {
+        match self.handle_panic::<CommEcallError>(cpu, msg, size) {
+            Ok(()) => CommEcallError::Panic,
+            Err(_) => CommEcallError::GenericError("xsend failed"),
         }
+    }
 
-        let ecall_code = reg!(T0);
-        match ecall_code {
-            ECALL_EXIT => return Err(CommEcallError::Exit(reg!(A0) as i32)),
-            ECALL_FATAL => {
-                self.handle_panic::<CommEcallError>(cpu, GPreg!(A0), reg!(A1) as usize)
-                    .map_err(|_| CommEcallError::GenericError("xsend failed"))?;
-                return Err(CommEcallError::Panic);
-            }
-            ECALL_XSEND => self
-                .handle_xsend::<CommEcallError>(cpu, GPreg!(A0), reg!(A1) as usize)
-                .map_err(|_| CommEcallError::GenericError("xsend failed"))?,
-            ECALL_XRECV => {
-                let ret = self
-                    .handle_xrecv::<CommEcallError>(cpu, GPreg!(A0), reg!(A1) as usize)
-                    .map_err(|_| CommEcallError::GenericError("xrecv failed"))?;
-                reg!(A0) = ret as u32;
-            }
-            ECALL_UX_IDLE => {
-                #[cfg(not(any(target_os = "stax", target_os = "flex")))]
-                {
-                    ledger_device_sdk::ui::gadgets::clear_screen();
-                    let page = ledger_device_sdk::ui::gadgets::Page::from((
-                        [self.manifest.get_app_name(), "is ready"],
-                        false,
-                    ));
-                    page.place();
-                }
+    fn xsend(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        buffer: GuestPointer,
+        size: usize,
+    ) -> Result<(), CommEcallError> {
+        self.handle_xsend::<CommEcallError>(cpu, buffer, size)
+            .map_err(|_| CommEcallError::GenericError("xsend failed"))
+    }
 
-                #[cfg(any(target_os = "stax", target_os = "flex"))]
-                {
-                    use include_gif::include_gif;
-                    const FERRIS: ledger_device_sdk::nbgl::NbglGlyph =
-                        ledger_device_sdk::nbgl::NbglGlyph::from_include(include_gif!(
-                            "crab_64x64.gif",
-                            NBGL
-                        ));
+    fn xrecv(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        buffer: GuestPointer,
+        size: usize,
+    ) -> Result<usize, CommEcallError> {
+        self.handle_xrecv::<CommEcallError>(cpu, buffer, size)
+            .map_err(|_| CommEcallError::GenericError("xrecv failed"))
+    }
 
-                    ledger_device_sdk::nbgl::NbglHomeAndSettings::new()
-                        .glyph(&FERRIS)
-                        .infos(
-                            self.manifest.get_app_name(),
-                            self.manifest.get_app_version(),
-                            "", // TODO
-                        )
-                        .show_and_return();
-                }
-            }
-            ECALL_MODM => {
-                self.handle_bn_modm::<CommEcallError>(
-                    cpu,
-                    GPreg!(A0),
-                    GPreg!(A1),
-                    reg!(A2) as usize,
-                    GPreg!(A3),
-                    reg!(A4) as usize,
-                )?;
+    fn exit(&mut self, _cpu: &mut Cpu<OutsourcedMemory<'a>>, status: i32) -> CommEcallError {
+        CommEcallError::Exit(status)
+    }
 
-                reg!(A0) = 1;
-            }
-            ECALL_ADDM => {
-                self.handle_bn_addm::<CommEcallError>(
-                    cpu,
-                    GPreg!(A0),
-                    GPreg!(A1),
-                    GPreg!(A2),
-                    GPreg!(A3),
-                    reg!(A4) as usize,
-                )?;
+    fn checkpoint(&mut self, cpu: &mut Cpu<OutsourcedMemory<'a>>) -> Result<u32, CommEcallError> {
+        self.handle_checkpoint::<CommEcallError>(cpu)?;
+        Ok(0)
+    }
 
-                reg!(A0) = 1;
-            }
-            ECALL_SUBM => {
-                self.handle_bn_subm::<CommEcallError>(
-                    cpu,
-                    GPreg!(A0),
-                    GPreg!(A1),
-                    GPreg!(A2),
-                    GPreg!(A3),
-                    reg!(A4) as usize,
-                )
-                .map_err(|_| CommEcallError::GenericError("bn_subm failed"))?;
+    fn client_call(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        request_id: u32,
+        payload: GuestPointer,
+        payload_len: usize,
+        reply: GuestPointer,
+        reply_max_len: usize,
+    ) -> Result<usize, CommEcallError> {
+        self.handle_client_call::<CommEcallError>(
+            cpu,
+            request_id,
+            payload,
+            payload_len,
+            reply,
+            reply_max_len,
+        )
+        .map_err(|_| CommEcallError::GenericError("client_call failed"))
+    }
 
-                reg!(A0) = 1;
-            }
-            ECALL_MULTM => {
-                self.handle_bn_multm::<CommEcallError>(
-                    cpu,
-                    GPreg!(A0),
-                    GPreg!(A1),
-                    GPreg!(A2),
-                    GPreg!(A3),
-                    reg!(A4) as usize,
-                )?;
+    fn ux_idle(&mut self, _cpu: &mut Cpu<OutsourcedMemory<'a>>) -> Result<(), CommEcallError> {
+        #[cfg(not(any(target_os = "stax", target_os = "flex")))]
+        {
+            ledger_device_sdk::ui::gadgets::clear_screen();
+            let page = ledger_device_sdk::ui::gadgets::Page::from((
+                [self.manifest.get_app_name(), "is ready"],
+                false,
+            ));
+            page.place();
+        }
 
-                reg!(A0) = 1;
-            }
-            ECALL_POWM => {
-                self.handle_bn_powm::<CommEcallError>(
-                    cpu,
-                    GPreg!(A0),
-                    GPreg!(A1),
-                    GPreg!(A2),
-                    reg!(A3) as usize,
-                    GPreg!(A4),
-                    reg!(A5) as usize,
-                )?;
+        #[cfg(any(target_os = "stax", target_os = "flex"))]
+        {
+            use include_gif::include_gif;
+            const FERRIS: ledger_device_sdk::nbgl::NbglGlyph =
+                ledger_device_sdk::nbgl::NbglGlyph::from_include(include_gif!(
+                    "crab_64x64.gif",
+                    NBGL
+                ));
 
-                reg!(A0) = 1;
-            }
-            ECALL_HASH_INIT => self
-                .handle_hash_init::<CommEcallError>(cpu, reg!(A0), GPreg!(A1))
-                .map_err(|_| CommEcallError::GenericError("hash_init failed"))?,
-            ECALL_HASH_UPDATE => self
-                .handle_hash_update::<CommEcallError>(
-                    cpu,
-                    reg!(A0),
-                    GPreg!(A1),
-                    GPreg!(A2),
-                    reg!(A3) as usize,
+            ledger_device_sdk::nbgl::NbglHomeAndSettings::new()
+                .glyph(&FERRIS)
+                .infos(
+                    self.manifest.get_app_name(),
+                    self.manifest.get_app_version(),
+                    "", // TODO
                 )
-                .map_err(|_| CommEcallError::GenericError("hash_update failed"))?,
-            ECALL_HASH_DIGEST => self
-                .handle_hash_digest::<CommEcallError>(cpu, reg!(A0), GPreg!(A1), GPreg!(A2))
-                .map_err(|_| CommEcallError::GenericError("hash_digest failed"))?,
-
-            ECALL_DERIVE_HD_NODE => {
-                self.handle_derive_hd_node::<CommEcallError>(
-                    cpu,
-                    reg!(A0),
-                    GPreg!(A1),
-                    reg!(A2) as usize,
-                    GPreg!(A3),
-                    GPreg!(A4),
-                )?;
+                .show_and_return();
+        }
+        Ok(())
+    }
 
-                reg!(A0) = 1;
-            }
-            ECALL_GET_MASTER_FINGERPRINT => {
-                reg!(A0) = self.handle_get_master_fingerprint::<CommEcallError>(cpu, reg!(A0))?;
-            }
+    fn memcpy(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        dst: GuestPointer,
+        src: GuestPointer,
+        n: usize,
+    ) -> Result<(), CommEcallError> {
+        self.handle_memcpy::<CommEcallError>(cpu, dst, src, n)
+            .map_err(|_| CommEcallError::GenericError("memcpy failed"))
+    }
 
-            ECALL_ECFP_ADD_POINT => {
-                reg!(A0) = self.handle_ecfp_add_point::<CommEcallError>(
-                    cpu,
-                    reg!(A0),
-                    GPreg!(A1),
-                    GPreg!(A2),
-                    GPreg!(A3),
-                )?;
-            }
-            ECALL_ECFP_SCALAR_MULT => {
-                reg!(A0) = self.handle_ecfp_scalar_mult::<CommEcallError>(
-                    cpu,
-                    reg!(A0),
-                    GPreg!(A1),
-                    GPreg!(A2),
-                    GPreg!(A3),
-                    reg!(A4) as usize,
-                )?;
-            }
+    fn memset(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        dst: GuestPointer,
+        c: u8,
+        n: usize,
+    ) -> Result<(), CommEcallError> {
+        self.handle_memset::<CommEcallError>(cpu, dst, c, n)
+            .map_err(|_| CommEcallError::GenericError("memset failed"))
+    }
 
-            ECALL_ECDSA_SIGN => {
-                reg!(A0) = self.handle_ecdsa_sign::<CommEcallError>(
-                    cpu,
-                    reg!(A0),
-                    reg!(A1),
-                    reg!(A2),
-                    GPreg!(A3),
-                    GPreg!(A4),
-                    GPreg!(A5),
-                )? as u32;
-            }
-            ECALL_ECDSA_VERIFY => {
-                reg!(A0) = self.handle_ecdsa_verify::<CommEcallError>(
-                    cpu,
-                    reg!(A0),
-                    GPreg!(A1),
-                    GPreg!(A2),
-                    GPreg!(A3),
-                    reg!(A4) as usize,
-                )?;
-            }
-            ECALL_SCHNORR_SIGN => {
-                reg!(A0) = self.handle_schnorr_sign::<CommEcallError>(
-                    cpu,
-                    reg!(A0),
-                    reg!(A1),
-                    reg!(A2),
-                    GPreg!(A3),
-                    GPreg!(A4),
-                    reg!(A5) as usize,
-                    GPreg!(A6),
-                )? as u32;
-            }
-            ECALL_SCHNORR_VERIFY => {
-                reg!(A0) = self.handle_schnorr_verify::<CommEcallError>(
-                    cpu,
-                    reg!(A0),
-                    reg!(A1),
-                    reg!(A2),
-                    GPreg!(A3),
-                    GPreg!(A4),
-                    reg!(A5) as usize,
-                    GPreg!(A6),
-                    reg!(A7) as usize,
-                )?;
-            }
+    fn memcmp(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        a: GuestPointer,
+        b: GuestPointer,
+        n: usize,
+    ) -> Result<i32, CommEcallError> {
+        self.handle_memcmp::<CommEcallError>(cpu, a, b, n)
+            .map_err(|_| CommEcallError::GenericError("memcmp failed"))
+    }
 
-            // Any other ecall is unhandled and will case the CPU to abort
-            _ => {
-                return Err(CommEcallError::UnhandledEcall);
-            }
-        }
+    fn bn_modm(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        r: GuestPointer,
+        n: GuestPointer,
+        len: usize,
+        m: GuestPointer,
+        len_m: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_bn_modm::<CommEcallError>(cpu, r, n, len, m, len_m)?;
+        Ok(1)
+    }
 
-        Ok(())
+    fn bn_addm(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_bn_addm::<CommEcallError>(cpu, r, a, b, m, len)?;
+        Ok(1)
+    }
+
+    fn bn_subm(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_bn_subm::<CommEcallError>(cpu, r, a, b, m, len)
+            .map_err(|_| CommEcallError::GenericError("bn_subm failed"))?;
+        Ok(1)
+    }
+
+    fn bn_multm(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_bn_multm::<CommEcallError>(cpu, r, a, b, m, len)?;
+        Ok(1)
+    }
+
+    fn bn_powm(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        r: GuestPointer,
+        a: GuestPointer,
+        e: GuestPointer,
+        len_e: usize,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_bn_powm::<CommEcallError>(cpu, r, a, e, len_e, m, len)?;
+        Ok(1)
+    }
+
+    fn bn_batch(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        m: GuestPointer,
+        len: usize,
+        program: GuestPointer,
+        program_len: usize,
+        inputs: GuestPointer,
+        n_inputs: usize,
+        outputs: GuestPointer,
+        n_outputs: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_bn_batch(
+            cpu,
+            m,
+            len,
+            program,
+            program_len,
+            inputs,
+            n_inputs,
+            outputs,
+            n_outputs,
+        )?;
+        Ok(1)
+    }
+
+    fn bn_mont_init(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        m: GuestPointer,
+        len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_bn_mont_init(cpu, m, len)
+    }
+
+    fn bn_mont_multm(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        handle: u32,
+        r: GuestPointer,
+        a: GuestPointer,
+        b: GuestPointer,
+        m: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        let ok = self.handle_bn_mont_multm(cpu, handle, r, a, b, m)?;
+        Ok(ok as u32)
+    }
+
+    fn bn_mont_powm(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        handle: u32,
+        r: GuestPointer,
+        a: GuestPointer,
+        e: GuestPointer,
+        len_e: usize,
+        m: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        let ok = self.handle_bn_mont_powm(cpu, handle, r, a, e, len_e, m)?;
+        Ok(ok as u32)
+    }
+
+    fn derive_hd_node(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        path: GuestPointer,
+        path_len: usize,
+        privkey: GuestPointer,
+        chain_code: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_derive_hd_node::<CommEcallError>(
+            cpu, curve, path, path_len, privkey, chain_code,
+        )?;
+        Ok(1)
+    }
+
+    fn get_master_fingerprint(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_get_master_fingerprint::<CommEcallError>(cpu, curve)
+    }
+
+    fn derive_hd_pubkeys(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        path: GuestPointer,
+        path_len: usize,
+        first_child: u32,
+        n_children: usize,
+        parent_fingerprint: GuestPointer,
+        children: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_derive_hd_pubkeys(
+            cpu,
+            curve,
+            path,
+            path_len,
+            first_child,
+            n_children,
+            parent_fingerprint,
+            children,
+        )?;
+        Ok(1)
+    }
+
+    fn hash_init(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        hash_id: u32,
+        ctx: GuestPointer,
+    ) -> Result<(), CommEcallError> {
+        self.handle_hash_init::<CommEcallError>(cpu, hash_id, ctx)
+            .map_err(|_| CommEcallError::GenericError("hash_init failed"))
+    }
+
+    // Like the other hash ECALLs, returns 1 on success; failures stop the V-App
+    fn hash_update(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        hash_id: u32,
+        ctx: GuestPointer,
+        data: GuestPointer,
+        len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_hash_update::<CommEcallError>(cpu, hash_id, ctx, data, len)
+            .map_err(|_| CommEcallError::GenericError("hash_update failed"))?;
+        Ok(1)
+    }
+
+    fn hash_final(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        hash_id: u32,
+        ctx: GuestPointer,
+        digest: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_hash_digest::<CommEcallError>(cpu, hash_id, ctx, digest)
+            .map_err(|_| CommEcallError::GenericError("hash_digest failed"))?;
+        Ok(1)
+    }
+
+    fn hash_oneshot(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        hash_id: u32,
+        data: GuestPointer,
+        len: usize,
+        digest: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_hash_oneshot::<CommEcallError>(cpu, hash_id, data, len, digest)
+            .map_err(|_| CommEcallError::GenericError("hash_oneshot failed"))?;
+        Ok(1)
+    }
+
+    fn hash_vectored(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        hash_id: u32,
+        segments: GuestPointer,
+        n_segments: usize,
+        digest: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_hash_vectored::<CommEcallError>(cpu, hash_id, segments, n_segments, digest)
+            .map_err(|_| CommEcallError::GenericError("hash_vectored failed"))?;
+        Ok(1)
+    }
+
+    fn merkle_root(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        kind: u32,
+        leaves: GuestPointer,
+        n_leaves: usize,
+        depths: GuestPointer,
+        root: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_merkle_root(cpu, kind, leaves, n_leaves, depths, root)
+    }
+
+    fn ecfp_add_point(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        r: GuestPointer,
+        p: GuestPointer,
+        q: GuestPointer,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_ecfp_add_point::<CommEcallError>(cpu, curve, r, p, q)
+    }
+
+    fn ecfp_scalar_mult(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        r: GuestPointer,
+        p: GuestPointer,
+        k: GuestPointer,
+        k_len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_ecfp_scalar_mult::<CommEcallError>(cpu, curve, r, p, k, k_len)
+    }
+
+    fn ecfp_msm(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        r: GuestPointer,
+        points: GuestPointer,
+        scalars: GuestPointer,
+        n: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_ecfp_msm(cpu, curve, r, points, scalars, n)
+    }
+
+    fn ecdsa_sign(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        mode: u32,
+        hash_id: u32,
+        privkey: GuestPointer,
+        msg_hash: GuestPointer,
+        signature: GuestPointer,
+    ) -> Result<usize, CommEcallError> {
+        self.handle_ecdsa_sign::<CommEcallError>(
+            cpu, curve, mode, hash_id, privkey, msg_hash, signature,
+        )
+    }
+
+    fn ecdsa_verify(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        pubkey: GuestPointer,
+        msg_hash: GuestPointer,
+        signature: GuestPointer,
+        signature_len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_ecdsa_verify::<CommEcallError>(
+            cpu,
+            curve,
+            pubkey,
+            msg_hash,
+            signature,
+            signature_len,
+        )
+    }
+
+    fn schnorr_sign(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        mode: u32,
+        hash_id: u32,
+        privkey: GuestPointer,
+        msg: GuestPointer,
+        msg_len: usize,
+        signature: GuestPointer,
+    ) -> Result<usize, CommEcallError> {
+        self.handle_schnorr_sign::<CommEcallError>(
+            cpu, curve, mode, hash_id, privkey, msg, msg_len, signature,
+        )
+    }
+
+    fn schnorr_verify(
+        &mut self,
+        cpu: &mut Cpu<OutsourcedMemory<'a>>,
+        curve: u32,
+        mode: u32,
+        hash_id: u32,
+        pubkey: GuestPointer,
+        msg: GuestPointer,
+        msg_len: usize,
+        signature: GuestPointer,
+        signature_len: usize,
+    ) -> Result<u32, CommEcallError> {
+        self.handle_schnorr_verify::<CommEcallError>(
+            cpu,
+            curve,
+            mode,
+            hash_id,
+            pubkey,
+            msg,
+            msg_len,
+            signature,
+            signature_len,
+        )
     }
 }
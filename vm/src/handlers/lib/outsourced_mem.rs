@@ -197,4 +197,17 @@ impl<'c> PagedMemory for OutsourcedMemory<'c> {
         // Return mutable reference to the page
         Ok(&mut self.pages[slot].page)
     }
+
+    fn flush(&mut self) -> Result<(), common::vm::MemoryError> {
+        if self.is_readonly {
+            return Ok(());
+        }
+        // the pages stay in the cache, as their content is unchanged
+        for i in 0..self.pages.len() {
+            if self.pages[i].valid {
+                self.commit_page_at(i)?;
+            }
+        }
+        Ok(())
+    }
 }
@@ -1,7 +1,7 @@
 use core::cell::RefCell;
 
 use alloc::rc::Rc;
-use common::client_commands::SectionKind;
+use common::client_commands::{GetCheckpointMessage, Message, SectionKind, VAppCheckpoint};
 use ledger_device_sdk::io;
 
 use alloc::vec::Vec;
@@ -9,18 +9,62 @@ use common::manifest::Manifest;
 use common::vm::{Cpu, MemorySegment};
 
 use super::lib::outsourced_mem::OutsourcedMemory;
-use crate::handlers::lib::ecall::{CommEcallError, CommEcallHandler};
-use crate::{println, AppSW};
+use crate::handlers::lib::ecall::{checkpoint_hmac, CommEcallError, CommEcallHandler};
+use crate::{println, AppSW, Instruction};
+
+// Requests to the host the checkpoint to resume the V-App from, and checks that it was produced by
+// this V-App on this device.
+fn get_checkpoint(
+    comm: &mut io::Comm,
+    manifest: &Manifest,
+    app_hmac: &[u8; 32],
+) -> Result<VAppCheckpoint, AppSW> {
+    GetCheckpointMessage::new().serialize_to_comm(comm);
+    comm.reply(AppSW::InterruptedExecution);
+
+    let (p1, p2) = match comm.next_command() {
+        Instruction::Continue(p1, p2) => (p1, p2),
+        Instruction::Abort => return Err(AppSW::VAppAborted),
+        _ => return Err(AppSW::InsNotSupported), // expected "Continue"
+    };
+    if (p1, p2) != (0, 0) {
+        return Err(AppSW::WrongP1P2);
+    }
+
+    let data = comm.get_data().map_err(|_| AppSW::WrongApduLength)?;
+    let checkpoint = VAppCheckpoint::deserialize(data).map_err(|_| AppSW::IncorrectData)?;
+
+    // constant-time comparison
+    let expected_hmac = checkpoint_hmac(manifest, app_hmac, checkpoint.pc, &checkpoint.regs);
+    let diff = expected_hmac
+        .iter()
+        .zip(checkpoint.hmac.iter())
+        .fold(0u8, |acc, (a, b)| acc | (a ^ b));
+    if diff != 0 {
+        return Err(AppSW::SignatureFail);
+    }
+    Ok(checkpoint)
+}
 
-pub fn handler_start_vapp(comm: &mut io::Comm) -> Result<Vec<u8>, AppSW> {
+// Returns true if the last command received from the host is Abort. The host can only send it while
+// the V-App waits for a response, and the V-App stops as the command is not the expected Continue.
+fn is_aborted(comm: &io::Comm) -> bool {
+    matches!(
+        Instruction::try_from(*comm.get_apdu_metadata()),
+        Ok(Instruction::Abort)
+    )
+}
+
+// Runs the V-App described by the manifest in the APDU. If resume is true, the state of the CPU is
+// restored from a checkpoint that the V-App took in a previous run, instead of starting from the
+// entrypoint; the host is expected to provide the memory as it was at that checkpoint.
+pub fn handler_start_vapp(comm: &mut io::Comm, resume: bool) -> Result<Vec<u8>, AppSW> {
     let data_raw = comm.get_data().map_err(|_| AppSW::WrongApduLength)?;
 
     let (manifest, hmac) =
         postcard::take_from_bytes::<Manifest>(data_raw).map_err(|_| AppSW::IncorrectData)?;
 
-    if hmac.len() != 32 {
-        return Err(AppSW::IncorrectData);
-    }
+    let app_hmac: [u8; 32] = hmac.try_into().map_err(|_| AppSW::IncorrectData)?;
 
     // TODO: actually check the HMAC (and use a constant-time comparison)
     if hmac != [0x42u8; 32] {
@@ -30,6 +74,12 @@ pub fn handler_start_vapp(comm: &mut io::Comm) -> Result<Vec<u8>, AppSW> {
     println!("Running app with Manifest: {:?}", manifest);
     println!("hmac: {:?}", hmac);
 
+    let checkpoint = if resume {
+        Some(get_checkpoint(comm, &manifest, &app_hmac)?)
+    } else {
+        None
+    };
+
     let comm = Rc::new(RefCell::new(comm));
 
     let code_seg = MemorySegment::<OutsourcedMemory>::new(
@@ -59,31 +109,44 @@ pub fn handler_start_vapp(comm: &mut io::Comm) -> Result<Vec<u8>, AppSW> {
     // we make sure it's aligned to a multiple of 4
     cpu.regs[2] = (manifest.stack_end - 4) & !3;
 
+    if let Some(checkpoint) = checkpoint {
+        cpu.pc = checkpoint.pc;
+        cpu.regs = checkpoint.regs;
+        cpu.regs[0] = 0;
+    }
+
     assert!(cpu.pc % 4 == 0, "Unaligned entrypoint");
 
-    let mut ecall_handler = CommEcallHandler::new(comm.clone(), &manifest);
+    let mut ecall_handler = CommEcallHandler::new(comm.clone(), &manifest, app_hmac);
 
     let mut instr_count = 0;
     loop {
-        // TODO: handle errors
-        let instr = cpu
-            .fetch_instruction::<CommEcallError>()
-            .expect("Failed to fetch instruction");
-
-        // TODO: remove debug prints
-        // println!("\x1b[93m{:?}\x1b[0m", cpu);
-
-        // println!(
-        //     "\x1b[32m{:08x?}: {:08x?} -> {:?}\x1b[0m",
-        //     cpu.pc,
-        //     instr,
-        //     common::riscv::decode::decode(instr)
-        // );
-
-        let result = cpu.execute(instr, Some(&mut ecall_handler));
+        // fetching the instruction can fail like executing it, as the code pages are requested to
+        // the host
+        let result = match cpu.fetch_instruction::<CommEcallError>() {
+            Ok(instr) => {
+                // TODO: remove debug prints
+                // println!("\x1b[93m{:?}\x1b[0m", cpu);
+
+                // println!(
+                //     "\x1b[32m{:08x?}: {:08x?} -> {:?}\x1b[0m",
+                //     cpu.pc,
+                //     instr,
+                //     common::riscv::decode::decode(instr)
+                // );
+
+                cpu.execute(instr, Some(&mut ecall_handler))
+            }
+            Err(e) => Err(e),
+        };
 
         instr_count += 1;
 
+        if result.is_err() && is_aborted(&comm.borrow()) {
+            println!("V-App aborted by the host");
+            return Err(AppSW::VAppAborted);
+        }
+
         match result {
             Ok(_) => {}
             Err(common::vm::CpuError::EcallError(e)) => match e {
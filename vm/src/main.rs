@@ -19,6 +19,7 @@
 #![no_main]
 
 mod app_ui;
+mod device_secret;
 mod handlers;
 
 mod settings;
@@ -109,6 +110,7 @@ pub enum AppSW {
 
     VMRuntimeError = 0xB020,
     VAppPanic = 0xB021,
+    VAppAborted = 0xB022,
 
     Ok = 0x9000,
 }
@@ -126,7 +128,9 @@ pub enum Instruction {
     GetAppName,
     RegisterVApp,
     StartVApp,
+    ResumeVApp,
     Continue(u8, u8), // client response to a request from the VM
+    Abort,            // stops the V-App waiting for a response, if any
 }
 
 impl TryFrom<ApduHeader> for Instruction {
@@ -149,7 +153,9 @@ impl TryFrom<ApduHeader> for Instruction {
             (1, 0, 0) => Ok(Instruction::GetAppName),
             (2, 0, 0) => Ok(Instruction::RegisterVApp),
             (3, 0, 0) => Ok(Instruction::StartVApp),
-            (0..=3, _, _) => Err(AppSW::WrongP1P2),
+            (3, 1, 0) => Ok(Instruction::ResumeVApp),
+            (0xfe, 0, 0) => Ok(Instruction::Abort),
+            (0..=3 | 0xfe, _, _) => Err(AppSW::WrongP1P2),
             (0xff, p1, p2) => Ok(Instruction::Continue(p1, p2)),
             (_, _, _) => Err(AppSW::InsNotSupported),
         }
@@ -212,7 +218,9 @@ fn handle_apdu(comm: &mut Comm, ins: Instruction) -> Result<Vec<u8>, AppSW> {
         }
         Instruction::GetVersion => handler_get_version(comm),
         Instruction::RegisterVApp => handler_register_vapp(comm),
-        Instruction::StartVApp => handler_start_vapp(comm),
+        Instruction::StartVApp => handler_start_vapp(comm, false),
+        Instruction::ResumeVApp => handler_start_vapp(comm, true),
         Instruction::Continue(_, _) => Err(AppSW::InsNotSupported), // 'Continue' command is only allowed when requested by the VM
+        Instruction::Abort => Ok(vec![]), // no V-App is running, there is nothing to abort
     }
 }